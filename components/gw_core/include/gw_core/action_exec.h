@@ -18,21 +18,9 @@ extern "C" {
 // Returns ESP_OK if action was accepted/scheduled.
 esp_err_t gw_action_exec(cJSON *action, char *err, size_t err_size);
 
-// Fast-path executor for compiled rules (avoids cJSON allocations at runtime).
-// Currently supports the MVP zigbee commands used by Automations UI:
-// - onoff.on / onoff.off / onoff.toggle
-// - level.move_to_level (arg0_u32=level 0..254, arg1_u32=transition_ms)
-esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
-                                        const gw_device_uid_t *device_uid,
-                                        uint8_t endpoint,
-                                        uint32_t arg0_u32,
-                                        uint32_t arg1_u32,
-                                        uint32_t arg2_u32,
-                                        char *err,
-                                        size_t err_size);
-
 // Execute a compiled action record from a `.gwar` file.
-// This is the main runtime path for automations (no JSON parsing).
+// This is the main runtime path for automations: a switch over action->op, no JSON or cmd parsing.
+// Actions whose op is 0 (not resolved, see gw_auto_entry_resolve()) fail with ESP_ERR_NOT_SUPPORTED.
 esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled,
                                  const gw_auto_bin_action_v2_t *action,
                                  char *err,
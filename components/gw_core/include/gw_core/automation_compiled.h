@@ -43,7 +43,7 @@ typedef struct {
     uint32_t id_off;   // string table offset
     uint32_t name_off; // string table offset
     uint8_t enabled;   // 0/1
-    uint8_t mode;      // reserved for future (single/parallel/etc)
+    uint8_t mode;      // gw_auto_mode_t
     uint16_t reserved;
 
     uint32_t triggers_index;    // base index into triggers array
@@ -52,6 +52,9 @@ typedef struct {
     uint32_t conditions_count;
     uint32_t actions_index;     // base index into actions array
     uint32_t actions_count;
+
+    uint32_t debounce_ms;
+    uint32_t throttle_ms;
 } gw_auto_bin_automation_v2_t;
 
 typedef struct {
@@ -71,6 +74,18 @@ esp_err_t gw_auto_compile_json(const char *json, gw_auto_compiled_t *out, char *
 
 void gw_auto_compiled_free(gw_auto_compiled_t *c);
 
+// Trigger "payload.cmd" name -> gw_event_cmd_t (GW_AUTO_CMD_UNKNOWN for names no event carries).
+uint8_t gw_auto_trigger_cmd(const char *name);
+
+// Sets a->op from the action kind and its cmd name after checking the converted args; also stores
+// the on/off command in arg0. Returns false (op = 0) if the cmd is not valid for the kind.
+bool gw_auto_action_resolve(gw_auto_bin_action_v2_t *a, const char *cmd);
+
+// Re-derives the resolved trigger (cmd) and action (op) fields from the entry's string table.
+// Entries written by older firmware have them zeroed (op sits in what was the high half of a
+// 32-bit cmd_off), so the store runs this on everything it loads.
+void gw_auto_entry_resolve(gw_automation_entry_t *entry);
+
 // Serialize compiled representation into a contiguous binary buffer (malloc'ed).
 esp_err_t gw_auto_compiled_serialize(const gw_auto_compiled_t *c, uint8_t **out_buf, size_t *out_len);
 
@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_err.h"
 #include "gw_core/types.h" // Include the new centralized types
@@ -10,6 +11,11 @@
 extern "C" {
 #endif
 
+// Most automations the store holds. The host rules benchmark defines it first to size the engine larger.
+#ifndef GW_AUTOMATION_CAP
+#define GW_AUTOMATION_CAP 32
+#endif
+
 esp_err_t gw_automation_store_init(void);
 
 // List/get functions now operate on the new, compiled-in-memory entry structure
@@ -17,6 +23,22 @@ size_t gw_automation_store_list(gw_automation_entry_t *out, size_t max_out);
 size_t gw_automation_store_list_meta(gw_automation_meta_t *out, size_t max_out);
 esp_err_t gw_automation_store_get(const char *id, gw_automation_entry_t *out);
 
+// Immutable view of the whole store. put/remove/set_enabled never modify a published snapshot:
+// they build a new one and swap it in, so readers can hold a reference without copying.
+typedef struct {
+    uint32_t version; // bumped on every put/remove/set_enabled (and on load)
+    uint32_t refs;    // managed by the store
+    size_t count;
+    gw_automation_entry_t items[];
+} gw_automation_snapshot_t;
+
+// Returns a reference to the current snapshot (never NULL after init); pair with _release().
+const gw_automation_snapshot_t *gw_automation_store_snapshot_acquire(void);
+void gw_automation_store_snapshot_release(const gw_automation_snapshot_t *snap);
+
+// Version of the current snapshot; consumers that cache derived data compare it to detect changes.
+uint32_t gw_automation_store_version(void);
+
 // The 'put' function now takes the raw JSON string to be compiled and stored.
 // This is the new primary way to add or update an automation.
 esp_err_t gw_automation_store_put(const char *id, const char *name, bool enabled, const char *json_str);
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "gw_core/types.h"
 
@@ -8,6 +11,8 @@
 extern "C" {
 #endif
 
+#define GW_DEVICE_REGISTRY_CAP 32
+
 typedef struct {
     gw_device_uid_t device_uid;
     uint16_t short_addr;
@@ -24,6 +29,27 @@ esp_err_t gw_device_registry_set_name(const gw_device_uid_t *uid, const char *na
 esp_err_t gw_device_registry_remove(const gw_device_uid_t *uid);
 size_t gw_device_registry_list(gw_device_t *out_devices, size_t max_devices);
 
+// Device handles: small integers interned per UID so in-memory stores can key by an integer.
+// Handles work before gw_device_registry_init() and for devices not (yet) in the registry.
+// A registered device keeps its handle (also across re-join). The table has room for as many
+// unregistered UIDs again (joining, removed, or reporting without being added); once it is full,
+// the handle of an unregistered UID is released for the new one: the state, sensor and zb_model
+// stores drop what they hold under it first, and the old UID gets a new handle when it shows up again.
+#define GW_DEV_HANDLE_MAX (GW_DEVICE_REGISTRY_CAP * 2)
+
+// Returns the handle for uid, assigning one on first use; GW_DEV_HANDLE_INVALID (logged) if every
+// handle belongs to a registered device.
+gw_dev_handle_t gw_device_registry_handle(const gw_device_uid_t *uid);
+// Lookup only; GW_DEV_HANDLE_INVALID if uid has no handle.
+gw_dev_handle_t gw_device_registry_find_handle(const gw_device_uid_t *uid);
+esp_err_t gw_device_registry_handle_uid(gw_dev_handle_t handle, gw_device_uid_t *out_uid);
+// Bumped whenever a UID gets or loses a handle; consumers that cache uid -> handle lookups compare
+// it to notice newly bound UIDs.
+uint32_t gw_device_registry_handle_gen(void);
+// Bumped whenever a handle is released; consumers that cache handles (or data keyed by them)
+// rebuild when it changes, as the handle may now stand for another UID.
+uint32_t gw_device_registry_handle_release_gen(void);
+
 #ifdef __cplusplus
 }
 #endif
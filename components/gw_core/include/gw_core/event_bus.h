@@ -7,6 +7,7 @@
 #include "esp_event.h"
 #include "freertos/FreeRTOS.h"
 
+#include "gw_core/json_writer.h"
 #include "gw_core/types.h"
 
 #ifdef __cplusplus
@@ -25,6 +26,35 @@ typedef enum {
     GW_EVENT_RULE_RESULT,
 } gw_event_id_t;
 
+// Command ids carried in gw_event_data_t.cmd (names match the "cmd" payload field).
+typedef enum {
+    GW_EVENT_CMD_NONE = 0,
+    GW_EVENT_CMD_OFF,
+    GW_EVENT_CMD_ON,
+    GW_EVENT_CMD_TOGGLE,
+    GW_EVENT_CMD_MOVE_TO_LEVEL,
+    GW_EVENT_CMD_MOVE_TO_COLOR_XY,
+    GW_EVENT_CMD_MOVE_TO_COLOR_TEMP,
+} gw_event_cmd_t;
+
+#define GW_EVENT_DATA_HAS_ENDPOINT (1u << 0)
+#define GW_EVENT_DATA_HAS_CLUSTER  (1u << 1)
+#define GW_EVENT_DATA_HAS_ATTR     (1u << 2)
+#define GW_EVENT_DATA_HAS_CMD      (1u << 3)
+#define GW_EVENT_DATA_HAS_VALUE    (1u << 4)
+
+// Typed, fixed-layout view of the fields consumers match on, filled by the producer
+// so the hot path never has to parse payload_json.
+typedef struct {
+    uint8_t evt_type; // gw_auto_evt_type_t; derived from `type` on publish, 0 for other events
+    uint8_t flags;    // GW_EVENT_DATA_HAS_*
+    uint8_t endpoint;
+    uint8_t cmd;      // gw_event_cmd_t
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    int32_t value;    // raw attribute value (same units as payload "value")
+} gw_event_data_t;
+
 typedef struct {
     uint8_t v; // event schema version (for clients)
     uint32_t id;
@@ -35,15 +65,50 @@ typedef struct {
     uint16_t short_addr;
     char msg[128];
     char payload_json[192]; // optional JSON object/array as string (unescaped)
+    gw_event_data_t data;
 } gw_event_t;
 
 typedef void (*gw_event_bus_listener_t)(const gw_event_t *event, void *user_ctx);
 
+// Ring consumer: reads events by id straight from the bus ring (one copy into the caller's buffer,
+// no per-consumer queue). Each consumer is owned by a single task.
+typedef struct gw_event_consumer gw_event_consumer_t;
+
+// Latency histograms are log2: bucket i counts samples below (GW_EVENT_LATENCY_BUCKET0_US << i) us
+// that did not fit the previous bucket; the last bucket is open-ended.
+#define GW_EVENT_LATENCY_BUCKETS 14
+#define GW_EVENT_LATENCY_BUCKET0_US 128
+
+typedef struct {
+    char name[16];
+    uint32_t delivered;   // events returned by gw_event_bus_consumer_read()
+    uint32_t filtered;    // events skipped by the consumer's filter
+    uint32_t dropped;     // events lost to ring overrun
+    uint32_t backlog;     // published but not yet read, at snapshot time
+    uint32_t backlog_hwm; // largest backlog seen when an event was read
+    uint32_t queue_us_max;
+    uint32_t handle_us_max;
+    uint32_t queue_hist[GW_EVENT_LATENCY_BUCKETS];  // publish -> read returned
+    uint32_t handle_hist[GW_EVENT_LATENCY_BUCKETS]; // read returned -> next read call
+} gw_event_consumer_stats_t;
+
+// Subscription filter, checked by the publisher against the record header before anything is
+// copied out. Every field is optional (NULL / 0 = any); set fields must all match.
+typedef struct {
+    const char *const *types; // event type names, any of
+    size_t type_count;
+    const char *source;
+    const char *device_uid;
+} gw_event_filter_t;
+
 esp_err_t gw_event_bus_init(void);
 esp_err_t gw_event_bus_post(gw_event_id_t id, const void *data, size_t data_size, TickType_t ticks_to_wait);
 
 // Lightweight, in-memory event log for UI/debugging.
 uint32_t gw_event_bus_last_id(void);
+// Continues the id sequence after a persisted one (event journal). Only valid before the first
+// publish and before any consumer is opened.
+esp_err_t gw_event_bus_set_next_id(uint32_t next_id);
 void gw_event_bus_publish(const char *type, const char *source, const char *device_uid, uint16_t short_addr, const char *msg);
 // Helper: publish a JSON payload string as msg (for normalized events).
 void gw_event_bus_publish_json(const char *type, const char *source, const char *device_uid, uint16_t short_addr, const char *payload_json);
@@ -54,10 +119,46 @@ void gw_event_bus_publish_ex(const char *type,
                             uint16_t short_addr,
                             const char *msg,
                             const char *payload_json);
+// Same as publish_ex, plus the typed header (may be NULL; evt_type is filled from `type` when 0).
+void gw_event_bus_publish_data(const char *type,
+                               const char *source,
+                               const char *device_uid,
+                               uint16_t short_addr,
+                               const char *msg,
+                               const char *payload_json,
+                               const gw_event_data_t *data);
 size_t gw_event_bus_list_since(uint32_t since_id, gw_event_t *out, size_t max_out, uint32_t *out_last_id);
 
-// Optional listeners called for each gw_event_bus_publish(). Keep callbacks fast and non-blocking.
+// Writes the event's fields (v, id, ts_ms, type, source, device_uid, short_addr, msg, payload) into an
+// already opened JSON object; the wire shape used by REST and WS.
+void gw_event_write_json_fields(gw_json_writer_t *w, const gw_event_t *e);
+
+const char *gw_event_cmd_name(gw_event_cmd_t cmd);
+gw_event_cmd_t gw_event_cmd_from_name(const char *name); // GW_EVENT_CMD_NONE if unknown
+
+// Opens a consumer positioned after the newest published event.
+esp_err_t gw_event_bus_consumer_open(const char *name, gw_event_consumer_t **out);
+void gw_event_bus_consumer_close(gw_event_consumer_t *c);
+// Only events matching `filter` (NULL = all) are delivered or wake the consumer's task.
+// Must be called before the first read.
+esp_err_t gw_event_bus_consumer_set_filter(gw_event_consumer_t *c, const gw_event_filter_t *filter);
+// Copies the next event into *out, waiting up to ticks_to_wait (ESP_ERR_TIMEOUT if none).
+// The first call binds the consumer to the calling task, which is woken by task notification
+// on publish; that task must not use its notification value for anything else.
+// A consumer that falls more than the ring capacity behind skips ahead and counts the loss.
+esp_err_t gw_event_bus_consumer_read(gw_event_consumer_t *c, gw_event_t *out, TickType_t ticks_to_wait);
+// Makes the owner's blocking read return ESP_ERR_TIMEOUT once no event is pending (now, or on its
+// next call), so the task can serve other work without a second wait primitive. Any task may call it.
+void gw_event_bus_consumer_wake(gw_event_consumer_t *c);
+uint32_t gw_event_bus_consumer_dropped(const gw_event_consumer_t *c);
+// Snapshot of the counters of every open consumer; returns the number written.
+size_t gw_event_bus_consumer_stats(gw_event_consumer_stats_t *out, size_t max_out);
+
+// Optional listeners called synchronously for each gw_event_bus_publish(). Keep callbacks fast and non-blocking;
+// prefer a ring consumer for anything that does real work.
 esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx);
+// Same, but the callback only runs for events matching `filter`; events nobody wants are never decoded.
+esp_err_t gw_event_bus_add_listener_filtered(gw_event_bus_listener_t cb, void *user_ctx, const gw_event_filter_t *filter);
 esp_err_t gw_event_bus_remove_listener(gw_event_bus_listener_t cb, void *user_ctx);
 
 #ifdef __cplusplus
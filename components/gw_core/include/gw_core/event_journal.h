@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "gw_core/event_bus.h"
+#include "gw_core/json_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Append-only event journal on the gw_data partition: a few rotating segment files with
+// a sparse in-RAM id index. A writer task consumes the event ring and flushes batches at a
+// bounded rate, so history survives reboots and bursts that overrun the RAM ring.
+
+// Call right after gw_event_bus_init(): mounts storage, restores the event id sequence
+// from the journal and starts the writer task.
+esp_err_t gw_event_journal_init(void);
+
+// A stretch of event ids that cannot be returned: a batch the journal dropped over its write
+// budget, events lost before they reached it, or history older than the oldest segment.
+// first_id == 0 means no gap.
+typedef struct {
+    uint32_t first_id;
+    uint32_t last_id;
+} gw_event_gap_t;
+
+// Same contract as gw_event_bus_list_since(), but ids older than the RAM ring are read
+// from the journal. Falls back to the RAM ring alone if the journal is not available.
+// *out_gap (optional) gets the first gap before or between the returned events; a client
+// should resync when it is set, since those events are gone.
+size_t gw_event_journal_list_since(uint32_t since_id, gw_event_t *out, size_t max_out, uint32_t *out_last_id,
+                                   gw_event_gap_t *out_gap);
+
+typedef struct {
+    uint32_t batches_dropped; // over the write budget
+    uint32_t events_dropped;
+    gw_event_gap_t last_drop; // ids of the most recently dropped batch
+} gw_event_journal_stats_t;
+
+void gw_event_journal_stats(gw_event_journal_stats_t *out);
+
+// Writes "gap": {"first_id", "last_id"} into the open object when gap is set; the shape used by
+// REST, WS events.list and the WS "gap" message.
+void gw_event_gap_write_json(gw_json_writer_t *w, const gw_event_gap_t *gap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred event log: a low-priority task reads the event ring and prints each event to the
+// console, so publishers never block on the UART.
+
+#define GW_EVENT_LOG_MAX_TYPES 8
+#define GW_EVENT_LOG_DEFAULT_RATE 10 // events/s
+#define GW_EVENT_LOG_DEFAULT_BURST 40
+
+esp_err_t gw_event_log_init(void);
+
+// Only log events whose type matches one of `types` (exact, or a prefix ending in '*').
+// count == 0 logs every type. Takes effect immediately.
+esp_err_t gw_event_log_set_types(const char *const *types, size_t count);
+// Token bucket: at most `per_sec` events/s on average with bursts of `burst`. per_sec == 0 mutes the log.
+void gw_event_log_set_rate(uint32_t per_sec, uint32_t burst);
+
+#ifdef __cplusplus
+}
+#endif
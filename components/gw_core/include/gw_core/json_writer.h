@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming JSON writer for outbound messages: no tree, no heap. Output goes into a caller-provided
+// buffer, or through it to a sink (e.g. an HTTP chunk) whenever it fills. Commas, escaping and
+// number formatting are handled here; nesting is limited to GW_JSON_MAX_DEPTH.
+//
+// Errors are sticky: after the first failure further calls are no-ops and gw_json_writer_finish()
+// reports it. In buffer mode with buf == NULL nothing is stored, which makes a cheap sizing pass:
+// gw_json_writer_len() is still exact.
+
+#define GW_JSON_MAX_DEPTH 32
+
+// Receives complete chunks of output; a non-ESP_OK return aborts the writer.
+typedef esp_err_t (*gw_json_sink_t)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t pos;   // bytes currently in buf
+    size_t total; // bytes produced since init
+    gw_json_sink_t sink;
+    void *sink_ctx;
+    esp_err_t err;
+    uint32_t has_items; // bit per nesting level: something was already written at that level
+    uint8_t depth;
+    bool after_key;
+} gw_json_writer_t;
+
+// Buffer mode: ESP_ERR_NO_MEM once the output (plus terminating NUL) does not fit.
+void gw_json_writer_init(gw_json_writer_t *w, char *buf, size_t cap);
+// Stream mode: buf is scratch space, flushed to sink whenever it fills and on finish.
+void gw_json_writer_init_stream(gw_json_writer_t *w, char *buf, size_t cap, gw_json_sink_t sink, void *ctx);
+// Flushes (stream mode) or NUL-terminates (buffer mode); returns the first error, if any.
+esp_err_t gw_json_writer_finish(gw_json_writer_t *w);
+// Total length of the output so far, including anything already flushed or that did not fit.
+size_t gw_json_writer_len(const gw_json_writer_t *w);
+
+void gw_json_obj_begin(gw_json_writer_t *w);
+void gw_json_obj_end(gw_json_writer_t *w);
+void gw_json_arr_begin(gw_json_writer_t *w);
+void gw_json_arr_end(gw_json_writer_t *w);
+void gw_json_key(gw_json_writer_t *w, const char *key);
+
+void gw_json_str(gw_json_writer_t *w, const char *s); // NULL is written as ""
+void gw_json_u64(gw_json_writer_t *w, uint64_t v);
+void gw_json_i64(gw_json_writer_t *w, int64_t v);
+void gw_json_f64(gw_json_writer_t *w, double v, int decimals); // non-finite values become null
+void gw_json_bool(gw_json_writer_t *w, bool v);
+void gw_json_null(gw_json_writer_t *w);
+// Pre-serialized JSON value, copied verbatim.
+void gw_json_raw(gw_json_writer_t *w, const char *json);
+
+// key + value shorthands
+void gw_json_kv_str(gw_json_writer_t *w, const char *key, const char *s);
+void gw_json_kv_u64(gw_json_writer_t *w, const char *key, uint64_t v);
+void gw_json_kv_i64(gw_json_writer_t *w, const char *key, int64_t v);
+void gw_json_kv_f64(gw_json_writer_t *w, const char *key, double v, int decimals);
+void gw_json_kv_bool(gw_json_writer_t *w, const char *key, bool v);
+void gw_json_kv_raw(gw_json_writer_t *w, const char *key, const char *json);
+
+#ifdef __cplusplus
+}
+#endif
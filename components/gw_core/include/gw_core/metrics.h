@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include "gw_core/json_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t gw_metrics_init(void);
+
+// Writes runtime pipeline metrics (event bus consumers, request methods) as one JSON object, shared by
+// GET /api/metrics and the WS "metrics.get" method. Writes "{}" before gw_metrics_init().
+void gw_metrics_write_json(gw_json_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cJSON.h"
+#include "esp_err.h"
+
+#include "gw_core/json_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Request methods ("events.list", "devices.onoff", ...) independent of the transport. Subsystems
+// register static tables of methods at startup; a transport looks the name up (binary search over
+// a sorted table), the params are checked against the method's arg schema, and the handler answers
+// through the call's reply callback. Calls are counted and timed per method.
+
+#define GW_RPC_MAX_METHODS 48
+#define GW_RPC_MAX_ARGS 8
+
+typedef enum {
+    GW_RPC_ARG_STR = 1, // string; min = minimum length (1 rejects "")
+    GW_RPC_ARG_NUM,     // number in [min, max]
+    GW_RPC_ARG_U16,     // number or "0x...." string in [min, max]
+    GW_RPC_ARG_BOOL,
+    GW_RPC_ARG_OBJ,
+    GW_RPC_ARG_ARR,
+} gw_rpc_arg_type_t;
+
+// One field of the "p" object. A required field that is absent, of the wrong type or out of range
+// fails the call with `err`, or by default "missing <name>" (strings, bools, objects, arrays) /
+// "bad <name>" (numbers). An optional field in that state is treated as absent, so the handler
+// falls back to its default.
+typedef struct {
+    const char *name;
+    uint8_t type; // gw_rpc_arg_type_t
+    bool required;
+    double min;
+    double max;
+    const char *err; // may be NULL
+} gw_rpc_arg_t;
+
+// Writes a method result (one JSON value) into the response.
+typedef void (*gw_rpc_result_fn)(gw_json_writer_t *w, const void *ctx);
+
+typedef struct gw_rpc_call gw_rpc_call_t;
+
+// Transport hook: sends the response for `call`. res (with res_ctx) is set for results, err for failures.
+typedef void (*gw_rpc_reply_fn)(gw_rpc_call_t *call, bool ok, const char *err, gw_rpc_result_fn res, const void *res_ctx);
+
+struct gw_rpc_call {
+    const char *method;
+    cJSON *params;                  // "p" object, NULL if absent
+    gw_rpc_reply_fn reply;
+    void *transport_ctx;
+    cJSON *args[GW_RPC_MAX_ARGS];   // filled by gw_rpc_dispatch() in schema order; NULL = absent
+    bool replied;
+    bool ok;
+};
+
+typedef void (*gw_rpc_handler_t)(gw_rpc_call_t *call);
+
+typedef struct {
+    const char *name;
+    gw_rpc_handler_t handler;
+    const gw_rpc_arg_t *args; // may be NULL
+    size_t arg_count;
+} gw_rpc_method_t;
+
+typedef struct {
+    const char *name;
+    uint32_t calls;
+    uint32_t errors;
+    uint32_t us_max;
+    uint64_t us_total;
+} gw_rpc_stats_t;
+
+// Adds a table of methods; the table must stay valid (static const). Register before the transports
+// start: lookups do not lock against registration. ESP_ERR_INVALID_STATE on a duplicate name.
+esp_err_t gw_rpc_register(const gw_rpc_method_t *methods, size_t count);
+
+// Looks up call->method, validates params, runs the handler and times it. A handler that returns
+// without replying is answered with ok. ESP_ERR_NOT_FOUND (nothing sent) for an unknown method.
+esp_err_t gw_rpc_dispatch(gw_rpc_call_t *call);
+
+// Only the first reply of a call is sent.
+void gw_rpc_reply_ok(gw_rpc_call_t *call);
+void gw_rpc_reply_err(gw_rpc_call_t *call, const char *err);
+void gw_rpc_reply_res(gw_rpc_call_t *call, gw_rpc_result_fn res, const void *res_ctx);
+
+// Accessors for validated args, by schema index; `def` when the optional arg is absent or unusable.
+const char *gw_rpc_arg_str(const gw_rpc_call_t *call, size_t i, const char *def);
+double gw_rpc_arg_num(const gw_rpc_call_t *call, size_t i, double def); // also parses GW_RPC_ARG_U16 strings
+bool gw_rpc_arg_bool(const gw_rpc_call_t *call, size_t i, bool def);
+
+size_t gw_rpc_stats(gw_rpc_stats_t *out, size_t max_out);
+
+// Registers the gw_core methods (events, metrics, eventlog, automations, devices.set_name, actions).
+esp_err_t gw_rpc_register_core(void);
+
+#ifdef __cplusplus
+}
+#endif
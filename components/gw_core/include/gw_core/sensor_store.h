@@ -23,6 +23,7 @@ typedef enum {
 
 typedef struct {
     gw_device_uid_t uid;
+    gw_dev_handle_t dev; // filled by gw_sensor_store_upsert()
     uint16_t short_addr;
     uint8_t endpoint;
     uint16_t cluster_id;
@@ -35,7 +36,9 @@ typedef struct {
 
 esp_err_t gw_sensor_store_init(void);
 esp_err_t gw_sensor_store_upsert(const gw_sensor_value_t *v);
-size_t gw_sensor_store_list(const gw_device_uid_t *uid, gw_sensor_value_t *out, size_t max_out);
+// Forgets every value of dev; the device registry calls it before it hands dev to another UID.
+void gw_sensor_store_drop_dev(gw_dev_handle_t dev);
+size_t gw_sensor_store_list(gw_dev_handle_t dev, gw_sensor_value_t *out, size_t max_out);
 
 #ifdef __cplusplus
 }
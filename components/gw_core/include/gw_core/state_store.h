@@ -6,6 +6,7 @@
 
 #include "esp_err.h"
 
+#include "gw_core/json_writer.h"
 #include "gw_core/types.h"
 
 #ifdef __cplusplus
@@ -13,7 +14,7 @@ extern "C" {
 #endif
 
 // In-memory normalized device state for automations/conditions.
-// Keyed by (device_uid, key) where key is a stable string like:
+// Keyed by (device handle, key id). Key ids are interned; names are only used at the API edge:
 // - "onoff" (bool)
 // - "temperature_c" (float)
 // - "humidity_pct" (float)
@@ -21,35 +22,122 @@ extern "C" {
 // - "last_seen_ms" (uint64)
 
 #define GW_STATE_KEY_MAX 24
-#define GW_STATE_MAX_ITEMS 128
+#define GW_STATE_KEY_CAP 32 // built-in + interned keys
+#define GW_STATE_MAX_ITEMS 512
+
+typedef uint8_t gw_state_key_t;
+
+enum {
+    GW_STATE_KEY_INVALID = 0,
+    GW_STATE_KEY_ONOFF,
+    GW_STATE_KEY_TEMPERATURE_C,
+    GW_STATE_KEY_HUMIDITY_PCT,
+    GW_STATE_KEY_BATTERY_PCT,
+    GW_STATE_KEY_LAST_SEEN_MS,
+    GW_STATE_KEY_BUILTIN_COUNT,
+};
 
 typedef enum {
+    GW_STATE_VALUE_NONE = 0, // item left the store (see the change listeners)
     GW_STATE_VALUE_BOOL = 1,
     GW_STATE_VALUE_F32 = 2,
     GW_STATE_VALUE_U32 = 3,
     GW_STATE_VALUE_U64 = 4,
 } gw_state_value_type_t;
 
+// Only the member selected by the item's value_type is valid.
+typedef union {
+    bool b;
+    float f32;
+    uint32_t u32;
+    uint64_t u64;
+} gw_state_value_t;
+
 typedef struct {
-    gw_device_uid_t uid;
-    char key[GW_STATE_KEY_MAX];
-    gw_state_value_type_t value_type;
-    bool value_bool;
-    float value_f32;
-    uint32_t value_u32;
-    uint64_t value_u64;
+    gw_dev_handle_t dev;
+    gw_state_key_t key;
+    uint8_t value_type; // gw_state_value_type_t
+    uint32_t version;   // store version of the item's last value change (set by the store)
     uint64_t ts_ms;
+    gw_state_value_t value;
 } gw_state_item_t;
 
 esp_err_t gw_state_store_init(void);
 
-esp_err_t gw_state_store_set_bool(const gw_device_uid_t *uid, const char *key, bool value, uint64_t ts_ms);
-esp_err_t gw_state_store_set_f32(const gw_device_uid_t *uid, const char *key, float value, uint64_t ts_ms);
-esp_err_t gw_state_store_set_u32(const gw_device_uid_t *uid, const char *key, uint32_t value, uint64_t ts_ms);
-esp_err_t gw_state_store_set_u64(const gw_device_uid_t *uid, const char *key, uint64_t value, uint64_t ts_ms);
+// Key registry. from_name() never allocates (GW_STATE_KEY_INVALID if unknown);
+// intern() assigns a new id for names beyond the built-ins.
+gw_state_key_t gw_state_key_from_name(const char *name);
+gw_state_key_t gw_state_key_intern(const char *name);
+const char *gw_state_key_name(gw_state_key_t key); // "" if unknown
+
+esp_err_t gw_state_store_set_bool(gw_dev_handle_t dev, gw_state_key_t key, bool value, uint64_t ts_ms);
+esp_err_t gw_state_store_set_f32(gw_dev_handle_t dev, gw_state_key_t key, float value, uint64_t ts_ms);
+esp_err_t gw_state_store_set_u32(gw_dev_handle_t dev, gw_state_key_t key, uint32_t value, uint64_t ts_ms);
+esp_err_t gw_state_store_set_u64(gw_dev_handle_t dev, gw_state_key_t key, uint64_t value, uint64_t ts_ms);
+
+esp_err_t gw_state_store_get(gw_dev_handle_t dev, gw_state_key_t key, gw_state_item_t *out);
+size_t gw_state_store_list(gw_dev_handle_t dev, gw_state_item_t *out, size_t max_out);
+// Removes every item of dev (listeners get each as GW_STATE_VALUE_NONE) and raises the removed
+// floor, so delta readers start over with a snapshot. The device registry calls it before it hands
+// dev to another UID.
+void gw_state_store_drop_dev(gw_dev_handle_t dev);
+
+// Change tracking: each insert, value change or eviction bumps a store-wide version and stamps the
+// item with it, so readers can fetch only what changed since the version they last saw.
+uint32_t gw_state_store_version(void);
+// Copies items with version > since, resuming the walk at *cursor (start at 0); returns the number
+// written and advances *cursor. Call again while it fills out completely. Read gw_state_store_version()
+// before the walk and use it as the next `since`: an item changed meanwhile may be returned twice,
+// never missed. For since > 0, items removed since then and not set again come last, with value_type
+// GW_STATE_VALUE_NONE.
+size_t gw_state_store_changed_since(uint32_t since, size_t *cursor, gw_state_item_t *out, size_t max_out);
+// Only the latest removals are remembered: a delta from a since below this version may miss some,
+// so such a reader takes a full snapshot (since 0) instead.
+uint32_t gw_state_store_removed_floor(void);
+
+// Change listeners run after a set that inserted an item or changed its value (a set that only
+// refreshes ts_ms is not reported), and for an item evicted to make room, which is reported once
+// with value_type GW_STATE_VALUE_NONE. They are called in the setter's task with no lock held;
+// keep them short and non-blocking.
+#define GW_STATE_LISTENER_CAP 4
+
+typedef void (*gw_state_listener_t)(const gw_state_item_t *item, void *user_ctx);
+
+esp_err_t gw_state_store_add_listener(gw_state_listener_t cb, void *user_ctx);
+esp_err_t gw_state_store_remove_listener(gw_state_listener_t cb, void *user_ctx);
+
+// Watches: transition detectors on one (dev, key) slot, evaluated by the setter while it holds the
+// store lock, only for sets that change the value. The callback runs afterwards, with no lock held,
+// and only when the watch fires. Watches are indexed by (dev, key), so a set only steps the watches of
+// its own slot and one nobody watches costs a single table lookup.
+// Numeric view of the value: bools are 0/1.
+#define GW_STATE_WATCH_CAP 64
+
+typedef enum {
+    GW_STATE_WATCH_CHANGE = 1, // every value change of an existing item (not the first value)
+    GW_STATE_WATCH_ABOVE,      // rises above threshold; re-armed once <= threshold - hysteresis
+    GW_STATE_WATCH_BELOW,      // falls below threshold; re-armed once >= threshold + hysteresis
+} gw_state_watch_kind_t;
+
+typedef struct {
+    gw_dev_handle_t dev;
+    gw_state_key_t key;
+    uint8_t kind; // gw_state_watch_kind_t
+    float threshold;
+    float hysteresis; // >= 0
+} gw_state_watch_t;
+
+typedef void (*gw_state_watch_cb_t)(uint16_t watch_id, const gw_state_item_t *item, void *user_ctx);
+
+// ABOVE/BELOW arm from the slot's current value (or its first one), so a value that is already past
+// the threshold when the watch is added does not fire. An evicted slot arms again from its next value. *out_id is stable until the watch is removed.
+esp_err_t gw_state_store_watch_add(const gw_state_watch_t *watch, gw_state_watch_cb_t cb, void *user_ctx, uint16_t *out_id);
+// Removes every watch registered with cb. A callback for a transition detected just before may
+// still be running or about to run; owners that reuse ids tell generations apart via user_ctx.
+void gw_state_store_watch_clear(gw_state_watch_cb_t cb);
 
-esp_err_t gw_state_store_get(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out);
-size_t gw_state_store_list(const gw_device_uid_t *uid, gw_state_item_t *out, size_t max_out);
+// Writes the item's value as a JSON value (bool, number or null); the shape used by REST and WS.
+void gw_state_write_json_value(gw_json_writer_t *w, const gw_state_item_t *item);
 
 #ifdef __cplusplus
 }
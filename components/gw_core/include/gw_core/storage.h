@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// gw_data SPIFFS partition, shared by the automation store and the event journal.
+// Overridable so host tests can point it at a scratch directory.
+#ifndef GW_STORAGE_BASE_PATH
+#define GW_STORAGE_BASE_PATH "/data"
+#endif
+
+// Mounts gw_data at GW_STORAGE_BASE_PATH; later calls are no-ops once mounted.
+esp_err_t gw_storage_mount(void);
+bool gw_storage_is_mounted(void);
+
+#ifdef __cplusplus
+}
+#endif
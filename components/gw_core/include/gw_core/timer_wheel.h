@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hierarchical timing wheel: GW_TIMER_WHEEL_LEVELS levels of 64 slots at GW_TIMER_WHEEL_TICK_MS
+// resolution. Arming and cancelling are O(1) list operations whatever the number of armed timers;
+// a timer further out than 64 ticks sits in a coarser level and is moved down when its slot comes
+// up. Timers are owned by the caller (no allocation, no task per timer).
+//
+// A wheel belongs to one task: arm/cancel/run are only called from it and expiry callbacks run
+// inside gw_timer_wheel_run(). One esp_timer is set to the next slot that needs work and calls the
+// wake hook (from the esp_timer task), which should make the owner call gw_timer_wheel_run().
+
+#define GW_TIMER_WHEEL_TICK_MS 10
+#define GW_TIMER_WHEEL_LEVELS 4 // 64^4 ticks (~46 h) ahead; later timers wait in the last level
+
+typedef struct gw_timer_wheel gw_timer_wheel_t;
+typedef struct gw_timer gw_timer_t;
+
+typedef void (*gw_timer_cb_t)(gw_timer_t *t, void *user_ctx);
+
+// Fields are private to the wheel; zero-initialized or gw_timer_init() = not armed.
+struct gw_timer {
+    gw_timer_t *next;
+    gw_timer_t **pprev; // NULL = not armed
+    uint32_t expires;   // tick
+    uint16_t slot;      // level * 64 + slot while armed
+    gw_timer_cb_t cb;
+    void *user_ctx;
+};
+
+// wake runs in the esp_timer task; keep it to a notification.
+esp_err_t gw_timer_wheel_create(const char *name, void (*wake)(void *ctx), void *wake_ctx, gw_timer_wheel_t **out);
+
+void gw_timer_init(gw_timer_t *t, gw_timer_cb_t cb, void *user_ctx);
+// (Re)arms t to fire once, no earlier than delay_ms from now. A callback may re-arm its own timer.
+void gw_timer_arm(gw_timer_wheel_t *w, gw_timer_t *t, uint32_t delay_ms);
+// Returns true if t was armed.
+bool gw_timer_cancel(gw_timer_wheel_t *w, gw_timer_t *t);
+
+static inline bool gw_timer_pending(const gw_timer_t *t)
+{
+    return t->pprev != NULL;
+}
+
+// Fires every timer that is due, then sets the esp_timer for the next slot that needs work (or
+// stops it when nothing is armed). Call after arming too, so a new earliest deadline is picked up.
+void gw_timer_wheel_run(gw_timer_wheel_t *w);
+
+uint32_t gw_timer_wheel_armed(const gw_timer_wheel_t *w);
+
+#ifdef __cplusplus
+}
+#endif
@@ -14,6 +14,10 @@ typedef struct {
     char uid[GW_DEVICE_UID_STRLEN];
 } gw_device_uid_t;
 
+// Compact per-device handle handed out by device_registry (see gw_device_registry_handle()).
+typedef uint16_t gw_dev_handle_t;
+#define GW_DEV_HANDLE_INVALID ((gw_dev_handle_t)0)
+
 typedef struct {
     gw_device_uid_t device_uid; // stable (IEEE)
     uint16_t short_addr;        // current network address (may change after rejoin)
@@ -40,8 +44,28 @@ typedef enum {
     GW_AUTO_EVT_ZIGBEE_ATTR_REPORT = 2,
     GW_AUTO_EVT_DEVICE_JOIN = 3,
     GW_AUTO_EVT_DEVICE_LEAVE = 4,
+    GW_AUTO_EVT_STATE = 5,    // state-change trigger (watch on a state slot), not a bus event
+    GW_AUTO_EVT_INTERVAL = 6, // periodic trigger (rules engine timer), not a bus event
 } gw_auto_evt_type_t;
 
+// How a trigger is handled while an earlier run of the automation is still waiting in a delay.
+typedef enum {
+    GW_AUTO_MODE_SINGLE = 1,  // ignore it
+    GW_AUTO_MODE_RESTART = 2, // abandon the earlier run and start over
+    GW_AUTO_MODE_QUEUED = 3,  // start another run after the earlier one (up to GW_AUTO_QUEUE_MAX waiting)
+} gw_auto_mode_t;
+
+#define GW_AUTO_QUEUE_MAX 4
+#define GW_AUTO_DELAY_MS_MAX 86400000u   // delay action / interval trigger: 24 h
+#define GW_AUTO_INTERVAL_MS_MIN 1000u
+#define GW_AUTO_WINDOW_MS_MAX 3600000u   // debounce_ms / throttle_ms: 1 h
+
+typedef enum {
+    GW_AUTO_EDGE_CHANGE = 1, // any value change
+    GW_AUTO_EDGE_ABOVE = 2,  // rises above threshold
+    GW_AUTO_EDGE_BELOW = 3,  // falls below threshold
+} gw_auto_edge_t;
+
 typedef enum {
     GW_AUTO_OP_EQ = 1,
     GW_AUTO_OP_NE = 2,
@@ -62,21 +86,48 @@ typedef enum {
     GW_AUTO_ACT_SCENE = 3,
     GW_AUTO_ACT_BIND = 4,
     GW_AUTO_ACT_MGMT = 5,
+    GW_AUTO_ACT_DELAY = 6,
 } gw_auto_act_kind_t;
 
+// Resolved action opcode; the compiler validates and converts the args so execution is a switch.
+typedef enum {
+    GW_AUTO_ACT_OP_ONOFF = 1,        // DEVICE/GROUP; arg0 = gw_zigbee_onoff_cmd_t
+    GW_AUTO_ACT_OP_LEVEL = 2,        // DEVICE/GROUP; arg0 = level 0..254, arg1 = transition_ms
+    GW_AUTO_ACT_OP_COLOR_XY = 3,     // DEVICE/GROUP; arg0 = x, arg1 = y, arg2 = transition_ms
+    GW_AUTO_ACT_OP_COLOR_TEMP = 4,   // DEVICE/GROUP; arg0 = mireds 1..1000, arg1 = transition_ms
+    GW_AUTO_ACT_OP_SCENE_STORE = 5,  // SCENE
+    GW_AUTO_ACT_OP_SCENE_RECALL = 6, // SCENE
+    GW_AUTO_ACT_OP_BIND = 7,         // BIND; GW_AUTO_ACT_FLAG_UNBIND selects unbind
+    GW_AUTO_ACT_OP_DELAY = 8,        // DELAY; arg0 = ms; handled by the rules engine, not gw_action_exec
+} gw_auto_act_op_t;
+
+#define GW_AUTO_TRANSITION_MS_MAX 60000
+
 typedef enum {
     GW_AUTO_ACT_FLAG_UNBIND = 1 << 0, // BIND: unbind instead of bind
     GW_AUTO_ACT_FLAG_REJOIN = 1 << 1, // MGMT leave: request rejoin
 } gw_auto_act_flag_t;
 
+// Trigger cmd name that is not a known gw_event_cmd_t; never matches an event.
+#define GW_AUTO_CMD_UNKNOWN 0xFF
+
 typedef struct {
     uint8_t event_type; // gw_auto_evt_type_t
     uint8_t endpoint;   // 0 = any
-    uint16_t reserved;
-    uint32_t device_uid_off; // string table offset (0 = any)
+    uint8_t cmd;        // gw_event_cmd_t resolved from cmd_off (GW_AUTO_CMD_UNKNOWN if no such command)
+    uint8_t edge;       // STATE: gw_auto_edge_t
+    uint32_t device_uid_off; // string table offset (0 = any; required for STATE)
     uint32_t cmd_off;    // string table offset (0 = any)
     uint16_t cluster_id; // 0 = any
     uint16_t attr_id;    // 0 = any
+    union {
+        struct {
+            uint32_t key_off; // STATE: state key name, string table offset
+            float threshold;  // STATE above/below
+            float hysteresis; // STATE above/below: distance back across the threshold that re-arms it
+        };
+        uint32_t interval_ms; // INTERVAL
+    };
 } gw_auto_bin_trigger_v2_t;
 
 typedef struct {
@@ -98,7 +149,9 @@ typedef struct {
     uint8_t flags;    // kind-specific flags (see below)
     uint16_t u16_0;
     uint16_t u16_1;
-    uint32_t cmd_off;  // string table offset (required)
+    uint16_t cmd_off;  // string table offset (required)
+    uint8_t op;        // gw_auto_act_op_t; 0 = not resolved (entries from older firmware, see gw_auto_entry_resolve())
+    uint8_t reserved;
     uint32_t uid_off;  // DEVICE: device_uid; BIND: src_device_uid; else 0
     uint32_t uid2_off; // BIND: dst_device_uid; else 0
     uint32_t arg0_u32;
@@ -114,7 +167,7 @@ typedef struct {
     char id[GW_AUTOMATION_ID_MAX];
     char name[GW_AUTOMATION_NAME_MAX];
     bool enabled;
-    uint8_t reserved; // Padding/alignment
+    uint8_t mode; // gw_auto_mode_t; 0 (entries from older firmware) = single
 
     uint8_t triggers_count;
     uint8_t conditions_count;
@@ -127,6 +180,9 @@ typedef struct {
 
     uint16_t string_table_size;
     char string_table[GW_AUTO_MAX_STRING_TABLE_BYTES];
+
+    uint32_t debounce_ms; // run only once triggers have been quiet this long (0 = off)
+    uint32_t throttle_ms; // ignore triggers this soon after the last accepted one (0 = off)
 } gw_automation_entry_t;
 
 // Lightweight metadata view for UI/status, does not need the full compiled body.
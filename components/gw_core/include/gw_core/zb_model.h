@@ -20,6 +20,7 @@ extern "C" {
 
 typedef struct {
     gw_device_uid_t uid;
+    gw_dev_handle_t dev; // filled by gw_zb_model_upsert_endpoint()
     uint16_t short_addr;
     uint8_t endpoint;
     uint16_t profile_id;
@@ -32,7 +33,9 @@ typedef struct {
 
 esp_err_t gw_zb_model_init(void);
 esp_err_t gw_zb_model_upsert_endpoint(const gw_zb_endpoint_t *ep);
-size_t gw_zb_model_list_endpoints(const gw_device_uid_t *uid, gw_zb_endpoint_t *out_eps, size_t max_eps);
+// Forgets every endpoint of dev; the device registry calls it before it hands dev to another UID.
+void gw_zb_model_drop_dev(gw_dev_handle_t dev);
+size_t gw_zb_model_list_endpoints(gw_dev_handle_t dev, gw_zb_endpoint_t *out_eps, size_t max_eps);
 bool gw_zb_model_find_uid_by_short(uint16_t short_addr, gw_device_uid_t *out_uid);
 
 #ifdef __cplusplus
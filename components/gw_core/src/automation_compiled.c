@@ -2,6 +2,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,10 @@
 #include "cJSON.h"
 #include "esp_log.h"
 
+#include "gw_core/event_bus.h"
+#include "gw_core/state_store.h"
+#include "gw_zigbee/gw_zigbee.h"
+
 #define MAGIC_GWAR 0x52415747u // 'GWAR'
 
 static void set_err(char *out, size_t out_size, const char *msg)
@@ -66,6 +71,23 @@ static uint32_t parse_u32_any(const cJSON *j, bool *ok)
     return 0;
 }
 
+// Optional duration in ms: absent -> 0, otherwise 0..max.
+static bool parse_ms(const cJSON *j, uint32_t max, uint32_t *out)
+{
+    *out = 0;
+    if (!j || cJSON_IsNull(j)) return true;
+    bool ok = false;
+    const uint32_t v = parse_u32_any(j, &ok);
+    if (!ok || v > max) return false;
+    *out = v;
+    return true;
+}
+
+static bool parse_transition_ms(const cJSON *j, uint32_t *out)
+{
+    return parse_ms(j, GW_AUTO_TRANSITION_MS_MAX, out);
+}
+
 typedef struct {
     char *buf;
     size_t len;
@@ -127,6 +149,65 @@ static gw_auto_evt_type_t evt_type_from_str(const char *s)
     return 0;
 }
 
+uint8_t gw_auto_trigger_cmd(const char *name)
+{
+    if (!name || !name[0]) return GW_AUTO_CMD_UNKNOWN;
+    const gw_event_cmd_t cmd = gw_event_cmd_from_name(name);
+    return cmd == GW_EVENT_CMD_NONE ? GW_AUTO_CMD_UNKNOWN : (uint8_t)cmd;
+}
+
+static bool group_id_valid(uint16_t group_id)
+{
+    return group_id != 0 && group_id != 0xFFFF;
+}
+
+bool gw_auto_action_resolve(gw_auto_bin_action_v2_t *a, const char *cmd)
+{
+    if (!a) return false;
+    a->op = 0;
+    if (!cmd || !cmd[0]) return false;
+
+    uint8_t op = 0;
+    switch (a->kind) {
+    case GW_AUTO_ACT_DEVICE:
+    case GW_AUTO_ACT_GROUP:
+        if (a->kind == GW_AUTO_ACT_DEVICE ? (a->uid_off == 0 || a->endpoint == 0) : !group_id_valid(a->u16_0)) return false;
+        if (strcmp(cmd, "onoff.off") == 0) {
+            op = GW_AUTO_ACT_OP_ONOFF;
+            a->arg0_u32 = GW_ZIGBEE_ONOFF_CMD_OFF;
+        } else if (strcmp(cmd, "onoff.on") == 0) {
+            op = GW_AUTO_ACT_OP_ONOFF;
+            a->arg0_u32 = GW_ZIGBEE_ONOFF_CMD_ON;
+        } else if (strcmp(cmd, "onoff.toggle") == 0) {
+            op = GW_AUTO_ACT_OP_ONOFF;
+            a->arg0_u32 = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
+        } else if (strcmp(cmd, "level.move_to_level") == 0) {
+            if (a->arg0_u32 <= 254 && a->arg1_u32 <= GW_AUTO_TRANSITION_MS_MAX) op = GW_AUTO_ACT_OP_LEVEL;
+        } else if (strcmp(cmd, "color.move_to_color_xy") == 0) {
+            if (a->arg0_u32 <= 65535 && a->arg1_u32 <= 65535 && a->arg2_u32 <= GW_AUTO_TRANSITION_MS_MAX) op = GW_AUTO_ACT_OP_COLOR_XY;
+        } else if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
+            if (a->arg0_u32 >= 1 && a->arg0_u32 <= 1000 && a->arg1_u32 <= GW_AUTO_TRANSITION_MS_MAX) op = GW_AUTO_ACT_OP_COLOR_TEMP;
+        }
+        break;
+    case GW_AUTO_ACT_SCENE:
+        if (!group_id_valid(a->u16_0) || a->u16_1 == 0 || a->u16_1 > 255) return false;
+        if (strcmp(cmd, "scene.store") == 0) op = GW_AUTO_ACT_OP_SCENE_STORE;
+        else if (strcmp(cmd, "scene.recall") == 0) op = GW_AUTO_ACT_OP_SCENE_RECALL;
+        break;
+    case GW_AUTO_ACT_BIND:
+        if (a->uid_off == 0 || a->uid2_off == 0 || a->endpoint == 0 || a->aux_ep == 0 || a->u16_0 == 0) return false;
+        op = GW_AUTO_ACT_OP_BIND;
+        break;
+    case GW_AUTO_ACT_DELAY:
+        if (strcmp(cmd, "delay") == 0 && a->arg0_u32 <= GW_AUTO_DELAY_MS_MAX) op = GW_AUTO_ACT_OP_DELAY;
+        break;
+    default:
+        break;
+    }
+    a->op = op;
+    return op != 0;
+}
+
 static gw_auto_op_t op_from_str(const char *s)
 {
     if (!s) return 0;
@@ -139,6 +220,46 @@ static gw_auto_op_t op_from_str(const char *s)
     return 0;
 }
 
+static bool parse_f32(const cJSON *j, float *out)
+{
+    if (!cJSON_IsNumber(j) || !isfinite(j->valuedouble)) return false;
+    *out = (float)j->valuedouble;
+    return true;
+}
+
+// {"type":"state","ref":{"device_uid","key"},"edge":"change|above|below","threshold":N,"hysteresis":N}.
+// Returns NULL or the error message.
+static const char *compile_state_trigger(const cJSON *t, gw_auto_bin_trigger_v2_t *out, strtab_t *st)
+{
+    const cJSON *ref_j = cJSON_GetObjectItemCaseSensitive(t, "ref");
+    const cJSON *edge_j = cJSON_GetObjectItemCaseSensitive(t, "edge");
+    const cJSON *uid_j = cJSON_IsObject(ref_j) ? cJSON_GetObjectItemCaseSensitive(ref_j, "device_uid") : NULL;
+    const cJSON *key_j = cJSON_IsObject(ref_j) ? cJSON_GetObjectItemCaseSensitive(ref_j, "key") : NULL;
+    if (!cJSON_IsString(uid_j) || !uid_j->valuestring || !uid_j->valuestring[0]) return "missing trigger.ref.device_uid";
+    if (!cJSON_IsString(key_j) || !key_j->valuestring || !key_j->valuestring[0]) return "missing trigger.ref.key";
+    if (strlen(key_j->valuestring) >= GW_STATE_KEY_MAX) return "bad trigger.ref.key";
+
+    memset(out, 0, sizeof(*out));
+    out->event_type = GW_AUTO_EVT_STATE;
+    if (!cJSON_IsString(edge_j) || !edge_j->valuestring || strcmp(edge_j->valuestring, "change") == 0) {
+        out->edge = GW_AUTO_EDGE_CHANGE;
+    } else if (strcmp(edge_j->valuestring, "above") == 0) {
+        out->edge = GW_AUTO_EDGE_ABOVE;
+    } else if (strcmp(edge_j->valuestring, "below") == 0) {
+        out->edge = GW_AUTO_EDGE_BELOW;
+    } else {
+        return "bad trigger.edge";
+    }
+    if (out->edge != GW_AUTO_EDGE_CHANGE) {
+        if (!parse_f32(cJSON_GetObjectItemCaseSensitive(t, "threshold"), &out->threshold)) return "bad trigger.threshold";
+        const cJSON *hyst_j = cJSON_GetObjectItemCaseSensitive(t, "hysteresis");
+        if (hyst_j && (!parse_f32(hyst_j, &out->hysteresis) || out->hysteresis < 0)) return "bad trigger.hysteresis";
+    }
+    out->device_uid_off = strtab_add(st, uid_j->valuestring);
+    out->key_off = strtab_add(st, key_j->valuestring);
+    return NULL;
+}
+
 static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *err, size_t err_size)
 {
     if (!json || !out) return ESP_ERR_INVALID_ARG;
@@ -189,6 +310,32 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
         goto done;
     }
 
+    uint8_t mode = GW_AUTO_MODE_SINGLE;
+    if (mode_j && !cJSON_IsNull(mode_j)) {
+        const char *m = cJSON_IsString(mode_j) && mode_j->valuestring ? mode_j->valuestring : "";
+        if (strcmp(m, "restart") == 0) {
+            mode = GW_AUTO_MODE_RESTART;
+        } else if (strcmp(m, "queued") == 0) {
+            mode = GW_AUTO_MODE_QUEUED;
+        } else if (strcmp(m, "single") != 0) {
+            set_err(err, err_size, "unsupported mode");
+            rc = ESP_ERR_INVALID_ARG;
+            goto done;
+        }
+    }
+    uint32_t debounce_ms = 0;
+    uint32_t throttle_ms = 0;
+    if (!parse_ms(cJSON_GetObjectItemCaseSensitive(root, "debounce_ms"), GW_AUTO_WINDOW_MS_MAX, &debounce_ms)) {
+        set_err(err, err_size, "bad debounce_ms");
+        rc = ESP_ERR_INVALID_ARG;
+        goto done;
+    }
+    if (!parse_ms(cJSON_GetObjectItemCaseSensitive(root, "throttle_ms"), GW_AUTO_WINDOW_MS_MAX, &throttle_ms)) {
+        set_err(err, err_size, "bad throttle_ms");
+        rc = ESP_ERR_INVALID_ARG;
+        goto done;
+    }
+
     // Counts
     const uint32_t trigger_count = (uint32_t)cJSON_GetArraySize((cJSON *)triggers_j);
     const uint32_t cond_count = cJSON_IsArray(conds_j) ? (uint32_t)cJSON_GetArraySize((cJSON *)conds_j) : 0;
@@ -211,7 +358,9 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
     auto_rec->id_off = strtab_add(&st, id_j->valuestring);
     auto_rec->name_off = strtab_add(&st, name_j->valuestring);
     auto_rec->enabled = cJSON_IsBool(enabled_j) ? (cJSON_IsTrue(enabled_j) ? 1 : 0) : 1;
-    auto_rec->mode = (cJSON_IsString(mode_j) && mode_j->valuestring && strcmp(mode_j->valuestring, "single") == 0) ? 1 : 1;
+    auto_rec->mode = mode;
+    auto_rec->debounce_ms = debounce_ms;
+    auto_rec->throttle_ms = throttle_ms;
     auto_rec->triggers_index = 0;
     auto_rec->triggers_count = trigger_count;
     auto_rec->conditions_index = 0;
@@ -231,6 +380,28 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
         const cJSON *type_j2 = cJSON_GetObjectItemCaseSensitive((cJSON *)t, "type");
         const cJSON *event_type_j = cJSON_GetObjectItemCaseSensitive((cJSON *)t, "event_type");
         const cJSON *match_j = cJSON_GetObjectItemCaseSensitive((cJSON *)t, "match");
+        if (cJSON_IsString(type_j2) && type_j2->valuestring && strcmp(type_j2->valuestring, "state") == 0) {
+            const char *msg = compile_state_trigger(t, &trigs[i], &st);
+            if (msg) {
+                set_err(err, err_size, msg);
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
+            continue;
+        }
+        if (cJSON_IsString(type_j2) && type_j2->valuestring && strcmp(type_j2->valuestring, "interval") == 0) {
+            uint32_t every_ms = 0;
+            const cJSON *every_j = cJSON_GetObjectItemCaseSensitive((cJSON *)t, "every_ms");
+            if (!every_j || !parse_ms(every_j, GW_AUTO_DELAY_MS_MAX, &every_ms) || every_ms < GW_AUTO_INTERVAL_MS_MIN) {
+                set_err(err, err_size, "bad trigger.every_ms");
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
+            memset(&trigs[i], 0, sizeof(trigs[i]));
+            trigs[i].event_type = GW_AUTO_EVT_INTERVAL;
+            trigs[i].interval_ms = every_ms;
+            continue;
+        }
         if (!cJSON_IsString(type_j2) || !type_j2->valuestring || strcmp(type_j2->valuestring, "event") != 0) {
             set_err(err, err_size, "unsupported trigger.type");
             rc = ESP_ERR_INVALID_ARG;
@@ -248,12 +419,8 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
             goto done_alloc;
         }
 
+        memset(&trigs[i], 0, sizeof(trigs[i]));
         trigs[i].event_type = (uint8_t)et;
-        trigs[i].endpoint = 0;
-        trigs[i].device_uid_off = 0;
-        trigs[i].cmd_off = 0;
-        trigs[i].cluster_id = 0;
-        trigs[i].attr_id = 0;
 
         if (cJSON_IsObject(match_j)) {
             const cJSON *uid_m = cJSON_GetObjectItemCaseSensitive((cJSON *)match_j, "device_uid");
@@ -274,6 +441,7 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                 const cJSON *cmd_m = cJSON_GetObjectItemCaseSensitive((cJSON *)match_j, "payload.cmd");
                 if (cJSON_IsString(cmd_m) && cmd_m->valuestring && cmd_m->valuestring[0]) {
                     trigs[i].cmd_off = strtab_add(&st, cmd_m->valuestring);
+                    trigs[i].cmd = gw_auto_trigger_cmd(cmd_m->valuestring);
                 }
                 const cJSON *cluster_m = cJSON_GetObjectItemCaseSensitive((cJSON *)match_j, "payload.cluster");
                 bool ok16 = false;
@@ -379,6 +547,17 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
 
         const cJSON *type_j2 = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "type");
         const cJSON *cmd_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "cmd");
+        if (cJSON_IsString(type_j2) && type_j2->valuestring && strcmp(type_j2->valuestring, "delay") == 0) {
+            const cJSON *ms_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "ms");
+            if (!ms_j || !parse_ms(ms_j, GW_AUTO_DELAY_MS_MAX, &acts[i].arg0_u32)) {
+                set_err(err, err_size, "bad action.ms");
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
+            acts[i].kind = GW_AUTO_ACT_DELAY;
+            acts[i].cmd_off = (uint16_t)strtab_add(&st, "delay");
+            continue;
+        }
         if (!cJSON_IsString(type_j2) || !type_j2->valuestring || strcmp(type_j2->valuestring, "zigbee") != 0) {
             set_err(err, err_size, "unsupported action.type");
             rc = ESP_ERR_INVALID_ARG;
@@ -391,7 +570,7 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
         }
 
         const char *cmd = cmd_j->valuestring;
-        acts[i].cmd_off = strtab_add(&st, cmd);
+        acts[i].cmd_off = (uint16_t)strtab_add(&st, cmd);
 
         // 1) Binding / unbinding (ZDO)
         if (strcmp(cmd, "bind") == 0 || strcmp(cmd, "unbind") == 0 ||
@@ -492,10 +671,14 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                     rc = ESP_ERR_INVALID_ARG;
                     goto done_alloc;
                 }
-                bool ok_tr = false;
-                uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+                uint32_t tr = 0;
+                if (!parse_transition_ms(tr_j, &tr)) {
+                    set_err(err, err_size, "bad action.transition_ms");
+                    rc = ESP_ERR_INVALID_ARG;
+                    goto done_alloc;
+                }
                 acts[i].arg0_u32 = lvl;
-                acts[i].arg1_u32 = ok_tr ? tr : 0;
+                acts[i].arg1_u32 = tr;
             } else if (strcmp(cmd, "color.move_to_color_xy") == 0) {
                 const cJSON *x_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "x");
                 const cJSON *y_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "y");
@@ -515,11 +698,15 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                     rc = ESP_ERR_INVALID_ARG;
                     goto done_alloc;
                 }
-                bool ok_tr = false;
-                uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+                uint32_t tr = 0;
+                if (!parse_transition_ms(tr_j, &tr)) {
+                    set_err(err, err_size, "bad action.transition_ms");
+                    rc = ESP_ERR_INVALID_ARG;
+                    goto done_alloc;
+                }
                 acts[i].arg0_u32 = x;
                 acts[i].arg1_u32 = y;
-                acts[i].arg2_u32 = ok_tr ? tr : 0;
+                acts[i].arg2_u32 = tr;
             } else if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
                 const cJSON *m_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "mireds");
                 const cJSON *tr_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "transition_ms");
@@ -531,10 +718,14 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                     rc = ESP_ERR_INVALID_ARG;
                     goto done_alloc;
                 }
-                bool ok_tr = false;
-                uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+                uint32_t tr = 0;
+                if (!parse_transition_ms(tr_j, &tr)) {
+                    set_err(err, err_size, "bad action.transition_ms");
+                    rc = ESP_ERR_INVALID_ARG;
+                    goto done_alloc;
+                }
                 acts[i].arg0_u32 = mireds;
-                acts[i].arg1_u32 = ok_tr ? tr : 0;
+                acts[i].arg1_u32 = tr;
             }
             continue;
         }
@@ -569,10 +760,14 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                 rc = ESP_ERR_INVALID_ARG;
                 goto done_alloc;
             }
-            bool ok_tr = false;
-            uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+            uint32_t tr = 0;
+            if (!parse_transition_ms(tr_j, &tr)) {
+                set_err(err, err_size, "bad action.transition_ms");
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
             acts[i].arg0_u32 = lvl;
-            acts[i].arg1_u32 = ok_tr ? tr : 0;
+            acts[i].arg1_u32 = tr;
         } else if (strcmp(cmd, "color.move_to_color_xy") == 0) {
             const cJSON *x_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "x");
             const cJSON *y_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "y");
@@ -592,11 +787,15 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                 rc = ESP_ERR_INVALID_ARG;
                 goto done_alloc;
             }
-            bool ok_tr = false;
-            uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+            uint32_t tr = 0;
+            if (!parse_transition_ms(tr_j, &tr)) {
+                set_err(err, err_size, "bad action.transition_ms");
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
             acts[i].arg0_u32 = x;
             acts[i].arg1_u32 = y;
-            acts[i].arg2_u32 = ok_tr ? tr : 0;
+            acts[i].arg2_u32 = tr;
         } else if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
             const cJSON *m_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "mireds");
             const cJSON *tr_j = cJSON_GetObjectItemCaseSensitive((cJSON *)a, "transition_ms");
@@ -608,10 +807,23 @@ static esp_err_t compile_one(const char *json, gw_auto_compiled_t *out, char *er
                 rc = ESP_ERR_INVALID_ARG;
                 goto done_alloc;
             }
-            bool ok_tr = false;
-            uint32_t tr = parse_u32_any(tr_j, &ok_tr);
+            uint32_t tr = 0;
+            if (!parse_transition_ms(tr_j, &tr)) {
+                set_err(err, err_size, "bad action.transition_ms");
+                rc = ESP_ERR_INVALID_ARG;
+                goto done_alloc;
+            }
             acts[i].arg0_u32 = mireds;
-            acts[i].arg1_u32 = ok_tr ? tr : 0;
+            acts[i].arg1_u32 = tr;
+        }
+    }
+
+    // Opcodes; also catches commands the action kind does not support.
+    for (uint32_t i = 0; i < action_count; i++) {
+        if (!gw_auto_action_resolve(&acts[i], st.buf + acts[i].cmd_off)) {
+            set_err(err, err_size, "unsupported action.cmd");
+            rc = ESP_ERR_INVALID_ARG;
+            goto done_alloc;
         }
     }
 
@@ -656,6 +868,25 @@ esp_err_t gw_auto_compile_json(const char *json, gw_auto_compiled_t *out, char *
     return compile_one(json, out, err, err_size);
 }
 
+static const char *entry_str(const gw_automation_entry_t *entry, uint32_t off)
+{
+    return (off && off < entry->string_table_size) ? entry->string_table + off : NULL;
+}
+
+void gw_auto_entry_resolve(gw_automation_entry_t *entry)
+{
+    if (!entry) return;
+    for (uint8_t i = 0; i < entry->triggers_count && i < GW_AUTO_MAX_TRIGGERS; i++) {
+        gw_auto_bin_trigger_v2_t *t = &entry->triggers[i];
+        const char *cmd = entry_str(entry, t->cmd_off);
+        t->cmd = cmd ? gw_auto_trigger_cmd(cmd) : 0;
+    }
+    for (uint8_t i = 0; i < entry->actions_count && i < GW_AUTO_MAX_ACTIONS; i++) {
+        // Leaves op = 0 (fails at run time) for anything the current compiler would reject.
+        (void)gw_auto_action_resolve(&entry->actions[i], entry_str(entry, entry->actions[i].cmd_off));
+    }
+}
+
 void gw_auto_compiled_free(gw_auto_compiled_t *c)
 {
     if (!c) return;
@@ -3,82 +3,112 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "gw_core/automation_compiled.h"
+#include "gw_core/storage.h"
 #include "gw_core/types.h" // Includes new definitions
 
 #include "esp_log.h"
-#include "esp_spiffs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "gw_autos";
 
 static bool s_inited;
-static bool s_fs_inited;
-
-#define GW_AUTOMATION_CAP 32
 
 typedef struct {
     uint32_t magic;
     uint16_t version;
     uint16_t count;
+} gw_automation_store_hdr_t;
+
+typedef struct {
+    gw_automation_store_hdr_t hdr;
     gw_automation_entry_t items[GW_AUTOMATION_CAP]; // Use the new compiled entry struct
-} gw_automation_store_blob_t;
+} gw_automation_store_blob_t; // on-disk layout
 
-static gw_automation_store_blob_t s_store;
+// Current snapshot; the store holds one reference. s_lock only guards the pointer swap and refcounts,
+// writers are serialized by s_write_lock so a put/remove never races another one.
+static gw_automation_snapshot_t *s_snap;
+static SemaphoreHandle_t s_write_lock;
+static const gw_automation_entry_t s_zero_entry;
 
 static const uint32_t MAGIC = 0x4155544f; // 'AUTO'
-static const uint16_t VERSION = 2; // Version bump for the new format
-static const char *AUTOS_PATH = "/data/autos.bin";
+static const uint16_t VERSION = 4; // 3: state-change triggers (larger trigger record); 4: mode, debounce/throttle
+static const char *AUTOS_PATH = GW_STORAGE_BASE_PATH "/autos.bin";
 
 static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
 
-static size_t find_idx_locked(const char *id)
+static size_t find_idx(const gw_automation_snapshot_t *snap, const char *id)
 {
-    if (!id || !id[0]) return (size_t)-1;
-    for (size_t i = 0; i < s_store.count; i++) {
-        if (strncmp(s_store.items[i].id, id, sizeof(s_store.items[i].id)) == 0) {
+    if (!snap || !id || !id[0]) return (size_t)-1;
+    for (size_t i = 0; i < snap->count; i++) {
+        if (strncmp(snap->items[i].id, id, sizeof(snap->items[i].id)) == 0) {
             return i;
         }
     }
     return (size_t)-1;
 }
 
-static esp_err_t fs_init_once(void)
+static gw_automation_snapshot_t *snapshot_alloc(size_t count)
 {
-    if (s_fs_inited) {
-        return ESP_OK;
-    }
+    gw_automation_snapshot_t *snap = (gw_automation_snapshot_t *)calloc(1, sizeof(*snap) + count * sizeof(gw_automation_entry_t));
+    if (!snap) return NULL;
+    snap->refs = 1;
+    snap->count = count;
+    return snap;
+}
 
-    const esp_vfs_spiffs_conf_t conf = {
-        .base_path = "/data",
-        .partition_label = "gw_data",
-        .max_files = 4,
-        .format_if_mount_failed = false,
-    };
+// Copy of the current snapshot with room for `extra` more items. Caller holds s_write_lock.
+static gw_automation_snapshot_t *snapshot_clone(size_t extra)
+{
+    const gw_automation_snapshot_t *cur = s_snap;
+    gw_automation_snapshot_t *next = snapshot_alloc(cur->count + extra);
+    if (!next) return NULL;
+    memcpy(next->items, cur->items, cur->count * sizeof(gw_automation_entry_t));
+    next->count = cur->count;
+    next->version = cur->version + 1;
+    return next;
+}
 
-    esp_err_t err = esp_vfs_spiffs_register(&conf);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "spiffs mount failed (gw_data): %s (0x%x)", esp_err_to_name(err), (unsigned)err);
-        return err;
-    }
+// Publishes `next` and drops the store's reference to the previous snapshot. Caller holds s_write_lock.
+static void snapshot_swap(gw_automation_snapshot_t *next)
+{
+    portENTER_CRITICAL(&s_lock);
+    gw_automation_snapshot_t *old = s_snap;
+    s_snap = next;
+    portEXIT_CRITICAL(&s_lock);
+    gw_automation_store_snapshot_release(old);
+}
 
-    size_t total = 0, used = 0;
-    if (esp_spiffs_info("gw_data", &total, &used) == ESP_OK) {
-        ESP_LOGI(TAG, "gw_data SPIFFS mounted: total=%u KB, used=%u KB", (unsigned)(total / 1024), (unsigned)(used / 1024));
-    }
+const gw_automation_snapshot_t *gw_automation_store_snapshot_acquire(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    gw_automation_snapshot_t *snap = s_snap;
+    if (snap) snap->refs++;
+    portEXIT_CRITICAL(&s_lock);
+    return snap;
+}
 
-    s_fs_inited = true;
-    return ESP_OK;
+void gw_automation_store_snapshot_release(const gw_automation_snapshot_t *snap)
+{
+    if (!snap) return;
+    gw_automation_snapshot_t *s = (gw_automation_snapshot_t *)snap;
+    portENTER_CRITICAL(&s_lock);
+    uint32_t refs = --s->refs;
+    portEXIT_CRITICAL(&s_lock);
+    if (refs == 0) free(s);
 }
 
-static esp_err_t save_to_fs(void)
+// Writes `snap` in the fixed-size blob layout (unused slots zero-filled). Caller holds s_write_lock.
+static esp_err_t save_to_fs(const gw_automation_snapshot_t *snap)
 {
-    if (!s_fs_inited) {
+    if (!gw_storage_is_mounted()) {
         ESP_LOGE(TAG, "save_to_fs: FS not initialized");
         return ESP_ERR_INVALID_STATE;
     }
@@ -89,60 +119,182 @@ static esp_err_t save_to_fs(void)
         return ESP_FAIL;
     }
 
-    size_t written = fwrite(&s_store, 1, sizeof(s_store), f);
+    const gw_automation_store_hdr_t hdr = {.magic = MAGIC, .version = VERSION, .count = (uint16_t)snap->count};
+
+    size_t written = fwrite(&hdr, 1, offsetof(gw_automation_store_blob_t, items), f);
+    written += fwrite(snap->items, 1, snap->count * sizeof(gw_automation_entry_t), f);
+    for (size_t i = snap->count; i < GW_AUTOMATION_CAP; i++) {
+        written += fwrite(&s_zero_entry, 1, sizeof(s_zero_entry), f);
+    }
     fclose(f);
 
-    if (written != sizeof(s_store)) {
-        ESP_LOGE(TAG, "save_to_fs: wrote %zu bytes, expected %zu", written, sizeof(s_store));
+    if (written != sizeof(gw_automation_store_blob_t)) {
+        ESP_LOGE(TAG, "save_to_fs: wrote %zu bytes, expected %zu", written, sizeof(gw_automation_store_blob_t));
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "save_to_fs: successfully wrote %zu bytes to %s", sizeof(s_store), AUTOS_PATH);
+    ESP_LOGI(TAG, "save_to_fs: successfully wrote %zu bytes to %s", written, AUTOS_PATH);
     return ESP_OK;
 }
 
+// Version 2 layout: same as gw_automation_entry_t with the shorter trigger record. Loaded and
+// converted so automations survive the upgrade.
+typedef struct {
+    uint8_t event_type;
+    uint8_t endpoint;
+    uint8_t cmd;
+    uint8_t reserved;
+    uint32_t device_uid_off;
+    uint32_t cmd_off;
+    uint16_t cluster_id;
+    uint16_t attr_id;
+} trigger_v2_t;
+
+typedef struct {
+    char id[GW_AUTOMATION_ID_MAX];
+    char name[GW_AUTOMATION_NAME_MAX];
+    bool enabled;
+    uint8_t reserved;
+    uint8_t triggers_count;
+    uint8_t conditions_count;
+    uint8_t actions_count;
+    uint8_t reserved2;
+    trigger_v2_t triggers[GW_AUTO_MAX_TRIGGERS];
+    gw_auto_bin_condition_v2_t conditions[GW_AUTO_MAX_CONDITIONS];
+    gw_auto_bin_action_v2_t actions[GW_AUTO_MAX_ACTIONS];
+    uint16_t string_table_size;
+    char string_table[GW_AUTO_MAX_STRING_TABLE_BYTES];
+} entry_v2_t;
+
+static void entry_from_v2(const entry_v2_t *in, gw_automation_entry_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    memcpy(out->id, in->id, sizeof(out->id));
+    memcpy(out->name, in->name, sizeof(out->name));
+    out->enabled = in->enabled;
+    out->triggers_count = in->triggers_count;
+    out->conditions_count = in->conditions_count;
+    out->actions_count = in->actions_count;
+    for (size_t i = 0; i < GW_AUTO_MAX_TRIGGERS; i++) {
+        const trigger_v2_t *t = &in->triggers[i];
+        out->triggers[i] = (gw_auto_bin_trigger_v2_t){
+            .event_type = t->event_type,
+            .endpoint = t->endpoint,
+            .device_uid_off = t->device_uid_off,
+            .cmd_off = t->cmd_off,
+            .cluster_id = t->cluster_id,
+            .attr_id = t->attr_id,
+        };
+    }
+    memcpy(out->conditions, in->conditions, sizeof(out->conditions));
+    memcpy(out->actions, in->actions, sizeof(out->actions));
+    out->string_table_size = in->string_table_size;
+    memcpy(out->string_table, in->string_table, sizeof(out->string_table));
+}
+
+// Reads the items of a version 2 file (header already consumed).
+static gw_automation_snapshot_t *load_v2(FILE *f, uint16_t count)
+{
+    gw_automation_snapshot_t *snap = snapshot_alloc(count);
+    entry_v2_t *old = (entry_v2_t *)malloc(sizeof(*old));
+    if (!snap || !old) {
+        free(old);
+        free(snap);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fread(old, 1, sizeof(*old), f) != sizeof(*old)) {
+            free(old);
+            free(snap);
+            return NULL;
+        }
+        entry_from_v2(old, &snap->items[i]);
+    }
+    free(old);
+    return snap;
+}
+
+// Version 3 entries are a prefix of the current ones (debounce_ms/throttle_ms were appended, mode
+// took a padding byte that was always 0); the tail stays zeroed.
+#define ENTRY_V3_SIZE                                                                                                  \
+    ((offsetof(gw_automation_entry_t, string_table) + GW_AUTO_MAX_STRING_TABLE_BYTES + _Alignof(gw_automation_entry_t) - 1) & \
+     ~(_Alignof(gw_automation_entry_t) - 1))
+
+static gw_automation_snapshot_t *load_v3(FILE *f, uint16_t count)
+{
+    gw_automation_snapshot_t *snap = snapshot_alloc(count);
+    if (!snap) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (fread(&snap->items[i], 1, ENTRY_V3_SIZE, f) != ENTRY_V3_SIZE) {
+            free(snap);
+            return NULL;
+        }
+    }
+    return snap;
+}
+
 esp_err_t gw_automation_store_init(void)
 {
     if (s_inited) {
         return ESP_OK;
     }
 
-    portENTER_CRITICAL(&s_lock);
-    memset(&s_store, 0, sizeof(s_store));
-    s_store.magic = MAGIC;
-    s_store.version = VERSION;
-    portEXIT_CRITICAL(&s_lock);
+    if (!s_write_lock) {
+        s_write_lock = xSemaphoreCreateMutex();
+        if (!s_write_lock) return ESP_ERR_NO_MEM;
+    }
+
+    gw_automation_snapshot_t *snap = snapshot_alloc(0);
+    if (!snap) return ESP_ERR_NO_MEM;
 
-    (void)fs_init_once();
+    (void)gw_storage_mount();
 
-    if (s_fs_inited) {
+    if (gw_storage_is_mounted()) {
         FILE *f = fopen(AUTOS_PATH, "rb");
         if (f) {
-            gw_automation_store_blob_t *tmp = (gw_automation_store_blob_t *)malloc(sizeof(*tmp));
-            if (tmp) {
-                size_t read = fread(tmp, 1, sizeof(*tmp), f);
-                ESP_LOGI(TAG, "automation file size: %u bytes (expected %u)", (unsigned)read, (unsigned)sizeof(*tmp));
-                
-                if (read == sizeof(*tmp) && tmp->magic == MAGIC && tmp->version == VERSION && tmp->count <= GW_AUTOMATION_CAP) {
-                    portENTER_CRITICAL(&s_lock);
-                    s_store = *tmp;
-                    portEXIT_CRITICAL(&s_lock);
-                    ESP_LOGI(TAG, "successfully loaded %u automations from disk", (unsigned)s_store.count);
-                } else if (tmp->magic != MAGIC) {
-                    ESP_LOGW(TAG, "autos magic mismatch - corrupt or old format");
-                } else if (tmp->version != VERSION) {
-                    ESP_LOGW(TAG, "autos version mismatch (got %u, expected %u) - incompatible format", (unsigned)tmp->version, (unsigned)VERSION);
-                } else {
-                    ESP_LOGW(TAG, "autos file read incomplete or corrupt");
+            gw_automation_store_hdr_t hdr = {0};
+            gw_automation_snapshot_t *loaded = NULL;
+            const size_t hdr_len = offsetof(gw_automation_store_blob_t, items);
+            if (fread(&hdr, 1, hdr_len, f) != hdr_len || hdr.magic != MAGIC) {
+                ESP_LOGW(TAG, "autos magic mismatch - corrupt or old format");
+            } else if (hdr.count > GW_AUTOMATION_CAP) {
+                ESP_LOGW(TAG, "autos file corrupt (count %u)", (unsigned)hdr.count);
+            } else if (hdr.version == VERSION) {
+                loaded = snapshot_alloc(hdr.count);
+                if (loaded && fread(loaded->items, 1, hdr.count * sizeof(gw_automation_entry_t), f) != hdr.count * sizeof(gw_automation_entry_t)) {
+                    free(loaded);
+                    loaded = NULL;
+                }
+            } else if (hdr.version == 2 || hdr.version == 3) {
+                loaded = hdr.version == 2 ? load_v2(f, hdr.count) : load_v3(f, hdr.count);
+                if (loaded) {
+                    ESP_LOGI(TAG, "converted %u automations from format v%u", (unsigned)hdr.count, (unsigned)hdr.version);
                 }
-                free(tmp);
+            } else {
+                ESP_LOGW(TAG, "autos version mismatch (got %u, expected %u) - incompatible format", (unsigned)hdr.version, (unsigned)VERSION);
             }
             fclose(f);
+
+            if (loaded) {
+                for (size_t i = 0; i < loaded->count; i++) {
+                    gw_auto_entry_resolve(&loaded->items[i]);
+                }
+                free(snap);
+                snap = loaded;
+                ESP_LOGI(TAG, "successfully loaded %u automations from disk", (unsigned)snap->count);
+            } else if (hdr.magic == MAGIC && hdr.count <= GW_AUTOMATION_CAP && (hdr.version >= 2 && hdr.version <= VERSION)) {
+                ESP_LOGW(TAG, "autos file read incomplete or corrupt");
+            }
         } else {
             ESP_LOGI(TAG, "no existing automations file at %s - starting fresh", AUTOS_PATH);
         }
     }
 
+    snap->version = 1;
+    portENTER_CRITICAL(&s_lock);
+    s_snap = snap;
+    portEXIT_CRITICAL(&s_lock);
+
     s_inited = true;
     ESP_LOGI(TAG, "automation store initialized");
     return ESP_OK;
@@ -151,50 +303,55 @@ esp_err_t gw_automation_store_init(void)
 size_t gw_automation_store_list(gw_automation_entry_t *out, size_t max_out)
 {
     if (!s_inited || !out || max_out == 0) return 0;
-    portENTER_CRITICAL(&s_lock);
-    size_t n = s_store.count < max_out ? s_store.count : max_out;
-    memcpy(out, s_store.items, n * sizeof(gw_automation_entry_t));
-    portEXIT_CRITICAL(&s_lock);
+    const gw_automation_snapshot_t *snap = gw_automation_store_snapshot_acquire();
+    size_t n = snap->count < max_out ? snap->count : max_out;
+    memcpy(out, snap->items, n * sizeof(gw_automation_entry_t));
+    gw_automation_store_snapshot_release(snap);
     return n;
 }
 
 size_t gw_automation_store_list_meta(gw_automation_meta_t *out, size_t max_out)
 {
     if (!s_inited || !out || max_out == 0) return 0;
-    portENTER_CRITICAL(&s_lock);
-    size_t n = s_store.count < max_out ? s_store.count : max_out;
+    const gw_automation_snapshot_t *snap = gw_automation_store_snapshot_acquire();
+    size_t n = snap->count < max_out ? snap->count : max_out;
     for (size_t i = 0; i < n; i++) {
-        const gw_automation_entry_t *a = &s_store.items[i];
+        const gw_automation_entry_t *a = &snap->items[i];
         gw_automation_meta_t *m = &out[i];
         strlcpy(m->id, a->id, sizeof(m->id));
         strlcpy(m->name, a->name, sizeof(m->name));
         m->enabled = a->enabled;
     }
-    portEXIT_CRITICAL(&s_lock);
+    gw_automation_store_snapshot_release(snap);
     return n;
 }
 
 esp_err_t gw_automation_store_get(const char *id, gw_automation_entry_t *out)
 {
     if (!s_inited || !id || !id[0] || !out) return ESP_ERR_INVALID_ARG;
-    portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(id);
-    if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_lock);
-        return ESP_ERR_NOT_FOUND;
+    const gw_automation_snapshot_t *snap = gw_automation_store_snapshot_acquire();
+    size_t idx = find_idx(snap, id);
+    if (idx != (size_t)-1) {
+        *out = snap->items[idx];
     }
-    *out = s_store.items[idx];
+    gw_automation_store_snapshot_release(snap);
+    return idx == (size_t)-1 ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+uint32_t gw_automation_store_version(void)
+{
+    if (!s_inited) return 0;
+    portENTER_CRITICAL(&s_lock);
+    uint32_t v = s_snap->version;
     portEXIT_CRITICAL(&s_lock);
-    return ESP_OK;
+    return v;
 }
 
 esp_err_t gw_automation_store_put(const char *id, const char *name, bool enabled, const char *json_str)
 {
     if (!s_inited || !id || !id[0] || !name || !json_str) return ESP_ERR_INVALID_ARG;
 
-    if (!s_fs_inited) {
-        fs_init_once();
-    }
+    (void)gw_storage_mount();
 
     gw_auto_compiled_t compiled_temp = {0};
     char err_buf[128] = {0};
@@ -219,24 +376,33 @@ esp_err_t gw_automation_store_put(const char *id, const char *name, bool enabled
         return ESP_ERR_NO_MEM;
     }
 
-    portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(id);
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    size_t idx = find_idx(s_snap, id);
+    if (idx == (size_t)-1 && s_snap->count >= GW_AUTOMATION_CAP) {
+        xSemaphoreGive(s_write_lock);
+        gw_auto_compiled_free(&compiled_temp);
+        ESP_LOGW(TAG, "Cannot save automation %s: capacity exceeded", id);
+        return ESP_ERR_NO_MEM;
+    }
+    gw_automation_snapshot_t *next = snapshot_clone(idx == (size_t)-1 ? 1 : 0);
+    if (!next) {
+        xSemaphoreGive(s_write_lock);
+        gw_auto_compiled_free(&compiled_temp);
+        return ESP_ERR_NO_MEM;
+    }
     if (idx == (size_t)-1) {
-        if (s_store.count >= GW_AUTOMATION_CAP) {
-            portEXIT_CRITICAL(&s_lock);
-            gw_auto_compiled_free(&compiled_temp);
-            ESP_LOGW(TAG, "Cannot save automation %s: capacity exceeded", id);
-            return ESP_ERR_NO_MEM;
-        }
-        idx = s_store.count++;
+        idx = next->count++;
     }
-    
-    gw_automation_entry_t *entry = &s_store.items[idx];
+
+    gw_automation_entry_t *entry = &next->items[idx];
     memset(entry, 0, sizeof(*entry));
 
     strlcpy(entry->id, id, sizeof(entry->id));
     strlcpy(entry->name, name, sizeof(entry->name));
     entry->enabled = enabled;
+    entry->mode = compiled_temp.autos[0].mode;
+    entry->debounce_ms = compiled_temp.autos[0].debounce_ms;
+    entry->throttle_ms = compiled_temp.autos[0].throttle_ms;
 
     entry->triggers_count = compiled_temp.hdr.trigger_count_total;
     if (entry->triggers_count > 0) {
@@ -257,12 +423,11 @@ esp_err_t gw_automation_store_put(const char *id, const char *name, bool enabled
     if (entry->string_table_size > 0) {
         memcpy(entry->string_table, compiled_temp.strings, entry->string_table_size);
     }
-    
-    portEXIT_CRITICAL(&s_lock);
-    
     gw_auto_compiled_free(&compiled_temp);
 
-    err = save_to_fs();
+    snapshot_swap(next);
+    err = save_to_fs(next);
+    xSemaphoreGive(s_write_lock);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to persist automation %s to disk: %s", id, esp_err_to_name(err));
         // Consider rolling back the in-memory change here
@@ -277,20 +442,25 @@ esp_err_t gw_automation_store_remove(const char *id)
 {
     if (!s_inited || !id || !id[0]) return ESP_ERR_INVALID_ARG;
 
-    portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(id);
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    size_t idx = find_idx(s_snap, id);
     if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_lock);
+        xSemaphoreGive(s_write_lock);
         return ESP_ERR_NOT_FOUND;
     }
-    for (size_t i = idx + 1; i < s_store.count; i++) {
-        s_store.items[i - 1] = s_store.items[i];
+    gw_automation_snapshot_t *next = snapshot_clone(0);
+    if (!next) {
+        xSemaphoreGive(s_write_lock);
+        return ESP_ERR_NO_MEM;
     }
-    s_store.count--;
-    memset(&s_store.items[s_store.count], 0, sizeof(s_store.items[s_store.count]));
-    portEXIT_CRITICAL(&s_lock);
+    for (size_t i = idx + 1; i < next->count; i++) {
+        next->items[i - 1] = next->items[i];
+    }
+    next->count--;
 
-    esp_err_t err = save_to_fs();
+    snapshot_swap(next);
+    esp_err_t err = save_to_fs(next);
+    xSemaphoreGive(s_write_lock);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "remove: failed to save after removing %s: %s", id, esp_err_to_name(err));
         return err;
@@ -304,14 +474,21 @@ esp_err_t gw_automation_store_set_enabled(const char *id, bool enabled)
 {
     if (!s_inited || !id || !id[0]) return ESP_ERR_INVALID_ARG;
 
-    portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(id);
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    size_t idx = find_idx(s_snap, id);
     if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_lock);
+        xSemaphoreGive(s_write_lock);
         return ESP_ERR_NOT_FOUND;
     }
-    s_store.items[idx].enabled = enabled;
-    portEXIT_CRITICAL(&s_lock);
+    gw_automation_snapshot_t *next = snapshot_clone(0);
+    if (!next) {
+        xSemaphoreGive(s_write_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    next->items[idx].enabled = enabled;
 
-    return save_to_fs();
+    snapshot_swap(next);
+    esp_err_t err = save_to_fs(next);
+    xSemaphoreGive(s_write_lock);
+    return err;
 }
@@ -5,16 +5,44 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "gw_core/sensor_store.h"
+#include "gw_core/state_store.h"
+#include "gw_core/zb_model.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 
+static const char *TAG = "gw_devices";
+
 // Fixed-size registry with NVS persistence.
 static bool s_inited;
-static gw_device_t s_devices[32];
+static gw_device_t s_devices[GW_DEVICE_REGISTRY_CAP];
 static size_t s_device_count;
 static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
 
+// UID -> handle interning (handle = index + 1). A slot with an empty uid is free; s_handle_count is
+// the high-water mark. Registered devices keep their handle; the others are reclaimed when the table
+// is full, after the stores have dropped what they keep under it.
+#define GW_DEV_HANDLE_HASH_CAP (GW_DEV_HANDLE_MAX * 2) // power of two
+
+_Static_assert((GW_DEV_HANDLE_HASH_CAP & (GW_DEV_HANDLE_HASH_CAP - 1)) == 0, "GW_DEV_HANDLE_HASH_CAP must be a power of two");
+_Static_assert(GW_DEV_HANDLE_MAX > GW_DEVICE_REGISTRY_CAP, "every registered device needs a handle");
+_Static_assert(GW_DEV_HANDLE_MAX < 256, "handles must fit in the uint8_t hash table");
+
+static gw_device_uid_t s_handle_uids[GW_DEV_HANDLE_MAX];
+static bool s_handle_registered[GW_DEV_HANDLE_MAX];
+static bool s_handle_dropping[GW_DEV_HANDLE_MAX]; // unbound, stores still being purged
+static size_t s_handle_count;
+static size_t s_handle_victim; // next index the reclaim scan starts at
+static uint32_t s_handle_gen;
+static uint32_t s_handle_release_gen;
+static bool s_handle_full_logged;
+static uint8_t s_handle_hash[GW_DEV_HANDLE_HASH_CAP]; // handle, 0 = empty
+static portMUX_TYPE s_handle_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void handle_set_registered(const gw_device_uid_t *uid, bool registered);
+
 static const char *NVS_NS = "gw";
 static const char *NVS_KEY = "devices";
 static const uint32_t MAGIC = 0x44564543; // 'DVEC'
@@ -24,7 +52,7 @@ typedef struct {
     uint32_t magic;
     uint16_t version;
     uint16_t count;
-    gw_device_t devices[32];
+    gw_device_t devices[GW_DEVICE_REGISTRY_CAP];
 } gw_device_registry_blob_t;
 
 static bool is_prefix_number_name(const char *name, const char *prefix, uint32_t *out_n)
@@ -164,7 +192,7 @@ esp_err_t gw_device_registry_init(void)
             } else {
                 err = ESP_ERR_NO_MEM;
             }
-            if (err == ESP_OK && blob->magic == MAGIC && blob->version == VERSION && blob->count <= 32) {
+            if (err == ESP_OK && blob->magic == MAGIC && blob->version == VERSION && blob->count <= GW_DEVICE_REGISTRY_CAP) {
                 portENTER_CRITICAL(&s_lock);
                 s_device_count = blob->count;
                 memcpy(s_devices, blob->devices, sizeof(s_devices));
@@ -174,6 +202,11 @@ esp_err_t gw_device_registry_init(void)
         }
         nvs_close(h);
     }
+
+    // Only this task touches s_devices until init returns.
+    for (size_t i = 0; i < s_device_count; i++) {
+        handle_set_registered(&s_devices[i].device_uid, true);
+    }
     return ESP_OK;
 }
 
@@ -221,6 +254,7 @@ esp_err_t gw_device_registry_upsert(const gw_device_t *device)
     s_devices[s_device_count++] = tmp;
     portEXIT_CRITICAL(&s_lock);
 
+    handle_set_registered(&tmp.device_uid, true);
     err = save_to_nvs();
     return err;
 }
@@ -282,6 +316,8 @@ esp_err_t gw_device_registry_remove(const gw_device_uid_t *uid)
     memset(&s_devices[s_device_count], 0, sizeof(s_devices[s_device_count]));
     portEXIT_CRITICAL(&s_lock);
 
+    // The handle stays bound (a re-join finds its data) until the table needs it for another UID.
+    handle_set_registered(uid, false);
     return save_to_nvs();
 }
 
@@ -297,3 +333,206 @@ size_t gw_device_registry_list(gw_device_t *out_devices, size_t max_devices)
     portEXIT_CRITICAL(&s_lock);
     return count;
 }
+
+static uint32_t uid_hash(const gw_device_uid_t *uid)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(uid->uid) && uid->uid[i]; i++) {
+        h ^= (uint8_t)uid->uid[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the handle or GW_DEV_HANDLE_INVALID; *out_pos gets the match or the free bucket.
+static gw_dev_handle_t find_handle_locked(const gw_device_uid_t *uid, size_t *out_pos)
+{
+    size_t pos = uid_hash(uid) & (GW_DEV_HANDLE_HASH_CAP - 1);
+    while (s_handle_hash[pos] != 0) {
+        const gw_dev_handle_t h = s_handle_hash[pos];
+        if (strncmp(s_handle_uids[h - 1].uid, uid->uid, sizeof(uid->uid)) == 0) {
+            if (out_pos) *out_pos = pos;
+            return h;
+        }
+        pos = (pos + 1) & (GW_DEV_HANDLE_HASH_CAP - 1);
+    }
+    if (out_pos) *out_pos = pos;
+    return GW_DEV_HANDLE_INVALID;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void hash_unbind_locked(gw_dev_handle_t h)
+{
+    const size_t mask = GW_DEV_HANDLE_HASH_CAP - 1;
+    size_t i = uid_hash(&s_handle_uids[h - 1]) & mask;
+    while (s_handle_hash[i] != h) {
+        i = (i + 1) & mask;
+    }
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (s_handle_hash[j] == 0) {
+            break;
+        }
+        const size_t home = uid_hash(&s_handle_uids[s_handle_hash[j] - 1]) & mask;
+        // Move j back into the hole unless its home lies cyclically in (i, j].
+        const bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            s_handle_hash[i] = s_handle_hash[j];
+            i = j;
+        }
+    }
+    s_handle_hash[i] = 0;
+}
+
+// A free handle: never used, or reclaimed and purged.
+static gw_dev_handle_t handle_alloc_locked(void)
+{
+    if (s_handle_count < GW_DEV_HANDLE_MAX) {
+        return (gw_dev_handle_t)(++s_handle_count);
+    }
+    for (size_t i = 0; i < GW_DEV_HANDLE_MAX; i++) {
+        if (s_handle_uids[i].uid[0] == '\0' && !s_handle_dropping[i]) {
+            return (gw_dev_handle_t)(i + 1);
+        }
+    }
+    return GW_DEV_HANDLE_INVALID;
+}
+
+// Unbinds the next handle of a UID that is not in the registry; the caller purges the stores.
+static gw_dev_handle_t handle_reclaim_locked(void)
+{
+    for (size_t n = 0; n < GW_DEV_HANDLE_MAX; n++) {
+        const size_t i = s_handle_victim;
+        s_handle_victim = (s_handle_victim + 1) % GW_DEV_HANDLE_MAX;
+        if (s_handle_uids[i].uid[0] != '\0' && !s_handle_registered[i]) {
+            const gw_dev_handle_t h = (gw_dev_handle_t)(i + 1);
+            hash_unbind_locked(h);
+            memset(&s_handle_uids[i], 0, sizeof(s_handle_uids[i]));
+            s_handle_dropping[i] = true;
+            s_handle_gen++;
+            s_handle_release_gen++;
+            return h;
+        }
+    }
+    return GW_DEV_HANDLE_INVALID;
+}
+
+// Returns uid's handle, binding one (reclaimed if need be) on first use; `registering` marks it as
+// held by a registered device.
+static gw_dev_handle_t handle_bind(const gw_device_uid_t *uid, bool registering)
+{
+    for (;;) {
+        bool log_full = false;
+        portENTER_CRITICAL(&s_handle_lock);
+        size_t pos = 0;
+        gw_dev_handle_t h = find_handle_locked(uid, &pos);
+        if (h == GW_DEV_HANDLE_INVALID) {
+            h = handle_alloc_locked();
+            if (h != GW_DEV_HANDLE_INVALID) {
+                strlcpy(s_handle_uids[h - 1].uid, uid->uid, sizeof(s_handle_uids[h - 1].uid));
+                s_handle_registered[h - 1] = false;
+                s_handle_hash[pos] = (uint8_t)h;
+                s_handle_gen++;
+            }
+        }
+        if (h != GW_DEV_HANDLE_INVALID) {
+            if (registering) {
+                s_handle_registered[h - 1] = true;
+            }
+            portEXIT_CRITICAL(&s_handle_lock);
+            return h;
+        }
+
+        const gw_dev_handle_t victim = handle_reclaim_locked();
+        if (victim == GW_DEV_HANDLE_INVALID) {
+            log_full = !s_handle_full_logged;
+            s_handle_full_logged = true;
+        }
+        portEXIT_CRITICAL(&s_handle_lock);
+        if (victim == GW_DEV_HANDLE_INVALID) {
+            if (log_full) {
+                ESP_LOGW(TAG, "Device handle table full (%u); no handle for %s", (unsigned)GW_DEV_HANDLE_MAX, uid->uid);
+            }
+            return GW_DEV_HANDLE_INVALID;
+        }
+
+        gw_state_store_drop_dev(victim);
+        gw_sensor_store_drop_dev(victim);
+        gw_zb_model_drop_dev(victim);
+        portENTER_CRITICAL(&s_handle_lock);
+        s_handle_dropping[victim - 1] = false;
+        portEXIT_CRITICAL(&s_handle_lock);
+        // Retry: the purged handle is free now, unless a concurrent caller took it first.
+    }
+}
+
+static void handle_set_registered(const gw_device_uid_t *uid, bool registered)
+{
+    if (uid->uid[0] == '\0') {
+        return;
+    }
+    if (registered) {
+        (void)handle_bind(uid, true);
+        return;
+    }
+    portENTER_CRITICAL(&s_handle_lock);
+    const gw_dev_handle_t h = find_handle_locked(uid, NULL);
+    if (h != GW_DEV_HANDLE_INVALID) {
+        s_handle_registered[h - 1] = false;
+        s_handle_full_logged = false;
+    }
+    portEXIT_CRITICAL(&s_handle_lock);
+}
+
+gw_dev_handle_t gw_device_registry_handle(const gw_device_uid_t *uid)
+{
+    if (uid == NULL || uid->uid[0] == '\0') {
+        return GW_DEV_HANDLE_INVALID;
+    }
+    return handle_bind(uid, false);
+}
+
+gw_dev_handle_t gw_device_registry_find_handle(const gw_device_uid_t *uid)
+{
+    if (uid == NULL || uid->uid[0] == '\0') {
+        return GW_DEV_HANDLE_INVALID;
+    }
+
+    portENTER_CRITICAL(&s_handle_lock);
+    gw_dev_handle_t h = find_handle_locked(uid, NULL);
+    portEXIT_CRITICAL(&s_handle_lock);
+    return h;
+}
+
+esp_err_t gw_device_registry_handle_uid(gw_dev_handle_t handle, gw_device_uid_t *out_uid)
+{
+    if (out_uid == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_handle_lock);
+    if (handle == GW_DEV_HANDLE_INVALID || handle > s_handle_count || s_handle_uids[handle - 1].uid[0] == '\0') {
+        portEXIT_CRITICAL(&s_handle_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    *out_uid = s_handle_uids[handle - 1];
+    portEXIT_CRITICAL(&s_handle_lock);
+    return ESP_OK;
+}
+
+uint32_t gw_device_registry_handle_gen(void)
+{
+    portENTER_CRITICAL(&s_handle_lock);
+    const uint32_t n = s_handle_gen;
+    portEXIT_CRITICAL(&s_handle_lock);
+    return n;
+}
+
+uint32_t gw_device_registry_handle_release_gen(void)
+{
+    portENTER_CRITICAL(&s_handle_lock);
+    const uint32_t n = s_handle_release_gen;
+    portEXIT_CRITICAL(&s_handle_lock);
+    return n;
+}
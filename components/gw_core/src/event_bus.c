@@ -1,5 +1,6 @@
 #include "gw_core/event_bus.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -7,6 +8,8 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 
 ESP_EVENT_DEFINE_BASE(GW_EVENT_BASE);
 
@@ -14,20 +17,91 @@ static const char *TAG = "gw_event";
 
 static bool s_inited;
 
-// In-memory ring buffer for UI/debugging. Keep small and fixed-size.
-#define GW_EVENT_RING_CAP 64
+// In-memory event history shared by all readers. Events are stored as variable-length records in a
+// byte ring (strings without padding, type/source interned), plus a small id -> record index.
+// Record `id` is described by index slot id % GW_EVENT_INDEX_CAP, whose sequence word holds the id
+// (SEQ_BUSY set while it is being written). A record's bytes are valid as long as the reserved byte
+// head has not moved more than GW_EVENT_RING_BYTES past it; readers copy, then re-check both.
+#define GW_EVENT_RING_BYTES 16384
+#define GW_EVENT_INDEX_CAP 512
+#define GW_EVENT_NAME_CAP 96
+#define GW_EVENT_NAME_MAX 32
+#define GW_EVENT_NAME_SLOTS 128 // name hash table, kept under 3/4 full
+#define SEQ_BUSY 0x80000000u
+
+_Static_assert((GW_EVENT_RING_BYTES & (GW_EVENT_RING_BYTES - 1)) == 0, "GW_EVENT_RING_BYTES must be a power of two");
+_Static_assert((GW_EVENT_INDEX_CAP & (GW_EVENT_INDEX_CAP - 1)) == 0, "GW_EVENT_INDEX_CAP must be a power of two");
+_Static_assert((GW_EVENT_NAME_SLOTS & (GW_EVENT_NAME_SLOTS - 1)) == 0 && GW_EVENT_NAME_SLOTS > GW_EVENT_NAME_CAP,
+               "GW_EVENT_NAME_SLOTS must be a power of two above GW_EVENT_NAME_CAP");
+
+// Record header; type/source (when not interned), uid, msg and payload follow back to back, unterminated.
+typedef struct {
+    uint64_t ts_ms;
+    gw_event_data_t data;
+    uint32_t uid_hash; // 0 = no device
+    uint32_t pub_us;   // low 32 bits of esp_timer_get_time() at publish (consumer latency)
+    uint16_t short_addr;
+    uint8_t v;
+    uint8_t type_id;   // interned name id, 0 = stored inline
+    uint8_t source_id; // interned name id, 0 = stored inline
+    uint8_t type_len;  // inline lengths (0 when interned)
+    uint8_t source_len;
+    uint8_t uid_len;
+    uint8_t msg_len;
+    uint8_t payload_len;
+} gw_event_rec_t;
 
-static gw_event_t s_ring[GW_EVENT_RING_CAP];
-static size_t s_ring_head;   // next write
-static size_t s_ring_count;  // <= GW_EVENT_RING_CAP
-static uint32_t s_next_id = 1;
-static portMUX_TYPE s_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+typedef struct {
+    atomic_uint seq;
+    uint32_t pos; // byte position of the record (monotonic, wraps modulo 2^32)
+    uint16_t len;
+} gw_event_index_t;
+
+static uint8_t s_buf[GW_EVENT_RING_BYTES];
+static gw_event_index_t s_index[GW_EVENT_INDEX_CAP];
+static atomic_uint s_head;        // next free byte position
+static atomic_uint s_next_id = 1; // next id to hand out
+static atomic_uint s_last_id;     // newest fully written id
+static SemaphoreHandle_t s_write_lock; // publishers and name inserts; readers never take it
+
+// Interned type/source names. Append-only; a name is written before its id is published. Looked up
+// through an open-addressing hash of name -> id (0 = empty slot), so publish does one compare.
+static char s_names[GW_EVENT_NAME_CAP][GW_EVENT_NAME_MAX];
+static atomic_uchar s_name_slots[GW_EVENT_NAME_SLOTS];
+static uint32_t s_name_count = 1; // id 0 is reserved for "inline"; written under s_write_lock
+
+// Compiled gw_event_filter_t, tested against a record header before anything is decoded.
+typedef struct {
+    bool any_type;
+    uint32_t type_mask[(GW_EVENT_NAME_CAP + 31) / 32]; // bit per interned type name id
+    uint8_t source_id;                                 // 0 = any
+    uint32_t uid_hash;                                 // 0 = any
+    char device_uid[GW_DEVICE_UID_STRLEN];
+} gw_event_match_t;
+
+// Ring consumers (rules, WS). next_id is advanced by the owning task, and by publishers stepping a
+// caught-up filtered consumer over an event it does not want (see gw_event_bus_publish_data).
+#define GW_EVENT_CONSUMER_CAP 6
+struct gw_event_consumer {
+    bool used;
+    char name[16];
+    atomic_uint next_id;
+    atomic_uint stepped; // events publishers stepped next_id over; reported as filtered
+    TaskHandle_t volatile waiter; // bound on first read; notified on publish
+    gw_event_match_t match;
+    int64_t returned_us; // when the last read returned an event; 0 = not handling one
+    atomic_bool wake;    // set by gw_event_bus_consumer_wake(), consumed by the next blocking read
+    gw_event_consumer_stats_t stats; // written by the owning task only
+};
+static gw_event_consumer_t s_consumers[GW_EVENT_CONSUMER_CAP];
+static portMUX_TYPE s_consumer_lock = portMUX_INITIALIZER_UNLOCKED;
 
 // Optional listeners called on publish.
 #define GW_EVENT_LISTENER_CAP 4
 typedef struct {
     gw_event_bus_listener_t cb;
     void *user_ctx;
+    gw_event_match_t match;
 } gw_event_listener_slot_t;
 static gw_event_listener_slot_t s_listeners[GW_EVENT_LISTENER_CAP];
 static portMUX_TYPE s_listener_lock = portMUX_INITIALIZER_UNLOCKED;
@@ -44,12 +118,46 @@ static void safe_copy_str(char *dst, size_t dst_size, const char *src)
     strlcpy(dst, src, dst_size);
 }
 
-void gw_event_bus_publish_ex(const char *type,
-                            const char *source,
-                            const char *device_uid,
-                            uint16_t short_addr,
-                            const char *msg,
-                            const char *payload_json);
+static const char *const s_cmd_names[] = {
+    [GW_EVENT_CMD_NONE] = "",
+    [GW_EVENT_CMD_OFF] = "off",
+    [GW_EVENT_CMD_ON] = "on",
+    [GW_EVENT_CMD_TOGGLE] = "toggle",
+    [GW_EVENT_CMD_MOVE_TO_LEVEL] = "move_to_level",
+    [GW_EVENT_CMD_MOVE_TO_COLOR_XY] = "move_to_color_xy",
+    [GW_EVENT_CMD_MOVE_TO_COLOR_TEMP] = "move_to_color_temperature",
+};
+
+const char *gw_event_cmd_name(gw_event_cmd_t cmd)
+{
+    if ((size_t)cmd >= sizeof(s_cmd_names) / sizeof(s_cmd_names[0])) {
+        return "";
+    }
+    return s_cmd_names[cmd];
+}
+
+gw_event_cmd_t gw_event_cmd_from_name(const char *name)
+{
+    if (!name || !name[0]) {
+        return GW_EVENT_CMD_NONE;
+    }
+    for (size_t i = 1; i < sizeof(s_cmd_names) / sizeof(s_cmd_names[0]); i++) {
+        if (strcmp(s_cmd_names[i], name) == 0) {
+            return (gw_event_cmd_t)i;
+        }
+    }
+    return GW_EVENT_CMD_NONE;
+}
+
+static uint8_t evt_type_from_name(const char *type)
+{
+    if (!type) return 0;
+    if (strcmp(type, "zigbee.command") == 0) return GW_AUTO_EVT_ZIGBEE_COMMAND;
+    if (strcmp(type, "zigbee.attr_report") == 0) return GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+    if (strcmp(type, "device.join") == 0) return GW_AUTO_EVT_DEVICE_JOIN;
+    if (strcmp(type, "device.leave") == 0) return GW_AUTO_EVT_DEVICE_LEAVE;
+    return 0;
+}
 
 esp_err_t gw_event_bus_init(void)
 {
@@ -57,12 +165,20 @@ esp_err_t gw_event_bus_init(void)
         return ESP_OK;
     }
     // Uses the default event loop created by esp_event_loop_create_default()
-    portENTER_CRITICAL(&s_ring_lock);
-    memset(s_ring, 0, sizeof(s_ring));
-    s_ring_head = 0;
-    s_ring_count = 0;
-    s_next_id = 1;
-    portEXIT_CRITICAL(&s_ring_lock);
+    if (!s_write_lock) {
+        s_write_lock = xSemaphoreCreateMutex();
+        if (!s_write_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    memset(s_index, 0, sizeof(s_index));
+    atomic_store(&s_head, 0);
+    atomic_store(&s_next_id, 1);
+    atomic_store(&s_last_id, 0);
+
+    portENTER_CRITICAL(&s_consumer_lock);
+    memset(s_consumers, 0, sizeof(s_consumers));
+    portEXIT_CRITICAL(&s_consumer_lock);
 
     portENTER_CRITICAL(&s_listener_lock);
     memset(s_listeners, 0, sizeof(s_listeners));
@@ -82,14 +198,261 @@ esp_err_t gw_event_bus_post(gw_event_id_t id, const void *data, size_t data_size
 
 uint32_t gw_event_bus_last_id(void)
 {
-    uint32_t last = 0;
-    portENTER_CRITICAL(&s_ring_lock);
-    if (s_ring_count > 0) {
-        size_t newest = (s_ring_head + GW_EVENT_RING_CAP - 1) % GW_EVENT_RING_CAP;
-        last = s_ring[newest].id;
+    return atomic_load_explicit(&s_last_id, memory_order_acquire);
+}
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; name[i]; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Returns the id for `name`, or 0 with *slot set to the empty slot where it would go.
+static uint8_t name_find(const char *name, uint32_t h, uint32_t *slot)
+{
+    for (uint32_t i = h;; i++) {
+        const uint8_t id = atomic_load_explicit(&s_name_slots[i & (GW_EVENT_NAME_SLOTS - 1)], memory_order_acquire);
+        if (id == 0 || strncmp(s_names[id], name, GW_EVENT_NAME_MAX) == 0) {
+            *slot = i & (GW_EVENT_NAME_SLOTS - 1);
+            return id;
+        }
+    }
+}
+
+// Returns the id for `name`, adding it if there is room; 0 means "store inline".
+static uint8_t name_intern(const char *name)
+{
+    if (name[0] == '\0' || strlen(name) >= GW_EVENT_NAME_MAX) {
+        return 0;
+    }
+    const uint32_t h = name_hash(name);
+    uint32_t slot = 0;
+    uint8_t id = name_find(name, h, &slot);
+    if (id) {
+        return id;
     }
-    portEXIT_CRITICAL(&s_ring_lock);
-    return last;
+
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    id = name_find(name, h, &slot);
+    if (!id && s_name_count < GW_EVENT_NAME_CAP) {
+        id = (uint8_t)s_name_count++;
+        strlcpy(s_names[id], name, GW_EVENT_NAME_MAX);
+        atomic_store_explicit(&s_name_slots[slot], id, memory_order_release);
+    }
+    xSemaphoreGive(s_write_lock);
+    return id;
+}
+
+static void ring_put(uint32_t pos, const void *src, size_t n)
+{
+    const size_t off = pos & (GW_EVENT_RING_BYTES - 1);
+    const size_t first = (n < GW_EVENT_RING_BYTES - off) ? n : GW_EVENT_RING_BYTES - off;
+    memcpy(&s_buf[off], src, first);
+    memcpy(s_buf, (const uint8_t *)src + first, n - first);
+}
+
+static void ring_get(uint32_t pos, void *dst, size_t n)
+{
+    const size_t off = pos & (GW_EVENT_RING_BYTES - 1);
+    const size_t first = (n < GW_EVENT_RING_BYTES - off) ? n : GW_EVENT_RING_BYTES - off;
+    memcpy(dst, &s_buf[off], first);
+    memcpy((uint8_t *)dst + first, s_buf, n - first);
+}
+
+// Reads a string field into a terminated buffer; lengths are clamped since a torn read is only
+// detected afterwards.
+static uint32_t ring_get_str(uint32_t pos, uint8_t len, char *dst, size_t dst_size)
+{
+    const size_t n = (len < dst_size) ? len : dst_size - 1;
+    ring_get(pos, dst, n);
+    dst[n] = '\0';
+    return pos + len;
+}
+
+esp_err_t gw_event_bus_set_next_id(uint32_t next_id)
+{
+    if (!s_inited) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (next_id == 0 || next_id >= SEQ_BUSY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_consumer_lock);
+    for (size_t i = 0; i < GW_EVENT_CONSUMER_CAP; i++) {
+        if (s_consumers[i].used) {
+            err = ESP_ERR_INVALID_STATE;
+        }
+    }
+    portEXIT_CRITICAL(&s_consumer_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    if (atomic_load_explicit(&s_next_id, memory_order_relaxed) != 1) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        atomic_store_explicit(&s_next_id, next_id, memory_order_release);
+        atomic_store_explicit(&s_last_id, next_id - 1, memory_order_release);
+    }
+    xSemaphoreGive(s_write_lock);
+    return err;
+}
+
+static void latency_record(uint32_t *hist, uint32_t *max_us, int64_t us)
+{
+    if (us < 0) {
+        us = 0;
+    }
+    const uint32_t v = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    if (v > *max_us) {
+        *max_us = v;
+    }
+    size_t b = 0;
+    while (b < GW_EVENT_LATENCY_BUCKETS - 1 && v >= ((uint32_t)GW_EVENT_LATENCY_BUCKET0_US << b)) {
+        b++;
+    }
+    hist[b]++;
+}
+
+static uint32_t uid_hash(const char *uid)
+{
+    if (!uid || !uid[0]) {
+        return 0;
+    }
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; uid[i] && i < GW_DEVICE_UID_STRLEN; i++) {
+        h = (h ^ (uint8_t)uid[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static bool match_header(const gw_event_match_t *m, uint8_t type_id, uint8_t source_id, uint32_t uid_h)
+{
+    if (!m->any_type && (type_id == 0 || !(m->type_mask[type_id / 32] & (1u << (type_id % 32))))) {
+        return false;
+    }
+    if (m->source_id && m->source_id != source_id) {
+        return false;
+    }
+    return m->uid_hash == 0 || m->uid_hash == uid_h;
+}
+
+static esp_err_t match_build(const gw_event_filter_t *f, gw_event_match_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->any_type = true;
+    if (!f) {
+        return ESP_OK;
+    }
+    if (f->types && f->type_count > 0) {
+        m->any_type = false;
+        for (size_t i = 0; i < f->type_count; i++) {
+            const uint8_t id = f->types[i] ? name_intern(f->types[i]) : 0;
+            if (id == 0) {
+                return ESP_ERR_NO_MEM;
+            }
+            m->type_mask[id / 32] |= 1u << (id % 32);
+        }
+    }
+    if (f->source && f->source[0]) {
+        m->source_id = name_intern(f->source);
+        if (m->source_id == 0) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (f->device_uid && f->device_uid[0]) {
+        safe_copy_str(m->device_uid, sizeof(m->device_uid), f->device_uid);
+        m->uid_hash = uid_hash(m->device_uid);
+    }
+    return ESP_OK;
+}
+
+enum {
+    RING_LOST = -1,  // already overwritten
+    RING_EMPTY = 0,  // not published yet
+    RING_OK = 1,     // copied into *out
+    RING_SKIP = 2,   // published, but filtered out by `match` (not decoded)
+};
+
+// Copies event `id` out of the ring if it passes `match` (NULL = everything).
+// *out_pub_us (optional) gets the publish timestamp of a copied event.
+static int ring_read(uint32_t id, const gw_event_match_t *match, gw_event_t *out, uint32_t *out_pub_us)
+{
+    gw_event_index_t *ix = &s_index[id & (GW_EVENT_INDEX_CAP - 1)];
+    const uint32_t seq = atomic_load_explicit(&ix->seq, memory_order_acquire);
+    const uint32_t held = seq & ~SEQ_BUSY;
+    if (held < id || seq == (id | SEQ_BUSY)) {
+        return RING_EMPTY;
+    }
+    if (held != id) {
+        return RING_LOST;
+    }
+    const uint32_t pos = ix->pos;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&ix->seq, memory_order_relaxed) != seq) {
+        return RING_LOST;
+    }
+
+    gw_event_rec_t h;
+    ring_get(pos, &h, sizeof(h));
+    int result = RING_OK;
+    if (match && !match_header(match, h.type_id, h.source_id, h.uid_hash)) {
+        result = RING_SKIP;
+    } else {
+        uint32_t p = pos + sizeof(h);
+        out->v = h.v;
+        out->id = id;
+        out->ts_ms = h.ts_ms;
+        out->short_addr = h.short_addr;
+        out->data = h.data;
+        if (h.type_id) {
+            strlcpy(out->type, s_names[h.type_id % GW_EVENT_NAME_CAP], sizeof(out->type));
+        } else {
+            p = ring_get_str(p, h.type_len, out->type, sizeof(out->type));
+        }
+        if (h.source_id) {
+            strlcpy(out->source, s_names[h.source_id % GW_EVENT_NAME_CAP], sizeof(out->source));
+        } else {
+            p = ring_get_str(p, h.source_len, out->source, sizeof(out->source));
+        }
+        p = ring_get_str(p, h.uid_len, out->device_uid, sizeof(out->device_uid));
+        p = ring_get_str(p, h.msg_len, out->msg, sizeof(out->msg));
+        (void)ring_get_str(p, h.payload_len, out->payload_json, sizeof(out->payload_json));
+        if (out_pub_us) {
+            *out_pub_us = h.pub_us;
+        }
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    const uint32_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    if (head - pos > GW_EVENT_RING_BYTES) {
+        return RING_LOST;
+    }
+    if (result == RING_OK && match && match->uid_hash &&
+        strncmp(out->device_uid, match->device_uid, sizeof(out->device_uid)) != 0) {
+        return RING_SKIP; // hash collision
+    }
+    return result;
+}
+
+// Lower bound for the oldest id still indexed; older records may also have been overwritten byte-wise.
+static uint32_t ring_oldest_id(void)
+{
+    const uint32_t next = atomic_load_explicit(&s_next_id, memory_order_acquire);
+    return (next > GW_EVENT_INDEX_CAP) ? next - GW_EVENT_INDEX_CAP : 1;
+}
+
+#define EVT_FIELD_CAP(f) sizeof(((gw_event_t *)0)->f)
+
+static uint8_t str_len(const char *s, size_t max)
+{
+    return s ? (uint8_t)strnlen(s, max) : 0;
 }
 
 void gw_event_bus_publish(const char *type, const char *source, const char *device_uid, uint16_t short_addr, const char *msg)
@@ -110,53 +473,119 @@ void gw_event_bus_publish_ex(const char *type,
                             uint16_t short_addr,
                             const char *msg,
                             const char *payload_json)
+{
+    gw_event_bus_publish_data(type, source, device_uid, short_addr, msg, payload_json, NULL);
+}
+
+void gw_event_bus_publish_data(const char *type,
+                               const char *source,
+                               const char *device_uid,
+                               uint16_t short_addr,
+                               const char *msg,
+                               const char *payload_json,
+                               const gw_event_data_t *data)
 {
     if (!s_inited) {
         return;
     }
 
-    gw_event_t e = {0};
-    e.v = 1;
-    e.ts_ms = (uint64_t)(esp_timer_get_time() / 1000);
-    safe_copy_str(e.type, sizeof(e.type), type);
-    safe_copy_str(e.source, sizeof(e.source), source);
-    safe_copy_str(e.device_uid, sizeof(e.device_uid), device_uid);
-    e.short_addr = short_addr;
-    safe_copy_str(e.msg, sizeof(e.msg), msg);
-    safe_copy_str(e.payload_json, sizeof(e.payload_json), payload_json);
+    gw_event_rec_t h = {0};
+    const int64_t now_us = esp_timer_get_time();
+    h.v = 1;
+    h.ts_ms = (uint64_t)(now_us / 1000);
+    h.pub_us = (uint32_t)now_us;
+    h.short_addr = short_addr;
+    h.uid_hash = uid_hash(device_uid);
+    if (data) {
+        h.data = *data;
+    }
+    if (h.data.evt_type == 0) {
+        h.data.evt_type = evt_type_from_name(type);
+    }
+    if (type == NULL) type = "";
+    if (source == NULL) source = "";
+    h.type_id = name_intern(type);
+    h.source_id = name_intern(source);
+    h.type_len = h.type_id ? 0 : str_len(type, EVT_FIELD_CAP(type) - 1);
+    h.source_len = h.source_id ? 0 : str_len(source, EVT_FIELD_CAP(source) - 1);
+    h.uid_len = str_len(device_uid, EVT_FIELD_CAP(device_uid) - 1);
+    h.msg_len = str_len(msg, EVT_FIELD_CAP(msg) - 1);
+    h.payload_len = str_len(payload_json, EVT_FIELD_CAP(payload_json) - 1);
+    const uint32_t len = sizeof(h) + h.type_len + h.source_len + h.uid_len + h.msg_len + h.payload_len;
+
+    // Publishers serialize on a mutex held for one record copy (typically ~100 bytes): with
+    // variable-length records a stalled writer could otherwise scribble over bytes the ring has
+    // already lapped. A mutex rather than a critical section, so interrupts stay enabled and a
+    // preempted publisher lends its priority to the ones waiting. Readers never take it.
+    xSemaphoreTake(s_write_lock, portMAX_DELAY);
+    const uint32_t id = atomic_load_explicit(&s_next_id, memory_order_relaxed);
+    const uint32_t pos = atomic_load_explicit(&s_head, memory_order_relaxed);
+    gw_event_index_t *ix = &s_index[id & (GW_EVENT_INDEX_CAP - 1)];
+    atomic_store_explicit(&ix->seq, id | SEQ_BUSY, memory_order_relaxed);
+    atomic_store_explicit(&s_head, pos + len, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    uint32_t p = pos;
+    ring_put(p, &h, sizeof(h));
+    p += sizeof(h);
+    ring_put(p, type, h.type_len);
+    p += h.type_len;
+    ring_put(p, source, h.source_len);
+    p += h.source_len;
+    ring_put(p, device_uid, h.uid_len);
+    p += h.uid_len;
+    ring_put(p, msg, h.msg_len);
+    p += h.msg_len;
+    ring_put(p, payload_json, h.payload_len);
+    ix->pos = pos;
+    ix->len = (uint16_t)len;
+    atomic_store_explicit(&ix->seq, id, memory_order_release);
+    atomic_store_explicit(&s_next_id, id + 1, memory_order_release);
+    atomic_store_explicit(&s_last_id, id, memory_order_release);
+    // A filtered consumer is not woken for events it does not want, so without this an idle one
+    // would find all that traffic overwritten on its next read and report it as lost. Done under
+    // the write lock so consecutive unwanted events keep stepping it in id order.
+    for (size_t i = 0; i < GW_EVENT_CONSUMER_CAP; i++) {
+        gw_event_consumer_t *c = &s_consumers[i];
+        if (!c->waiter || match_header(&c->match, h.type_id, h.source_id, h.uid_hash)) {
+            continue;
+        }
+        uint32_t expected = id;
+        if (atomic_compare_exchange_strong_explicit(&c->next_id, &expected, id + 1, memory_order_relaxed,
+                                                    memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&c->stepped, 1, memory_order_relaxed);
+        }
+    }
+    xSemaphoreGive(s_write_lock);
 
-    portENTER_CRITICAL(&s_ring_lock);
-    e.id = s_next_id++;
-    s_ring[s_ring_head] = e;
-    s_ring_head = (s_ring_head + 1) % GW_EVENT_RING_CAP;
-    if (s_ring_count < GW_EVENT_RING_CAP) {
-        s_ring_count++;
+    // Only wake consumers whose filter wants this event.
+    for (size_t i = 0; i < GW_EVENT_CONSUMER_CAP; i++) {
+        TaskHandle_t waiter = s_consumers[i].waiter;
+        if (waiter && match_header(&s_consumers[i].match, h.type_id, h.source_id, h.uid_hash)) {
+            xTaskNotifyGive(waiter);
+        }
     }
-    portEXIT_CRITICAL(&s_ring_lock);
 
-    // Notify listeners outside of the ring critical section.
+    // Synchronous listeners (legacy path).
     gw_event_listener_slot_t listeners[GW_EVENT_LISTENER_CAP];
     size_t listener_count = 0;
     portENTER_CRITICAL(&s_listener_lock);
     for (size_t i = 0; i < GW_EVENT_LISTENER_CAP; i++) {
-        if (s_listeners[i].cb) {
+        if (s_listeners[i].cb && match_header(&s_listeners[i].match, h.type_id, h.source_id, h.uid_hash)) {
             listeners[listener_count++] = s_listeners[i];
         }
     }
     portEXIT_CRITICAL(&s_listener_lock);
-    for (size_t i = 0; i < listener_count; i++) {
-        listeners[i].cb(&e, listeners[i].user_ctx);
+    if (listener_count > 0) {
+        gw_event_t e;
+        if (ring_read(id, NULL, &e, NULL) == RING_OK) {
+            for (size_t i = 0; i < listener_count; i++) {
+                if (listeners[i].match.uid_hash == 0 ||
+                    strncmp(e.device_uid, listeners[i].match.device_uid, sizeof(e.device_uid)) == 0) {
+                    listeners[i].cb(&e, listeners[i].user_ctx);
+                }
+            }
+        }
     }
-
-    // Duplicate event log to UART/monitor for convenience.
-    ESP_LOGI(TAG,
-             "#%u %s/%s uid=%s short=0x%04x %s",
-             (unsigned)e.id,
-             e.source,
-             e.type,
-             e.device_uid[0] ? e.device_uid : "-",
-             (unsigned)e.short_addr,
-             e.msg[0] ? e.msg : "-");
 }
 
 size_t gw_event_bus_list_since(uint32_t since_id, gw_event_t *out, size_t max_out, uint32_t *out_last_id)
@@ -168,32 +597,208 @@ size_t gw_event_bus_list_since(uint32_t since_id, gw_event_t *out, size_t max_ou
         return 0;
     }
 
+    const uint32_t last = atomic_load_explicit(&s_last_id, memory_order_acquire);
+    uint32_t id = ring_oldest_id();
+    if (id <= since_id) {
+        id = since_id + 1;
+    }
+
     size_t written = 0;
-    portENTER_CRITICAL(&s_ring_lock);
+    for (; id <= last && written < max_out; id++) {
+        int r = ring_read(id, NULL, &out[written], NULL);
+        if (r == RING_OK) {
+            written++;
+        } else if (r == RING_EMPTY) {
+            break; // a publisher is still writing this one; report what precedes it
+        }
+        // r < 0: overwritten while we were reading; skip it.
+    }
+
+    if (out_last_id) {
+        *out_last_id = last;
+    }
+    return written;
+}
+
+void gw_event_write_json_fields(gw_json_writer_t *w, const gw_event_t *e)
+{
+    gw_json_kv_u64(w, "v", e->v);
+    gw_json_kv_u64(w, "id", e->id);
+    gw_json_kv_u64(w, "ts_ms", e->ts_ms);
+    gw_json_kv_str(w, "type", e->type);
+    gw_json_kv_str(w, "source", e->source);
+    gw_json_kv_str(w, "device_uid", e->device_uid);
+    gw_json_kv_u64(w, "short_addr", e->short_addr);
+    gw_json_kv_str(w, "msg", e->msg);
+    // payload_json comes from our own publishers, so it is embedded as-is.
+    if (e->payload_json[0] == '{' || e->payload_json[0] == '[') {
+        gw_json_kv_raw(w, "payload", e->payload_json);
+    }
+}
+
+esp_err_t gw_event_bus_consumer_open(const char *name, gw_event_consumer_t **out)
+{
+    if (!s_inited) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_consumer_lock);
+    for (size_t i = 0; i < GW_EVENT_CONSUMER_CAP; i++) {
+        gw_event_consumer_t *c = &s_consumers[i];
+        if (!c->used) {
+            memset(c, 0, sizeof(*c));
+            c->used = true;
+            safe_copy_str(c->name, sizeof(c->name), name);
+            (void)match_build(NULL, &c->match); // all events until gw_event_bus_consumer_set_filter()
+            atomic_store_explicit(&c->next_id, atomic_load_explicit(&s_next_id, memory_order_acquire),
+                                  memory_order_relaxed);
+            portEXIT_CRITICAL(&s_consumer_lock);
+            *out = c;
+            return ESP_OK;
+        }
+    }
+    portEXIT_CRITICAL(&s_consumer_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void gw_event_bus_consumer_close(gw_event_consumer_t *c)
+{
+    if (!c) {
+        return;
+    }
+    portENTER_CRITICAL(&s_consumer_lock);
+    c->waiter = NULL;
+    c->used = false;
+    portEXIT_CRITICAL(&s_consumer_lock);
+}
+
+esp_err_t gw_event_bus_consumer_set_filter(gw_event_consumer_t *c, const gw_event_filter_t *filter)
+{
+    if (!c || !c->used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Publishers only look at the filter once a waiter is bound, so it must be set before that.
+    if (c->waiter) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return match_build(filter, &c->match);
+}
 
-    uint32_t last = 0;
-    if (s_ring_count > 0) {
-        size_t newest = (s_ring_head + GW_EVENT_RING_CAP - 1) % GW_EVENT_RING_CAP;
-        last = s_ring[newest].id;
+esp_err_t gw_event_bus_consumer_read(gw_event_consumer_t *c, gw_event_t *out, TickType_t ticks_to_wait)
+{
+    if (!c || !c->used || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!c->waiter) {
+        c->waiter = xTaskGetCurrentTaskHandle();
+    }
+    gw_event_consumer_stats_t *st = &c->stats;
+    if (c->returned_us) {
+        // Coming back for the next event means the previous one has been handled.
+        latency_record(st->handle_hist, &st->handle_us_max, esp_timer_get_time() - c->returned_us);
+        c->returned_us = 0;
     }
 
-    size_t start = (s_ring_head + GW_EVENT_RING_CAP - s_ring_count) % GW_EVENT_RING_CAP;
-    for (size_t i = 0; i < s_ring_count && written < max_out; i++) {
-        const gw_event_t *e = &s_ring[(start + i) % GW_EVENT_RING_CAP];
-        if (e->id > since_id) {
-            out[written++] = *e;
+    uint32_t lost = 0;
+    for (;;) {
+        uint32_t pub_us = 0;
+        uint32_t id = atomic_load_explicit(&c->next_id, memory_order_relaxed);
+        int r = ring_read(id, &c->match, out, &pub_us);
+        if (r == RING_SKIP) {
+            // Fails only if a publisher stepped over this id already (and counted it).
+            if (atomic_compare_exchange_strong_explicit(&c->next_id, &id, id + 1, memory_order_relaxed,
+                                                        memory_order_relaxed)) {
+                st->filtered++;
+            }
+            continue;
+        }
+        if (r == RING_LOST) {
+            // Fell behind the ring; resume at the oldest event still held. Publishers only step
+            // a cursor sitting on the id they publish, never on an overwritten one.
+            const uint32_t oldest = ring_oldest_id();
+            const uint32_t skip = (oldest > id) ? oldest - id : 1;
+            lost += skip;
+            atomic_store_explicit(&c->next_id, id + skip, memory_order_relaxed);
+            continue;
+        }
+        if (lost) {
+            st->dropped += lost;
+            ESP_LOGW(TAG, "%s consumer overrun; %u events lost", c->name, (unsigned)lost);
+            lost = 0;
+        }
+        if (r == RING_OK) {
+            const uint32_t backlog = atomic_load_explicit(&s_next_id, memory_order_acquire) - id;
+            if (backlog > st->backlog_hwm) {
+                st->backlog_hwm = backlog;
+            }
+            c->returned_us = esp_timer_get_time();
+            latency_record(st->queue_hist, &st->queue_us_max, (int64_t)(uint32_t)((uint32_t)c->returned_us - pub_us));
+            st->delivered++;
+            atomic_store_explicit(&c->next_id, id + 1, memory_order_relaxed);
+            return ESP_OK;
+        }
+        if (atomic_exchange_explicit(&c->wake, false, memory_order_acq_rel)) {
+            return ESP_ERR_TIMEOUT;
+        }
+        // Notifications accumulate, so a publish between the check above and this wait is not lost.
+        if (ulTaskNotifyTake(pdTRUE, ticks_to_wait) == 0) {
+            return ESP_ERR_TIMEOUT;
         }
     }
+}
 
-    portEXIT_CRITICAL(&s_ring_lock);
+void gw_event_bus_consumer_wake(gw_event_consumer_t *c)
+{
+    if (!c || !c->used) {
+        return;
+    }
+    atomic_store_explicit(&c->wake, true, memory_order_release);
+    TaskHandle_t waiter = c->waiter;
+    if (waiter) {
+        xTaskNotifyGive(waiter);
+    }
+}
 
-    if (out_last_id) {
-        *out_last_id = last;
+uint32_t gw_event_bus_consumer_dropped(const gw_event_consumer_t *c)
+{
+    return c ? c->stats.dropped : 0;
+}
+
+size_t gw_event_bus_consumer_stats(gw_event_consumer_stats_t *out, size_t max_out)
+{
+    if (!out || max_out == 0) {
+        return 0;
+    }
+
+    const uint32_t next = atomic_load_explicit(&s_next_id, memory_order_acquire);
+    size_t written = 0;
+    portENTER_CRITICAL(&s_consumer_lock);
+    for (size_t i = 0; i < GW_EVENT_CONSUMER_CAP && written < max_out; i++) {
+        const gw_event_consumer_t *c = &s_consumers[i];
+        if (!c->used) {
+            continue;
+        }
+        // Counters are plain words updated by the owning task; a snapshot may be one event stale.
+        out[written] = c->stats;
+        out[written].filtered += atomic_load_explicit(&c->stepped, memory_order_relaxed);
+        strlcpy(out[written].name, c->name, sizeof(out[written].name));
+        const uint32_t next_id = atomic_load_explicit(&c->next_id, memory_order_relaxed);
+        out[written].backlog = (next > next_id) ? next - next_id : 0;
+        written++;
     }
+    portEXIT_CRITICAL(&s_consumer_lock);
     return written;
 }
 
 esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx)
+{
+    return gw_event_bus_add_listener_filtered(cb, user_ctx, NULL);
+}
+
+esp_err_t gw_event_bus_add_listener_filtered(gw_event_bus_listener_t cb, void *user_ctx, const gw_event_filter_t *filter)
 {
     if (!s_inited) {
         return ESP_ERR_INVALID_STATE;
@@ -201,10 +806,16 @@ esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx)
     if (!cb) {
         return ESP_ERR_INVALID_ARG;
     }
+    gw_event_match_t match;
+    esp_err_t err = match_build(filter, &match);
+    if (err != ESP_OK) {
+        return err;
+    }
 
     portENTER_CRITICAL(&s_listener_lock);
     for (size_t i = 0; i < GW_EVENT_LISTENER_CAP; i++) {
         if (s_listeners[i].cb == cb && s_listeners[i].user_ctx == user_ctx) {
+            s_listeners[i].match = match;
             portEXIT_CRITICAL(&s_listener_lock);
             return ESP_OK;
         }
@@ -213,6 +824,7 @@ esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx)
         if (s_listeners[i].cb == NULL) {
             s_listeners[i].cb = cb;
             s_listeners[i].user_ctx = user_ctx;
+            s_listeners[i].match = match;
             portEXIT_CRITICAL(&s_listener_lock);
             return ESP_OK;
         }
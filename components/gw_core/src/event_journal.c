@@ -0,0 +1,581 @@
+#include "gw_core/event_journal.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "gw_core/storage.h"
+
+static const char *TAG = "gw_journal";
+
+// Layout: GW_JOURNAL_SEGMENTS files used round-robin; the oldest one is truncated when the current
+// one is full. Records are appended in id order and never rewritten.
+#define GW_JOURNAL_SEGMENTS 4
+#define GW_JOURNAL_SEG_BYTES (16 * 1024)
+#define GW_JOURNAL_MARK_EVERY 1024 // sparse index: one (id, offset) mark per ~1 KB of segment
+#define GW_JOURNAL_MARKS_PER_SEG (GW_JOURNAL_SEG_BYTES / GW_JOURNAL_MARK_EVERY + 1)
+
+// Write policy: events are batched in RAM and flushed when the batch is full or its oldest event
+// is GW_JOURNAL_FLUSH_MS old. A byte token bucket bounds long-term flash writes (~5.5 MB/day,
+// i.e. ~20 erase cycles/day spread over gw_data); a full batch that exceeds the budget is dropped,
+// counted in gw_event_journal_stats() and reported as a gap by gw_event_journal_list_since().
+#define GW_JOURNAL_BATCH_BYTES 2048
+#define GW_JOURNAL_FLUSH_MS 30000
+#define GW_JOURNAL_RATE_BYTES_PER_S 64
+#define GW_JOURNAL_BURST_BYTES (4 * GW_JOURNAL_BATCH_BYTES)
+
+#define GW_JOURNAL_MAGIC 0x4a45 // 'EJ'
+
+// On-flash record header; type, source, uid, msg and payload follow back to back, unterminated.
+typedef struct {
+    uint16_t magic;
+    uint16_t len; // whole record, header included
+    uint32_t id;
+    uint64_t ts_ms;
+    gw_event_data_t data;
+    uint16_t short_addr;
+    uint8_t v;
+    uint8_t type_len;
+    uint8_t source_len;
+    uint8_t uid_len;
+    uint8_t msg_len;
+    uint8_t payload_len;
+} gw_journal_rec_t;
+
+#define EVT_FIELD_CAP(f) sizeof(((gw_event_t *)0)->f)
+#define GW_JOURNAL_REC_MAX                                                                                            \
+    (sizeof(gw_journal_rec_t) + EVT_FIELD_CAP(type) + EVT_FIELD_CAP(source) + EVT_FIELD_CAP(device_uid) +             \
+     EVT_FIELD_CAP(msg) + EVT_FIELD_CAP(payload_json))
+
+typedef struct {
+    uint32_t id;
+    uint32_t offset;
+} gw_journal_mark_t;
+
+typedef struct {
+    uint32_t first_id; // 0 = empty
+    uint32_t last_id;
+    uint32_t size;
+    uint8_t mark_count;
+    gw_journal_mark_t marks[GW_JOURNAL_MARKS_PER_SEG];
+} gw_journal_seg_t;
+
+static bool s_inited;
+static SemaphoreHandle_t s_io_lock; // segments, batch and s_read_buf
+static gw_journal_seg_t s_segs[GW_JOURNAL_SEGMENTS];
+static size_t s_cur;
+static bool s_cur_sealed; // torn tail found at boot: start the next segment instead of appending
+
+static uint8_t s_batch[GW_JOURNAL_BATCH_BYTES];
+static size_t s_batch_len;
+static uint64_t s_batch_since_ms;
+static uint32_t s_tokens;
+static uint64_t s_tokens_ms;
+static gw_event_journal_stats_t s_stats; // updated by the writer task under s_io_lock
+
+static uint8_t s_read_buf[GW_JOURNAL_REC_MAX];
+
+static gw_event_consumer_t *s_consumer;
+static TaskHandle_t s_task;
+
+static uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+static void seg_path(size_t idx, char *buf, size_t buf_size)
+{
+    snprintf(buf, buf_size, GW_STORAGE_BASE_PATH "/evj%u.bin", (unsigned)idx);
+}
+
+static void seg_reset(gw_journal_seg_t *seg)
+{
+    memset(seg, 0, sizeof(*seg));
+}
+
+static void seg_note_record(gw_journal_seg_t *seg, uint32_t id, uint32_t len)
+{
+    if (seg->first_id == 0) {
+        seg->first_id = id;
+    }
+    seg->last_id = id;
+    if (seg->mark_count < GW_JOURNAL_MARKS_PER_SEG && seg->size >= (uint32_t)seg->mark_count * GW_JOURNAL_MARK_EVERY) {
+        seg->marks[seg->mark_count].id = id;
+        seg->marks[seg->mark_count].offset = seg->size;
+        seg->mark_count++;
+    }
+    seg->size += len;
+}
+
+static uint8_t field_len(const char *s, size_t cap)
+{
+    return (uint8_t)strnlen(s, cap - 1);
+}
+
+static size_t encode(const gw_event_t *e, uint8_t *dst, size_t cap)
+{
+    gw_journal_rec_t h = {0};
+    h.magic = GW_JOURNAL_MAGIC;
+    h.id = e->id;
+    h.ts_ms = e->ts_ms;
+    h.data = e->data;
+    h.short_addr = e->short_addr;
+    h.v = e->v;
+    h.type_len = field_len(e->type, sizeof(e->type));
+    h.source_len = field_len(e->source, sizeof(e->source));
+    h.uid_len = field_len(e->device_uid, sizeof(e->device_uid));
+    h.msg_len = field_len(e->msg, sizeof(e->msg));
+    h.payload_len = field_len(e->payload_json, sizeof(e->payload_json));
+    const size_t len = sizeof(h) + h.type_len + h.source_len + h.uid_len + h.msg_len + h.payload_len;
+    if (len > cap) {
+        return 0;
+    }
+    h.len = (uint16_t)len;
+
+    uint8_t *p = dst;
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    memcpy(p, e->type, h.type_len);
+    p += h.type_len;
+    memcpy(p, e->source, h.source_len);
+    p += h.source_len;
+    memcpy(p, e->device_uid, h.uid_len);
+    p += h.uid_len;
+    memcpy(p, e->msg, h.msg_len);
+    p += h.msg_len;
+    memcpy(p, e->payload_json, h.payload_len);
+    return len;
+}
+
+static const uint8_t *decode_str(const uint8_t *p, uint8_t len, char *dst, size_t dst_size)
+{
+    const size_t n = (len < dst_size) ? len : dst_size - 1;
+    memcpy(dst, p, n);
+    dst[n] = '\0';
+    return p + len;
+}
+
+// `rec` must hold a header that passed rec_header_valid() and its full body.
+static void decode(const uint8_t *rec, gw_event_t *out)
+{
+    gw_journal_rec_t h;
+    memcpy(&h, rec, sizeof(h));
+    out->v = h.v;
+    out->id = h.id;
+    out->ts_ms = h.ts_ms;
+    out->data = h.data;
+    out->short_addr = h.short_addr;
+    const uint8_t *p = rec + sizeof(h);
+    p = decode_str(p, h.type_len, out->type, sizeof(out->type));
+    p = decode_str(p, h.source_len, out->source, sizeof(out->source));
+    p = decode_str(p, h.uid_len, out->device_uid, sizeof(out->device_uid));
+    p = decode_str(p, h.msg_len, out->msg, sizeof(out->msg));
+    (void)decode_str(p, h.payload_len, out->payload_json, sizeof(out->payload_json));
+}
+
+static bool rec_header_valid(const gw_journal_rec_t *h)
+{
+    if (h->magic != GW_JOURNAL_MAGIC || h->id == 0 || h->len < sizeof(*h) || h->len > GW_JOURNAL_REC_MAX) {
+        return false;
+    }
+    const size_t body = (size_t)h->type_len + h->source_len + h->uid_len + h->msg_len + h->payload_len;
+    return sizeof(*h) + body == h->len;
+}
+
+// Rebuilds the in-RAM index of one segment. Returns false if the file ends in a torn record.
+static bool scan_segment(size_t idx)
+{
+    gw_journal_seg_t *seg = &s_segs[idx];
+    seg_reset(seg);
+
+    char path[32];
+    seg_path(idx, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return true;
+    }
+
+    long file_size = 0;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        file_size = ftell(f);
+    }
+    rewind(f);
+
+    gw_journal_rec_t h;
+    while (fread(&h, 1, sizeof(h), f) == sizeof(h)) {
+        if (!rec_header_valid(&h) || h.id <= seg->last_id || (long)(seg->size + h.len) > file_size ||
+            fseek(f, (long)(h.len - sizeof(h)), SEEK_CUR) != 0) {
+            break;
+        }
+        seg_note_record(seg, h.id, h.len);
+    }
+    const bool clean = (long)seg->size == file_size;
+    fclose(f);
+    return clean;
+}
+
+static void tokens_refill(void)
+{
+    const uint64_t now = now_ms();
+    const uint64_t add = (now - s_tokens_ms) * GW_JOURNAL_RATE_BYTES_PER_S / 1000;
+    if (add > 0) {
+        s_tokens = (s_tokens + add > GW_JOURNAL_BURST_BYTES) ? GW_JOURNAL_BURST_BYTES : (uint32_t)(s_tokens + add);
+        s_tokens_ms = now;
+    }
+}
+
+static void rotate_locked(void)
+{
+    s_cur = (s_cur + 1) % GW_JOURNAL_SEGMENTS;
+    s_cur_sealed = false;
+    seg_reset(&s_segs[s_cur]);
+
+    char path[32];
+    seg_path(s_cur, path, sizeof(path));
+    FILE *f = fopen(path, "wb"); // truncate the oldest segment
+    if (f) {
+        fclose(f);
+    }
+}
+
+// Appends the batch to the current segment. Caller holds s_io_lock.
+static esp_err_t flush_locked(void)
+{
+    if (s_batch_len == 0) {
+        return ESP_OK;
+    }
+
+    gw_journal_seg_t *seg = &s_segs[s_cur];
+    if (s_cur_sealed || seg->size + s_batch_len > GW_JOURNAL_SEG_BYTES) {
+        rotate_locked();
+        seg = &s_segs[s_cur];
+    }
+
+    char path[32];
+    seg_path(s_cur, path, sizeof(path));
+    FILE *f = fopen(path, "ab");
+    if (!f) {
+        ESP_LOGW(TAG, "fopen(%s) failed", path);
+        return ESP_FAIL;
+    }
+    const size_t written = fwrite(s_batch, 1, s_batch_len, f);
+    fclose(f);
+    if (written != s_batch_len) {
+        // Partial append: index what fits and seal the segment so the tail is never appended to.
+        s_cur_sealed = true;
+    }
+
+    size_t off = 0;
+    while (off < written) {
+        gw_journal_rec_t h;
+        memcpy(&h, &s_batch[off], sizeof(h));
+        if (off + h.len > written) {
+            break;
+        }
+        seg_note_record(seg, h.id, h.len);
+        off += h.len;
+    }
+
+    const bool complete = written == s_batch_len;
+    s_tokens -= (s_batch_len < s_tokens) ? (uint32_t)s_batch_len : s_tokens;
+    s_batch_len = 0;
+    return complete ? ESP_OK : ESP_FAIL;
+}
+
+// Flushes if the batch is due. A full batch beyond the write budget is dropped so the task keeps up.
+static void maybe_flush(bool batch_full)
+{
+    if (s_batch_len == 0) {
+        return;
+    }
+    tokens_refill();
+    const bool due = batch_full || now_ms() - s_batch_since_ms >= GW_JOURNAL_FLUSH_MS;
+    if (!due) {
+        return;
+    }
+
+    xSemaphoreTake(s_io_lock, portMAX_DELAY);
+    if (s_tokens >= s_batch_len) {
+        (void)flush_locked();
+    } else if (batch_full) {
+        gw_event_gap_t gap = {0};
+        uint32_t events = 0;
+        for (size_t off = 0; off < s_batch_len;) {
+            gw_journal_rec_t h;
+            memcpy(&h, &s_batch[off], sizeof(h));
+            if (gap.first_id == 0) {
+                gap.first_id = h.id;
+            }
+            gap.last_id = h.id;
+            events++;
+            off += h.len;
+        }
+        s_stats.batches_dropped++;
+        s_stats.events_dropped += events;
+        s_stats.last_drop = gap;
+        ESP_LOGW(TAG, "write budget exhausted; dropped events %u..%u (%u bytes, batches dropped: %u)",
+                 (unsigned)gap.first_id, (unsigned)gap.last_id, (unsigned)s_batch_len, (unsigned)s_stats.batches_dropped);
+        s_batch_len = 0;
+    }
+    xSemaphoreGive(s_io_lock);
+}
+
+static void journal_task(void *arg)
+{
+    (void)arg;
+    gw_event_t e;
+    uint8_t rec[GW_JOURNAL_REC_MAX];
+    for (;;) {
+        if (gw_event_bus_consumer_read(s_consumer, &e, pdMS_TO_TICKS(1000)) != ESP_OK) {
+            maybe_flush(false);
+            continue;
+        }
+
+        const size_t len = encode(&e, rec, sizeof(rec));
+        if (len == 0) {
+            continue;
+        }
+        if (s_batch_len + len > sizeof(s_batch)) {
+            maybe_flush(true);
+        }
+
+        xSemaphoreTake(s_io_lock, portMAX_DELAY);
+        if (s_batch_len + len <= sizeof(s_batch)) {
+            if (s_batch_len == 0) {
+                s_batch_since_ms = now_ms();
+            }
+            memcpy(&s_batch[s_batch_len], rec, len);
+            s_batch_len += len;
+        }
+        xSemaphoreGive(s_io_lock);
+
+        maybe_flush(false);
+    }
+}
+
+esp_err_t gw_event_journal_init(void)
+{
+    if (s_inited) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = gw_storage_mount();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_io_lock = xSemaphoreCreateMutex();
+    if (!s_io_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t last_id = 0;
+    for (size_t i = 0; i < GW_JOURNAL_SEGMENTS; i++) {
+        const bool clean = scan_segment(i);
+        if (s_segs[i].last_id > last_id || (last_id == 0 && i == 0)) {
+            last_id = s_segs[i].last_id;
+            s_cur = i;
+            s_cur_sealed = !clean;
+        }
+    }
+
+    if (last_id > 0) {
+        err = gw_event_bus_set_next_id(last_id + 1);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "event ids not continued from journal: %s", esp_err_to_name(err));
+        }
+    }
+
+    s_tokens = GW_JOURNAL_BURST_BYTES;
+    s_tokens_ms = now_ms();
+
+    err = gw_event_bus_consumer_open("journal", &s_consumer);
+    if (err != ESP_OK) {
+        vSemaphoreDelete(s_io_lock);
+        s_io_lock = NULL;
+        return err;
+    }
+    if (xTaskCreate(journal_task, "ev_journal", 4096, NULL, 2, &s_task) != pdPASS) {
+        gw_event_bus_consumer_close(s_consumer);
+        s_consumer = NULL;
+        vSemaphoreDelete(s_io_lock);
+        s_io_lock = NULL;
+        return ESP_FAIL;
+    }
+
+    s_inited = true;
+    ESP_LOGI(TAG, "event journal ready (last id %u, segment %u)", (unsigned)last_id, (unsigned)s_cur);
+    return ESP_OK;
+}
+
+// Offset to start scanning a segment for ids > since_id (last mark at or before since_id + 1).
+static uint32_t seg_seek_offset(const gw_journal_seg_t *seg, uint32_t since_id)
+{
+    uint32_t off = 0;
+    for (uint8_t i = 0; i < seg->mark_count && seg->marks[i].id <= since_id + 1; i++) {
+        off = seg->marks[i].offset;
+    }
+    return off;
+}
+
+// Reads events with since_id < id < before_id from one segment. Caller holds s_io_lock.
+static size_t read_segment_locked(size_t idx, uint32_t since_id, uint32_t before_id, gw_event_t *out, size_t max_out)
+{
+    const gw_journal_seg_t *seg = &s_segs[idx];
+    char path[32];
+    seg_path(idx, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+
+    size_t written = 0;
+    uint32_t off = seg_seek_offset(seg, since_id);
+    if (fseek(f, (long)off, SEEK_SET) == 0) {
+        gw_journal_rec_t h;
+        while (written < max_out && off < seg->size && fread(&h, 1, sizeof(h), f) == sizeof(h)) {
+            if (!rec_header_valid(&h) || h.id >= before_id) {
+                break;
+            }
+            if (h.id <= since_id) {
+                if (fseek(f, (long)(h.len - sizeof(h)), SEEK_CUR) != 0) break;
+            } else {
+                memcpy(s_read_buf, &h, sizeof(h));
+                if (fread(s_read_buf + sizeof(h), 1, h.len - sizeof(h), f) != h.len - sizeof(h)) break;
+                decode(s_read_buf, &out[written++]);
+            }
+            off += h.len;
+        }
+    }
+    fclose(f);
+    return written;
+}
+
+// Events still waiting in the batch. Caller holds s_io_lock.
+static size_t read_batch_locked(uint32_t since_id, uint32_t before_id, gw_event_t *out, size_t max_out)
+{
+    size_t written = 0;
+    size_t off = 0;
+    while (written < max_out && off + sizeof(gw_journal_rec_t) <= s_batch_len) {
+        gw_journal_rec_t h;
+        memcpy(&h, &s_batch[off], sizeof(h));
+        if (h.id >= before_id) {
+            break;
+        }
+        if (h.id > since_id) {
+            decode(&s_batch[off], &out[written++]);
+        }
+        off += h.len;
+    }
+    return written;
+}
+
+static size_t journal_read(uint32_t since_id, uint32_t before_id, gw_event_t *out, size_t max_out)
+{
+    size_t written = 0;
+    xSemaphoreTake(s_io_lock, portMAX_DELAY);
+
+    // Segments in id order (oldest first), starting after the current one.
+    for (size_t k = 1; k <= GW_JOURNAL_SEGMENTS && written < max_out; k++) {
+        const size_t idx = (s_cur + k) % GW_JOURNAL_SEGMENTS;
+        const gw_journal_seg_t *seg = &s_segs[idx];
+        if (seg->first_id == 0 || seg->last_id <= since_id || seg->first_id >= before_id) {
+            continue;
+        }
+        written += read_segment_locked(idx, since_id, before_id, out + written, max_out - written);
+        if (written > 0) {
+            since_id = out[written - 1].id;
+        }
+    }
+    if (written < max_out) {
+        written += read_batch_locked(since_id, before_id, out + written, max_out - written);
+    }
+
+    xSemaphoreGive(s_io_lock);
+    return written;
+}
+
+// Ids run without holes through the bus, so any jump in a result is a gap. With since_id 0 there
+// is no cursor, and the result starts wherever history does.
+static void find_gap(uint32_t since_id, const gw_event_t *ev, size_t count, uint32_t last, gw_event_gap_t *out)
+{
+    *out = (gw_event_gap_t){0};
+    uint32_t expect = since_id ? since_id + 1 : (count ? ev[0].id : 0);
+    for (size_t i = 0; i < count; i++, expect++) {
+        if (ev[i].id != expect) {
+            *out = (gw_event_gap_t){.first_id = expect, .last_id = ev[i].id - 1};
+            return;
+        }
+    }
+    if (count == 0 && since_id && last > since_id) {
+        *out = (gw_event_gap_t){.first_id = since_id + 1, .last_id = last};
+    }
+}
+
+static size_t list_since(uint32_t since_id, gw_event_t *out, size_t max_out, uint32_t *out_last)
+{
+    size_t count = gw_event_bus_list_since(since_id, out, max_out, out_last);
+    // since_id 0 means "no cursor": recent history from RAM only, as before.
+    if (!s_inited || out == NULL || max_out == 0 || since_id == 0 || *out_last <= since_id) {
+        return count;
+    }
+
+    // Anything between since_id and the oldest event the RAM ring still had comes from flash.
+    const uint32_t first_ram = (count > 0) ? out[0].id : *out_last + 1;
+    if (first_ram <= since_id + 1) {
+        return count;
+    }
+
+    size_t written = journal_read(since_id, first_ram, out, max_out);
+    if (written < max_out) {
+        const uint32_t after = (written > 0) ? out[written - 1].id : since_id;
+        written += gw_event_bus_list_since(after, out + written, max_out - written, NULL);
+    }
+    return written;
+}
+
+size_t gw_event_journal_list_since(uint32_t since_id, gw_event_t *out, size_t max_out, uint32_t *out_last_id,
+                                   gw_event_gap_t *out_gap)
+{
+    uint32_t last = 0;
+    const size_t count = list_since(since_id, out, max_out, &last);
+    if (out_last_id) {
+        *out_last_id = last;
+    }
+    if (out_gap) {
+        find_gap(since_id, out, count, last, out_gap);
+    }
+    return count;
+}
+
+void gw_event_gap_write_json(gw_json_writer_t *w, const gw_event_gap_t *gap)
+{
+    if (!gap || gap->first_id == 0) {
+        return;
+    }
+    gw_json_key(w, "gap");
+    gw_json_obj_begin(w);
+    gw_json_kv_u64(w, "first_id", gap->first_id);
+    gw_json_kv_u64(w, "last_id", gap->last_id);
+    gw_json_obj_end(w);
+}
+
+void gw_event_journal_stats(gw_event_journal_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    if (!s_inited) {
+        *out = (gw_event_journal_stats_t){0};
+        return;
+    }
+    xSemaphoreTake(s_io_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_io_lock);
+}
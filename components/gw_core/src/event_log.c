@@ -0,0 +1,154 @@
+#include "gw_core/event_log.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "gw_core/event_bus.h"
+
+static const char *TAG = "gw_event";
+
+static bool s_inited;
+static gw_event_consumer_t *s_consumer;
+static TaskHandle_t s_task;
+
+// Runtime settings; copied out by the log task under s_cfg_lock.
+static portMUX_TYPE s_cfg_lock = portMUX_INITIALIZER_UNLOCKED;
+static char s_types[GW_EVENT_LOG_MAX_TYPES][32];
+static size_t s_type_count;
+static uint32_t s_rate = GW_EVENT_LOG_DEFAULT_RATE;
+static uint32_t s_burst = GW_EVENT_LOG_DEFAULT_BURST;
+
+// Token bucket in milli-events; only touched by the log task.
+static uint64_t s_tokens;
+static int64_t s_tokens_us;
+static uint32_t s_suppressed;
+
+static bool type_allowed(const char *type)
+{
+    bool allowed = true;
+    portENTER_CRITICAL(&s_cfg_lock);
+    if (s_type_count > 0) {
+        allowed = false;
+        for (size_t i = 0; i < s_type_count && !allowed; i++) {
+            const char *p = s_types[i];
+            const size_t n = strlen(p);
+            if (n > 0 && p[n - 1] == '*') {
+                allowed = strncmp(type, p, n - 1) == 0;
+            } else {
+                allowed = strcmp(type, p) == 0;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&s_cfg_lock);
+    return allowed;
+}
+
+static bool take_token(void)
+{
+    portENTER_CRITICAL(&s_cfg_lock);
+    const uint32_t rate = s_rate;
+    const uint64_t cap = (uint64_t)s_burst * 1000;
+    portEXIT_CRITICAL(&s_cfg_lock);
+    if (rate == 0) {
+        return false;
+    }
+
+    const int64_t now = esp_timer_get_time();
+    s_tokens += (uint64_t)(now - s_tokens_us) * rate / 1000;
+    s_tokens_us = now;
+    if (s_tokens > cap) {
+        s_tokens = cap;
+    }
+    if (s_tokens < 1000) {
+        return false;
+    }
+    s_tokens -= 1000;
+    return true;
+}
+
+static void event_log_task(void *arg)
+{
+    (void)arg;
+    gw_event_t e;
+    for (;;) {
+        if (gw_event_bus_consumer_read(s_consumer, &e, portMAX_DELAY) != ESP_OK) {
+            continue;
+        }
+        if (!type_allowed(e.type)) {
+            continue;
+        }
+        if (!take_token()) {
+            s_suppressed++;
+            continue;
+        }
+        if (s_suppressed) {
+            ESP_LOGW(TAG, "%u events not logged (rate limit)", (unsigned)s_suppressed);
+            s_suppressed = 0;
+        }
+        ESP_LOGI(TAG,
+                 "#%u %s/%s uid=%s short=0x%04x %s",
+                 (unsigned)e.id,
+                 e.source,
+                 e.type,
+                 e.device_uid[0] ? e.device_uid : "-",
+                 (unsigned)e.short_addr,
+                 e.msg[0] ? e.msg : "-");
+    }
+}
+
+esp_err_t gw_event_log_set_types(const char *const *types, size_t count)
+{
+    if (count > GW_EVENT_LOG_MAX_TYPES || (count > 0 && !types)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!types[i] || types[i][0] == '\0' || strlen(types[i]) >= sizeof(s_types[0])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    portENTER_CRITICAL(&s_cfg_lock);
+    for (size_t i = 0; i < count; i++) {
+        strlcpy(s_types[i], types[i], sizeof(s_types[i]));
+    }
+    s_type_count = count;
+    portEXIT_CRITICAL(&s_cfg_lock);
+    return ESP_OK;
+}
+
+void gw_event_log_set_rate(uint32_t per_sec, uint32_t burst)
+{
+    portENTER_CRITICAL(&s_cfg_lock);
+    s_rate = per_sec;
+    s_burst = burst ? burst : 1;
+    portEXIT_CRITICAL(&s_cfg_lock);
+}
+
+esp_err_t gw_event_log_init(void)
+{
+    if (s_inited) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = gw_event_bus_consumer_open("log", &s_consumer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_tokens = (uint64_t)s_burst * 1000;
+    s_tokens_us = esp_timer_get_time();
+
+    // Lowest priority above idle: console output must never delay real work.
+    if (xTaskCreate(event_log_task, "ev_log", 3072, NULL, 1, &s_task) != pdPASS) {
+        gw_event_bus_consumer_close(s_consumer);
+        s_consumer = NULL;
+        return ESP_FAIL;
+    }
+
+    s_inited = true;
+    return ESP_OK;
+}
@@ -0,0 +1,299 @@
+#include "gw_core/json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static void put(gw_json_writer_t *w, const char *p, size_t n)
+{
+    if (w->err != ESP_OK) {
+        return;
+    }
+    w->total += n;
+    if (!w->buf) {
+        return; // sizing pass
+    }
+    while (n > 0) {
+        size_t room = w->cap - w->pos;
+        if (room == 0) {
+            if (!w->sink) {
+                w->err = ESP_ERR_NO_MEM;
+                return;
+            }
+            w->err = w->sink(w->sink_ctx, w->buf, w->pos);
+            w->pos = 0;
+            if (w->err != ESP_OK) {
+                return;
+            }
+            room = w->cap;
+        }
+        const size_t chunk = (n < room) ? n : room;
+        memcpy(&w->buf[w->pos], p, chunk);
+        w->pos += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+static void put_c(gw_json_writer_t *w, char c)
+{
+    put(w, &c, 1);
+}
+
+// Separator before a value or key at the current level.
+static void before_item(gw_json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    const uint32_t bit = 1u << (w->depth % GW_JSON_MAX_DEPTH);
+    if (w->has_items & bit) {
+        put_c(w, ',');
+    }
+    w->has_items |= bit;
+}
+
+void gw_json_writer_init(gw_json_writer_t *w, char *buf, size_t cap)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->cap = buf ? cap : 0;
+}
+
+void gw_json_writer_init_stream(gw_json_writer_t *w, char *buf, size_t cap, gw_json_sink_t sink, void *ctx)
+{
+    gw_json_writer_init(w, buf, cap);
+    w->sink = sink;
+    w->sink_ctx = ctx;
+    if (!buf || cap == 0 || !sink) {
+        w->err = ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t gw_json_writer_finish(gw_json_writer_t *w)
+{
+    if (w->err != ESP_OK || !w->buf) {
+        return w->err;
+    }
+    if (w->sink) {
+        if (w->pos > 0) {
+            w->err = w->sink(w->sink_ctx, w->buf, w->pos);
+            w->pos = 0;
+        }
+        return w->err;
+    }
+    if (w->pos >= w->cap) {
+        w->err = ESP_ERR_NO_MEM;
+        return w->err;
+    }
+    w->buf[w->pos] = '\0';
+    return ESP_OK;
+}
+
+size_t gw_json_writer_len(const gw_json_writer_t *w)
+{
+    return w->total;
+}
+
+static void open_scope(gw_json_writer_t *w, char c)
+{
+    before_item(w);
+    put_c(w, c);
+    if (w->depth + 1 >= GW_JSON_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void close_scope(gw_json_writer_t *w, char c)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    w->after_key = false;
+    put_c(w, c);
+}
+
+void gw_json_obj_begin(gw_json_writer_t *w)
+{
+    open_scope(w, '{');
+}
+
+void gw_json_obj_end(gw_json_writer_t *w)
+{
+    close_scope(w, '}');
+}
+
+void gw_json_arr_begin(gw_json_writer_t *w)
+{
+    open_scope(w, '[');
+}
+
+void gw_json_arr_end(gw_json_writer_t *w)
+{
+    close_scope(w, ']');
+}
+
+static void put_escaped(gw_json_writer_t *w, const char *s)
+{
+    put_c(w, '"');
+    const char *run = s;
+    for (; *s; s++) {
+        const unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put(w, run, (size_t)(s - run));
+        run = s + 1;
+        switch (c) {
+        case '"':
+            put(w, "\\\"", 2);
+            break;
+        case '\\':
+            put(w, "\\\\", 2);
+            break;
+        case '\n':
+            put(w, "\\n", 2);
+            break;
+        case '\r':
+            put(w, "\\r", 2);
+            break;
+        case '\t':
+            put(w, "\\t", 2);
+            break;
+        default: {
+            static const char hex[] = "0123456789abcdef";
+            const char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            put(w, esc, sizeof(esc));
+            break;
+        }
+        }
+    }
+    put(w, run, (size_t)(s - run));
+    put_c(w, '"');
+}
+
+void gw_json_key(gw_json_writer_t *w, const char *key)
+{
+    before_item(w);
+    put_escaped(w, key ? key : "");
+    put_c(w, ':');
+    w->after_key = true;
+}
+
+void gw_json_str(gw_json_writer_t *w, const char *s)
+{
+    before_item(w);
+    put_escaped(w, s ? s : "");
+}
+
+static void put_u64(gw_json_writer_t *w, uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[sizeof(tmp) - 1 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    put(w, &tmp[sizeof(tmp) - n], n);
+}
+
+void gw_json_u64(gw_json_writer_t *w, uint64_t v)
+{
+    before_item(w);
+    put_u64(w, v);
+}
+
+void gw_json_i64(gw_json_writer_t *w, int64_t v)
+{
+    before_item(w);
+    if (v < 0) {
+        put_c(w, '-');
+        put_u64(w, (uint64_t)0 - (uint64_t)v);
+    } else {
+        put_u64(w, (uint64_t)v);
+    }
+}
+
+void gw_json_f64(gw_json_writer_t *w, double v, int decimals)
+{
+    before_item(w);
+    if (!isfinite(v)) {
+        put(w, "null", 4);
+        return;
+    }
+    char tmp[40];
+    const int n = snprintf(tmp, sizeof(tmp), "%.*f", decimals, v);
+    if (n < 0 || n >= (int)sizeof(tmp)) {
+        put(w, "null", 4);
+        return;
+    }
+    put(w, tmp, (size_t)n);
+}
+
+void gw_json_bool(gw_json_writer_t *w, bool v)
+{
+    before_item(w);
+    if (v) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void gw_json_null(gw_json_writer_t *w)
+{
+    before_item(w);
+    put(w, "null", 4);
+}
+
+void gw_json_raw(gw_json_writer_t *w, const char *json)
+{
+    before_item(w);
+    if (json && json[0]) {
+        put(w, json, strlen(json));
+    } else {
+        put(w, "null", 4);
+    }
+}
+
+void gw_json_kv_str(gw_json_writer_t *w, const char *key, const char *s)
+{
+    gw_json_key(w, key);
+    gw_json_str(w, s);
+}
+
+void gw_json_kv_u64(gw_json_writer_t *w, const char *key, uint64_t v)
+{
+    gw_json_key(w, key);
+    gw_json_u64(w, v);
+}
+
+void gw_json_kv_i64(gw_json_writer_t *w, const char *key, int64_t v)
+{
+    gw_json_key(w, key);
+    gw_json_i64(w, v);
+}
+
+void gw_json_kv_f64(gw_json_writer_t *w, const char *key, double v, int decimals)
+{
+    gw_json_key(w, key);
+    gw_json_f64(w, v, decimals);
+}
+
+void gw_json_kv_bool(gw_json_writer_t *w, const char *key, bool v)
+{
+    gw_json_key(w, key);
+    gw_json_bool(w, v);
+}
+
+void gw_json_kv_raw(gw_json_writer_t *w, const char *key, const char *json)
+{
+    gw_json_key(w, key);
+    gw_json_raw(w, json);
+}
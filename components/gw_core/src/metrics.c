@@ -0,0 +1,107 @@
+#include "gw_core/metrics.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "gw_core/event_bus.h"
+#include "gw_core/event_journal.h"
+#include "gw_core/rpc.h"
+
+#define GW_METRICS_MAX_CONSUMERS 8
+
+// Snapshots copied out of the event bus and the method registry (~2.3 KB together). Static rather
+// than on the caller's stack (HTTP server task, WS workers), so they are shared under s_lock.
+static gw_event_consumer_stats_t s_consumers[GW_METRICS_MAX_CONSUMERS];
+static gw_rpc_stats_t s_rpc[GW_RPC_MAX_METHODS];
+static SemaphoreHandle_t s_lock;
+
+static void write_hist(gw_json_writer_t *w, const char *name, const uint32_t *hist)
+{
+    gw_json_key(w, name);
+    gw_json_arr_begin(w);
+    for (size_t i = 0; i < GW_EVENT_LATENCY_BUCKETS; i++) {
+        gw_json_u64(w, hist[i]);
+    }
+    gw_json_arr_end(w);
+}
+
+esp_err_t gw_metrics_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void gw_metrics_write_json(gw_json_writer_t *w)
+{
+    gw_json_obj_begin(w);
+    if (!s_lock) {
+        gw_json_obj_end(w);
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const size_t count = gw_event_bus_consumer_stats(s_consumers, GW_METRICS_MAX_CONSUMERS);
+
+    gw_json_kv_u64(w, "uptime_ms", (uint64_t)(esp_timer_get_time() / 1000));
+
+    gw_json_key(w, "event_bus");
+    gw_json_obj_begin(w);
+    gw_json_kv_u64(w, "last_id", gw_event_bus_last_id());
+    gw_json_kv_u64(w, "latency_bucket0_us", GW_EVENT_LATENCY_BUCKET0_US);
+
+    gw_json_key(w, "consumers");
+    gw_json_arr_begin(w);
+    for (size_t i = 0; i < count; i++) {
+        const gw_event_consumer_stats_t *s = &s_consumers[i];
+        gw_json_obj_begin(w);
+        gw_json_kv_str(w, "name", s->name);
+        gw_json_kv_u64(w, "delivered", s->delivered);
+        gw_json_kv_u64(w, "filtered", s->filtered);
+        gw_json_kv_u64(w, "dropped", s->dropped);
+        gw_json_kv_u64(w, "backlog", s->backlog);
+        gw_json_kv_u64(w, "backlog_hwm", s->backlog_hwm);
+        gw_json_kv_u64(w, "queue_us_max", s->queue_us_max);
+        gw_json_kv_u64(w, "handle_us_max", s->handle_us_max);
+        write_hist(w, "queue_hist", s->queue_hist);
+        write_hist(w, "handle_hist", s->handle_hist);
+        gw_json_obj_end(w);
+    }
+    gw_json_arr_end(w);
+    gw_json_obj_end(w);
+
+    gw_event_journal_stats_t journal;
+    gw_event_journal_stats(&journal);
+    gw_json_key(w, "journal");
+    gw_json_obj_begin(w);
+    gw_json_kv_u64(w, "batches_dropped", journal.batches_dropped);
+    gw_json_kv_u64(w, "events_dropped", journal.events_dropped);
+    gw_event_gap_write_json(w, &journal.last_drop);
+    gw_json_obj_end(w);
+
+    // Request methods that were called at least once.
+    const size_t rpc_count = gw_rpc_stats(s_rpc, GW_RPC_MAX_METHODS);
+    gw_json_key(w, "rpc");
+    gw_json_arr_begin(w);
+    for (size_t i = 0; i < rpc_count; i++) {
+        const gw_rpc_stats_t *s = &s_rpc[i];
+        if (s->calls == 0) {
+            continue;
+        }
+        gw_json_obj_begin(w);
+        gw_json_kv_str(w, "method", s->name);
+        gw_json_kv_u64(w, "calls", s->calls);
+        gw_json_kv_u64(w, "errors", s->errors);
+        gw_json_kv_u64(w, "us_avg", s->us_total / s->calls);
+        gw_json_kv_u64(w, "us_max", s->us_max);
+        gw_json_obj_end(w);
+    }
+    gw_json_arr_end(w);
+    xSemaphoreGive(s_lock);
+    gw_json_obj_end(w);
+}
@@ -0,0 +1,216 @@
+#include "gw_core/rpc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Sorted by name; s_stats[i] belongs to s_methods[i].
+static const gw_rpc_method_t *s_methods[GW_RPC_MAX_METHODS];
+static gw_rpc_stats_t s_stats[GW_RPC_MAX_METHODS];
+static size_t s_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t lower_bound(const char *name)
+{
+    size_t lo = 0;
+    size_t hi = s_count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (strcmp(s_methods[mid]->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+esp_err_t gw_rpc_register(const gw_rpc_method_t *methods, size_t count)
+{
+    if (methods == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (methods[i].name == NULL || methods[i].handler == NULL || methods[i].arg_count > GW_RPC_MAX_ARGS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < count && err == ESP_OK; i++) {
+        const size_t pos = lower_bound(methods[i].name);
+        if (pos < s_count && strcmp(s_methods[pos]->name, methods[i].name) == 0) {
+            err = ESP_ERR_INVALID_STATE;
+        } else if (s_count >= GW_RPC_MAX_METHODS) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            memmove(&s_methods[pos + 1], &s_methods[pos], (s_count - pos) * sizeof(s_methods[0]));
+            memmove(&s_stats[pos + 1], &s_stats[pos], (s_count - pos) * sizeof(s_stats[0]));
+            s_methods[pos] = &methods[i];
+            s_stats[pos] = (gw_rpc_stats_t){.name = methods[i].name};
+            s_count++;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+// Number, or for GW_RPC_ARG_U16 a decimal / "0x...." string.
+static bool parse_number(const cJSON *j, double *out)
+{
+    if (cJSON_IsNumber(j)) {
+        *out = j->valuedouble;
+        return true;
+    }
+    if (cJSON_IsString(j) && j->valuestring && j->valuestring[0] != '\0') {
+        char *end = NULL;
+        const unsigned long v = strtoul(j->valuestring, &end, 0);
+        if (end && *end == '\0' && v <= 65535UL) {
+            *out = (double)v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool arg_valid(const gw_rpc_arg_t *a, const cJSON *j)
+{
+    double v = 0;
+    switch (a->type) {
+    case GW_RPC_ARG_STR:
+        return cJSON_IsString(j) && j->valuestring && strlen(j->valuestring) >= (size_t)a->min;
+    case GW_RPC_ARG_NUM:
+        return cJSON_IsNumber(j) && j->valuedouble >= a->min && j->valuedouble <= a->max;
+    case GW_RPC_ARG_U16:
+        return parse_number(j, &v) && v >= a->min && v <= a->max;
+    case GW_RPC_ARG_BOOL:
+        return cJSON_IsBool(j);
+    case GW_RPC_ARG_OBJ:
+        return cJSON_IsObject(j);
+    case GW_RPC_ARG_ARR:
+        return cJSON_IsArray(j);
+    default:
+        return false;
+    }
+}
+
+// Fills call->args; on failure writes the error message into err.
+static bool check_args(const gw_rpc_method_t *m, gw_rpc_call_t *call, char *err, size_t err_size)
+{
+    for (size_t i = 0; i < m->arg_count; i++) {
+        const gw_rpc_arg_t *a = &m->args[i];
+        cJSON *j = cJSON_IsObject(call->params) ? cJSON_GetObjectItemCaseSensitive(call->params, a->name) : NULL;
+        if (j != NULL && arg_valid(a, j)) {
+            call->args[i] = j;
+            continue;
+        }
+        call->args[i] = NULL;
+        if (!a->required) {
+            continue;
+        }
+        if (a->err) {
+            strlcpy(err, a->err, err_size);
+        } else {
+            const bool number = (a->type == GW_RPC_ARG_NUM || a->type == GW_RPC_ARG_U16);
+            snprintf(err, err_size, "%s %s", number ? "bad" : "missing", a->name);
+        }
+        return false;
+    }
+    return true;
+}
+
+esp_err_t gw_rpc_dispatch(gw_rpc_call_t *call)
+{
+    if (call == NULL || call->method == NULL || call->reply == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const size_t pos = lower_bound(call->method);
+    if (pos >= s_count || strcmp(s_methods[pos]->name, call->method) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const gw_rpc_method_t *m = s_methods[pos];
+
+    const int64_t t0 = esp_timer_get_time();
+    char err[48];
+    if (check_args(m, call, err, sizeof(err))) {
+        m->handler(call);
+        if (!call->replied) {
+            gw_rpc_reply_ok(call);
+        }
+    } else {
+        gw_rpc_reply_err(call, err);
+    }
+    const uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+
+    portENTER_CRITICAL(&s_lock);
+    gw_rpc_stats_t *s = &s_stats[pos];
+    s->calls++;
+    s->errors += call->ok ? 0 : 1;
+    s->us_total += us;
+    if (us > s->us_max) {
+        s->us_max = us;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+static void reply(gw_rpc_call_t *call, bool ok, const char *err, gw_rpc_result_fn res, const void *res_ctx)
+{
+    if (call->replied) {
+        return;
+    }
+    call->replied = true;
+    call->ok = ok;
+    call->reply(call, ok, err, res, res_ctx);
+}
+
+void gw_rpc_reply_ok(gw_rpc_call_t *call)
+{
+    reply(call, true, NULL, NULL, NULL);
+}
+
+void gw_rpc_reply_err(gw_rpc_call_t *call, const char *err)
+{
+    reply(call, false, err, NULL, NULL);
+}
+
+void gw_rpc_reply_res(gw_rpc_call_t *call, gw_rpc_result_fn res, const void *res_ctx)
+{
+    reply(call, true, NULL, res, res_ctx);
+}
+
+const char *gw_rpc_arg_str(const gw_rpc_call_t *call, size_t i, const char *def)
+{
+    const cJSON *j = (i < GW_RPC_MAX_ARGS) ? call->args[i] : NULL;
+    return (cJSON_IsString(j) && j->valuestring) ? j->valuestring : def;
+}
+
+double gw_rpc_arg_num(const gw_rpc_call_t *call, size_t i, double def)
+{
+    const cJSON *j = (i < GW_RPC_MAX_ARGS) ? call->args[i] : NULL;
+    double v = def;
+    return (j && parse_number(j, &v)) ? v : def;
+}
+
+bool gw_rpc_arg_bool(const gw_rpc_call_t *call, size_t i, bool def)
+{
+    const cJSON *j = (i < GW_RPC_MAX_ARGS) ? call->args[i] : NULL;
+    return cJSON_IsBool(j) ? cJSON_IsTrue(j) : def;
+}
+
+size_t gw_rpc_stats(gw_rpc_stats_t *out, size_t max_out)
+{
+    if (out == NULL) {
+        return 0;
+    }
+    portENTER_CRITICAL(&s_lock);
+    const size_t n = s_count < max_out ? s_count : max_out;
+    memcpy(out, s_stats, n * sizeof(out[0]));
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
@@ -0,0 +1,274 @@
+#include "gw_core/rpc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gw_core/action_exec.h"
+#include "gw_core/automation_store.h"
+#include "gw_core/device_registry.h"
+#include "gw_core/event_bus.h"
+#include "gw_core/event_journal.h"
+#include "gw_core/event_log.h"
+#include "gw_core/metrics.h"
+
+static const char *TAG = "gw_rpc";
+
+typedef struct {
+    const gw_event_t *events;
+    size_t count;
+    uint32_t last_id;
+    gw_event_gap_t gap;
+} events_res_t;
+
+static void build_events_res(gw_json_writer_t *w, const void *ctx)
+{
+    const events_res_t *r = (const events_res_t *)ctx;
+    gw_json_obj_begin(w);
+    gw_json_kv_u64(w, "last_id", r->last_id);
+    gw_event_gap_write_json(w, &r->gap);
+    gw_json_key(w, "events");
+    gw_json_arr_begin(w);
+    for (size_t i = 0; i < r->count; i++) {
+        gw_json_obj_begin(w);
+        gw_event_write_json_fields(w, &r->events[i]);
+        gw_json_obj_end(w);
+    }
+    gw_json_arr_end(w);
+    gw_json_obj_end(w);
+}
+
+static const gw_rpc_arg_t s_events_list_args[] = {
+    {"since", GW_RPC_ARG_NUM, false, 0, UINT32_MAX},
+    {"limit", GW_RPC_ARG_NUM, false, 1, 128},
+};
+
+static void events_list(gw_rpc_call_t *call)
+{
+    const uint32_t since = (uint32_t)gw_rpc_arg_num(call, 0, 0);
+    const size_t limit = (size_t)gw_rpc_arg_num(call, 1, 64);
+
+    gw_event_t *events = (gw_event_t *)calloc(limit, sizeof(gw_event_t));
+    if (!events) {
+        gw_rpc_reply_err(call, "no mem");
+        return;
+    }
+    events_res_t res = {.events = events};
+    res.count = gw_event_journal_list_since(since, events, limit, &res.last_id, &res.gap);
+    gw_rpc_reply_res(call, build_events_res, &res);
+    free(events);
+}
+
+static void build_metrics_res(gw_json_writer_t *w, const void *ctx)
+{
+    (void)ctx;
+    gw_metrics_write_json(w);
+}
+
+static void metrics_get(gw_rpc_call_t *call)
+{
+    gw_rpc_reply_res(call, build_metrics_res, NULL);
+}
+
+static const gw_rpc_arg_t s_eventlog_set_args[] = {
+    {"types", GW_RPC_ARG_ARR, false, 0, 0},
+    {"rate", GW_RPC_ARG_NUM, false, 0, 1000},
+    {"burst", GW_RPC_ARG_NUM, false, 1, 1000},
+};
+
+static void eventlog_set(gw_rpc_call_t *call)
+{
+    if (!cJSON_IsObject(call->params)) {
+        gw_rpc_reply_err(call, "missing p");
+        return;
+    }
+    const cJSON *types_j = call->args[0];
+    if (types_j) {
+        const char *types[GW_EVENT_LOG_MAX_TYPES];
+        size_t count = 0;
+        const cJSON *t = NULL;
+        cJSON_ArrayForEach(t, types_j)
+        {
+            if (!cJSON_IsString(t) || count >= GW_EVENT_LOG_MAX_TYPES) {
+                gw_rpc_reply_err(call, "bad types");
+                return;
+            }
+            types[count++] = t->valuestring;
+        }
+        if (gw_event_log_set_types(types, count) != ESP_OK) {
+            gw_rpc_reply_err(call, "bad types");
+            return;
+        }
+    }
+    if (call->args[1]) {
+        gw_event_log_set_rate((uint32_t)gw_rpc_arg_num(call, 1, 0), (uint32_t)gw_rpc_arg_num(call, 2, GW_EVENT_LOG_DEFAULT_BURST));
+    }
+}
+
+typedef struct {
+    const gw_automation_meta_t *metas;
+    size_t count;
+} automations_res_t;
+
+static void build_automations_res(gw_json_writer_t *w, const void *ctx)
+{
+    const automations_res_t *r = (const automations_res_t *)ctx;
+    gw_json_obj_begin(w);
+    gw_json_key(w, "automations");
+    gw_json_arr_begin(w);
+    for (size_t i = 0; i < r->count; i++) {
+        const gw_automation_meta_t *a = &r->metas[i];
+        gw_json_obj_begin(w);
+        gw_json_kv_str(w, "id", a->id);
+        gw_json_kv_str(w, "name", a->name);
+        gw_json_kv_bool(w, "enabled", a->enabled);
+        // NOTE: The "json" field is no longer sent, this is an API change.
+        gw_json_obj_end(w);
+    }
+    gw_json_arr_end(w);
+    gw_json_obj_end(w);
+}
+
+static void automations_list(gw_rpc_call_t *call)
+{
+    gw_automation_meta_t *metas = (gw_automation_meta_t *)calloc(GW_AUTOMATION_CAP, sizeof(gw_automation_meta_t));
+    if (!metas) {
+        gw_rpc_reply_err(call, "no mem");
+        return;
+    }
+    const automations_res_t res = {.metas = metas, .count = gw_automation_store_list_meta(metas, GW_AUTOMATION_CAP)};
+    gw_rpc_reply_res(call, build_automations_res, &res);
+    free(metas);
+}
+
+static const gw_rpc_arg_t s_automations_put_args[] = {
+    {"id", GW_RPC_ARG_STR, true, 1, 0, "missing or empty id"},
+    {"name", GW_RPC_ARG_STR, true, 0, 0},
+    {"enabled", GW_RPC_ARG_BOOL, false, 0, 0},
+    {"json", GW_RPC_ARG_STR, true, 0, 0},
+};
+
+static void automations_put(gw_rpc_call_t *call)
+{
+    const char *automation_id = gw_rpc_arg_str(call, 0, "");
+    esp_err_t err = gw_automation_store_put(automation_id, gw_rpc_arg_str(call, 1, ""), gw_rpc_arg_bool(call, 2, true), gw_rpc_arg_str(call, 3, ""));
+    if (err != ESP_OK) {
+        char emsg[128];
+        snprintf(emsg, sizeof(emsg), "store failed: %s (0x%x)", esp_err_to_name(err), (unsigned)err);
+        gw_rpc_reply_err(call, emsg);
+        return;
+    }
+
+    // Publish an event to notify other modules (like the rules engine) that an automation has changed.
+    // The rules engine wakes on it to rebuild from the new snapshot and re-arm its interval timers.
+    gw_event_bus_publish("automation_saved", "ws", "", 0, automation_id);
+}
+
+static const gw_rpc_arg_t s_automation_id_args[] = {
+    {"id", GW_RPC_ARG_STR, true, 1, 0},
+};
+
+static void automations_remove(gw_rpc_call_t *call)
+{
+    const char *auto_id = gw_rpc_arg_str(call, 0, "");
+    ESP_LOGI(TAG, "automations.remove: deleting %s", auto_id);
+    esp_err_t err = gw_automation_store_remove(auto_id);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "automations.remove: failed to remove %s: %s", auto_id, esp_err_to_name(err));
+        gw_rpc_reply_err(call, "not found");
+        return;
+    }
+    gw_event_bus_publish("automation_removed", "ws", "", 0, auto_id);
+}
+
+static const gw_rpc_arg_t s_automations_set_enabled_args[] = {
+    {"id", GW_RPC_ARG_STR, true, 1, 0},
+    {"enabled", GW_RPC_ARG_BOOL, true, 0, 0},
+};
+
+static void automations_set_enabled(gw_rpc_call_t *call)
+{
+    const char *auto_id = gw_rpc_arg_str(call, 0, "");
+    const bool enabled = gw_rpc_arg_bool(call, 1, false);
+    if (gw_automation_store_set_enabled(auto_id, enabled) != ESP_OK) {
+        gw_rpc_reply_err(call, "not found");
+        return;
+    }
+    char msg[96];
+    (void)snprintf(msg, sizeof(msg), "id=%s enabled=%u", auto_id, enabled ? 1U : 0U);
+    char payload[128];
+    (void)snprintf(payload, sizeof(payload), "{\"id\":\"%s\",\"enabled\":%s}", auto_id, enabled ? "true" : "false");
+    gw_event_bus_publish_ex("automation_enabled", "ws", "", 0, msg, payload);
+}
+
+static const gw_rpc_arg_t s_devices_set_name_args[] = {
+    {"uid", GW_RPC_ARG_STR, true, 1, 0},
+    {"name", GW_RPC_ARG_STR, true, 0, 0},
+};
+
+static void devices_set_name(gw_rpc_call_t *call)
+{
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, gw_rpc_arg_str(call, 0, ""), sizeof(uid.uid));
+    const char *name = gw_rpc_arg_str(call, 1, "");
+
+    esp_err_t err = gw_device_registry_set_name(&uid, name);
+    if (err != ESP_OK) {
+        gw_rpc_reply_err(call, (err == ESP_ERR_NOT_FOUND) ? "device not found" : "registry failed");
+        return;
+    }
+    gw_event_bus_publish("device_renamed", "ws", uid.uid, 0, name);
+}
+
+static const gw_rpc_arg_t s_actions_exec_args[] = {
+    {"action", GW_RPC_ARG_OBJ, false, 0, 0},
+    {"actions", GW_RPC_ARG_ARR, false, 0, 0},
+};
+
+static void actions_exec(gw_rpc_call_t *call)
+{
+    char errbuf[96];
+    if (call->args[0]) {
+        if (gw_action_exec(call->args[0], errbuf, sizeof(errbuf)) != ESP_OK) {
+            gw_rpc_reply_err(call, (errbuf[0] != '\0') ? errbuf : "action failed");
+        }
+        return;
+    }
+    if (call->args[1]) {
+        cJSON *it = NULL;
+        cJSON_ArrayForEach(it, call->args[1])
+        {
+            if (!cJSON_IsObject(it)) {
+                gw_rpc_reply_err(call, "actions must be objects");
+                return;
+            }
+            if (gw_action_exec(it, errbuf, sizeof(errbuf)) != ESP_OK) {
+                gw_rpc_reply_err(call, (errbuf[0] != '\0') ? errbuf : "action failed");
+                return;
+            }
+        }
+        return;
+    }
+    gw_rpc_reply_err(call, "missing action/actions");
+}
+
+#define ARGS(a) (a), (sizeof(a) / sizeof((a)[0]))
+
+static const gw_rpc_method_t s_core_methods[] = {
+    {"actions.exec", actions_exec, ARGS(s_actions_exec_args)},
+    {"automations.list", automations_list, NULL, 0},
+    {"automations.put", automations_put, ARGS(s_automations_put_args)},
+    {"automations.remove", automations_remove, ARGS(s_automation_id_args)},
+    {"automations.set_enabled", automations_set_enabled, ARGS(s_automations_set_enabled_args)},
+    {"devices.set_name", devices_set_name, ARGS(s_devices_set_name_args)},
+    {"eventlog.set", eventlog_set, ARGS(s_eventlog_set_args)},
+    {"events.list", events_list, ARGS(s_events_list_args)},
+    {"metrics.get", metrics_get, NULL, 0},
+};
+
+esp_err_t gw_rpc_register_core(void)
+{
+    return gw_rpc_register(s_core_methods, sizeof(s_core_methods) / sizeof(s_core_methods[0]));
+}
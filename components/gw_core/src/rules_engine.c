@@ -1,31 +1,31 @@
 #include "gw_core/rules_engine.h"
 
 #include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/task.h"
 
 #include "gw_core/action_exec.h"
 #include "gw_core/automation_store.h"
+#include "gw_core/device_registry.h"
+#include "gw_core/json_writer.h"
 #include "gw_core/state_store.h"
+#include "gw_core/timer_wheel.h"
 #include "gw_core/types.h"
 
 static const char *TAG = "gw_rules";
 
-#define GW_AUTOMATION_CAP 32
-
 static bool s_inited;
-static QueueHandle_t s_q;
+static gw_event_consumer_t *s_consumer;
 static TaskHandle_t s_task;
 
 static const char *strtab_at(const gw_automation_entry_t *entry, uint32_t off)
@@ -36,221 +36,894 @@ static const char *strtab_at(const gw_automation_entry_t *entry, uint32_t off)
     return entry->string_table + off;
 }
 
-static void publish_rules_fired(const gw_event_t *e, const char *automation_id)
+static void publish_rules_fired(gw_dev_handle_t dev, uint16_t short_addr, const char *automation_id)
 {
+    gw_device_uid_t uid = {0};
+    if (dev != GW_DEV_HANDLE_INVALID) (void)gw_device_registry_handle_uid(dev, &uid);
+
     char msg[128];
-    snprintf(msg, sizeof(msg), "{\"automation_id\":\"%s\"}", automation_id ? automation_id : "");
-    gw_event_bus_publish("rules.fired", "rules", e ? e->device_uid : "", e ? e->short_addr : 0, msg);
+    gw_json_writer_t w;
+    gw_json_writer_init(&w, msg, sizeof(msg));
+    gw_json_obj_begin(&w);
+    gw_json_kv_str(&w, "automation_id", automation_id);
+    gw_json_obj_end(&w);
+    if (gw_json_writer_finish(&w) != ESP_OK) return;
+    gw_event_bus_publish("rules.fired", "rules", uid.uid, short_addr, msg);
 }
 
 static void publish_rules_action(const char *automation_id, size_t idx, bool ok, const char *err)
 {
     char msg[192];
+    gw_json_writer_t w;
+    gw_json_writer_init(&w, msg, sizeof(msg));
+    gw_json_obj_begin(&w);
+    gw_json_kv_str(&w, "automation_id", automation_id);
+    gw_json_kv_u64(&w, "idx", idx);
+    gw_json_kv_bool(&w, "ok", ok && err == NULL);
     if (err) {
-        snprintf(msg, sizeof(msg), "{\"automation_id\":\"%s\",\"idx\":%u,\"ok\":false,\"err\":\"%s\"}", automation_id, (unsigned)idx, err);
-    } else {
-        snprintf(msg, sizeof(msg), "{\"automation_id\":\"%s\",\"idx\":%u,\"ok\":true}", automation_id, (unsigned)idx);
+        gw_json_kv_str(&w, "err", err);
     }
+    gw_json_obj_end(&w);
+    if (gw_json_writer_finish(&w) != ESP_OK) return;
     gw_event_bus_publish("rules.action", "rules", "", 0, msg);
 }
 
+static bool state_to_number_bool(const gw_state_item_t *s, double *out_n, bool *out_b)
+{
+    if (!s) return false;
+    switch (s->value_type) {
+    case GW_STATE_VALUE_BOOL: *out_n = s->value.b ? 1.0 : 0.0; *out_b = s->value.b; return true;
+    case GW_STATE_VALUE_F32:  *out_n = s->value.f32; *out_b = fabs(s->value.f32) > 1e-6; return true;
+    case GW_STATE_VALUE_U32:  *out_n = s->value.u32; *out_b = s->value.u32 != 0; return true;
+    case GW_STATE_VALUE_U64:  *out_n = s->value.u64; *out_b = s->value.u64 != 0; return true;
+    default: return false;
+    }
+}
+
+// Trigger index: (event type, device, cluster, attr/cmd) -> triggers that can fire for it.
+// Fields a trigger leaves as wildcard are indexed as "any"; lookups probe every specific/any
+// combination of the event's fields, so dispatch only visits candidate rules.
+// Each entry carries the trigger bound to integers (device uid -> handle, cmd name -> enum), so
+// matching never touches the string table. Entries are sorted by key hash; collisions are
+// filtered by trigger_matches().
 typedef struct {
-    uint8_t endpoint;
-    bool has_endpoint;
-    const char *cmd;
-    bool has_cmd;
-    uint16_t cluster_id;
-    bool has_cluster;
-    uint16_t attr_id;
-    bool has_attr;
-} event_payload_view_t;
+    uint32_t key;
+    uint16_t auto_idx;
+    uint8_t trig_idx;
+    uint8_t evt_type;
+    gw_dev_handle_t dev; // GW_DEV_HANDLE_INVALID = any
+    uint16_t cluster_id; // 0 = any
+    uint16_t sub;        // attr id, or cmd_key() for commands; 0 = any
+    uint8_t endpoint;    // 0 = any
+    uint8_t reserved;
+} trig_index_entry_t;
+
+// Condition bound to integers: (device handle, state key) slot, op and constant.
+typedef struct {
+    gw_dev_handle_t dev; // GW_DEV_HANDLE_INVALID: uid has no handle yet, never passes
+    gw_state_key_t key;
+    uint8_t op;          // gw_auto_op_t
+    uint8_t val_type;    // gw_auto_val_type_t
+    double value;        // bool constants as 0/1
+} cond_bound_t;
+
+// Cached result of an automation's conditions; COND_DIRTY until evaluated and again whenever a
+// state slot one of them reads changes.
+enum { COND_DIRTY = 0, COND_PASS, COND_FAIL };
+
+#define RUN_IDLE 0xFF // auto_rt_t.next_action when no run is waiting in a delay
 
-static bool parse_u16_any_json(const cJSON *j, uint16_t *out)
+typedef struct {
+    uint32_t seen;      // dedup stamp for the current event
+    uint16_t cond_base; // first entry in s_conds
+    uint8_t cond_count;
+    uint8_t cond_state;
+    uint8_t next_action; // action a run waiting in a delay resumes at, or RUN_IDLE
+    uint8_t queued;      // QUEUED mode: runs waiting for the current one
+    uint8_t unbound_watch;       // state triggers (bit per trigger) whose device has no handle yet
+    uint16_t pending_short;      // trigger waiting out the debounce window
+    gw_dev_handle_t pending_dev;
+    int64_t accepted_ms; // last accepted trigger, for throttle_ms; 0 = none yet
+    gw_timer_t delay;
+    gw_timer_t debounce;
+} auto_rt_t;
+
+_Static_assert(GW_AUTO_MAX_TRIGGERS <= 8, "auto_rt_t.unbound_watch has a bit per trigger");
+
+// Interval trigger, re-armed each time it fires.
+typedef struct {
+    gw_timer_t timer;
+    uint32_t every_ms;
+    uint16_t auto_idx;
+} interval_t;
+
+// State changes reach the rules task as bits in a small bucket set keyed by (dev, key): the state
+// listener (any task) sets a bucket's dirty bit if it is watched, the rules task drains the bits
+// and marks the automations depending on those buckets (s_dep_auto, grouped by bucket) dirty.
+#define COND_BUCKETS 256
+#define COND_BUCKET_WORDS (COND_BUCKETS / 32)
+
+static _Atomic uint32_t s_cond_watch[COND_BUCKET_WORDS];
+static _Atomic uint32_t s_cond_dirty[COND_BUCKET_WORDS];
+
+// Owned by rules_task only. s_snap is a reference into the automation store (no copy);
+// everything is rebuilt whenever the store publishes a new snapshot or the registry releases a
+// handle, and the unbound triggers, watches and conditions are bound in place when a device handle
+// appears while they wait for one.
+static const gw_automation_snapshot_t *s_snap;
+static trig_index_entry_t *s_index;
+static size_t s_index_count;
+static size_t s_unbound;       // triggers/conditions whose uid has no handle yet
+static uint32_t s_handle_gen;  // gw_device_registry_handle_gen() the index was bound against
+static uint32_t s_release_gen; // gw_device_registry_handle_release_gen() of the last build
+static auto_rt_t *s_rt;        // per automation in s_snap
+static size_t s_rt_count;
+static interval_t *s_intervals;
+static size_t s_interval_count;
+static gw_timer_wheel_t *s_wheel; // delays, debounce windows and intervals; expiries run in rules_task
+static cond_bound_t *s_conds;
+static uint16_t *s_dep_auto;
+static uint16_t s_dep_start[COND_BUCKETS + 1];
+static uint32_t s_seen_stamp;
+
+// State triggers are state store watches, one per trigger. The watch callback (setter's task)
+// records its build generation for the watch id, sets the id's pending bit and wakes rules_task
+// through the bus consumer. A callback of a replaced build can still land after the reset (ids are
+// reused), so rules_task only accepts an id whose recorded generation is the current s_watch_gen.
+#define WATCH_WORDS (GW_STATE_WATCH_CAP / 32)
+#define WATCH_AUTO_NONE UINT16_MAX
+
+static _Atomic uint32_t s_watch_gen;
+static _Atomic uint32_t s_watch_pending[WATCH_WORDS];
+static _Atomic uint32_t s_watch_fired_gen[GW_STATE_WATCH_CAP]; // newest generation that fired the id
+static uint16_t s_watch_auto[GW_STATE_WATCH_CAP]; // watch id -> automation (rules_task only)
+static gw_dev_handle_t s_watch_dev[GW_STATE_WATCH_CAP];
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t trig_key(uint8_t evt_type, gw_dev_handle_t dev, uint16_t cluster_id, uint16_t sub)
 {
-    if (cJSON_IsNumber(j)) { *out = (uint16_t)j->valuedouble; return true; }
-    if (cJSON_IsString(j)) { *out = (uint16_t)strtoul(j->valuestring, NULL, 0); return true; }
-    return false;
+    const uint64_t packed = (uint64_t)evt_type << 48 | (uint64_t)dev << 32 | (uint64_t)cluster_id << 16 | sub;
+    return fnv1a(2166136261u, &packed, sizeof(packed));
 }
 
-static void build_payload_view(const cJSON *payload, event_payload_view_t *out)
+// Command sub-key; 0 is reserved for "any", GW_AUTO_CMD_UNKNOWN gets a key no event produces.
+static uint16_t cmd_key(uint8_t cmd)
 {
-    memset(out, 0, sizeof(*out));
-    if (!payload) return;
-    const cJSON *ep = cJSON_GetObjectItem(payload, "endpoint");
-    if (cJSON_IsNumber(ep)) { out->endpoint = (uint8_t)ep->valuedouble; out->has_endpoint = true; }
-    const cJSON *cmd = cJSON_GetObjectItem(payload, "cmd");
-    if (cJSON_IsString(cmd)) { out->cmd = cmd->valuestring; out->has_cmd = true; }
-    if (parse_u16_any_json(cJSON_GetObjectItem(payload, "cluster"), &out->cluster_id)) { out->has_cluster = true; }
-    if (parse_u16_any_json(cJSON_GetObjectItem(payload, "attr"), &out->attr_id)) { out->has_attr = true; }
+    return (uint16_t)(0x100u | cmd);
 }
 
-static gw_auto_evt_type_t evt_type_from_event(const gw_event_t *e)
+// The event's attr/cmd sub-key, or 0 when it carries neither.
+static uint16_t event_sub(const gw_event_data_t *d)
 {
-    if (strcmp(e->type, "zigbee.command") == 0) return GW_AUTO_EVT_ZIGBEE_COMMAND;
-    if (strcmp(e->type, "zigbee.attr_report") == 0) return GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
-    if (strcmp(e->type, "device.join") == 0) return GW_AUTO_EVT_DEVICE_JOIN;
-    if (strcmp(e->type, "device.leave") == 0) return GW_AUTO_EVT_DEVICE_LEAVE;
+    if (d->evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
+        return (d->flags & GW_EVENT_DATA_HAS_CMD) ? cmd_key(d->cmd) : 0;
+    }
+    if (d->evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
+        return (d->flags & GW_EVENT_DATA_HAS_ATTR) ? d->attr_id : 0;
+    }
     return 0;
 }
 
-static bool trigger_matches(const gw_automation_entry_t *entry, const gw_auto_bin_trigger_v2_t *t, gw_auto_evt_type_t evt_type, const gw_event_t *e, const event_payload_view_t *pv)
+// Binds a compiled trigger; false if it names a device that has no handle yet.
+static bool trigger_bind(const gw_automation_entry_t *entry, const gw_auto_bin_trigger_v2_t *t, trig_index_entry_t *out)
+{
+    out->evt_type = t->event_type;
+    out->endpoint = t->endpoint;
+    out->dev = GW_DEV_HANDLE_INVALID;
+    out->cluster_id = 0;
+    out->sub = 0;
+    if (t->device_uid_off) {
+        gw_device_uid_t uid = {0};
+        strlcpy(uid.uid, strtab_at(entry, t->device_uid_off), sizeof(uid.uid));
+        out->dev = gw_device_registry_find_handle(&uid);
+        if (out->dev == GW_DEV_HANDLE_INVALID) return false;
+    }
+    if (t->event_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
+        out->cluster_id = t->cluster_id;
+        out->sub = t->cmd_off ? cmd_key(t->cmd) : 0;
+    } else if (t->event_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
+        out->cluster_id = t->cluster_id;
+        out->sub = t->attr_id;
+    }
+    out->key = trig_key(out->evt_type, out->dev, out->cluster_id, out->sub);
+    return true;
+}
+
+static bool trigger_matches(const trig_index_entry_t *t, gw_dev_handle_t dev, uint16_t sub, const gw_event_data_t *d)
 {
-    if (t->event_type != evt_type) return false;
-    if (t->device_uid_off && strcmp(strtab_at(entry, t->device_uid_off), e->device_uid) != 0) return false;
-    if (t->endpoint && (!pv->has_endpoint || pv->endpoint != t->endpoint)) return false;
+    if (t->evt_type != d->evt_type) return false;
+    if (t->dev != GW_DEV_HANDLE_INVALID && t->dev != dev) return false;
+    if (t->endpoint && (!(d->flags & GW_EVENT_DATA_HAS_ENDPOINT) || d->endpoint != t->endpoint)) return false;
+    if (t->cluster_id && (!(d->flags & GW_EVENT_DATA_HAS_CLUSTER) || d->cluster_id != t->cluster_id)) return false;
+    if (t->sub && t->sub != sub) return false;
+    return true;
+}
 
-    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
-        if (t->cmd_off && (!pv->has_cmd || strcmp(strtab_at(entry, t->cmd_off), pv->cmd) != 0)) return false;
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-        if (t->attr_id && (!pv->has_attr || pv->attr_id != t->attr_id)) return false;
+// Watch callback; runs in the setter's task.
+static void on_state_watch(uint16_t watch_id, const gw_state_item_t *item, void *ctx)
+{
+    (void)item;
+    const uint32_t gen = (uint32_t)(uintptr_t)ctx;
+    if (gen != atomic_load(&s_watch_gen) || watch_id >= GW_STATE_WATCH_CAP) return;
+    // Keep the newest generation, so a late callback of an older build cannot mask this one.
+    uint32_t seen = atomic_load(&s_watch_fired_gen[watch_id]);
+    while ((int32_t)(gen - seen) > 0 && !atomic_compare_exchange_weak(&s_watch_fired_gen[watch_id], &seen, gen)) {
     }
+    atomic_fetch_or(&s_watch_pending[watch_id / 32], 1u << (watch_id % 32));
+    gw_event_bus_consumer_wake(s_consumer);
+}
+
+static uint8_t watch_kind(gw_auto_edge_t edge)
+{
+    switch (edge) {
+    case GW_AUTO_EDGE_ABOVE: return GW_STATE_WATCH_ABOVE;
+    case GW_AUTO_EDGE_BELOW: return GW_STATE_WATCH_BELOW;
+    default: return GW_STATE_WATCH_CHANGE;
+    }
+}
+
+// Registers the watch for a compiled state trigger; false if its device has no handle yet.
+static bool watch_bind(const gw_automation_entry_t *entry, const gw_auto_bin_trigger_v2_t *t, uint16_t auto_idx)
+{
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, strtab_at(entry, t->device_uid_off), sizeof(uid.uid));
+    const gw_state_watch_t w = {
+        .dev = gw_device_registry_find_handle(&uid),
+        .key = gw_state_key_intern(strtab_at(entry, t->key_off)),
+        .kind = watch_kind((gw_auto_edge_t)t->edge),
+        .threshold = t->threshold,
+        .hysteresis = t->hysteresis,
+    };
+    if (w.dev == GW_DEV_HANDLE_INVALID) return false;
+
+    uint16_t id = 0;
+    const uint32_t gen = atomic_load(&s_watch_gen);
+    esp_err_t err = gw_state_store_watch_add(&w, on_state_watch, (void *)(uintptr_t)gen, &id);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "state trigger of %s not watched: %s", entry->id, esp_err_to_name(err));
+        return true;
+    }
+    s_watch_auto[id] = auto_idx;
+    s_watch_dev[id] = w.dev;
     return true;
 }
 
-static bool state_to_number_bool(const gw_state_item_t *s, double *out_n, bool *out_b)
+static uint8_t cond_bucket(gw_dev_handle_t dev, gw_state_key_t key)
 {
-    if (!s) return false;
-    switch (s->value_type) {
-    case GW_STATE_VALUE_BOOL: *out_n = s->value_bool ? 1.0 : 0.0; *out_b = s->value_bool; return true;
-    case GW_STATE_VALUE_F32:  *out_n = s->value_f32; *out_b = fabs(s->value_f32) > 1e-6; return true;
-    case GW_STATE_VALUE_U32:  *out_n = s->value_u32; *out_b = s->value_u32 != 0; return true;
-    case GW_STATE_VALUE_U64:  *out_n = s->value_u64; *out_b = s->value_u64 != 0; return true;
-    default: return false;
+    return (uint8_t)((((uint32_t)dev << 8 | key) * 2654435761u) >> 24);
+}
+
+// Binds a compiled condition; false if it names a device that has no handle yet. The key is
+// interned so the slot exists before the first report for it.
+static bool condition_bind(const gw_automation_entry_t *entry, const gw_auto_bin_condition_v2_t *co, cond_bound_t *out)
+{
+    out->op = co->op;
+    out->val_type = co->val_type;
+    out->value = co->val_type == GW_AUTO_VAL_BOOL ? (co->v.b ? 1.0 : 0.0) : co->v.f64;
+    out->key = gw_state_key_intern(strtab_at(entry, co->key_off));
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, strtab_at(entry, co->device_uid_off), sizeof(uid.uid));
+    out->dev = gw_device_registry_find_handle(&uid);
+    return out->dev != GW_DEV_HANDLE_INVALID;
+}
+
+static bool condition_eval(const cond_bound_t *co)
+{
+    if (co->dev == GW_DEV_HANDLE_INVALID || co->key == GW_STATE_KEY_INVALID) return false;
+    gw_state_item_t st;
+    if (gw_state_store_get(co->dev, co->key, &st) != ESP_OK) return false;
+
+    double act = 0;
+    bool act_b = false;
+    if (!state_to_number_bool(&st, &act, &act_b)) return false;
+
+    const gw_auto_op_t op = (gw_auto_op_t)co->op;
+    if (co->val_type == GW_AUTO_VAL_BOOL) {
+        const bool exp = co->value != 0;
+        return !((op == GW_AUTO_OP_EQ && act_b != exp) || (op == GW_AUTO_OP_NE && act_b == exp));
+    }
+    const double exp = co->value;
+    return !((op == GW_AUTO_OP_EQ && fabs(act - exp) > 1e-6) || (op == GW_AUTO_OP_NE && fabs(act - exp) < 1e-6) ||
+             (op == GW_AUTO_OP_GT && act <= exp) || (op == GW_AUTO_OP_LT && act >= exp) ||
+             (op == GW_AUTO_OP_GE && act < exp) || (op == GW_AUTO_OP_LE && act > exp));
+}
+
+// State listener (value changes and evictions); runs in the setter's task.
+static void on_state_change(const gw_state_item_t *item, void *ctx)
+{
+    (void)ctx;
+    const uint8_t b = cond_bucket(item->dev, item->key);
+    const uint32_t bit = 1u << (b % 32);
+    if (atomic_load_explicit(&s_cond_watch[b / 32], memory_order_relaxed) & bit) {
+        atomic_fetch_or_explicit(&s_cond_dirty[b / 32], bit, memory_order_relaxed);
     }
 }
 
-static bool conditions_pass(const gw_automation_entry_t *entry)
+static void conditions_drain_dirty(void)
 {
-    if (entry->conditions_count == 0) return true;
+    for (size_t w = 0; w < COND_BUCKET_WORDS; w++) {
+        uint32_t bits = atomic_exchange_explicit(&s_cond_dirty[w], 0, memory_order_relaxed);
+        while (bits) {
+            const size_t b = w * 32 + (size_t)__builtin_ctz(bits);
+            bits &= bits - 1;
+            for (size_t i = s_dep_start[b]; i < s_dep_start[b + 1]; i++) {
+                s_rt[s_dep_auto[i]].cond_state = COND_DIRTY;
+            }
+        }
+    }
+}
 
-    for (uint8_t i = 0; i < entry->conditions_count; i++) {
-        const gw_auto_bin_condition_v2_t *co = &entry->conditions[i];
-        const char *uid_s = strtab_at(entry, co->device_uid_off);
-        const char *key = strtab_at(entry, co->key_off);
-        if (!uid_s[0] || !key[0]) return false;
+static bool conditions_pass(uint16_t auto_idx)
+{
+    auto_rt_t *rt = &s_rt[auto_idx];
+    if (rt->cond_state == COND_DIRTY) {
+        bool pass = true;
+        for (uint8_t i = 0; i < rt->cond_count && pass; i++) {
+            pass = condition_eval(&s_conds[rt->cond_base + i]);
+        }
+        rt->cond_state = pass ? COND_PASS : COND_FAIL;
+    }
+    return rt->cond_state == COND_PASS;
+}
 
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_s, sizeof(uid.uid));
-        gw_state_item_t st = {0};
-        if (gw_state_store_get(&uid, key, &st) != ESP_OK) return false;
-
-        double actual_n = 0;
-        bool actual_b = false;
-        if (!state_to_number_bool(&st, &actual_n, &actual_b)) return false;
-
-        const gw_auto_op_t op = (gw_auto_op_t)co->op;
-        if (co->val_type == GW_AUTO_VAL_BOOL) {
-            bool exp = co->v.b != 0;
-            if ((op == GW_AUTO_OP_EQ && actual_b != exp) || (op == GW_AUTO_OP_NE && actual_b == exp)) return false;
-        } else {
-            double exp = co->v.f64;
-            double act = actual_n;
-            if ((op == GW_AUTO_OP_EQ && fabs(act - exp) > 1e-6) || (op == GW_AUTO_OP_NE && fabs(act - exp) < 1e-6) ||
-                (op == GW_AUTO_OP_GT && act <= exp) || (op == GW_AUTO_OP_LT && act >= exp) ||
-                (op == GW_AUTO_OP_GE && act < exp) || (op == GW_AUTO_OP_LE && act > exp)) return false;
+static void conditions_index(size_t auto_count);
+
+// Builds s_conds, the per-automation cache and the bucket -> automation dependency lists, then
+// publishes the watched buckets. Every cache starts dirty, so changes that raced the rebuild are
+// covered by the first evaluation.
+static bool conditions_build(const gw_automation_snapshot_t *snap)
+{
+    size_t cond_total = 0;
+    for (size_t i = 0; i < snap->count; i++) {
+        if (snap->items[i].enabled) cond_total += snap->items[i].conditions_count;
+    }
+    if (cond_total) {
+        s_conds = (cond_bound_t *)calloc(cond_total, sizeof(cond_bound_t));
+        s_dep_auto = (uint16_t *)calloc(cond_total, sizeof(uint16_t));
+        if (!s_conds || !s_dep_auto) return false;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < snap->count; i++) {
+        const gw_automation_entry_t *entry = &snap->items[i];
+        if (!entry->enabled) continue;
+        s_rt[i].cond_base = (uint16_t)n;
+        s_rt[i].cond_count = entry->conditions_count;
+        for (uint8_t ci = 0; ci < entry->conditions_count; ci++) {
+            if (!condition_bind(entry, &entry->conditions[ci], &s_conds[n++])) s_unbound++;
         }
     }
+    conditions_index(snap->count);
     return true;
 }
 
-static void process_event(const gw_event_t *e)
+// Groups the bound conditions of the first auto_count automations by bucket into s_dep_auto and
+// publishes the watched buckets.
+static void conditions_index(size_t auto_count)
 {
-    if (!e || !e->type[0] || strcmp(e->source, "rules") == 0) return;
+    uint32_t watch[COND_BUCKET_WORDS] = {0};
+    uint16_t bucket_count[COND_BUCKETS] = {0};
+    for (size_t i = 0; i < auto_count; i++) {
+        for (uint8_t ci = 0; ci < s_rt[i].cond_count; ci++) {
+            const cond_bound_t *co = &s_conds[s_rt[i].cond_base + ci];
+            if (co->dev == GW_DEV_HANDLE_INVALID) continue;
+            const uint8_t b = cond_bucket(co->dev, co->key);
+            watch[b / 32] |= 1u << (b % 32);
+            bucket_count[b]++;
+        }
+    }
 
-    const gw_auto_evt_type_t evt_type = evt_type_from_event(e);
-    if (!evt_type) return;
-    
-    gw_automation_entry_t *all_autos = (gw_automation_entry_t *)calloc(GW_AUTOMATION_CAP, sizeof(gw_automation_entry_t));
-    if (!all_autos) {
-        ESP_LOGE(TAG, "Failed to allocate memory for automations");
+    s_dep_start[0] = 0;
+    for (size_t b = 0; b < COND_BUCKETS; b++) {
+        s_dep_start[b + 1] = (uint16_t)(s_dep_start[b] + bucket_count[b]);
+        bucket_count[b] = s_dep_start[b]; // reused as the fill cursor
+    }
+    for (size_t i = 0; i < auto_count; i++) {
+        for (uint8_t ci = 0; ci < s_rt[i].cond_count; ci++) {
+            const cond_bound_t *co = &s_conds[s_rt[i].cond_base + ci];
+            if (co->dev == GW_DEV_HANDLE_INVALID) continue;
+            s_dep_auto[bucket_count[cond_bucket(co->dev, co->key)]++] = (uint16_t)i;
+        }
+    }
+
+    for (size_t w = 0; w < COND_BUCKET_WORDS; w++) {
+        atomic_store_explicit(&s_cond_watch[w], watch[w], memory_order_relaxed);
+    }
+}
+
+// Runs (or resumes after a delay) the run of an automation until it finishes or reaches the next
+// delay, then starts its queued runs.
+static void run_actions(uint16_t auto_idx)
+{
+    const gw_automation_entry_t *entry = &s_snap->items[auto_idx];
+    auto_rt_t *rt = &s_rt[auto_idx];
+    gw_auto_compiled_t temp_compiled = {
+        .strings = (char *)entry->string_table,
+        .hdr.strings_size = entry->string_table_size,
+    };
+    for (;;) {
+        for (uint8_t ai = rt->next_action; ai < entry->actions_count; ai++) {
+            const gw_auto_bin_action_v2_t *a = &entry->actions[ai];
+            if (a->op == GW_AUTO_ACT_OP_DELAY) {
+                publish_rules_action(entry->id, ai, true, NULL);
+                rt->next_action = (uint8_t)(ai + 1);
+                gw_timer_arm(s_wheel, &rt->delay, a->arg0_u32);
+                return;
+            }
+            char errbuf[96] = {0};
+            esp_err_t rc = gw_action_exec_compiled(&temp_compiled, a, errbuf, sizeof(errbuf));
+            if (rc != ESP_OK) {
+                publish_rules_action(entry->id, ai, false, errbuf[0] ? errbuf : "exec failed");
+                break; // Stop actions on first failure for this rule
+            }
+            publish_rules_action(entry->id, ai, true, NULL);
+        }
+        if (rt->queued == 0) {
+            rt->next_action = RUN_IDLE;
+            return;
+        }
+        rt->queued--;
+        rt->next_action = 0;
+    }
+}
+
+static void on_delay_done(gw_timer_t *t, void *ctx)
+{
+    (void)t;
+    run_actions((uint16_t)(uintptr_t)ctx);
+}
+
+// A trigger past its debounce window: checks conditions and throttle_ms, then starts a run or, if
+// one is waiting in a delay, applies the automation's mode.
+static void automation_accept(uint16_t auto_idx, gw_dev_handle_t dev, uint16_t short_addr)
+{
+    if (!conditions_pass(auto_idx)) return;
+
+    const gw_automation_entry_t *entry = &s_snap->items[auto_idx];
+    auto_rt_t *rt = &s_rt[auto_idx];
+    const int64_t now_ms = esp_timer_get_time() / 1000;
+    if (entry->throttle_ms && rt->accepted_ms && now_ms - rt->accepted_ms < entry->throttle_ms) return;
+
+    const bool busy = rt->next_action != RUN_IDLE;
+    if (busy && entry->mode != GW_AUTO_MODE_RESTART &&
+        (entry->mode != GW_AUTO_MODE_QUEUED || rt->queued >= GW_AUTO_QUEUE_MAX)) {
+        return;
+    }
+    rt->accepted_ms = now_ms;
+    publish_rules_fired(dev, short_addr, entry->id);
+    if (busy && entry->mode == GW_AUTO_MODE_QUEUED) {
+        rt->queued++;
         return;
     }
+    (void)gw_timer_cancel(s_wheel, &rt->delay); // RESTART: drop the waiting run
+    rt->next_action = 0;
+    run_actions(auto_idx);
+}
 
-    size_t auto_count = gw_automation_store_list(all_autos, GW_AUTOMATION_CAP);
-    if (auto_count == 0) {
-        free(all_autos);
+static void on_trigger(uint16_t auto_idx, gw_dev_handle_t dev, uint16_t short_addr)
+{
+    const gw_automation_entry_t *entry = &s_snap->items[auto_idx];
+    if (entry->debounce_ms == 0) {
+        automation_accept(auto_idx, dev, short_addr);
         return;
     }
+    // Trailing edge: every trigger restarts the window; the last one is accepted when it closes.
+    auto_rt_t *rt = &s_rt[auto_idx];
+    rt->pending_dev = dev;
+    rt->pending_short = short_addr;
+    gw_timer_arm(s_wheel, &rt->debounce, entry->debounce_ms);
+}
 
-    cJSON *payload = e->payload_json[0] ? cJSON_Parse(e->payload_json) : NULL;
-    event_payload_view_t pv;
-    build_payload_view(payload, &pv);
+static void on_debounce_done(gw_timer_t *t, void *ctx)
+{
+    (void)t;
+    const uint16_t auto_idx = (uint16_t)(uintptr_t)ctx;
+    conditions_drain_dirty();
+    automation_accept(auto_idx, s_rt[auto_idx].pending_dev, s_rt[auto_idx].pending_short);
+}
 
-    for (size_t i = 0; i < auto_count; i++) {
-        const gw_automation_entry_t *entry = &all_autos[i];
+static void on_interval(gw_timer_t *t, void *ctx)
+{
+    interval_t *iv = (interval_t *)ctx;
+    gw_timer_arm(s_wheel, t, iv->every_ms);
+    conditions_drain_dirty();
+    on_trigger(iv->auto_idx, GW_DEV_HANDLE_INVALID, 0);
+}
+
+static int trig_index_cmp(const void *a, const void *b)
+{
+    const trig_index_entry_t *x = (const trig_index_entry_t *)a;
+    const trig_index_entry_t *y = (const trig_index_entry_t *)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->auto_idx != y->auto_idx) return x->auto_idx < y->auto_idx ? -1 : 1;
+    return (int)x->trig_idx - (int)y->trig_idx;
+}
+
+static void automations_reset(void)
+{
+    // Runs waiting in a delay or debounce window belong to the old build and are dropped.
+    for (size_t i = 0; i < s_rt_count; i++) {
+        (void)gw_timer_cancel(s_wheel, &s_rt[i].delay);
+        (void)gw_timer_cancel(s_wheel, &s_rt[i].debounce);
+    }
+    for (size_t i = 0; i < s_interval_count; i++) {
+        (void)gw_timer_cancel(s_wheel, &s_intervals[i].timer);
+    }
+    free(s_intervals);
+    s_intervals = NULL;
+    s_interval_count = 0;
+    s_rt_count = 0;
+    free(s_index);
+    free(s_rt);
+    free(s_conds);
+    free(s_dep_auto);
+    s_index = NULL;
+    s_rt = NULL;
+    s_conds = NULL;
+    s_dep_auto = NULL;
+    s_index_count = 0;
+    s_unbound = 0;
+    for (size_t w = 0; w < COND_BUCKET_WORDS; w++) {
+        atomic_store_explicit(&s_cond_watch[w], 0, memory_order_relaxed);
+    }
+    // New generation first: a callback already past the clear sees a stale ctx and drops itself.
+    atomic_fetch_add(&s_watch_gen, 1);
+    gw_state_store_watch_clear(on_state_watch);
+    for (size_t w = 0; w < WATCH_WORDS; w++) {
+        atomic_store(&s_watch_pending[w], 0);
+    }
+    for (size_t id = 0; id < GW_STATE_WATCH_CAP; id++) {
+        s_watch_auto[id] = WATCH_AUTO_NONE;
+        s_watch_dev[id] = GW_DEV_HANDLE_INVALID;
+    }
+}
+
+// Binds the event triggers of snap into s_index (sized for all its triggers) and sorts it.
+// Returns how many name a device that has no handle yet.
+static size_t index_bind(const gw_automation_snapshot_t *snap)
+{
+    size_t unbound = 0;
+    s_index_count = 0;
+    for (size_t i = 0; i < snap->count; i++) {
+        const gw_automation_entry_t *entry = &snap->items[i];
         if (!entry->enabled) continue;
+        for (uint8_t ti = 0; ti < entry->triggers_count; ti++) {
+            const uint8_t evt_type = entry->triggers[ti].event_type;
+            if (evt_type == GW_AUTO_EVT_INTERVAL || evt_type == GW_AUTO_EVT_STATE) continue;
+            trig_index_entry_t *ie = &s_index[s_index_count];
+            if (!trigger_bind(entry, &entry->triggers[ti], ie)) {
+                unbound++;
+                continue;
+            }
+            ie->auto_idx = (uint16_t)i;
+            ie->trig_idx = ti;
+            s_index_count++;
+        }
+    }
+    qsort(s_index, s_index_count, sizeof(s_index[0]), trig_index_cmp);
+    return unbound;
+}
 
-        bool matched = false;
+// A device got a handle while some trigger, watch or condition of the current snapshot still
+// waited for one: binds those in place. Waiting runs, debounce windows, throttle stamps and
+// interval phases are kept; only automations with a newly bound condition re-evaluate.
+static void automations_rebind(void)
+{
+    size_t unbound = index_bind(s_snap);
+    for (size_t i = 0; i < s_rt_count; i++) {
+        const gw_automation_entry_t *entry = &s_snap->items[i];
+        auto_rt_t *rt = &s_rt[i];
+        for (uint8_t ti = 0; rt->unbound_watch && ti < entry->triggers_count; ti++) {
+            const uint8_t bit = (uint8_t)(1u << ti);
+            if (!(rt->unbound_watch & bit)) continue;
+            if (watch_bind(entry, &entry->triggers[ti], (uint16_t)i)) rt->unbound_watch &= (uint8_t)~bit;
+            else unbound++;
+        }
+        for (uint8_t ci = 0; ci < rt->cond_count; ci++) {
+            cond_bound_t *co = &s_conds[rt->cond_base + ci];
+            if (co->dev != GW_DEV_HANDLE_INVALID) continue;
+            if (condition_bind(entry, &entry->conditions[ci], co)) rt->cond_state = COND_DIRTY;
+            else unbound++;
+        }
+    }
+    conditions_index(s_rt_count);
+    s_unbound = unbound;
+    ESP_LOGI(TAG, "triggers rebound (v%u): %u triggers, %u unbound", (unsigned)s_snap->version,
+             (unsigned)s_index_count, (unsigned)s_unbound);
+}
+
+static void automations_refresh(void)
+{
+    const gw_automation_snapshot_t *snap = gw_automation_store_snapshot_acquire();
+    if (!snap) return;
+    const uint32_t handle_gen = gw_device_registry_handle_gen();
+    const uint32_t release_gen = gw_device_registry_handle_release_gen();
+    if (snap == s_snap && release_gen == s_release_gen) {
+        gw_automation_store_snapshot_release(snap);
+        if (s_unbound && handle_gen != s_handle_gen) {
+            s_handle_gen = handle_gen;
+            automations_rebind();
+        }
+        return;
+    }
+
+    gw_automation_store_snapshot_release(s_snap);
+    s_snap = snap;
+    s_handle_gen = handle_gen;
+    s_release_gen = release_gen;
+    automations_reset();
+
+    size_t trig_total = 0;
+    size_t interval_total = 0;
+    for (size_t i = 0; i < snap->count; i++) {
+        if (!snap->items[i].enabled) continue;
+        trig_total += snap->items[i].triggers_count;
+        for (uint8_t ti = 0; ti < snap->items[i].triggers_count; ti++) {
+            if (snap->items[i].triggers[ti].event_type == GW_AUTO_EVT_INTERVAL) interval_total++;
+        }
+    }
+    if (trig_total == 0) return;
+
+    s_rt = (auto_rt_t *)calloc(snap->count, sizeof(auto_rt_t));
+    s_index = (trig_index_entry_t *)calloc(trig_total, sizeof(trig_index_entry_t));
+    s_intervals = interval_total ? (interval_t *)calloc(interval_total, sizeof(interval_t)) : NULL;
+    if (!s_rt || !s_index || (interval_total && !s_intervals) || !conditions_build(snap)) {
+        ESP_LOGE(TAG, "Failed to allocate trigger index");
+        automations_reset();
+        // Drop the reference so the next event retries the build.
+        gw_automation_store_snapshot_release(s_snap);
+        s_snap = NULL;
+        return;
+    }
+
+    s_rt_count = snap->count;
+    for (size_t i = 0; i < snap->count; i++) {
+        s_rt[i].next_action = RUN_IDLE;
+        gw_timer_init(&s_rt[i].delay, on_delay_done, (void *)(uintptr_t)i);
+        gw_timer_init(&s_rt[i].debounce, on_debounce_done, (void *)(uintptr_t)i);
+    }
+
+    for (size_t i = 0; i < snap->count; i++) {
+        const gw_automation_entry_t *entry = &snap->items[i];
+        if (!entry->enabled) continue;
         for (uint8_t ti = 0; ti < entry->triggers_count; ti++) {
-            if (trigger_matches(entry, &entry->triggers[ti], evt_type, e, &pv)) {
-                matched = true;
-                break;
+            if (entry->triggers[ti].event_type == GW_AUTO_EVT_INTERVAL) {
+                interval_t *iv = &s_intervals[s_interval_count++];
+                iv->every_ms = entry->triggers[ti].interval_ms;
+                iv->auto_idx = (uint16_t)i;
+                gw_timer_init(&iv->timer, on_interval, iv);
+                gw_timer_arm(s_wheel, &iv->timer, iv->every_ms);
+                continue;
+            }
+            if (entry->triggers[ti].event_type == GW_AUTO_EVT_STATE &&
+                !watch_bind(entry, &entry->triggers[ti], (uint16_t)i)) {
+                s_rt[i].unbound_watch |= (uint8_t)(1u << ti);
+                s_unbound++;
             }
         }
-        if (!matched) continue;
-        if (!conditions_pass(entry)) continue;
+    }
+    s_unbound += index_bind(snap);
+    ESP_LOGI(TAG, "trigger index rebuilt (v%u): %u automations, %u triggers, %u intervals, %u unbound",
+             (unsigned)snap->version, (unsigned)snap->count, (unsigned)s_index_count, (unsigned)s_interval_count,
+             (unsigned)s_unbound);
+}
 
-        publish_rules_fired(e, entry->id);
+static size_t trig_index_lower_bound(uint32_t key)
+{
+    size_t lo = 0, hi = s_index_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s_index[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-        for (uint8_t ai = 0; ai < entry->actions_count; ai++) {
-            char errbuf[96] = {0};
-            // This function needs to be adapted or wrapped to work with gw_automation_entry_t
-            // For now, let's assume a wrapper exists. We will need to create it.
-            // esp_err_t rc = gw_action_exec_compiled(c, &acts[ai], errbuf, sizeof(errbuf));
-            // Let's create a temporary compatible structure for gw_action_exec_compiled
-            gw_auto_compiled_t temp_compiled = {
-                .strings = (char*)entry->string_table,
-                .hdr.strings_size = entry->string_table_size
-            };
-
-            esp_err_t rc = gw_action_exec_compiled(&temp_compiled, &entry->actions[ai], errbuf, sizeof(errbuf));
-            if (rc != ESP_OK) {
-                publish_rules_action(entry->id, ai, false, errbuf[0] ? errbuf : "exec failed");
-                break; // Stop actions on first failure for this rule
+static void collect_candidates(uint32_t key, gw_dev_handle_t dev, uint16_t sub, const gw_event_data_t *d, uint16_t *matched, size_t *matched_count)
+{
+    for (size_t i = trig_index_lower_bound(key); i < s_index_count && s_index[i].key == key; i++) {
+        const trig_index_entry_t *ie = &s_index[i];
+        if (s_rt[ie->auto_idx].seen == s_seen_stamp) continue;
+        if (!trigger_matches(ie, dev, sub, d)) continue;
+        s_rt[ie->auto_idx].seen = s_seen_stamp;
+        matched[(*matched_count)++] = ie->auto_idx;
+    }
+}
+
+static void next_seen_stamp(void)
+{
+    if (++s_seen_stamp == 0) {
+        for (size_t i = 0; i < s_snap->count; i++) s_rt[i].seen = 0;
+        s_seen_stamp = 1;
+    }
+}
+
+static void sort_matched(uint16_t *matched, size_t count)
+{
+    for (size_t i = 1; i < count; i++) {
+        uint16_t v = matched[i];
+        size_t j = i;
+        while (j > 0 && matched[j - 1] > v) {
+            matched[j] = matched[j - 1];
+            j--;
+        }
+        matched[j] = v;
+    }
+}
+
+static void process_event(const gw_event_t *e)
+{
+    if (!e || !e->type[0] || strcmp(e->source, "rules") == 0) return;
+
+    const gw_event_data_t *d = &e->data;
+    const gw_auto_evt_type_t evt_type = (gw_auto_evt_type_t)d->evt_type;
+    if (!evt_type) return;
+
+    // Resolve the event's device once (assigning a handle if it is new, so the refresh below can
+    // bind triggers that were waiting for it); everything after this compares integers.
+    gw_dev_handle_t dev = GW_DEV_HANDLE_INVALID;
+    if (e->device_uid[0]) {
+        gw_device_uid_t uid = {0};
+        strlcpy(uid.uid, e->device_uid, sizeof(uid.uid));
+        dev = gw_device_registry_handle(&uid);
+    }
+
+    automations_refresh();
+    if (s_index_count == 0) return;
+
+    // Probe specific and "any" variants of each indexed field.
+    const gw_dev_handle_t devs[2] = {GW_DEV_HANDLE_INVALID, dev};
+    const size_t dev_n = dev != GW_DEV_HANDLE_INVALID ? 2 : 1;
+    const uint16_t sub = event_sub(d);
+    uint16_t clusters[2] = {0, 0};
+    const uint16_t subs[2] = {0, sub};
+    size_t cluster_n = 1;
+    const size_t sub_n = sub ? 2 : 1;
+    if ((evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND || evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) &&
+        (d->flags & GW_EVENT_DATA_HAS_CLUSTER) && d->cluster_id) {
+        clusters[cluster_n++] = d->cluster_id;
+    }
+
+    uint16_t matched[GW_AUTOMATION_CAP];
+    size_t matched_count = 0;
+    next_seen_stamp();
+    for (size_t u = 0; u < dev_n; u++) {
+        for (size_t c = 0; c < cluster_n; c++) {
+            for (size_t k = 0; k < sub_n; k++) {
+                collect_candidates(trig_key((uint8_t)evt_type, devs[u], clusters[c], subs[k]), dev, sub, d, matched, &matched_count);
             }
-            publish_rules_action(entry->id, ai, true, NULL);
         }
     }
 
-    if (payload) cJSON_Delete(payload);
-    free(all_autos);
+    // Preserve store order when several rules fire on the same event.
+    sort_matched(matched, matched_count);
+    if (matched_count) conditions_drain_dirty();
+    for (size_t i = 0; i < matched_count; i++) {
+        on_trigger(matched[i], dev, e->short_addr);
+    }
+}
+
+// Runs the automations whose state watches fired since the last call. An automation is run once
+// per pass even if several of its watches fired; rules.fired names the device of the first one.
+static void process_state_triggers(void)
+{
+    bool pending = false;
+    for (size_t w = 0; w < WATCH_WORDS && !pending; w++) {
+        pending = atomic_load_explicit(&s_watch_pending[w], memory_order_relaxed) != 0;
+    }
+    if (!pending) return;
+
+    // A rebuild here clears the pending bits along with the watches they refer to.
+    automations_refresh();
+    if (!s_rt) return;
+
+    uint16_t matched[GW_AUTOMATION_CAP];
+    gw_dev_handle_t fired_dev[GW_AUTOMATION_CAP];
+    size_t matched_count = 0;
+    next_seen_stamp();
+    for (size_t w = 0; w < WATCH_WORDS; w++) {
+        uint32_t bits = atomic_exchange(&s_watch_pending[w], 0);
+        while (bits) {
+            const size_t id = w * 32 + (size_t)__builtin_ctz(bits);
+            bits &= bits - 1;
+            // Bits set by a replaced build carry its generation (or none once consumed); drop them.
+            const uint32_t fired_gen = atomic_exchange(&s_watch_fired_gen[id], 0);
+            const uint16_t auto_idx = s_watch_auto[id];
+            if (fired_gen != atomic_load(&s_watch_gen) || auto_idx >= s_rt_count) continue;
+            if (s_rt[auto_idx].seen == s_seen_stamp) continue;
+            s_rt[auto_idx].seen = s_seen_stamp;
+            fired_dev[auto_idx] = s_watch_dev[id];
+            matched[matched_count++] = auto_idx;
+        }
+    }
+
+    sort_matched(matched, matched_count);
+    if (matched_count) conditions_drain_dirty();
+    for (size_t i = 0; i < matched_count; i++) {
+        on_trigger(matched[i], fired_dev[matched[i]], 0);
+    }
 }
 
 static void rules_task(void *arg)
 {
     gw_event_t e;
     for (;;) {
-        if (xQueueReceive(s_q, &e, portMAX_DELAY) == pdTRUE) {
+        // ESP_ERR_TIMEOUT here means a state watch or the timer wheel woke us.
+        if (gw_event_bus_consumer_read(s_consumer, &e, portMAX_DELAY) == ESP_OK) {
             process_event(&e);
         }
+        // Arms new intervals and drops timers of removed or disabled automations right away.
+        automations_refresh();
+        process_state_triggers();
+        // Fires due timers and re-aims the wheel's esp_timer at whatever was armed above.
+        gw_timer_wheel_run(s_wheel);
     }
 }
 
-static void rules_event_listener(const gw_event_t *event, void *user_ctx)
+// esp_timer task: a timer is due, let rules_task run the wheel.
+static void wheel_wake(void *ctx)
 {
-    if (s_inited && s_q && event) {
-        if (xQueueSend(s_q, event, 0) != pdTRUE) {
-            ESP_LOGW(TAG, "rules event queue overflow");
-        }
-    }
+    (void)ctx;
+    gw_event_bus_consumer_wake(s_consumer);
 }
 
 esp_err_t gw_rules_init(void)
 {
     if (s_inited) return ESP_OK;
 
-    s_q = xQueueCreate(16, sizeof(gw_event_t));
-    if (!s_q) return ESP_ERR_NO_MEM;
+    // Events are read straight from the bus ring; no per-engine queue.
+    esp_err_t err = gw_event_bus_consumer_open("rules", &s_consumer);
+    if (err != ESP_OK) return err;
+
+    // Only trigger-capable event types and automation edits wake the rules task; the latter make
+    // it pick up the new snapshot even when no Zigbee traffic follows.
+    static const char *const trigger_types[] = {
+        "zigbee.command",
+        "zigbee.attr_report",
+        "device.join",
+        "device.leave",
+        "automation_saved",
+        "automation_removed",
+        "automation_enabled",
+    };
+    const gw_event_filter_t filter = {
+        .types = trigger_types,
+        .type_count = sizeof(trigger_types) / sizeof(trigger_types[0]),
+    };
+    err = gw_event_bus_consumer_set_filter(s_consumer, &filter);
+    if (!s_wheel && err == ESP_OK) {
+        err = gw_timer_wheel_create("rules", wheel_wake, NULL, &s_wheel);
+    }
+    if (err != ESP_OK) {
+        gw_event_bus_consumer_close(s_consumer);
+        s_consumer = NULL;
+        return err;
+    }
+
+    // Condition results are cached; state changes only mark the dependent automations dirty.
+    err = gw_state_store_add_listener(on_state_change, NULL);
+    if (err != ESP_OK) {
+        gw_event_bus_consumer_close(s_consumer);
+        s_consumer = NULL;
+        return err;
+    }
 
     if (xTaskCreate(rules_task, "rules", 4096, NULL, 5, &s_task) != pdPASS) {
-        vQueueDelete(s_q);
+        gw_state_store_remove_listener(on_state_change, NULL);
+        gw_event_bus_consumer_close(s_consumer);
+        s_consumer = NULL;
         return ESP_FAIL;
     }
 
-    gw_event_bus_add_listener(rules_event_listener, NULL);
-
     s_inited = true;
     ESP_LOGI(TAG, "rules engine initialized");
     return ESP_OK;
@@ -3,21 +3,15 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "gw_core/device_registry.h"
+
 static bool s_inited;
 static gw_sensor_value_t s_vals[GW_SENSOR_MAX_VALUES];
 static size_t s_val_count;
 
-static bool uid_equals(const gw_device_uid_t *a, const gw_device_uid_t *b)
-{
-    if (a == NULL || b == NULL) {
-        return false;
-    }
-    return strncmp(a->uid, b->uid, sizeof(a->uid)) == 0;
-}
-
 static bool key_equals(const gw_sensor_value_t *a, const gw_sensor_value_t *b)
 {
-    return uid_equals(&a->uid, &b->uid) && a->endpoint == b->endpoint && a->cluster_id == b->cluster_id && a->attr_id == b->attr_id;
+    return a->dev == b->dev && a->endpoint == b->endpoint && a->cluster_id == b->cluster_id && a->attr_id == b->attr_id;
 }
 
 esp_err_t gw_sensor_store_init(void)
@@ -34,9 +28,15 @@ esp_err_t gw_sensor_store_upsert(const gw_sensor_value_t *v)
         return ESP_ERR_INVALID_ARG;
     }
 
+    gw_sensor_value_t tmp = *v;
+    tmp.dev = gw_device_registry_handle(&v->uid);
+    if (tmp.dev == GW_DEV_HANDLE_INVALID) {
+        return ESP_ERR_NO_MEM;
+    }
+
     for (size_t i = 0; i < s_val_count; i++) {
-        if (key_equals(&s_vals[i], v)) {
-            s_vals[i] = *v;
+        if (key_equals(&s_vals[i], &tmp)) {
+            s_vals[i] = tmp;
             return ESP_OK;
         }
     }
@@ -45,19 +45,35 @@ esp_err_t gw_sensor_store_upsert(const gw_sensor_value_t *v)
         return ESP_ERR_NO_MEM;
     }
 
-    s_vals[s_val_count++] = *v;
+    s_vals[s_val_count++] = tmp;
     return ESP_OK;
 }
 
-size_t gw_sensor_store_list(const gw_device_uid_t *uid, gw_sensor_value_t *out, size_t max_out)
+void gw_sensor_store_drop_dev(gw_dev_handle_t dev)
+{
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID) {
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < s_val_count; i++) {
+        if (s_vals[i].dev != dev) {
+            s_vals[kept++] = s_vals[i];
+        }
+    }
+    memset(&s_vals[kept], 0, (s_val_count - kept) * sizeof(s_vals[0]));
+    s_val_count = kept;
+}
+
+size_t gw_sensor_store_list(gw_dev_handle_t dev, gw_sensor_value_t *out, size_t max_out)
 {
-    if (!s_inited || uid == NULL || out == NULL || max_out == 0) {
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID || out == NULL || max_out == 0) {
         return 0;
     }
 
     size_t written = 0;
     for (size_t i = 0; i < s_val_count && written < max_out; i++) {
-        if (uid_equals(&s_vals[i].uid, uid)) {
+        if (s_vals[i].dev == dev) {
             out[written++] = s_vals[i];
         }
     }
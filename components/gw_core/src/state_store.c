@@ -6,53 +6,205 @@
 #include "freertos/FreeRTOS.h"
 
 static bool s_inited;
-static gw_state_item_t s_items[GW_STATE_MAX_ITEMS];
-static size_t s_item_count;
 static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
 
-static bool uid_equals(const gw_device_uid_t *a, const gw_device_uid_t *b)
+// Items live in fixed slots stored as parallel arrays, so a per-device scan only walks s_dev[].
+// A (device handle, key id) -> slot open-addressing table gives O(1) get/set,
+// and a doubly-linked LRU list (most recently updated first) gives O(1) eviction.
+#define GW_STATE_HASH_CAP (GW_STATE_MAX_ITEMS * 2) // power of two, load factor <= 0.5
+#define SLOT_NIL 0xFFFFu
+
+_Static_assert((GW_STATE_HASH_CAP & (GW_STATE_HASH_CAP - 1)) == 0, "GW_STATE_HASH_CAP must be a power of two");
+_Static_assert(GW_STATE_MAX_ITEMS < SLOT_NIL, "slot index must fit in uint16_t");
+
+static gw_dev_handle_t s_dev[GW_STATE_MAX_ITEMS];
+static gw_state_key_t s_key[GW_STATE_MAX_ITEMS];
+static uint8_t s_type[GW_STATE_MAX_ITEMS];
+static gw_state_value_t s_val[GW_STATE_MAX_ITEMS];
+static uint64_t s_ts[GW_STATE_MAX_ITEMS];
+static uint32_t s_ver[GW_STATE_MAX_ITEMS];
+static uint16_t s_prev[GW_STATE_MAX_ITEMS]; // LRU: more recently updated
+static uint16_t s_next[GW_STATE_MAX_ITEMS]; // LRU: less recently updated
+static size_t s_item_count;
+static uint16_t s_hash[GW_STATE_HASH_CAP]; // slot index + 1, 0 = empty
+static uint16_t s_lru_head = SLOT_NIL;
+static uint16_t s_lru_tail = SLOT_NIL;
+static uint32_t s_version; // bumped on every insert / value change / removal
+
+// Removed items, so deltas can report them: a ring of the last GW_STATE_REMOVED_LOG removals.
+// s_removed_floor is the version of the newest removal that fell off the ring.
+#define GW_STATE_REMOVED_LOG 32
+
+typedef struct {
+    gw_dev_handle_t dev;
+    gw_state_key_t key;
+    uint32_t version;
+} removed_t;
+
+static removed_t s_removed[GW_STATE_REMOVED_LOG];
+static size_t s_removed_next;
+static uint32_t s_removed_floor;
+
+// Key registry; the id is the index. Built-ins are fixed, the rest are interned on demand.
+static char s_keys[GW_STATE_KEY_CAP][GW_STATE_KEY_MAX] = {
+    [GW_STATE_KEY_ONOFF] = "onoff",
+    [GW_STATE_KEY_TEMPERATURE_C] = "temperature_c",
+    [GW_STATE_KEY_HUMIDITY_PCT] = "humidity_pct",
+    [GW_STATE_KEY_BATTERY_PCT] = "battery_pct",
+    [GW_STATE_KEY_LAST_SEEN_MS] = "last_seen_ms",
+};
+static size_t s_key_count = GW_STATE_KEY_BUILTIN_COUNT;
+static portMUX_TYPE s_key_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    gw_state_listener_t cb;
+    void *ctx;
+} listener_t;
+
+static listener_t s_listeners[GW_STATE_LISTENER_CAP];
+static portMUX_TYPE s_listener_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    gw_state_watch_t w;
+    gw_state_watch_cb_t cb; // NULL = free
+    void *ctx;
+    int8_t armed; // ABOVE/BELOW: 1 armed, 0 fired (waiting to re-arm), -1 no value seen yet
+} watch_t;
+
+// Guarded by s_lock. Watches are chained per (dev, key) bucket in id order (id + 1, 0 = end), so a
+// set only looks at the watches of its own bucket, however many are registered.
+#define WATCH_BUCKETS 256
+#define WATCH_FIRE_MAX 8 // callbacks one set can trigger; more watches on one slot are not reported
+
+_Static_assert(GW_STATE_WATCH_CAP < 256, "watch id + 1 must fit in uint8_t");
+
+static watch_t s_watches[GW_STATE_WATCH_CAP];
+static uint8_t s_watch_head[WATCH_BUCKETS];
+static uint8_t s_watch_next[GW_STATE_WATCH_CAP];
+
+typedef struct {
+    gw_state_watch_cb_t cb;
+    void *ctx;
+    uint16_t id;
+} watch_fire_t;
+
+static gw_state_key_t key_find_locked(const char *name)
 {
-    if (a == NULL || b == NULL) {
-        return false;
+    for (size_t i = 1; i < s_key_count; i++) {
+        if (strncmp(s_keys[i], name, GW_STATE_KEY_MAX) == 0) {
+            return (gw_state_key_t)i;
+        }
     }
-    return strncmp(a->uid, b->uid, sizeof(a->uid)) == 0;
+    return GW_STATE_KEY_INVALID;
 }
 
-static bool key_equals(const char *a, const char *b)
+gw_state_key_t gw_state_key_from_name(const char *name)
 {
-    if (a == NULL || b == NULL) {
-        return false;
+    if (name == NULL || name[0] == '\0') {
+        return GW_STATE_KEY_INVALID;
+    }
+    portENTER_CRITICAL(&s_key_lock);
+    gw_state_key_t key = key_find_locked(name);
+    portEXIT_CRITICAL(&s_key_lock);
+    return key;
+}
+
+gw_state_key_t gw_state_key_intern(const char *name)
+{
+    if (name == NULL || name[0] == '\0' || strlen(name) >= GW_STATE_KEY_MAX) {
+        return GW_STATE_KEY_INVALID;
     }
-    return strncmp(a, b, GW_STATE_KEY_MAX) == 0;
+    portENTER_CRITICAL(&s_key_lock);
+    gw_state_key_t key = key_find_locked(name);
+    if (key == GW_STATE_KEY_INVALID && s_key_count < GW_STATE_KEY_CAP) {
+        strlcpy(s_keys[s_key_count], name, GW_STATE_KEY_MAX);
+        key = (gw_state_key_t)s_key_count++;
+    }
+    portEXIT_CRITICAL(&s_key_lock);
+    return key;
 }
 
-static size_t find_idx_locked(const gw_device_uid_t *uid, const char *key)
+const char *gw_state_key_name(gw_state_key_t key)
 {
-    if (uid == NULL || key == NULL || key[0] == '\0') {
-        return (size_t)-1;
+    // Names are written once before their id is handed out, so reading needs no lock.
+    if (key == GW_STATE_KEY_INVALID || key >= GW_STATE_KEY_CAP) {
+        return "";
     }
-    for (size_t i = 0; i < s_item_count; i++) {
-        if (uid_equals(&s_items[i].uid, uid) && key_equals(s_items[i].key, key)) {
-            return i;
+    return s_keys[key];
+}
+
+// murmur3 fmix32: every output bit depends on every input bit, so the table index (low bits)
+// and the watch bucket (top byte) both spread over the whole device handle.
+static uint32_t item_hash(gw_dev_handle_t dev, gw_state_key_t key)
+{
+    uint32_t h = ((uint32_t)dev << 8) | key;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Returns the slot holding (dev, key) or SLOT_NIL; *out_pos gets the table position
+// of the match, or of the empty bucket where it would be inserted.
+static uint16_t find_slot_locked(uint32_t hash, gw_dev_handle_t dev, gw_state_key_t key, size_t *out_pos)
+{
+    size_t pos = hash & (GW_STATE_HASH_CAP - 1);
+    while (s_hash[pos] != 0) {
+        const uint16_t slot = (uint16_t)(s_hash[pos] - 1);
+        if (s_dev[slot] == dev && s_key[slot] == key) {
+            if (out_pos) *out_pos = pos;
+            return slot;
         }
+        pos = (pos + 1) & (GW_STATE_HASH_CAP - 1);
     }
-    return (size_t)-1;
+    if (out_pos) *out_pos = pos;
+    return SLOT_NIL;
 }
 
-static size_t find_oldest_idx_locked(void)
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void hash_remove_locked(uint16_t slot)
 {
-    if (s_item_count == 0) {
-        return (size_t)-1;
+    const size_t mask = GW_STATE_HASH_CAP - 1;
+    size_t i = item_hash(s_dev[slot], s_key[slot]) & mask;
+    while (s_hash[i] != slot + 1) {
+        i = (i + 1) & mask;
     }
-    size_t oldest = 0;
-    uint64_t oldest_ts = s_items[0].ts_ms;
-    for (size_t i = 1; i < s_item_count; i++) {
-        if (s_items[i].ts_ms < oldest_ts) {
-            oldest = i;
-            oldest_ts = s_items[i].ts_ms;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (s_hash[j] == 0) {
+            break;
+        }
+        const uint16_t other = (uint16_t)(s_hash[j] - 1);
+        const size_t home = item_hash(s_dev[other], s_key[other]) & mask;
+        // Move j back into the hole unless its home lies cyclically in (i, j].
+        const bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            s_hash[i] = s_hash[j];
+            i = j;
         }
     }
-    return oldest;
+    s_hash[i] = 0;
+}
+
+static void lru_unlink_locked(uint16_t slot)
+{
+    if (s_prev[slot] != SLOT_NIL) s_next[s_prev[slot]] = s_next[slot];
+    else s_lru_head = s_next[slot];
+    if (s_next[slot] != SLOT_NIL) s_prev[s_next[slot]] = s_prev[slot];
+    else s_lru_tail = s_prev[slot];
+    s_prev[slot] = s_next[slot] = SLOT_NIL;
+}
+
+static void lru_push_front_locked(uint16_t slot)
+{
+    s_prev[slot] = SLOT_NIL;
+    s_next[slot] = s_lru_head;
+    if (s_lru_head != SLOT_NIL) s_prev[s_lru_head] = slot;
+    s_lru_head = slot;
+    if (s_lru_tail == SLOT_NIL) s_lru_tail = slot;
 }
 
 esp_err_t gw_state_store_init(void)
@@ -60,129 +212,511 @@ esp_err_t gw_state_store_init(void)
     portENTER_CRITICAL(&s_lock);
     s_inited = true;
     s_item_count = 0;
-    memset(s_items, 0, sizeof(s_items));
+    s_lru_head = SLOT_NIL;
+    s_lru_tail = SLOT_NIL;
+    s_version = 0;
+    s_removed_next = 0;
+    s_removed_floor = 0;
+    memset(s_removed, 0, sizeof(s_removed));
+    memset(s_dev, 0, sizeof(s_dev));
+    memset(s_key, 0, sizeof(s_key));
+    memset(s_hash, 0, sizeof(s_hash));
     portEXIT_CRITICAL(&s_lock);
     return ESP_OK;
 }
 
-static esp_err_t upsert_item(const gw_state_item_t *item)
+static void write_slot_locked(uint16_t slot, const gw_state_item_t *item)
+{
+    s_dev[slot] = item->dev;
+    s_key[slot] = item->key;
+    s_type[slot] = item->value_type;
+    s_val[slot] = item->value;
+    s_ts[slot] = item->ts_ms;
+    s_ver[slot] = item->version;
+}
+
+static void read_slot_locked(uint16_t slot, gw_state_item_t *out)
+{
+    out->dev = s_dev[slot];
+    out->key = s_key[slot];
+    out->value_type = s_type[slot];
+    out->value = s_val[slot];
+    out->ts_ms = s_ts[slot];
+    out->version = s_ver[slot];
+}
+
+static bool value_equal_locked(uint16_t slot, const gw_state_item_t *item)
+{
+    if (s_type[slot] != item->value_type) {
+        return false;
+    }
+    switch (item->value_type) {
+    case GW_STATE_VALUE_BOOL:
+        return s_val[slot].b == item->value.b;
+    case GW_STATE_VALUE_F32:
+        return s_val[slot].f32 == item->value.f32;
+    case GW_STATE_VALUE_U32:
+        return s_val[slot].u32 == item->value.u32;
+    case GW_STATE_VALUE_U64:
+        return s_val[slot].u64 == item->value.u64;
+    default:
+        return false;
+    }
+}
+
+static uint8_t watch_bucket(gw_dev_handle_t dev, gw_state_key_t key)
+{
+    return (uint8_t)(item_hash(dev, key) >> 24);
+}
+
+static double item_number(uint8_t type, const gw_state_value_t *v)
+{
+    switch (type) {
+    case GW_STATE_VALUE_BOOL:
+        return v->b ? 1.0 : 0.0;
+    case GW_STATE_VALUE_F32:
+        return v->f32;
+    case GW_STATE_VALUE_U32:
+        return v->u32;
+    case GW_STATE_VALUE_U64:
+        return (double)v->u64;
+    default:
+        return 0;
+    }
+}
+
+// Updates the arming state for value v; true if the watch fires.
+static bool watch_step(watch_t *wt, double v, bool inserted)
+{
+    const double th = wt->w.threshold;
+    const double hyst = wt->w.hysteresis;
+    switch (wt->w.kind) {
+    case GW_STATE_WATCH_CHANGE:
+        return !inserted;
+    case GW_STATE_WATCH_ABOVE:
+        if (v > th) {
+            const bool fire = wt->armed == 1;
+            wt->armed = 0;
+            return fire;
+        }
+        if (v <= th - hyst || wt->armed < 0) wt->armed = 1;
+        return false;
+    case GW_STATE_WATCH_BELOW:
+        if (v < th) {
+            const bool fire = wt->armed == 1;
+            wt->armed = 0;
+            return fire;
+        }
+        if (v >= th + hyst || wt->armed < 0) wt->armed = 1;
+        return false;
+    default:
+        return false;
+    }
+}
+
+static size_t watches_eval_locked(const gw_state_item_t *item, bool inserted, watch_fire_t *fire)
+{
+    size_t n = 0;
+    for (uint8_t id = s_watch_head[watch_bucket(item->dev, item->key)]; id != 0; id = s_watch_next[id - 1]) {
+        watch_t *wt = &s_watches[id - 1];
+        if (wt->w.dev != item->dev || wt->w.key != item->key) continue;
+        if (watch_step(wt, item_number(item->value_type, &item->value), inserted) && n < WATCH_FIRE_MAX) {
+            fire[n++] = (watch_fire_t){.cb = wt->cb, .ctx = wt->ctx, .id = (uint16_t)(id - 1)};
+        }
+    }
+    return n;
+}
+
+// The slot left the store: its ABOVE/BELOW watches arm again from the next value, as if just added.
+static void watches_forget_locked(gw_dev_handle_t dev, gw_state_key_t key)
+{
+    for (uint8_t id = s_watch_head[watch_bucket(dev, key)]; id != 0; id = s_watch_next[id - 1]) {
+        watch_t *wt = &s_watches[id - 1];
+        if (wt->w.dev == dev && wt->w.key == key) {
+            wt->armed = -1;
+        }
+    }
+}
+
+static void watch_link_locked(uint8_t id)
+{
+    uint8_t *link = &s_watch_head[watch_bucket(s_watches[id].w.dev, s_watches[id].w.key)];
+    while (*link != 0 && *link - 1 < id) {
+        link = &s_watch_next[*link - 1];
+    }
+    s_watch_next[id] = *link;
+    *link = (uint8_t)(id + 1);
+}
+
+static void watch_unlink_locked(uint8_t id)
 {
-    if (!s_inited || item == NULL || item->uid.uid[0] == '\0' || item->key[0] == '\0') {
+    uint8_t *link = &s_watch_head[watch_bucket(s_watches[id].w.dev, s_watches[id].w.key)];
+    while (*link != id + 1) {
+        link = &s_watch_next[*link - 1];
+    }
+    *link = s_watch_next[id];
+    s_watch_next[id] = 0;
+}
+
+static void removed_log_locked(const gw_state_item_t *item)
+{
+    for (size_t i = 0; i < GW_STATE_REMOVED_LOG; i++) {
+        if (s_removed[i].dev == item->dev && s_removed[i].key == item->key) {
+            s_removed[i].version = 0; // superseded; a delta reports each key once
+        }
+    }
+    removed_t *r = &s_removed[s_removed_next];
+    if (r->version > s_removed_floor) {
+        s_removed_floor = r->version;
+    }
+    *r = (removed_t){.dev = item->dev, .key = item->key, .version = item->version};
+    s_removed_next = (s_removed_next + 1) % GW_STATE_REMOVED_LOG;
+}
+
+static void notify_listeners(const gw_state_item_t *item)
+{
+    listener_t ls[GW_STATE_LISTENER_CAP];
+    portENTER_CRITICAL(&s_listener_lock);
+    memcpy(ls, s_listeners, sizeof(ls));
+    portEXIT_CRITICAL(&s_listener_lock);
+    for (size_t i = 0; i < GW_STATE_LISTENER_CAP; i++) {
+        if (ls[i].cb) {
+            ls[i].cb(item, ls[i].ctx);
+        }
+    }
+}
+
+static esp_err_t upsert_item(gw_state_item_t *item)
+{
+    if (!s_inited || item == NULL || item->dev == GW_DEV_HANDLE_INVALID || item->key == GW_STATE_KEY_INVALID) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    const uint32_t hash = item_hash(item->dev, item->key);
+    watch_fire_t fire[WATCH_FIRE_MAX];
+    size_t fire_count = 0;
     portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(&item->uid, item->key);
-    if (idx != (size_t)-1) {
-        s_items[idx] = *item;
+    size_t pos = 0;
+    uint16_t slot = find_slot_locked(hash, item->dev, item->key, &pos);
+    if (slot != SLOT_NIL) {
+        const bool changed = !value_equal_locked(slot, item);
+        item->version = changed ? ++s_version : s_ver[slot];
+        write_slot_locked(slot, item);
+        lru_unlink_locked(slot);
+        lru_push_front_locked(slot);
+        if (changed) {
+            fire_count = watches_eval_locked(item, false, fire);
+        }
         portEXIT_CRITICAL(&s_lock);
+        if (changed) {
+            notify_listeners(item);
+        }
+        for (size_t i = 0; i < fire_count; i++) {
+            fire[i].cb(fire[i].id, item, fire[i].ctx);
+        }
         return ESP_OK;
     }
 
-    if (s_item_count < (sizeof(s_items) / sizeof(s_items[0]))) {
-        s_items[s_item_count++] = *item;
-        portEXIT_CRITICAL(&s_lock);
-        return ESP_OK;
+    gw_state_item_t evicted = {0};
+    if (s_item_count < GW_STATE_MAX_ITEMS) {
+        slot = (uint16_t)s_item_count++;
+    } else {
+        // Evict the least recently updated item (bounded memory).
+        slot = s_lru_tail;
+        read_slot_locked(slot, &evicted);
+        evicted.value_type = GW_STATE_VALUE_NONE;
+        evicted.version = ++s_version;
+        watches_forget_locked(evicted.dev, evicted.key);
+        removed_log_locked(&evicted);
+        hash_remove_locked(slot);
+        lru_unlink_locked(slot);
+        (void)find_slot_locked(hash, item->dev, item->key, &pos); // removal may have shifted the chain
     }
 
-    // Evict oldest (bounded memory).
-    idx = find_oldest_idx_locked();
-    if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_lock);
-        return ESP_ERR_NO_MEM;
-    }
-    s_items[idx] = *item;
+    item->version = ++s_version;
+    write_slot_locked(slot, item);
+    s_hash[pos] = (uint16_t)(slot + 1);
+    lru_push_front_locked(slot);
+    fire_count = watches_eval_locked(item, true, fire);
     portEXIT_CRITICAL(&s_lock);
+    if (evicted.dev != GW_DEV_HANDLE_INVALID) {
+        // Cached readers (rule conditions) must not keep a value the store no longer has.
+        notify_listeners(&evicted);
+    }
+    notify_listeners(item);
+    for (size_t i = 0; i < fire_count; i++) {
+        fire[i].cb(fire[i].id, item, fire[i].ctx);
+    }
     return ESP_OK;
 }
 
-esp_err_t gw_state_store_set_bool(const gw_device_uid_t *uid, const char *key, bool value, uint64_t ts_ms)
+esp_err_t gw_state_store_set_bool(gw_dev_handle_t dev, gw_state_key_t key, bool value, uint64_t ts_ms)
 {
-    if (uid == NULL || key == NULL || key[0] == '\0') {
-        return ESP_ERR_INVALID_ARG;
-    }
     gw_state_item_t item = {0};
-    item.uid = *uid;
-    strlcpy(item.key, key, sizeof(item.key));
+    item.dev = dev;
+    item.key = key;
     item.value_type = GW_STATE_VALUE_BOOL;
-    item.value_bool = value;
+    item.value.b = value;
     item.ts_ms = ts_ms;
     return upsert_item(&item);
 }
 
-esp_err_t gw_state_store_set_f32(const gw_device_uid_t *uid, const char *key, float value, uint64_t ts_ms)
+esp_err_t gw_state_store_set_f32(gw_dev_handle_t dev, gw_state_key_t key, float value, uint64_t ts_ms)
 {
-    if (uid == NULL || key == NULL || key[0] == '\0') {
-        return ESP_ERR_INVALID_ARG;
-    }
     gw_state_item_t item = {0};
-    item.uid = *uid;
-    strlcpy(item.key, key, sizeof(item.key));
+    item.dev = dev;
+    item.key = key;
     item.value_type = GW_STATE_VALUE_F32;
-    item.value_f32 = value;
+    item.value.f32 = value;
     item.ts_ms = ts_ms;
     return upsert_item(&item);
 }
 
-esp_err_t gw_state_store_set_u32(const gw_device_uid_t *uid, const char *key, uint32_t value, uint64_t ts_ms)
+esp_err_t gw_state_store_set_u32(gw_dev_handle_t dev, gw_state_key_t key, uint32_t value, uint64_t ts_ms)
 {
-    if (uid == NULL || key == NULL || key[0] == '\0') {
-        return ESP_ERR_INVALID_ARG;
-    }
     gw_state_item_t item = {0};
-    item.uid = *uid;
-    strlcpy(item.key, key, sizeof(item.key));
+    item.dev = dev;
+    item.key = key;
     item.value_type = GW_STATE_VALUE_U32;
-    item.value_u32 = value;
+    item.value.u32 = value;
     item.ts_ms = ts_ms;
     return upsert_item(&item);
 }
 
-esp_err_t gw_state_store_set_u64(const gw_device_uid_t *uid, const char *key, uint64_t value, uint64_t ts_ms)
+esp_err_t gw_state_store_set_u64(gw_dev_handle_t dev, gw_state_key_t key, uint64_t value, uint64_t ts_ms)
 {
-    if (uid == NULL || key == NULL || key[0] == '\0') {
-        return ESP_ERR_INVALID_ARG;
-    }
     gw_state_item_t item = {0};
-    item.uid = *uid;
-    strlcpy(item.key, key, sizeof(item.key));
+    item.dev = dev;
+    item.key = key;
     item.value_type = GW_STATE_VALUE_U64;
-    item.value_u64 = value;
+    item.value.u64 = value;
     item.ts_ms = ts_ms;
     return upsert_item(&item);
 }
 
-esp_err_t gw_state_store_get(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out)
+esp_err_t gw_state_store_get(gw_dev_handle_t dev, gw_state_key_t key, gw_state_item_t *out)
 {
-    if (!s_inited || uid == NULL || key == NULL || key[0] == '\0' || out == NULL) {
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID || key == GW_STATE_KEY_INVALID || out == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
     portENTER_CRITICAL(&s_lock);
-    size_t idx = find_idx_locked(uid, key);
-    if (idx == (size_t)-1) {
+    const uint16_t slot = find_slot_locked(item_hash(dev, key), dev, key, NULL);
+    if (slot == SLOT_NIL) {
         portEXIT_CRITICAL(&s_lock);
         return ESP_ERR_NOT_FOUND;
     }
-    *out = s_items[idx];
+    read_slot_locked(slot, out);
     portEXIT_CRITICAL(&s_lock);
     return ESP_OK;
 }
 
-size_t gw_state_store_list(const gw_device_uid_t *uid, gw_state_item_t *out, size_t max_out)
+size_t gw_state_store_list(gw_dev_handle_t dev, gw_state_item_t *out, size_t max_out)
 {
-    if (!s_inited || uid == NULL || out == NULL || max_out == 0) {
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID || out == NULL || max_out == 0) {
         return 0;
     }
 
     size_t written = 0;
     portENTER_CRITICAL(&s_lock);
     for (size_t i = 0; i < s_item_count && written < max_out; i++) {
-        if (uid_equals(&s_items[i].uid, uid)) {
-            out[written++] = s_items[i];
+        if (s_dev[i] == dev) {
+            read_slot_locked((uint16_t)i, &out[written++]);
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return written;
+}
+
+uint32_t gw_state_store_version(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    const uint32_t v = s_version;
+    portEXIT_CRITICAL(&s_lock);
+    return v;
+}
+
+size_t gw_state_store_changed_since(uint32_t since, size_t *cursor, gw_state_item_t *out, size_t max_out)
+{
+    if (!s_inited || cursor == NULL || out == NULL || max_out == 0) {
+        return 0;
+    }
+
+    size_t written = 0;
+    portENTER_CRITICAL(&s_lock);
+    size_t i = *cursor;
+    for (; i < s_item_count && written < max_out; i++) {
+        if (s_ver[i] > since) {
+            read_slot_locked((uint16_t)i, &out[written++]);
+        }
+    }
+    if (i >= s_item_count && i < GW_STATE_MAX_ITEMS) {
+        i = GW_STATE_MAX_ITEMS; // slots done, continue with the removal log
+    }
+    // A snapshot (since 0) has no use for removals, and an item that is back is reported by its slot.
+    for (; since != 0 && i < GW_STATE_MAX_ITEMS + GW_STATE_REMOVED_LOG && written < max_out; i++) {
+        const removed_t *r = &s_removed[i - GW_STATE_MAX_ITEMS];
+        size_t pos = 0;
+        if (r->version > since && find_slot_locked(item_hash(r->dev, r->key), r->dev, r->key, &pos) == SLOT_NIL) {
+            out[written++] = (gw_state_item_t){.dev = r->dev, .key = r->key, .value_type = GW_STATE_VALUE_NONE, .version = r->version};
         }
     }
     portEXIT_CRITICAL(&s_lock);
+    *cursor = i;
     return written;
 }
 
+// Moves the last slot into the hole at `to`, keeping slots dense for the version walk.
+static void move_last_slot_locked(uint16_t to)
+{
+    const uint16_t from = (uint16_t)s_item_count;
+    size_t pos = 0;
+    (void)find_slot_locked(item_hash(s_dev[from], s_key[from]), s_dev[from], s_key[from], &pos);
+    s_hash[pos] = (uint16_t)(to + 1);
+    gw_state_item_t item;
+    read_slot_locked(from, &item);
+    write_slot_locked(to, &item);
+    s_prev[to] = s_prev[from];
+    s_next[to] = s_next[from];
+    if (s_prev[to] != SLOT_NIL) s_next[s_prev[to]] = to;
+    else s_lru_head = to;
+    if (s_next[to] != SLOT_NIL) s_prev[s_next[to]] = to;
+    else s_lru_tail = to;
+}
+
+void gw_state_store_drop_dev(gw_dev_handle_t dev)
+{
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID) {
+        return;
+    }
+
+    // One item per critical section, so listeners hear about each one with no lock held.
+    size_t i = 0;
+    for (;;) {
+        gw_state_item_t gone = {0};
+        portENTER_CRITICAL(&s_lock);
+        while (i < s_item_count && s_dev[i] != dev) {
+            i++;
+        }
+        if (i == s_item_count) {
+            // Slots moved and the handle may get another uid: no delta from before is valid.
+            s_removed_floor = ++s_version;
+            portEXIT_CRITICAL(&s_lock);
+            return;
+        }
+        const uint16_t slot = (uint16_t)i;
+        read_slot_locked(slot, &gone);
+        gone.value_type = GW_STATE_VALUE_NONE;
+        gone.version = ++s_version;
+        watches_forget_locked(dev, gone.key);
+        hash_remove_locked(slot);
+        lru_unlink_locked(slot);
+        s_item_count--;
+        if (slot != s_item_count) {
+            move_last_slot_locked(slot);
+        }
+        s_dev[s_item_count] = GW_DEV_HANDLE_INVALID;
+        portEXIT_CRITICAL(&s_lock);
+        notify_listeners(&gone);
+    }
+}
+
+uint32_t gw_state_store_removed_floor(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    const uint32_t v = s_removed_floor;
+    portEXIT_CRITICAL(&s_lock);
+    return v;
+}
+
+esp_err_t gw_state_store_add_listener(gw_state_listener_t cb, void *user_ctx)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_listener_lock);
+    for (size_t i = 0; i < GW_STATE_LISTENER_CAP; i++) {
+        if (s_listeners[i].cb == NULL) {
+            s_listeners[i] = (listener_t){.cb = cb, .ctx = user_ctx};
+            err = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_listener_lock);
+    return err;
+}
+
+esp_err_t gw_state_store_remove_listener(gw_state_listener_t cb, void *user_ctx)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&s_listener_lock);
+    for (size_t i = 0; i < GW_STATE_LISTENER_CAP; i++) {
+        if (s_listeners[i].cb == cb && s_listeners[i].ctx == user_ctx) {
+            s_listeners[i] = (listener_t){0};
+            err = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_listener_lock);
+    return err;
+}
+
+esp_err_t gw_state_store_watch_add(const gw_state_watch_t *watch, gw_state_watch_cb_t cb, void *user_ctx, uint16_t *out_id)
+{
+    if (watch == NULL || cb == NULL || watch->dev == GW_DEV_HANDLE_INVALID || watch->key == GW_STATE_KEY_INVALID ||
+        watch->kind < GW_STATE_WATCH_CHANGE || watch->kind > GW_STATE_WATCH_BELOW || !(watch->hysteresis >= 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < GW_STATE_WATCH_CAP; i++) {
+        watch_t *wt = &s_watches[i];
+        if (wt->cb) continue;
+        *wt = (watch_t){.w = *watch, .cb = cb, .ctx = user_ctx, .armed = -1};
+        const uint16_t slot = find_slot_locked(item_hash(watch->dev, watch->key), watch->dev, watch->key, NULL);
+        if (slot != SLOT_NIL) {
+            (void)watch_step(wt, item_number(s_type[slot], &s_val[slot]), true);
+        }
+        watch_link_locked((uint8_t)i);
+        if (out_id) *out_id = (uint16_t)i;
+        err = ESP_OK;
+        break;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+void gw_state_store_watch_clear(gw_state_watch_cb_t cb)
+{
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < GW_STATE_WATCH_CAP; i++) {
+        if (s_watches[i].cb == cb) {
+            watch_unlink_locked((uint8_t)i);
+            s_watches[i] = (watch_t){0};
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void gw_state_write_json_value(gw_json_writer_t *w, const gw_state_item_t *item)
+{
+    switch (item->value_type) {
+    case GW_STATE_VALUE_BOOL:
+        gw_json_bool(w, item->value.b);
+        break;
+    case GW_STATE_VALUE_F32:
+        gw_json_f64(w, item->value.f32, 3);
+        break;
+    case GW_STATE_VALUE_U32:
+        gw_json_u64(w, item->value.u32);
+        break;
+    case GW_STATE_VALUE_U64:
+        gw_json_u64(w, item->value.u64);
+        break;
+    default:
+        gw_json_null(w);
+        break;
+    }
+}
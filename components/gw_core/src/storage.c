@@ -0,0 +1,43 @@
+#include "gw_core/storage.h"
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_spiffs.h"
+
+static const char *TAG = "gw_storage";
+
+static bool s_mounted;
+
+esp_err_t gw_storage_mount(void)
+{
+    if (s_mounted) {
+        return ESP_OK;
+    }
+
+    const esp_vfs_spiffs_conf_t conf = {
+        .base_path = GW_STORAGE_BASE_PATH,
+        .partition_label = "gw_data",
+        .max_files = 6, // automations + event journal writer/readers
+        .format_if_mount_failed = false,
+    };
+
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "spiffs mount failed (gw_data): %s (0x%x)", esp_err_to_name(err), (unsigned)err);
+        return err;
+    }
+
+    size_t total = 0, used = 0;
+    if (esp_spiffs_info("gw_data", &total, &used) == ESP_OK) {
+        ESP_LOGI(TAG, "gw_data SPIFFS mounted: total=%u KB, used=%u KB", (unsigned)(total / 1024), (unsigned)(used / 1024));
+    }
+
+    s_mounted = true;
+    return ESP_OK;
+}
+
+bool gw_storage_is_mounted(void)
+{
+    return s_mounted;
+}
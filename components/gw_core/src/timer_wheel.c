@@ -0,0 +1,227 @@
+#include "gw_core/timer_wheel.h"
+
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "gw_timer_wheel";
+
+#define SLOT_BITS 6
+#define SLOTS (1u << SLOT_BITS)
+#define SLOT_MASK (SLOTS - 1u)
+#define TICK_US ((int64_t)GW_TIMER_WHEEL_TICK_MS * 1000)
+
+// Level L holds timers due 64^L..64^(L+1) ticks ahead in slot (expires >> 6L) & 63. When level 0
+// wraps, the due slot of level 1 (and of higher levels at their wraps) is emptied and its timers
+// are linked again, which moves them down. Level 0 slots hold timers of exactly one tick.
+struct gw_timer_wheel {
+    gw_timer_t *slots[GW_TIMER_WHEEL_LEVELS * SLOTS];
+    uint64_t occupied[GW_TIMER_WHEEL_LEVELS]; // bit per non-empty slot
+    uint32_t tick;                            // next tick to process
+    uint32_t armed;
+    uint32_t wake_tick; // tick the esp_timer is set for
+    bool scheduled;
+    esp_timer_handle_t timer;
+    void (*wake)(void *ctx);
+    void *wake_ctx;
+};
+
+static uint32_t now_tick(void)
+{
+    return (uint32_t)(esp_timer_get_time() / TICK_US);
+}
+
+static void link_timer(gw_timer_wheel_t *w, gw_timer_t *t)
+{
+    // Overdue timers go to the slot processed next.
+    const uint32_t when = (int32_t)(t->expires - w->tick) < 0 ? w->tick : t->expires;
+    size_t level = 0;
+    for (; level + 1 < GW_TIMER_WHEEL_LEVELS; level++) {
+        const unsigned shift = SLOT_BITS * (unsigned)level;
+        if ((((when >> shift) - (w->tick >> shift)) & (UINT32_MAX >> shift)) < SLOTS) break;
+    }
+    const unsigned shift = SLOT_BITS * (unsigned)level;
+    const uint32_t ahead = ((when >> shift) - (w->tick >> shift)) & (UINT32_MAX >> shift);
+    // Beyond the last level: park in its furthest slot and get relinked from there.
+    const uint32_t slot = (ahead < SLOTS ? (when >> shift) : (w->tick >> shift) + SLOT_MASK) & SLOT_MASK;
+
+    const uint16_t idx = (uint16_t)(level * SLOTS + slot);
+    t->slot = idx;
+    t->next = w->slots[idx];
+    if (t->next) t->next->pprev = &t->next;
+    w->slots[idx] = t;
+    t->pprev = &w->slots[idx];
+    w->occupied[level] |= 1ull << slot;
+}
+
+static void unlink_timer(gw_timer_wheel_t *w, gw_timer_t *t)
+{
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+    // Also right for timers on a detached list: their old slot is then empty or refilled.
+    if (!w->slots[t->slot]) w->occupied[t->slot / SLOTS] &= ~(1ull << (t->slot % SLOTS));
+}
+
+// Moves a slot's list to *head so it can be walked while callbacks arm and cancel timers.
+static void slot_detach(gw_timer_wheel_t *w, size_t level, uint32_t slot, gw_timer_t **head)
+{
+    const size_t idx = level * SLOTS + slot;
+    *head = w->slots[idx];
+    if (*head) (*head)->pprev = head;
+    w->slots[idx] = NULL;
+    w->occupied[level] &= ~(1ull << slot);
+}
+
+static void process_tick(gw_timer_wheel_t *w)
+{
+    const uint32_t t0 = w->tick;
+    gw_timer_t *head = NULL;
+    gw_timer_t *t = NULL;
+
+    // Cascade the coarse slots that come due at this tick, highest level first.
+    size_t top = 0;
+    while (top + 1 < GW_TIMER_WHEEL_LEVELS && ((t0 >> (SLOT_BITS * top)) & SLOT_MASK) == 0) top++;
+    for (size_t level = top; level > 0; level--) {
+        slot_detach(w, level, (t0 >> (SLOT_BITS * level)) & SLOT_MASK, &head);
+        while ((t = head) != NULL) {
+            unlink_timer(w, t);
+            link_timer(w, t);
+        }
+    }
+
+    slot_detach(w, 0, t0 & SLOT_MASK, &head);
+    w->tick = t0 + 1; // callbacks arm relative to the next tick
+    while ((t = head) != NULL) {
+        unlink_timer(w, t);
+        w->armed--;
+        t->cb(t, t->user_ctx);
+    }
+}
+
+// Ticks from w->tick to the next one that fires a timer or cascades a non-empty slot.
+static uint32_t next_work(const gw_timer_wheel_t *w)
+{
+    uint32_t d = UINT32_MAX;
+    for (size_t level = 0; level < GW_TIMER_WHEEL_LEVELS; level++) {
+        const uint64_t occ = w->occupied[level];
+        if (!occ) continue;
+        const unsigned shift = SLOT_BITS * (unsigned)level;
+        const uint32_t cur = (w->tick >> shift) & SLOT_MASK;
+        const uint64_t rot = cur ? (occ >> cur) | (occ << (SLOTS - cur)) : occ;
+        const uint32_t k = (uint32_t)__builtin_ctzll(rot);
+        // Level 0: the slot's own tick; coarser levels: the tick the slot is cascaded at.
+        const uint32_t at = level == 0 ? w->tick + k : ((w->tick >> shift) + k) << shift;
+        const uint32_t dist = (int32_t)(at - w->tick) > 0 ? at - w->tick : 0;
+        if (dist < d) d = dist;
+    }
+    return d;
+}
+
+static void schedule(gw_timer_wheel_t *w)
+{
+    if (w->armed == 0) {
+        if (w->scheduled) {
+            (void)esp_timer_stop(w->timer);
+            w->scheduled = false;
+        }
+        return;
+    }
+    const uint32_t at = w->tick + next_work(w);
+    if (w->scheduled && w->wake_tick == at) return;
+
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t ahead = (int32_t)(at - (uint32_t)(now_us / TICK_US));
+    const int64_t wait_us = (now_us / TICK_US + ahead) * TICK_US - now_us;
+    (void)esp_timer_stop(w->timer); // ESP_ERR_INVALID_STATE when it already fired
+    esp_err_t err = esp_timer_start_once(w->timer, (uint64_t)(wait_us > 0 ? wait_us : 0));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_timer_start_once failed: %s", esp_err_to_name(err));
+        w->scheduled = false;
+        return;
+    }
+    w->wake_tick = at;
+    w->scheduled = true;
+}
+
+static void on_esp_timer(void *arg)
+{
+    gw_timer_wheel_t *w = (gw_timer_wheel_t *)arg;
+    w->wake(w->wake_ctx);
+}
+
+esp_err_t gw_timer_wheel_create(const char *name, void (*wake)(void *ctx), void *wake_ctx, gw_timer_wheel_t **out)
+{
+    if (!wake || !out) return ESP_ERR_INVALID_ARG;
+
+    gw_timer_wheel_t *w = (gw_timer_wheel_t *)calloc(1, sizeof(*w));
+    if (!w) return ESP_ERR_NO_MEM;
+    w->wake = wake;
+    w->wake_ctx = wake_ctx;
+    w->tick = now_tick();
+
+    const esp_timer_create_args_t args = {
+        .callback = on_esp_timer,
+        .arg = w,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = name ? name : "gw_wheel",
+    };
+    esp_err_t err = esp_timer_create(&args, &w->timer);
+    if (err != ESP_OK) {
+        free(w);
+        return err;
+    }
+    *out = w;
+    return ESP_OK;
+}
+
+void gw_timer_init(gw_timer_t *t, gw_timer_cb_t cb, void *user_ctx)
+{
+    *t = (gw_timer_t){.cb = cb, .user_ctx = user_ctx};
+}
+
+void gw_timer_arm(gw_timer_wheel_t *w, gw_timer_t *t, uint32_t delay_ms)
+{
+    if (gw_timer_pending(t)) {
+        unlink_timer(w, t);
+        w->armed--;
+    }
+    if (w->armed == 0) {
+        w->tick = now_tick(); // nothing to catch up on
+    }
+    const int64_t due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    t->expires = (uint32_t)((due_us + TICK_US - 1) / TICK_US);
+    link_timer(w, t);
+    w->armed++;
+}
+
+bool gw_timer_cancel(gw_timer_wheel_t *w, gw_timer_t *t)
+{
+    if (!gw_timer_pending(t)) return false;
+    unlink_timer(w, t);
+    w->armed--;
+    return true;
+}
+
+void gw_timer_wheel_run(gw_timer_wheel_t *w)
+{
+    const uint32_t now = now_tick();
+    while (w->armed && (int32_t)(now - w->tick) >= 0) {
+        // Jump over ticks with nothing to fire or cascade.
+        const uint32_t skip = next_work(w);
+        if (skip) {
+            const uint32_t behind = now - w->tick + 1;
+            w->tick += skip < behind ? skip : behind;
+            continue;
+        }
+        process_tick(w);
+    }
+    schedule(w);
+}
+
+uint32_t gw_timer_wheel_armed(const gw_timer_wheel_t *w)
+{
+    return w->armed;
+}
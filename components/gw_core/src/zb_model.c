@@ -3,18 +3,12 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "gw_core/device_registry.h"
+
 static bool s_inited;
 static gw_zb_endpoint_t s_eps[GW_ZB_MAX_ENDPOINTS];
 static size_t s_ep_count;
 
-static bool uid_equals(const gw_device_uid_t *a, const gw_device_uid_t *b)
-{
-    if (a == NULL || b == NULL) {
-        return false;
-    }
-    return strncmp(a->uid, b->uid, sizeof(a->uid)) == 0;
-}
-
 esp_err_t gw_zb_model_init(void)
 {
     s_inited = true;
@@ -29,9 +23,15 @@ esp_err_t gw_zb_model_upsert_endpoint(const gw_zb_endpoint_t *ep)
         return ESP_ERR_INVALID_ARG;
     }
 
+    gw_zb_endpoint_t tmp = *ep;
+    tmp.dev = gw_device_registry_handle(&ep->uid);
+    if (tmp.dev == GW_DEV_HANDLE_INVALID) {
+        return ESP_ERR_NO_MEM;
+    }
+
     for (size_t i = 0; i < s_ep_count; i++) {
-        if (uid_equals(&s_eps[i].uid, &ep->uid) && s_eps[i].endpoint == ep->endpoint) {
-            s_eps[i] = *ep;
+        if (s_eps[i].dev == tmp.dev && s_eps[i].endpoint == tmp.endpoint) {
+            s_eps[i] = tmp;
             return ESP_OK;
         }
     }
@@ -40,19 +40,35 @@ esp_err_t gw_zb_model_upsert_endpoint(const gw_zb_endpoint_t *ep)
         return ESP_ERR_NO_MEM;
     }
 
-    s_eps[s_ep_count++] = *ep;
+    s_eps[s_ep_count++] = tmp;
     return ESP_OK;
 }
 
-size_t gw_zb_model_list_endpoints(const gw_device_uid_t *uid, gw_zb_endpoint_t *out_eps, size_t max_eps)
+void gw_zb_model_drop_dev(gw_dev_handle_t dev)
+{
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID) {
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < s_ep_count; i++) {
+        if (s_eps[i].dev != dev) {
+            s_eps[kept++] = s_eps[i];
+        }
+    }
+    memset(&s_eps[kept], 0, (s_ep_count - kept) * sizeof(s_eps[0]));
+    s_ep_count = kept;
+}
+
+size_t gw_zb_model_list_endpoints(gw_dev_handle_t dev, gw_zb_endpoint_t *out_eps, size_t max_eps)
 {
-    if (!s_inited || uid == NULL || out_eps == NULL || max_eps == 0) {
+    if (!s_inited || dev == GW_DEV_HANDLE_INVALID || out_eps == NULL || max_eps == 0) {
         return 0;
     }
 
     size_t written = 0;
     for (size_t i = 0; i < s_ep_count && written < max_eps; i++) {
-        if (uid_equals(&s_eps[i].uid, uid)) {
+        if (s_eps[i].dev == dev) {
             out_eps[written++] = s_eps[i];
         }
     }
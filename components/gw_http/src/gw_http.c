@@ -11,11 +11,13 @@
 #include "esp_log.h"
 #include "esp_spiffs.h"
 
-#include "cJSON.h"
 
 #include "gw_core/device_registry.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/event_journal.h"
 #include "gw_core/sensor_store.h"
+#include "gw_core/json_writer.h"
+#include "gw_core/metrics.h"
 #include "gw_core/state_store.h"
 #include "gw_core/zb_classify.h"
 #include "gw_core/zb_model.h"
@@ -29,13 +31,55 @@ static uint16_t s_server_port;
 static bool s_spiffs_mounted;
 
 static const char *find_query_value(const char *query, const char *key, char *out, size_t out_size);
-static esp_err_t gw_http_json_send_escaped(httpd_req_t *req, const char *s);
 
 static esp_err_t api_events_get_handler(httpd_req_t *req);
 static esp_err_t api_devices_remove_post_handler(httpd_req_t *req);
 static esp_err_t api_endpoints_get_handler(httpd_req_t *req);
 static esp_err_t api_sensors_get_handler(httpd_req_t *req);
 static esp_err_t api_state_get_handler(httpd_req_t *req);
+static esp_err_t api_metrics_get_handler(httpd_req_t *req);
+
+// /api/* JSON responses are written with gw_json_writer into one MSS-sized buffer. A body that
+// fits goes out in a single httpd_resp_send(); larger ones are flushed as full-buffer chunks.
+// httpd runs every handler on its single server task, so one static buffer serves all requests
+// and keeps it off the handler stack.
+#define GW_HTTP_RESP_BUF 1460
+
+static char s_resp_buf[GW_HTTP_RESP_BUF];
+
+typedef struct {
+    httpd_req_t *req;
+    bool chunked; // at least one chunk already sent
+} gw_http_resp_t;
+
+static esp_err_t http_chunk_sink(void *ctx, const char *data, size_t len)
+{
+    gw_http_resp_t *r = (gw_http_resp_t *)ctx;
+    r->chunked = true;
+    return httpd_resp_send_chunk(r->req, data, (ssize_t)len);
+}
+
+static void http_json_begin(gw_http_resp_t *r, httpd_req_t *req, gw_json_writer_t *w)
+{
+    r->req = req;
+    r->chunked = false;
+    httpd_resp_set_type(req, "application/json");
+    gw_json_writer_init_stream(w, s_resp_buf, sizeof(s_resp_buf), http_chunk_sink, r);
+}
+
+// Sends what is left. On failure after chunks went out the connection is dropped by httpd,
+// since part of the body is already on the wire.
+static esp_err_t http_json_end(gw_http_resp_t *r, gw_json_writer_t *w)
+{
+    if (!r->chunked && w->err == ESP_OK) {
+        return httpd_resp_send(r->req, w->buf, (ssize_t)w->pos);
+    }
+    esp_err_t err = gw_json_writer_finish(w);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_send_chunk(r->req, NULL, 0);
+}
 
 static esp_err_t gw_http_spiffs_init(void)
 {
@@ -197,8 +241,6 @@ static esp_err_t static_get_handler(httpd_req_t *req)
 
 static esp_err_t api_devices_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-
     const size_t max_devices = 32;
     gw_device_t *devices = (gw_device_t *)calloc(max_devices, sizeof(gw_device_t));
     if (devices == NULL) {
@@ -208,48 +250,23 @@ static esp_err_t api_devices_get_handler(httpd_req_t *req)
 
     size_t count = gw_device_registry_list(devices, max_devices);
 
-    esp_err_t err = httpd_resp_sendstr_chunk(req, "[");
-    if (err != ESP_OK) {
-        free(devices);
-        return err;
-    }
-
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_arr_begin(&w);
     for (size_t i = 0; i < count; i++) {
         const gw_device_t *d = &devices[i];
-        char line[192];
-        int n = snprintf(line,
-                         sizeof(line),
-                         "%s{\"device_uid\":\"%s\",\"name\":\"%s\",\"short_addr\":%u,\"has_onoff\":%s,\"has_button\":%s}",
-                         (i == 0 ? "" : ","),
-                         d->device_uid.uid,
-                         d->name,
-                         (unsigned)d->short_addr,
-                         d->has_onoff ? "true" : "false",
-                         d->has_button ? "true" : "false");
-        if (n < 0) {
-            free(devices);
-            httpd_resp_sendstr_chunk(req, NULL);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-            return ESP_OK;
-        }
-
-        err = httpd_resp_sendstr_chunk(req, line);
-        if (err != ESP_OK) {
-            free(devices);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-    }
-
+        gw_json_obj_begin(&w);
+        gw_json_kv_str(&w, "device_uid", d->device_uid.uid);
+        gw_json_kv_str(&w, "name", d->name);
+        gw_json_kv_u64(&w, "short_addr", d->short_addr);
+        gw_json_kv_bool(&w, "has_onoff", d->has_onoff);
+        gw_json_kv_bool(&w, "has_button", d->has_button);
+        gw_json_obj_end(&w);
+    }
+    gw_json_arr_end(&w);
     free(devices);
-
-    err = httpd_resp_sendstr_chunk(req, "]");
-    if (err != ESP_OK) {
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-
-    return httpd_resp_sendstr_chunk(req, NULL);
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_endpoints_get_handler(httpd_req_t *req)
@@ -275,7 +292,7 @@ static esp_err_t api_endpoints_get_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    size_t count = gw_zb_model_list_endpoints(&uid, eps, max_eps);
+    size_t count = gw_zb_model_list_endpoints(gw_device_registry_find_handle(&uid), eps, max_eps);
 
     // Avoid large stack frames in the httpd task.
     char *accepts = (char *)malloc(1024);
@@ -290,80 +307,47 @@ static esp_err_t api_endpoints_get_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    cJSON *arr = cJSON_CreateArray();
-    if (!arr) {
-        free(accepts);
-        free(emits);
-        free(reports);
-        free(eps);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
-        return ESP_OK;
-    }
-
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_arr_begin(&w);
     for (size_t i = 0; i < count; i++) {
         const gw_zb_endpoint_t *e = &eps[i];
+        gw_json_obj_begin(&w);
+        gw_json_kv_u64(&w, "endpoint", e->endpoint);
+        gw_json_kv_u64(&w, "profile_id", e->profile_id);
+        gw_json_kv_u64(&w, "device_id", e->device_id);
 
-        cJSON *o = cJSON_CreateObject();
-        if (!o) {
-            cJSON_Delete(arr);
-            free(accepts);
-            free(emits);
-            free(reports);
-            free(eps);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
-            return ESP_OK;
-        }
-
-        cJSON_AddNumberToObject(o, "endpoint", (double)e->endpoint);
-        cJSON_AddNumberToObject(o, "profile_id", (double)e->profile_id);
-        cJSON_AddNumberToObject(o, "device_id", (double)e->device_id);
-
-        cJSON *in = cJSON_AddArrayToObject(o, "in_clusters");
+        gw_json_key(&w, "in_clusters");
+        gw_json_arr_begin(&w);
         for (uint8_t c = 0; c < e->in_cluster_count; c++) {
-            cJSON_AddItemToArray(in, cJSON_CreateNumber((double)e->in_clusters[c]));
+            gw_json_u64(&w, e->in_clusters[c]);
         }
-        cJSON *out = cJSON_AddArrayToObject(o, "out_clusters");
+        gw_json_arr_end(&w);
+        gw_json_key(&w, "out_clusters");
+        gw_json_arr_begin(&w);
         for (uint8_t c = 0; c < e->out_cluster_count; c++) {
-            cJSON_AddItemToArray(out, cJSON_CreateNumber((double)e->out_clusters[c]));
-        }
-
-        cJSON_AddStringToObject(o, "kind", gw_zb_endpoint_kind(e));
-        {
-            gw_zb_endpoint_accepts_json(e, accepts, 1024);
-            gw_zb_endpoint_emits_json(e, emits, 1024);
-            gw_zb_endpoint_reports_json(e, reports, 1024);
-
-            cJSON *a = cJSON_Parse(accepts);
-            cJSON *m = cJSON_Parse(emits);
-            cJSON *r = cJSON_Parse(reports);
-
-            if (!a) a = cJSON_CreateArray();
-            if (!m) m = cJSON_CreateArray();
-            if (!r) r = cJSON_CreateArray();
-
-            if (a) cJSON_AddItemToObject(o, "accepts", a);
-            if (m) cJSON_AddItemToObject(o, "emits", m);
-            if (r) cJSON_AddItemToObject(o, "reports", r);
+            gw_json_u64(&w, e->out_clusters[c]);
         }
+        gw_json_arr_end(&w);
 
-        cJSON_AddItemToArray(arr, o);
+        gw_json_kv_str(&w, "kind", gw_zb_endpoint_kind(e));
+        // The classifier already produces JSON arrays; embed them as-is.
+        gw_zb_endpoint_accepts_json(e, accepts, 1024);
+        gw_zb_endpoint_emits_json(e, emits, 1024);
+        gw_zb_endpoint_reports_json(e, reports, 1024);
+        gw_json_kv_raw(&w, "accepts", accepts[0] == '[' ? accepts : "[]");
+        gw_json_kv_raw(&w, "emits", emits[0] == '[' ? emits : "[]");
+        gw_json_kv_raw(&w, "reports", reports[0] == '[' ? reports : "[]");
+        gw_json_obj_end(&w);
     }
+    gw_json_arr_end(&w);
 
-    char *s = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
     free(accepts);
     free(emits);
     free(reports);
     free(eps);
-    if (!s) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
-        return ESP_OK;
-    }
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t err = httpd_resp_send(req, s, HTTPD_RESP_USE_STRLEN);
-    cJSON_free(s);
-    return err;
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_sensors_get_handler(httpd_req_t *req)
@@ -389,53 +373,29 @@ static esp_err_t api_sensors_get_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    size_t count = gw_sensor_store_list(&uid, vals, max_vals);
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t err = httpd_resp_sendstr_chunk(req, "[");
-    if (err != ESP_OK) {
-        free(vals);
-        return err;
-    }
+    size_t count = gw_sensor_store_list(gw_device_registry_find_handle(&uid), vals, max_vals);
 
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_arr_begin(&w);
     for (size_t i = 0; i < count; i++) {
         const gw_sensor_value_t *v = &vals[i];
-        char line[196];
-        const char *key = (v->value_type == GW_SENSOR_VALUE_I32) ? "value_i32" : "value_u32";
-        long long ts = (long long)v->ts_ms;
-        long long val = (v->value_type == GW_SENSOR_VALUE_I32) ? (long long)v->value_i32 : (long long)v->value_u32;
-
-        int n = snprintf(line,
-                         sizeof(line),
-                         "%s{\"endpoint\":%u,\"cluster_id\":%u,\"attr_id\":%u,\"%s\":%lld,\"ts_ms\":%lld}",
-                         (i == 0 ? "" : ","),
-                         (unsigned)v->endpoint,
-                         (unsigned)v->cluster_id,
-                         (unsigned)v->attr_id,
-                         key,
-                         val,
-                         ts);
-        if (n < 0) {
-            free(vals);
-            httpd_resp_sendstr_chunk(req, NULL);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-            return ESP_OK;
-        }
-        err = httpd_resp_sendstr_chunk(req, line);
-        if (err != ESP_OK) {
-            free(vals);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-    }
-
+        gw_json_obj_begin(&w);
+        gw_json_kv_u64(&w, "endpoint", v->endpoint);
+        gw_json_kv_u64(&w, "cluster_id", v->cluster_id);
+        gw_json_kv_u64(&w, "attr_id", v->attr_id);
+        if (v->value_type == GW_SENSOR_VALUE_I32) {
+            gw_json_kv_i64(&w, "value_i32", v->value_i32);
+        } else {
+            gw_json_kv_u64(&w, "value_u32", v->value_u32);
+        }
+        gw_json_kv_u64(&w, "ts_ms", v->ts_ms);
+        gw_json_obj_end(&w);
+    }
+    gw_json_arr_end(&w);
     free(vals);
-    err = httpd_resp_sendstr_chunk(req, "]");
-    if (err != ESP_OK) {
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-    return httpd_resp_sendstr_chunk(req, NULL);
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_state_get_handler(httpd_req_t *req)
@@ -461,93 +421,24 @@ static esp_err_t api_state_get_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    size_t count = gw_state_store_list(&uid, items, max_items);
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t err = httpd_resp_sendstr_chunk(req, "{\"uid\":\"");
-    if (err != ESP_OK) {
-        free(items);
-        return err;
-    }
-
-    err = gw_http_json_send_escaped(req, uid.uid);
-    if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\",\"state\":{");
-    if (err != ESP_OK) {
-        free(items);
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
+    size_t count = gw_state_store_list(gw_device_registry_find_handle(&uid), items, max_items);
 
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_obj_begin(&w);
+    gw_json_kv_str(&w, "uid", uid.uid);
+    gw_json_key(&w, "state");
+    gw_json_obj_begin(&w);
     for (size_t i = 0; i < count; i++) {
         const gw_state_item_t *it = &items[i];
-
-        err = httpd_resp_sendstr_chunk(req, (i == 0) ? "\"" : ",\"");
-        if (err != ESP_OK) {
-            free(items);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-        err = gw_http_json_send_escaped(req, it->key);
-        if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\":");
-        if (err != ESP_OK) {
-            free(items);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        char tmp[64];
-        switch (it->value_type) {
-        case GW_STATE_VALUE_BOOL:
-            err = httpd_resp_sendstr_chunk(req, it->value_bool ? "true" : "false");
-            break;
-        case GW_STATE_VALUE_F32: {
-            int n = snprintf(tmp, sizeof(tmp), "%.3f", (double)it->value_f32);
-            if (n < 0 || n >= (int)sizeof(tmp)) {
-                err = ESP_FAIL;
-            } else {
-                err = httpd_resp_sendstr_chunk(req, tmp);
-            }
-            break;
-        }
-        case GW_STATE_VALUE_U32: {
-            int n = snprintf(tmp, sizeof(tmp), "%u", (unsigned)it->value_u32);
-            if (n < 0 || n >= (int)sizeof(tmp)) {
-                err = ESP_FAIL;
-            } else {
-                err = httpd_resp_sendstr_chunk(req, tmp);
-            }
-            break;
-        }
-        case GW_STATE_VALUE_U64: {
-            int n = snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)it->value_u64);
-            if (n < 0 || n >= (int)sizeof(tmp)) {
-                err = ESP_FAIL;
-            } else {
-                err = httpd_resp_sendstr_chunk(req, tmp);
-            }
-            break;
-        }
-        default:
-            err = httpd_resp_sendstr_chunk(req, "null");
-            break;
-        }
-
-        if (err != ESP_OK) {
-            free(items);
-            httpd_resp_sendstr_chunk(req, NULL);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-            return ESP_OK;
-        }
+        gw_json_key(&w, gw_state_key_name(it->key));
+        gw_state_write_json_value(&w, it);
     }
-
+    gw_json_obj_end(&w);
+    gw_json_obj_end(&w);
     free(items);
-
-    err = httpd_resp_sendstr_chunk(req, "}}");
-    if (err != ESP_OK) {
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-    return httpd_resp_sendstr_chunk(req, NULL);
+    return http_json_end(&r, &w);
 }
 
 static const char *find_query_value(const char *query, const char *key, char *out, size_t out_size)
@@ -578,79 +469,6 @@ static const char *find_query_value(const char *query, const char *key, char *ou
     return NULL;
 }
 
-static esp_err_t gw_http_json_send_escaped(httpd_req_t *req, const char *s)
-{
-    if (s == NULL) {
-        s = "";
-    }
-
-    char out[96];
-    size_t out_len = 0;
-
-    const unsigned char *p = (const unsigned char *)s;
-    while (*p) {
-        const unsigned char c = *p++;
-        const char *rep = NULL;
-        char esc[8];
-
-        switch (c) {
-        case '\\':
-            rep = "\\\\";
-            break;
-        case '"':
-            rep = "\\\"";
-            break;
-        case '\n':
-            rep = "\\n";
-            break;
-        case '\r':
-            rep = "\\r";
-            break;
-        case '\t':
-            rep = "\\t";
-            break;
-        default:
-            if (c < 0x20) {
-                (void)snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)c);
-                rep = esc;
-            }
-            break;
-        }
-
-        if (rep != NULL) {
-            size_t rep_len = strlen(rep);
-            if (out_len + rep_len >= sizeof(out)) {
-                out[out_len] = '\0';
-                esp_err_t err = httpd_resp_sendstr_chunk(req, out);
-                if (err != ESP_OK) {
-                    return err;
-                }
-                out_len = 0;
-            }
-            memcpy(&out[out_len], rep, rep_len);
-            out_len += rep_len;
-            continue;
-        }
-
-        if (out_len + 1 >= sizeof(out)) {
-            out[out_len] = '\0';
-            esp_err_t err = httpd_resp_sendstr_chunk(req, out);
-            if (err != ESP_OK) {
-                return err;
-            }
-            out_len = 0;
-        }
-        out[out_len++] = (char)c;
-    }
-
-    if (out_len > 0) {
-        out[out_len] = '\0';
-        return httpd_resp_sendstr_chunk(req, out);
-    }
-
-    return ESP_OK;
-}
-
 static esp_err_t api_devices_post_handler(httpd_req_t *req)
 {
     char query[256];
@@ -697,8 +515,13 @@ static esp_err_t api_devices_post_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"ok\":true}", HTTPD_RESP_USE_STRLEN);
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_obj_begin(&w);
+    gw_json_kv_bool(&w, "ok", true);
+    gw_json_obj_end(&w);
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_devices_remove_post_handler(httpd_req_t *req)
@@ -752,14 +575,15 @@ static esp_err_t api_devices_remove_post_handler(httpd_req_t *req)
 
     gw_event_bus_publish("api_device_removed", "http", uid.uid, short_addr, kick ? "kick=1" : "kick=0");
 
-    httpd_resp_set_type(req, "application/json");
-    char resp[96];
-    int n = snprintf(resp,
-                     sizeof(resp),
-                     "{\"ok\":true,\"uid\":\"%s\",\"kick\":%s}",
-                     uid.uid,
-                     kick ? "true" : "false");
-    return httpd_resp_send(req, resp, n);
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_obj_begin(&w);
+    gw_json_kv_bool(&w, "ok", true);
+    gw_json_kv_str(&w, "uid", uid.uid);
+    gw_json_kv_bool(&w, "kick", kick);
+    gw_json_obj_end(&w);
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_network_permit_join_post_handler(httpd_req_t *req)
@@ -790,10 +614,23 @@ static esp_err_t api_network_permit_join_post_handler(httpd_req_t *req)
         gw_event_bus_publish("api_permit_join", "http", "", 0, msg);
     }
 
-    char resp[64];
-    int n = snprintf(resp, sizeof(resp), "{\"ok\":true,\"seconds\":%u}", (unsigned)seconds);
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, resp, n);
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_obj_begin(&w);
+    gw_json_kv_bool(&w, "ok", true);
+    gw_json_kv_u64(&w, "seconds", seconds);
+    gw_json_obj_end(&w);
+    return http_json_end(&r, &w);
+}
+
+static esp_err_t api_metrics_get_handler(httpd_req_t *req)
+{
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_metrics_write_json(&w);
+    return http_json_end(&r, &w);
 }
 
 static esp_err_t api_events_get_handler(httpd_req_t *req)
@@ -826,131 +663,26 @@ static esp_err_t api_events_get_handler(httpd_req_t *req)
     }
 
     uint32_t last_id = 0;
-    size_t count = gw_event_bus_list_since(since, events, limit, &last_id);
-
-    httpd_resp_set_type(req, "application/json");
-
-    esp_err_t err = httpd_resp_sendstr_chunk(req, "{\"last_id\":");
-    if (err != ESP_OK) {
-        free(events);
-        return err;
-    }
-
-    char tmp[64];
-    int n = snprintf(tmp, sizeof(tmp), "%u", (unsigned)last_id);
-    if (n < 0) {
-        free(events);
-        httpd_resp_sendstr_chunk(req, NULL);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-        return ESP_OK;
-    }
-
-    err = httpd_resp_sendstr_chunk(req, tmp);
-    if (err != ESP_OK) {
-        free(events);
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-
-    err = httpd_resp_sendstr_chunk(req, ",\"events\":[");
-    if (err != ESP_OK) {
-        free(events);
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-
+    gw_event_gap_t gap = {0};
+    size_t count = gw_event_journal_list_since(since, events, limit, &last_id, &gap);
+
+    gw_http_resp_t r;
+    gw_json_writer_t w;
+    http_json_begin(&r, req, &w);
+    gw_json_obj_begin(&w);
+    gw_json_kv_u64(&w, "last_id", last_id);
+    gw_event_gap_write_json(&w, &gap);
+    gw_json_key(&w, "events");
+    gw_json_arr_begin(&w);
     for (size_t i = 0; i < count; i++) {
-        const gw_event_t *e = &events[i];
-        err = httpd_resp_sendstr_chunk(req, (i == 0) ? "{" : ",{");
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        n = snprintf(tmp, sizeof(tmp), "\"v\":%u,\"id\":%u,\"ts_ms\":%llu,", (unsigned)e->v, (unsigned)e->id, (unsigned long long)e->ts_ms);
-        if (n < 0) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-            return ESP_OK;
-        }
-        err = httpd_resp_sendstr_chunk(req, tmp);
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        err = httpd_resp_sendstr_chunk(req, "\"type\":\"");
-        if (err == ESP_OK) err = gw_http_json_send_escaped(req, e->type);
-        if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\",\"source\":\"");
-        if (err == ESP_OK) err = gw_http_json_send_escaped(req, e->source);
-        if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\",\"device_uid\":\"");
-        if (err == ESP_OK) err = gw_http_json_send_escaped(req, e->device_uid);
-        if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\"");
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        n = snprintf(tmp, sizeof(tmp), ",\"short_addr\":%u,\"msg\":\"", (unsigned)e->short_addr);
-        if (n < 0) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "format error");
-            return ESP_OK;
-        }
-        err = httpd_resp_sendstr_chunk(req, tmp);
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        err = gw_http_json_send_escaped(req, e->msg);
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        err = httpd_resp_sendstr_chunk(req, "\"");
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
-
-        const char *pj = (e->payload_json[0] != '\0') ? e->payload_json : NULL;
-        if (pj && (pj[0] == '{' || pj[0] == '[')) {
-            err = httpd_resp_sendstr_chunk(req, ",\"payload\":");
-            if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, pj);
-            if (err != ESP_OK) {
-                free(events);
-                httpd_resp_sendstr_chunk(req, NULL);
-                return err;
-            }
-        }
-
-        err = httpd_resp_sendstr_chunk(req, "}");
-        if (err != ESP_OK) {
-            free(events);
-            httpd_resp_sendstr_chunk(req, NULL);
-            return err;
-        }
+        gw_json_obj_begin(&w);
+        gw_event_write_json_fields(&w, &events[i]);
+        gw_json_obj_end(&w);
     }
-
+    gw_json_arr_end(&w);
+    gw_json_obj_end(&w);
     free(events);
-
-    err = httpd_resp_sendstr_chunk(req, "]}");
-    if (err != ESP_OK) {
-        httpd_resp_sendstr_chunk(req, NULL);
-        return err;
-    }
-
-    return httpd_resp_sendstr_chunk(req, NULL);
+    return http_json_end(&r, &w);
 }
 
 esp_err_t gw_http_start(void)
@@ -966,7 +698,7 @@ esp_err_t gw_http_start(void)
     // We register several API endpoints + a wildcard handler for SPA/static files.
     // Default (8) is too small once UI grows.
     config.max_uri_handlers = 16;
-    // Web UI uses WebSocket + JSON (cJSON), which can be stack-hungry in the httpd task.
+    // Web UI uses WebSocket + JSON (cJSON request parsing), which can be stack-hungry in the httpd task.
     config.stack_size = 12288;
     s_server_port = config.server_port;
 
@@ -1031,6 +763,12 @@ esp_err_t gw_http_start(void)
         .handler = api_events_get_handler,
         .user_ctx = NULL,
     };
+    static const httpd_uri_t api_metrics_get_uri = {
+        .uri = "/api/metrics",
+        .method = HTTP_GET,
+        .handler = api_metrics_get_handler,
+        .user_ctx = NULL,
+    };
     static const httpd_uri_t static_uri = {
         .uri = "/*",
         .method = HTTP_GET,
@@ -1047,6 +785,7 @@ esp_err_t gw_http_start(void)
     ESP_ERROR_CHECK(httpd_register_uri_handler(s_server, &api_devices_remove_post_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(s_server, &api_network_permit_join_post_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(s_server, &api_events_get_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(s_server, &api_metrics_get_uri));
     ESP_ERROR_CHECK(gw_ws_register(s_server));
     ESP_ERROR_CHECK(httpd_register_uri_handler(s_server, &static_uri));
 
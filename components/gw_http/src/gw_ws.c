@@ -1,46 +1,91 @@
 #include "gw_http/gw_ws.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 
-#include "gw_core/action_exec.h"
 #include "gw_core/device_registry.h"
-#include "gw_core/automation_store.h"
 #include "gw_core/event_bus.h"
-#include "gw_zigbee/gw_zigbee.h"
+#include "gw_core/event_journal.h"
+#include "gw_core/json_writer.h"
+#include "gw_core/rpc.h"
+#include "gw_core/state_store.h"
 
 static const char *TAG = "gw_ws";
 
-static bool ws_parse_u16(cJSON *j, uint16_t *out)
-{
-    if (!out) return false;
-    if (cJSON_IsNumber(j) && j->valuedouble >= 0 && j->valuedouble <= 65535) {
-        *out = (uint16_t)j->valuedouble;
-        return true;
-    }
-    if (cJSON_IsString(j) && j->valuestring && j->valuestring[0] != '\0') {
-        char *end = NULL;
-        unsigned long v = strtoul(j->valuestring, &end, 0);
-        if (end && *end == '\0' && v <= 65535UL) {
-            *out = (uint16_t)v;
-            return true;
-        }
-    }
-    return false;
-}
+// Outgoing frame shared by every client it is sent to; freed when the last transfer completes.
+typedef struct {
+    atomic_uint refs;
+    size_t len;
+    uint8_t data[];
+} gw_ws_frame_t;
+
+// Per-client backpressure for pushed events: at most GW_WS_CLIENT_MAX_INFLIGHT frames /
+// _INFLIGHT_BYTES are handed to httpd at once; the rest wait in a small per-client queue where
+// attribute reports for the same (device, endpoint, cluster, attr) replace each other. When the
+// queue overflows it is dropped and the client gets a "resync" marker instead.
+#define GW_WS_CLIENT_MAX_INFLIGHT 4
+#define GW_WS_CLIENT_MAX_INFLIGHT_BYTES (8 * 1024)
+#define GW_WS_CLIENT_QUEUE 16
+#define GW_WS_CLIENT_MAX_QUEUED_BYTES (16 * 1024)
+
+typedef struct {
+    gw_ws_frame_t *f;
+    uint32_t key;      // coalescing key, 0 = never coalesced
+    uint32_t event_id; // event the frame carries, 0 for other frames
+    bool binary;
+} gw_ws_pending_t;
+
+// Subscription filter, checked before anything is serialized. Empty lists match everything;
+// devices apply to both topics, types (exact or "zigbee.*" prefixes) to events only.
+// Device uids are kept and resolved to handles by lookup only; devs[i] is GW_DEV_HANDLE_INVALID
+// (matches nothing) until that uid gets a handle, and is re-resolved whenever the registry's
+// handle generation moves past handle_gen (see ws_filters_rebind()).
+#define GW_WS_SUB_MAX_DEVICES 8
+#define GW_WS_SUB_MAX_TYPES 8
+
+typedef struct {
+    uint8_t dev_count;
+    uint8_t type_count;
+    uint32_t handle_gen;
+    gw_device_uid_t uids[GW_WS_SUB_MAX_DEVICES];
+    gw_dev_handle_t devs[GW_WS_SUB_MAX_DEVICES];
+    char types[GW_WS_SUB_MAX_TYPES][32];
+} ws_sub_filter_t;
 
 typedef struct {
     int fd;
+    uint32_t session; // distinguishes connections that reuse an fd
     bool subscribed_events;
+    bool subscribed_state;
+    bool binary_events; // client announced "enc":"tlv" in hello
+    bool pumping;       // a task is draining q (see ws_client_pump())
+    bool need_resync;
+    uint8_t inflight;
+    uint8_t q_len;
+    uint32_t inflight_bytes;
+    uint32_t queued_bytes;
+    uint32_t resync_id; // newest event dropped while behind
+    // `since` replays queued or running. Live events are not pushed meanwhile; the replay takes
+    // them over and, once caught up, sets live_after to the last id it covered.
+    uint8_t replays;
+    uint32_t live_after;
+    gw_ws_pending_t q[GW_WS_CLIENT_QUEUE];
+    ws_sub_filter_t filter;
+    // State topic (see ws_state_task_fn): the store version this client has been sent up to.
+    bool state_full;          // next batch is a full snapshot
+    uint16_t state_interval_ms;
+    uint32_t state_ver;
+    int64_t state_due_us;     // earliest time of the next batch
 } gw_ws_client_t;
 
 static httpd_handle_t s_server;
@@ -50,17 +95,64 @@ static portMUX_TYPE s_client_lock = portMUX_INITIALIZER_UNLOCKED;
 static gw_ws_client_t s_clients[GW_WS_MAX_CLIENTS];
 
 static void ws_client_remove_fd(int fd);
+static void ws_jobs_drop_fd(int fd);
+static uint32_t s_session_seq;
+
+static gw_ws_client_t *ws_client_find_locked(int fd)
+{
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd == fd && fd != 0) {
+            return &s_clients[i];
+        }
+    }
+    return NULL;
+}
+
+static gw_ws_frame_t *ws_frame_alloc(size_t len)
+{
+    gw_ws_frame_t *f = (gw_ws_frame_t *)malloc(sizeof(gw_ws_frame_t) + len + 1);
+    if (!f) {
+        return NULL;
+    }
+    atomic_init(&f->refs, 1);
+    f->len = len;
+    f->data[len] = '\0';
+    return f;
+}
+
+static void ws_frame_release(gw_ws_frame_t *f)
+{
+    if (f && atomic_fetch_sub_explicit(&f->refs, 1, memory_order_acq_rel) == 1) {
+        free(f);
+    }
+}
+
+static void ws_client_pump(int fd);
 
 static void ws_transfer_done_cb(esp_err_t err, int socket, void *arg)
 {
     (void)err;
-    (void)socket;
-    free(arg);
+    gw_ws_frame_t *f = (gw_ws_frame_t *)arg;
+    bool pending = false;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(socket);
+    if (c) {
+        // Clamped: a reused fd may inherit completions from the previous connection.
+        c->inflight = c->inflight ? c->inflight - 1 : 0;
+        c->inflight_bytes = (c->inflight_bytes > f->len) ? c->inflight_bytes - (uint32_t)f->len : 0;
+        pending = c->q_len > 0 || c->need_resync;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    ws_frame_release(f);
+    if (pending) {
+        ws_client_pump(socket);
+    }
 }
 
-static esp_err_t ws_send_json_async(int fd, const char *json)
+// Queues `f` for `fd`; the transfer holds its own reference, the caller keeps theirs.
+static esp_err_t ws_send_frame_async(int fd, gw_ws_frame_t *f, httpd_ws_type_t type)
 {
-    if (!s_server || !json) {
+    if (!s_server || !f) {
         return ESP_ERR_INVALID_STATE;
     }
 
@@ -69,962 +161,1224 @@ static esp_err_t ws_send_json_async(int fd, const char *json)
         return ESP_ERR_INVALID_STATE;
     }
 
-    size_t n = strlen(json);
-    char *copy = (char *)malloc(n + 1);
-    if (!copy) {
-        return ESP_ERR_NO_MEM;
-    }
-    memcpy(copy, json, n + 1);
-
     httpd_ws_frame_t frame = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)copy,
-        .len = n,
+        .type = type,
+        .payload = f->data,
+        .len = f->len,
     };
 
-    esp_err_t err = httpd_ws_send_data_async(s_server, fd, &frame, ws_transfer_done_cb, copy);
+    atomic_fetch_add_explicit(&f->refs, 1, memory_order_relaxed);
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (c) {
+        c->inflight++;
+        c->inflight_bytes += (uint32_t)f->len;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+
+    esp_err_t err = httpd_ws_send_data_async(s_server, fd, &frame, ws_transfer_done_cb, f);
     if (err != ESP_OK) {
-        free(copy);
+        portENTER_CRITICAL(&s_client_lock);
+        c = ws_client_find_locked(fd);
+        if (c) {
+            c->inflight = c->inflight ? c->inflight - 1 : 0;
+            c->inflight_bytes = (c->inflight_bytes > f->len) ? c->inflight_bytes - (uint32_t)f->len : 0;
+        }
+        portEXIT_CRITICAL(&s_client_lock);
+        ws_frame_release(f);
     }
     return err;
 }
 
-static void ws_send_hello(int fd)
+static esp_err_t ws_send_json_async(int fd, const char *json)
 {
-    char buf[256];
-    int n = snprintf(buf,
-                     sizeof(buf),
-                     "{\"t\":\"hello\",\"proto\":\"gw-ws-1\",\"caps\":{\"events\":true,\"req\":true},\"event_last_id\":%u}",
-                     (unsigned)gw_event_bus_last_id());
-    if (n > 0 && (size_t)n < sizeof(buf)) {
-        (void)ws_send_json_async(fd, buf);
+    if (!s_server || !json) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t n = strlen(json);
+    gw_ws_frame_t *f = ws_frame_alloc(n);
+    if (!f) {
+        return ESP_ERR_NO_MEM;
     }
+    memcpy(f->data, json, n);
+
+    esp_err_t err = ws_send_frame_async(fd, f, HTTPD_WS_TYPE_TEXT);
+    ws_frame_release(f);
+    return err;
 }
 
-static void ws_client_remove_fd(int fd)
+typedef void (*ws_build_fn)(gw_json_writer_t *w, const void *ctx);
+
+// Serializes a message straight into a frame: a sizing pass, then a fill pass into exactly that
+// many bytes. No intermediate tree or string copy.
+static gw_ws_frame_t *ws_build_frame(ws_build_fn build, const void *ctx)
 {
-    portENTER_CRITICAL(&s_client_lock);
-    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == fd) {
-            s_clients[i] = (gw_ws_client_t){0};
-            break;
-        }
+    gw_json_writer_t w;
+    gw_json_writer_init(&w, NULL, 0);
+    build(&w, ctx);
+    gw_ws_frame_t *f = ws_frame_alloc(gw_json_writer_len(&w));
+    if (!f) {
+        return NULL;
+    }
+    gw_json_writer_init(&w, (char *)f->data, f->len + 1);
+    build(&w, ctx);
+    if (gw_json_writer_finish(&w) != ESP_OK) {
+        ws_frame_release(f);
+        return NULL;
+    }
+    return f;
+}
+
+static esp_err_t ws_send_built(int fd, ws_build_fn build, const void *ctx)
+{
+    gw_ws_frame_t *f = ws_build_frame(build, ctx);
+    if (!f) {
+        return ESP_ERR_NO_MEM;
     }
-    portEXIT_CRITICAL(&s_client_lock);
+    esp_err_t err = ws_send_frame_async(fd, f, HTTPD_WS_TYPE_TEXT);
+    ws_frame_release(f);
+    return err;
 }
 
-static bool ws_client_add_fd(int fd)
+static void ws_build_hello(gw_json_writer_t *w, const void *ctx)
 {
+    (void)ctx;
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "hello");
+    gw_json_kv_str(w, "proto", "gw-ws-1");
+    gw_json_key(w, "caps");
+    gw_json_obj_begin(w);
+    gw_json_kv_bool(w, "events", true);
+    gw_json_kv_bool(w, "state", true);
+    gw_json_kv_bool(w, "req", true);
+    gw_json_key(w, "enc");
+    gw_json_arr_begin(w);
+    gw_json_str(w, "json");
+    gw_json_str(w, "tlv");
+    gw_json_arr_end(w);
+    gw_json_obj_end(w);
+    gw_json_kv_u64(w, "event_last_id", gw_event_bus_last_id());
+    gw_json_obj_end(w);
+}
+
+static void ws_send_hello(int fd)
+{
+    (void)ws_send_built(fd, ws_build_hello, NULL);
+}
+
+// Clears the slot of `fd`, or every slot when fd < 0; queued frames are released outside the lock.
+static void ws_client_clear(int fd)
+{
+    gw_ws_frame_t *drop[GW_WS_CLIENT_QUEUE * GW_WS_MAX_CLIENTS];
+    size_t n = 0;
     portENTER_CRITICAL(&s_client_lock);
     for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == fd) {
-            portEXIT_CRITICAL(&s_client_lock);
-            return true;
+        gw_ws_client_t *c = &s_clients[i];
+        if (fd >= 0 && c->fd != fd) {
+            continue;
         }
-    }
-    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == 0) {
-            s_clients[i].fd = fd;
-            s_clients[i].subscribed_events = false;
-            portEXIT_CRITICAL(&s_client_lock);
-            return true;
+        for (size_t k = 0; k < c->q_len; k++) {
+            drop[n++] = c->q[k].f;
         }
+        *c = (gw_ws_client_t){0};
     }
     portEXIT_CRITICAL(&s_client_lock);
-    return false;
+    for (size_t i = 0; i < n; i++) {
+        ws_frame_release(drop[i]);
+    }
 }
 
-static void ws_send_events_since(int fd, uint32_t since, size_t limit)
+static void ws_client_remove_fd(int fd)
 {
-    if (limit < 1) {
-        return;
-    }
-    if (limit > 128) {
-        limit = 128;
+    if (fd > 0) {
+        ws_jobs_drop_fd(fd);
+        ws_client_clear(fd);
     }
+}
 
-    gw_event_t *events = (gw_event_t *)calloc(limit, sizeof(gw_event_t));
-    if (!events) {
+// 0 if fd has no client.
+static uint32_t ws_client_session(int fd)
+{
+    portENTER_CRITICAL(&s_client_lock);
+    const gw_ws_client_t *c = ws_client_find_locked(fd);
+    const uint32_t session = c ? c->session : 0;
+    portEXIT_CRITICAL(&s_client_lock);
+    return session;
+}
+
+static void ws_build_resync(gw_json_writer_t *w, const void *ctx)
+{
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "resync");
+    gw_json_kv_u64(w, "last_id", *(const uint32_t *)ctx);
+    gw_json_obj_end(w);
+}
+
+// Moves queued frames to httpd while the client has room. Whichever task finds the client idle
+// drains it; others only enqueue, so frames for one client are always handed over in order.
+static void ws_client_pump(int fd)
+{
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (!c || c->pumping) {
+        portEXIT_CRITICAL(&s_client_lock);
         return;
     }
-
-    uint32_t last_id = 0;
-    size_t count = gw_event_bus_list_since(since, events, limit, &last_id);
-    for (size_t i = 0; i < count; i++) {
-        const gw_event_t *e = &events[i];
-        cJSON *o = cJSON_CreateObject();
-        if (!o) {
-            continue;
+    c->pumping = true;
+    for (;;) {
+        const bool room = c->inflight < GW_WS_CLIENT_MAX_INFLIGHT && c->inflight_bytes < GW_WS_CLIENT_MAX_INFLIGHT_BYTES;
+        gw_ws_pending_t next = {0};
+        uint32_t resync_id = 0;
+        if (room && c->q_len > 0) {
+            next = c->q[0];
+            c->q_len--;
+            memmove(&c->q[0], &c->q[1], c->q_len * sizeof(c->q[0]));
+            c->queued_bytes -= (uint32_t)next.f->len;
+        } else if (room && c->need_resync) {
+            c->need_resync = false;
+            resync_id = c->resync_id;
+        } else {
+            c->pumping = false;
+            break;
         }
-        cJSON_AddStringToObject(o, "t", "event");
-        cJSON_AddNumberToObject(o, "v", (double)e->v);
-        cJSON_AddNumberToObject(o, "id", (double)e->id);
-        cJSON_AddNumberToObject(o, "ts_ms", (double)e->ts_ms);
-        cJSON_AddStringToObject(o, "type", e->type);
-        cJSON_AddStringToObject(o, "source", e->source);
-        cJSON_AddStringToObject(o, "device_uid", e->device_uid);
-        cJSON_AddNumberToObject(o, "short_addr", (double)e->short_addr);
-        cJSON_AddStringToObject(o, "msg", e->msg);
-
-        // Structured payload (no legacy JSON-in-msg fallback).
-        if (e->payload_json[0] != '\0') {
-            cJSON *p = cJSON_Parse(e->payload_json);
-            if (p) cJSON_AddItemToObject(o, "payload", p);
+        portEXIT_CRITICAL(&s_client_lock);
+
+        if (next.f) {
+            (void)ws_send_frame_async(fd, next.f, next.binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT);
+            ws_frame_release(next.f);
+        } else {
+            gw_ws_frame_t *f = ws_build_frame(ws_build_resync, &resync_id);
+            if (f) {
+                (void)ws_send_frame_async(fd, f, HTTPD_WS_TYPE_TEXT);
+                ws_frame_release(f);
+            }
         }
 
-        char *s = cJSON_PrintUnformatted(o);
-        if (s) {
-            (void)ws_send_json_async(fd, s);
-            cJSON_free(s);
+        portENTER_CRITICAL(&s_client_lock);
+        c = ws_client_find_locked(fd);
+        if (!c) {
+            break;
         }
-        cJSON_Delete(o);
     }
-
-    free(events);
+    portEXIT_CRITICAL(&s_client_lock);
 }
 
-// Queue used to offload event -> WS JSON build/send from publisher context.
-static QueueHandle_t s_event_q = NULL;
-static TaskHandle_t s_event_task = NULL;
-
-static void ws_event_task_fn(void *arg)
+// Queues a pushed frame for `fd` (takes its own reference), then pumps the client. event_id is the
+// event the frame carries, 0 for state batches. Returns false if the frame was dropped; a report
+// older than the one queued for the same key is skipped, which counts as delivered.
+static bool ws_client_push_event(int fd, gw_ws_frame_t *f, bool binary, uint32_t key, uint32_t event_id)
 {
-    (void)arg;
-    gw_event_t e;
-    while (true) {
-        if (xQueueReceive(s_event_q, &e, portMAX_DELAY) == pdTRUE) {
-            int fds[GW_WS_MAX_CLIENTS];
-            size_t fd_count = 0;
+    bool queued = false;
+    gw_ws_frame_t *drop[GW_WS_CLIENT_QUEUE + 1];
+    size_t n = 0;
+    bool overflow = false;
 
-            portENTER_CRITICAL(&s_client_lock);
-            for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-                if (s_clients[i].fd != 0 && s_clients[i].subscribed_events) {
-                    fds[fd_count++] = s_clients[i].fd;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (!c) {
+        portEXIT_CRITICAL(&s_client_lock);
+        return false;
+    }
+    if (c->need_resync) {
+        if (event_id) {
+            c->resync_id = event_id; // still behind; the marker covers this one too
+        }
+    } else {
+        bool stale = false;
+        if (key) {
+            // A newer report for the same attribute supersedes the queued one; an older one (a
+            // replay racing the live stream) is skipped so the client never steps back in time.
+            for (size_t i = 0; i < c->q_len; i++) {
+                if (c->q[i].key == key) {
+                    if (event_id <= c->q[i].event_id) {
+                        stale = true;
+                        break;
+                    }
+                    drop[n++] = c->q[i].f;
+                    c->queued_bytes -= (uint32_t)c->q[i].f->len;
+                    c->q_len--;
+                    memmove(&c->q[i], &c->q[i + 1], (c->q_len - i) * sizeof(c->q[0]));
+                    break;
                 }
             }
-            portEXIT_CRITICAL(&s_client_lock);
-
-            cJSON *o = cJSON_CreateObject();
-            if (!o) continue;
-
-            cJSON_AddStringToObject(o, "t", "event");
-            cJSON_AddNumberToObject(o, "v", (double)e.v);
-            cJSON_AddNumberToObject(o, "id", (double)e.id);
-            cJSON_AddNumberToObject(o, "ts_ms", (double)e.ts_ms);
-            cJSON_AddStringToObject(o, "type", e.type);
-            cJSON_AddStringToObject(o, "source", e.source);
-            cJSON_AddStringToObject(o, "device_uid", e.device_uid);
-            cJSON_AddNumberToObject(o, "short_addr", (double)e.short_addr);
-            cJSON_AddStringToObject(o, "msg", e.msg);
-
-            if (e.payload_json[0] != '\0') {
-                cJSON *p = cJSON_Parse(e.payload_json);
-                if (p) cJSON_AddItemToObject(o, "payload", p);
-            }
-
-            char *s = cJSON_PrintUnformatted(o);
-            if (!s) {
-                cJSON_Delete(o);
-                continue;
+        }
+        if (stale) {
+            queued = true;
+        } else if (c->q_len < GW_WS_CLIENT_QUEUE && c->queued_bytes + f->len <= GW_WS_CLIENT_MAX_QUEUED_BYTES) {
+            atomic_fetch_add_explicit(&f->refs, 1, memory_order_relaxed);
+            c->q[c->q_len++] = (gw_ws_pending_t){.f = f, .key = key, .event_id = event_id, .binary = binary};
+            c->queued_bytes += (uint32_t)f->len;
+            queued = true;
+        } else {
+            for (size_t i = 0; i < c->q_len; i++) {
+                drop[n++] = c->q[i].f;
             }
-
-            for (size_t i = 0; i < fd_count; i++) {
-                int fd = fds[i];
-                if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
-                    ws_client_remove_fd(fd);
-                    continue;
-                }
-                (void)ws_send_json_async(fd, s);
+            c->q_len = 0;
+            c->queued_bytes = 0;
+            c->need_resync = true;
+            if (event_id) {
+                c->resync_id = event_id;
             }
-
-            cJSON_free(s);
-            cJSON_Delete(o);
+            overflow = true;
         }
     }
+    portEXIT_CRITICAL(&s_client_lock);
+
+    for (size_t i = 0; i < n; i++) {
+        ws_frame_release(drop[i]);
+    }
+    if (overflow) {
+        ESP_LOGW(TAG, "ws client fd=%d fell behind; dropping its queue and sending resync", fd);
+    }
+    ws_client_pump(fd);
+    return queued;
 }
 
-static void ws_publish_event_to_clients(const gw_event_t *e, void *user_ctx)
+static bool ws_client_add_fd(int fd)
 {
-    (void)user_ctx;
-    if (!e || !s_event_q) return;
-    
-    // Early exit if no clients subscribed to events (avoid queue/JSON overhead).
-    bool has_subscribers = false;
     portENTER_CRITICAL(&s_client_lock);
     for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd != 0 && s_clients[i].subscribed_events) {
-            has_subscribers = true;
-            break;
+        if (s_clients[i].fd == fd) {
+            portEXIT_CRITICAL(&s_client_lock);
+            return true;
         }
     }
-    portEXIT_CRITICAL(&s_client_lock);
-    
-    if (!has_subscribers) {
-        return;  // No one listening, skip event processing entirely.
-    }
-    
-    // Non-blocking enqueue; if queue is full, drop to avoid blocking publisher.
-    if (xQueueSend(s_event_q, e, 0) != pdTRUE) {
-        ESP_LOGW(TAG, "ws event queue overflow (id=%u type=%s); ws clients may miss event", (unsigned)e->id, e->type);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd == 0) {
+            s_clients[i] = (gw_ws_client_t){0};
+            s_clients[i].fd = fd;
+            s_clients[i].session = ++s_session_seq ? s_session_seq : ++s_session_seq;
+            portEXIT_CRITICAL(&s_client_lock);
+            return true;
+        }
     }
+    portEXIT_CRITICAL(&s_client_lock);
+    return false;
 }
 
-static void ws_send_rsp(int fd, cJSON *id, bool ok, const char *err)
+// Events are encoded straight into a shared frame (JSON via ws_build_frame(), TLV with the same
+// sizing + fill passes), so one event costs one allocation however many clients receive it.
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} ws_enc_t;
+
+static void enc_put(ws_enc_t *w, const void *p, size_t n)
 {
-    cJSON *o = cJSON_CreateObject();
-    if (!o) return;
-    cJSON_AddStringToObject(o, "t", "rsp");
-    if (id) {
-        cJSON_AddItemToObject(o, "id", cJSON_Duplicate(id, 1));
-    }
-    cJSON_AddBoolToObject(o, "ok", ok);
-    if (!ok && err) {
-        cJSON_AddStringToObject(o, "err", err);
-    }
-    char *s = cJSON_PrintUnformatted(o);
-    if (s) {
-        (void)ws_send_json_async(fd, s);
-        cJSON_free(s);
-    }
-    cJSON_Delete(o);
+    if (w->buf) {
+        memcpy(w->buf + w->len, p, n);
+    }
+    w->len += n;
 }
 
-static void ws_handle_req(int fd, cJSON *root)
+static void ws_build_event_json(gw_json_writer_t *w, const void *ctx)
 {
-    cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id");
-    cJSON *m = cJSON_GetObjectItemCaseSensitive(root, "m");
-    if (!cJSON_IsString(m) || !m->valuestring) {
-        ws_send_rsp(fd, id, false, "missing m");
-        return;
-    }
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "event");
+    gw_event_write_json_fields(w, (const gw_event_t *)ctx);
+    gw_json_obj_end(w);
+}
 
-    if (strcmp(m->valuestring, "events.list") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        uint32_t since = 0;
-        size_t limit = 64;
-        if (cJSON_IsObject(p)) {
-            cJSON *since_j = cJSON_GetObjectItemCaseSensitive(p, "since");
-            cJSON *limit_j = cJSON_GetObjectItemCaseSensitive(p, "limit");
-            if (cJSON_IsNumber(since_j) && since_j->valuedouble >= 0) {
-                since = (uint32_t)since_j->valuedouble;
-            }
-            if (cJSON_IsNumber(limit_j) && limit_j->valuedouble >= 1 && limit_j->valuedouble <= 128) {
-                limit = (size_t)limit_j->valuedouble;
-            }
-        }
+// Binary event frame (docs/ws-protocol.md): magic, version, then tag/len/value fields, little-endian.
+#define GW_WS_TLV_MAGIC 0xE7
+#define GW_WS_TLV_VERSION 1
+
+enum {
+    GW_WS_TLV_ID = 1,
+    GW_WS_TLV_TS_MS = 2,
+    GW_WS_TLV_TYPE = 3,
+    GW_WS_TLV_SOURCE = 4,
+    GW_WS_TLV_DEVICE_UID = 5,
+    GW_WS_TLV_SHORT_ADDR = 6,
+    GW_WS_TLV_MSG = 7,
+    GW_WS_TLV_PAYLOAD = 8,
+    GW_WS_TLV_DATA = 9,
+};
+
+static void enc_tlv(ws_enc_t *w, uint8_t tag, const void *p, size_t n)
+{
+    const uint8_t hdr[2] = {tag, (uint8_t)n};
+    enc_put(w, hdr, sizeof(hdr));
+    enc_put(w, p, n);
+}
 
-        gw_event_t *events = (gw_event_t *)calloc(limit, sizeof(gw_event_t));
-        if (!events) {
-            ws_send_rsp(fd, id, false, "no mem");
-            return;
-        }
+static void enc_tlv_uint(ws_enc_t *w, uint8_t tag, uint64_t v, size_t n)
+{
+    uint8_t le[8];
+    for (size_t i = 0; i < n; i++) {
+        le[i] = (uint8_t)(v >> (8 * i));
+    }
+    enc_tlv(w, tag, le, n);
+}
 
-        uint32_t last_id = 0;
-        size_t count = gw_event_bus_list_since(since, events, limit, &last_id);
+static void enc_tlv_str(ws_enc_t *w, uint8_t tag, const char *s)
+{
+    const size_t n = strlen(s);
+    if (n > 0) {
+        enc_tlv(w, tag, s, n > 255 ? 255 : n);
+    }
+}
 
-        cJSON *o = cJSON_CreateObject();
-        cJSON_AddStringToObject(o, "t", "rsp");
-        if (id) cJSON_AddItemToObject(o, "id", cJSON_Duplicate(id, 1));
-        cJSON_AddBoolToObject(o, "ok", true);
+static void ws_encode_event_tlv(ws_enc_t *w, const gw_event_t *e)
+{
+    const uint8_t hdr[3] = {GW_WS_TLV_MAGIC, GW_WS_TLV_VERSION, e->v};
+    enc_put(w, hdr, sizeof(hdr));
+    enc_tlv_uint(w, GW_WS_TLV_ID, e->id, 4);
+    enc_tlv_uint(w, GW_WS_TLV_TS_MS, e->ts_ms, 8);
+    enc_tlv_str(w, GW_WS_TLV_TYPE, e->type);
+    enc_tlv_str(w, GW_WS_TLV_SOURCE, e->source);
+    enc_tlv_str(w, GW_WS_TLV_DEVICE_UID, e->device_uid);
+    enc_tlv_uint(w, GW_WS_TLV_SHORT_ADDR, e->short_addr, 2);
+    enc_tlv_str(w, GW_WS_TLV_MSG, e->msg);
+    if (e->payload_json[0] == '{' || e->payload_json[0] == '[') {
+        enc_tlv_str(w, GW_WS_TLV_PAYLOAD, e->payload_json);
+    }
+    if (e->data.evt_type || e->data.flags) {
+        const gw_event_data_t *d = &e->data;
+        const uint8_t data[12] = {
+            d->evt_type, d->flags, d->endpoint, d->cmd,
+            (uint8_t)d->cluster_id, (uint8_t)(d->cluster_id >> 8),
+            (uint8_t)d->attr_id, (uint8_t)(d->attr_id >> 8),
+            (uint8_t)d->value, (uint8_t)((uint32_t)d->value >> 8),
+            (uint8_t)((uint32_t)d->value >> 16), (uint8_t)((uint32_t)d->value >> 24),
+        };
+        enc_tlv(w, GW_WS_TLV_DATA, data, sizeof(data));
+    }
+}
 
-        cJSON *res = cJSON_AddObjectToObject(o, "res");
-        cJSON_AddNumberToObject(res, "last_id", (double)last_id);
-        cJSON *arr = cJSON_AddArrayToObject(res, "events");
-        for (size_t i = 0; i < count; i++) {
-            const gw_event_t *e = &events[i];
-            cJSON *je = cJSON_CreateObject();
-            cJSON_AddNumberToObject(je, "v", (double)e->v);
-            cJSON_AddNumberToObject(je, "id", (double)e->id);
-            cJSON_AddNumberToObject(je, "ts_ms", (double)e->ts_ms);
-            cJSON_AddStringToObject(je, "type", e->type);
-            cJSON_AddStringToObject(je, "source", e->source);
-            cJSON_AddStringToObject(je, "device_uid", e->device_uid);
-            cJSON_AddNumberToObject(je, "short_addr", (double)e->short_addr);
-            cJSON_AddStringToObject(je, "msg", e->msg);
-
-            if (e->payload_json[0] != '\0') {
-                cJSON *p = cJSON_Parse(e->payload_json);
-                if (p) cJSON_AddItemToObject(je, "payload", p);
-            }
-            cJSON_AddItemToArray(arr, je);
-        }
+static gw_ws_frame_t *ws_event_frame(const gw_event_t *e, bool binary)
+{
+    if (!binary) {
+        return ws_build_frame(ws_build_event_json, e);
+    }
+    ws_enc_t w = {0};
+    ws_encode_event_tlv(&w, e);
+    gw_ws_frame_t *f = ws_frame_alloc(w.len);
+    if (!f) {
+        return NULL;
+    }
+    w = (ws_enc_t){.buf = f->data};
+    ws_encode_event_tlv(&w, e);
+    return f;
+}
 
-        char *s = cJSON_PrintUnformatted(o);
-        if (s) {
-            (void)ws_send_json_async(fd, s);
-            cJSON_free(s);
+static bool ws_filter_dev(const ws_sub_filter_t *f, gw_dev_handle_t dev)
+{
+    if (f->dev_count == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < f->dev_count; i++) {
+        if (f->devs[i] == dev) {
+            return true;
         }
-        cJSON_Delete(o);
-        free(events);
-        return;
     }
+    return false;
+}
 
-    if (strcmp(m->valuestring, "automations.list") == 0) {
-        const size_t max_autos = 32;  // Match GW_AUTOMATION_CAP
-        gw_automation_meta_t *metas = (gw_automation_meta_t *)calloc(max_autos, sizeof(gw_automation_meta_t));
-        if (!metas) {
-            ws_send_rsp(fd, id, false, "no mem");
-            return;
+static bool ws_filter_type(const ws_sub_filter_t *f, const char *type)
+{
+    if (f->type_count == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < f->type_count; i++) {
+        const char *p = f->types[i];
+        const size_t n = strlen(p);
+        if (n > 0 && p[n - 1] == '*' ? strncmp(type, p, n - 1) == 0 : strcmp(type, p) == 0) {
+            return true;
         }
-        size_t count = gw_automation_store_list_meta(metas, max_autos);
-        ESP_LOGI("gw_ws", "automations.list: fd=%d, count=%zu", fd, count);
+    }
+    return false;
+}
 
-        cJSON *o = cJSON_CreateObject();
-        cJSON_AddStringToObject(o, "t", "rsp");
-        if (id) cJSON_AddItemToObject(o, "id", cJSON_Duplicate(id, 1));
-        cJSON_AddBoolToObject(o, "ok", true);
+static void ws_filter_bind(ws_sub_filter_t *f, uint32_t handle_gen)
+{
+    for (size_t i = 0; i < f->dev_count; i++) {
+        f->devs[i] = gw_device_registry_find_handle(&f->uids[i]);
+    }
+    f->handle_gen = handle_gen;
+}
 
-        cJSON *res = cJSON_AddObjectToObject(o, "res");
-        cJSON *arr = cJSON_AddArrayToObject(res, "automations");
-        for (size_t i = 0; i < count; i++) {
-            const gw_automation_meta_t *a = &metas[i];
-            cJSON *ja = cJSON_CreateObject();
-            cJSON_AddStringToObject(ja, "id", a->id);
-            cJSON_AddStringToObject(ja, "name", a->name);
-            cJSON_AddBoolToObject(ja, "enabled", a->enabled);
-            // NOTE: The "json" field is no longer sent, this is an API change.
-            cJSON_AddItemToArray(arr, ja);
+// Re-resolves the device lists bound against an older handle generation: a device that got its
+// handle since starts matching, and a released handle stops standing for the old uid.
+static void ws_filters_rebind(void)
+{
+    const uint32_t gen = gw_device_registry_handle_gen();
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        ws_sub_filter_t f;
+        portENTER_CRITICAL(&s_client_lock);
+        const int fd = s_clients[i].fd;
+        const bool stale = fd != 0 && s_clients[i].filter.dev_count > 0 && s_clients[i].filter.handle_gen != gen;
+        if (stale) {
+            f = s_clients[i].filter;
+        }
+        portEXIT_CRITICAL(&s_client_lock);
+        if (!stale) {
+            continue;
         }
 
-        char *s = cJSON_PrintUnformatted(o);
-        if (s) {
-            (void)ws_send_json_async(fd, s);
-            cJSON_free(s);
+        ws_filter_bind(&f, gen);
+        portENTER_CRITICAL(&s_client_lock);
+        ws_sub_filter_t *cur = &s_clients[i].filter;
+        // Keep a filter the client replaced meanwhile.
+        if (s_clients[i].fd == fd && cur->dev_count == f.dev_count && memcmp(cur->uids, f.uids, sizeof(f.uids)) == 0) {
+            memcpy(cur->devs, f.devs, sizeof(f.devs));
+            cur->handle_gen = gen;
         }
-        cJSON_Delete(o);
-        free(metas);
-        return;
+        portEXIT_CRITICAL(&s_client_lock);
     }
+}
 
-    if (strcmp(m->valuestring, "automations.put") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "id") : NULL;
-        cJSON *name_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "name") : NULL;
-        cJSON *enabled_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "enabled") : NULL;
-        cJSON *json_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "json") : NULL;
+// `dev` is the handle of e->device_uid (GW_DEV_HANDLE_INVALID if none), looked up once per event.
+static bool ws_filter_event(const ws_sub_filter_t *f, const gw_event_t *e, gw_dev_handle_t dev)
+{
+    if (f->dev_count > 0 && (dev == GW_DEV_HANDLE_INVALID || !ws_filter_dev(f, dev))) {
+        return false;
+    }
+    return ws_filter_type(f, e->type);
+}
 
-        if (!cJSON_IsString(id_j) || !id_j->valuestring || id_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing or empty id");
-            return;
-        }
-        if (!cJSON_IsString(name_j) || !name_j->valuestring) {
-            ws_send_rsp(fd, id, false, "missing name");
-            return;
-        }
-        if (!cJSON_IsString(json_j) || !json_j->valuestring) {
-            ws_send_rsp(fd, id, false, "missing json");
-            return;
-        }
+static gw_dev_handle_t ws_event_dev(const gw_event_t *e)
+{
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, e->device_uid, sizeof(uid.uid));
+    return gw_device_registry_find_handle(&uid);
+}
 
-        const char *automation_id = id_j->valuestring;
-        const char *automation_name = name_j->valuestring;
-        const char *automation_json = json_j->valuestring;
-        bool enabled = cJSON_IsBool(enabled_j) ? cJSON_IsTrue(enabled_j) : true;
+// Attribute reports for the same (device, endpoint, cluster, attr) may replace each other while a
+// client is behind; everything else is delivered as is (key 0).
+static uint32_t ws_event_coalesce_key(const gw_event_t *e)
+{
+    const gw_event_data_t *d = &e->data;
+    const uint8_t need = GW_EVENT_DATA_HAS_CLUSTER | GW_EVENT_DATA_HAS_ATTR;
+    if (d->evt_type != GW_AUTO_EVT_ZIGBEE_ATTR_REPORT || (d->flags & need) != need) {
+        return 0;
+    }
+    uint32_t h = 2166136261u;
+    for (const char *p = e->device_uid; *p; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    h = (h ^ d->endpoint) * 16777619u;
+    h = (h ^ d->cluster_id) * 16777619u;
+    h = (h ^ d->attr_id) * 16777619u;
+    return h ? h : 1;
+}
 
-        esp_err_t err = gw_automation_store_put(automation_id, automation_name, enabled, automation_json);
+#define GW_WS_REPLAY_MAX 64
+#define GW_WS_REPLAY_POLL_MS 10
+#define GW_WS_REPLAY_STALL_MS 2000 // a paced replay stops waiting for a client that takes no frames
 
-        if (err != ESP_OK) {
-            char emsg[128];
-            snprintf(emsg, sizeof(emsg), "store failed: %s (0x%x)", esp_err_to_name(err), (unsigned)err);
-            ws_send_rsp(fd, id, false, emsg);
+// Waits until half of fd's send queue is free, so a replay leaves room for live events. Returns
+// at once if the client is gone or already behind (resync pending), and after
+// GW_WS_REPLAY_STALL_MS, from where the queue's overflow handling takes over.
+static void ws_replay_wait_room(int fd)
+{
+    for (uint32_t waited = 0; waited < GW_WS_REPLAY_STALL_MS; waited += GW_WS_REPLAY_POLL_MS) {
+        portENTER_CRITICAL(&s_client_lock);
+        const gw_ws_client_t *c = ws_client_find_locked(fd);
+        const bool room = !c || c->need_resync ||
+                          (c->q_len < GW_WS_CLIENT_QUEUE / 2 && c->queued_bytes < GW_WS_CLIENT_MAX_QUEUED_BYTES / 2);
+        portEXIT_CRITICAL(&s_client_lock);
+        if (room) {
             return;
         }
-
-        // Publish an event to notify other modules (like the rules engine) that an automation has changed.
-        // Although the rules engine is now stateless, this event is useful for logging and external integrations.
-        gw_event_bus_publish("automation_saved", "ws", "", 0, automation_id);
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+        vTaskDelay(pdMS_TO_TICKS(GW_WS_REPLAY_POLL_MS));
     }
+}
 
-    if (strcmp(m->valuestring, "automations.remove") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "id") : NULL;
-        if (!cJSON_IsString(id_j) || !id_j->valuestring || id_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing id");
-            return;
-        }
-        const char *auto_id = id_j->valuestring;
-        ESP_LOGI("gw_ws", "automations.remove: deleting %s", auto_id);
-        esp_err_t err = gw_automation_store_remove(auto_id);
-        if (err != ESP_OK) {
-            ESP_LOGW("gw_ws", "automations.remove: failed to remove %s: %s", auto_id, esp_err_to_name(err));
-            ws_send_rsp(fd, id, false, "not found");
-            return;
-        }
-        gw_event_bus_publish("automation_removed", "ws", "", 0, auto_id);
-        ESP_LOGI("gw_ws", "automations.remove: successfully deleted %s", auto_id);
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+static void ws_build_gap(gw_json_writer_t *w, const void *ctx)
+{
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "gap");
+    gw_event_gap_write_json(w, (const gw_event_gap_t *)ctx);
+    gw_json_obj_end(w);
+}
+
+static void ws_push_gap(int fd, const gw_event_gap_t *gap)
+{
+    gw_ws_frame_t *f = ws_build_frame(ws_build_gap, gap);
+    if (f) {
+        (void)ws_client_push_event(fd, f, false, 0, 0);
+        ws_frame_release(f);
     }
+}
 
-    if (strcmp(m->valuestring, "automations.set_enabled") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "id") : NULL;
-        cJSON *enabled_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "enabled") : NULL;
-        if (!cJSON_IsString(id_j) || !id_j->valuestring || id_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing id");
-            return;
-        }
-        if (!cJSON_IsBool(enabled_j)) {
-            ws_send_rsp(fd, id, false, "missing enabled");
-            return;
-        }
-        esp_err_t err = gw_automation_store_set_enabled(id_j->valuestring, cJSON_IsTrue(enabled_j));
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "not found");
-            return;
-        }
-        char msg[96];
-        (void)snprintf(msg, sizeof(msg), "id=%s enabled=%u", id_j->valuestring, cJSON_IsTrue(enabled_j) ? 1U : 0U);
-        char payload[128];
-        (void)snprintf(payload,
-                       sizeof(payload),
-                       "{\"id\":\"%s\",\"enabled\":%s}",
-                       id_j->valuestring,
-                       cJSON_IsTrue(enabled_j) ? "true" : "false");
-        gw_event_bus_publish_ex("automation_enabled", "ws", "", 0, msg, payload);
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+// Ends a replay of fd's connection `session` that did not catch up: the client gets a resync
+// marker for the rest and live pushes resume after the current head.
+static void ws_replay_abort(int fd, uint32_t session)
+{
+    bool resync = false;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (c && c->session == session) {
+        c->replays = c->replays ? c->replays - 1 : 0;
+        c->live_after = gw_event_bus_last_id();
+        c->need_resync = true;
+        c->resync_id = c->live_after;
+        resync = true;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    if (resync) {
+        ws_client_pump(fd);
     }
+}
 
-    if (strcmp(m->valuestring, "network.permit_join") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        int seconds = 180;
-        if (cJSON_IsObject(p)) {
-            cJSON *sec = cJSON_GetObjectItemCaseSensitive(p, "seconds");
-            if (cJSON_IsNumber(sec) && sec->valueint > 0 && sec->valueint <= 255) {
-                seconds = sec->valueint;
-            }
-        }
+// Replays events after `since` (the newest `limit` events for since 0) while live pushes to the
+// client are held back (see gw_ws_client_t.replays), then hands over to them at the last replayed
+// id, so the client sees every id once and in order. More than `limit` events behind, the replay
+// stops with a resync marker. Replayed events go through the client's send queue like pushed ones,
+// so a client that cannot take the backlog gets a resync marker instead of an unbounded pile of
+// frames in httpd. With `pace` (request workers only, never the httpd task) each frame waits for
+// queue room first.
+static void ws_send_events_since(int fd, uint32_t since, size_t limit, bool pace)
+{
+    const uint32_t session = ws_client_session(fd);
+    if (limit < 1 || limit > 128) {
+        limit = limit < 1 ? 1 : 128;
+    }
 
-        esp_err_t err = gw_zigbee_permit_join((uint8_t)seconds);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "permit_join failed");
-            return;
-        }
-        char emsg[48];
-        (void)snprintf(emsg, sizeof(emsg), "seconds=%u", (unsigned)seconds);
-        gw_event_bus_publish("api_permit_join", "ws", "", 0, emsg);
-        ws_send_rsp(fd, id, true, NULL);
+    gw_event_t *events = (gw_event_t *)calloc(limit, sizeof(gw_event_t));
+    if (!events) {
+        ws_replay_abort(fd, session);
         return;
     }
 
-    if (strcmp(m->valuestring, "devices.remove") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *kick_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "kick") : NULL;
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
-        }
+    ws_filters_rebind();
+    bool binary = false;
+    ws_sub_filter_t filter = {0};
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (c) {
+        binary = c->binary_events;
+        filter = c->filter;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
 
-        bool kick = cJSON_IsBool(kick_j) ? cJSON_IsTrue(kick_j) : false;
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-
-        uint16_t short_addr = 0;
-        if (kick) {
-            gw_device_t d = {0};
-            esp_err_t gerr = gw_device_registry_get(&uid, &d);
-            if (gerr != ESP_OK) {
-                ws_send_rsp(fd, id, false, "device not found");
-                return;
+    if (since == 0) {
+        const uint32_t head = gw_event_bus_last_id();
+        since = head > limit ? head - (uint32_t)limit : 0;
+    }
+
+    size_t replayed = 0;
+    bool caught_up = false;
+    while (replayed < limit) {
+        uint32_t last_id = 0;
+        gw_event_gap_t gap = {0};
+        const size_t count = gw_event_journal_list_since(since, events, limit - replayed, &last_id, &gap);
+        for (size_t i = 0; i < count; i++) {
+            // The gap message goes where the missing ids would have been, whatever the filter.
+            if (gap.first_id && events[i].id > gap.last_id) {
+                ws_push_gap(fd, &gap);
+                gap.first_id = 0;
+            }
+            since = events[i].id;
+            if (!ws_filter_event(&filter, &events[i], ws_event_dev(&events[i]))) {
+                continue;
+            }
+            if (pace) {
+                ws_replay_wait_room(fd);
             }
-            short_addr = d.short_addr;
-            esp_err_t lerr = gw_zigbee_device_leave(&uid, short_addr, false);
-            if (lerr != ESP_OK) {
-                ws_send_rsp(fd, id, false, "leave failed");
-                return;
+            gw_ws_frame_t *f = ws_event_frame(&events[i], binary);
+            if (f) {
+                (void)ws_client_push_event(fd, f, binary, ws_event_coalesce_key(&events[i]), events[i].id);
+                ws_frame_release(f);
             }
-            char msg[64];
-            (void)snprintf(msg, sizeof(msg), "uid=%s short=0x%04x", uid.uid, (unsigned)short_addr);
-            gw_event_bus_publish("api_device_kick", "ws", uid.uid, short_addr, msg);
         }
-
-        esp_err_t rm = gw_device_registry_remove(&uid);
-        if (rm != ESP_OK) {
-            ws_send_rsp(fd, id, false, "device not found");
-            return;
+        if (gap.first_id) {
+            ws_push_gap(fd, &gap);
+            since = gap.last_id > since ? gap.last_id : since;
         }
-        gw_event_bus_publish("api_device_removed", "ws", uid.uid, short_addr, kick ? "kick=1" : "kick=0");
-        ws_send_rsp(fd, id, true, NULL);
-        return;
-    }
+        replayed += count;
 
-    if (strcmp(m->valuestring, "devices.set_name") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *name_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "name") : NULL;
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
+        // Checked under the client lock: an event published after this is pushed live, one
+        // published before is still ahead of `since` and gets replayed.
+        portENTER_CRITICAL(&s_client_lock);
+        c = ws_client_find_locked(fd);
+        const bool gone = !c || c->session != session;
+        caught_up = gone || !c->subscribed_events || gw_event_bus_last_id() <= since;
+        if (caught_up && !gone) {
+            c->replays = c->replays ? c->replays - 1 : 0;
+            c->live_after = since;
         }
-        if (!cJSON_IsString(name_j) || !name_j->valuestring) {
-            ws_send_rsp(fd, id, false, "missing name");
-            return;
+        portEXIT_CRITICAL(&s_client_lock);
+        if (caught_up) {
+            break;
         }
-
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-
-        esp_err_t err = gw_device_registry_set_name(&uid, name_j->valuestring);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, (err == ESP_ERR_NOT_FOUND) ? "device not found" : "registry failed");
-            return;
+        if (count == 0 && !gap.first_id) {
+            vTaskDelay(1); // the next id is still being written
         }
-        gw_event_bus_publish("device_renamed", "ws", uid.uid, 0, name_j->valuestring);
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+    }
+    if (!caught_up) {
+        ws_replay_abort(fd, session);
     }
 
-    if (strcmp(m->valuestring, "devices.onoff") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *endpoint_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "endpoint") : NULL;
-        cJSON *cmd_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "cmd") : NULL;
+    free(events);
+}
 
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
-        }
-        if (!cJSON_IsString(cmd_j) || !cmd_j->valuestring || cmd_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing cmd");
-            return;
-        }
+// Ring consumer used to offload event -> WS JSON build/send from publisher context.
+static gw_event_consumer_t *s_event_consumer = NULL;
+static TaskHandle_t s_event_task = NULL;
 
-        uint8_t endpoint = 1;
-        if (cJSON_IsNumber(endpoint_j) && endpoint_j->valuedouble >= 1 && endpoint_j->valuedouble <= 240) {
-            endpoint = (uint8_t)endpoint_j->valuedouble;
-        }
+static void ws_event_task_fn(void *arg)
+{
+    (void)arg;
+    gw_event_t e;
+    while (true) {
+        if (gw_event_bus_consumer_read(s_event_consumer, &e, portMAX_DELAY) == ESP_OK) {
+            int fds[GW_WS_MAX_CLIENTS];
+            bool binary[GW_WS_MAX_CLIENTS];
+            size_t fd_count = 0;
+            ws_filters_rebind();
+            const gw_dev_handle_t dev = e.device_uid[0] ? ws_event_dev(&e) : GW_DEV_HANDLE_INVALID;
 
-        gw_zigbee_onoff_cmd_t c = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        if (strcmp(cmd_j->valuestring, "on") == 0) {
-            c = GW_ZIGBEE_ONOFF_CMD_ON;
-        } else if (strcmp(cmd_j->valuestring, "off") == 0) {
-            c = GW_ZIGBEE_ONOFF_CMD_OFF;
-        } else if (strcmp(cmd_j->valuestring, "toggle") == 0) {
-            c = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        } else {
-            ws_send_rsp(fd, id, false, "bad cmd");
-            return;
-        }
+            // Filters are checked before serialization, so events nobody wants are never encoded.
+            portENTER_CRITICAL(&s_client_lock);
+            for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+                const gw_ws_client_t *c = &s_clients[i];
+                if (c->fd != 0 && c->subscribed_events && c->replays == 0 && e.id > c->live_after &&
+                    ws_filter_event(&c->filter, &e, dev)) {
+                    binary[fd_count] = s_clients[i].binary_events;
+                    fds[fd_count++] = s_clients[i].fd;
+                }
+            }
+            portEXIT_CRITICAL(&s_client_lock);
 
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-        esp_err_t err = gw_zigbee_onoff_cmd(&uid, endpoint, c);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "onoff failed");
-            return;
+            // No one listening: skip encoding entirely.
+            if (fd_count == 0) continue;
+
+            // Each encoding is built at most once and shared by all clients that use it.
+            gw_ws_frame_t *frames[2] = {NULL, NULL}; // [json, tlv]
+            const uint32_t key = ws_event_coalesce_key(&e);
+            for (size_t i = 0; i < fd_count; i++) {
+                const size_t enc = binary[i] ? 1 : 0;
+                if (!frames[enc]) {
+                    frames[enc] = ws_event_frame(&e, binary[i]);
+                    if (!frames[enc]) continue;
+                }
+                ws_client_push_event(fds[i], frames[enc], binary[i], key, e.id);
+            }
+            ws_frame_release(frames[0]);
+            ws_frame_release(frames[1]);
         }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
     }
+}
 
-    if (strcmp(m->valuestring, "devices.level") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *endpoint_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "endpoint") : NULL;
-        cJSON *level_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "level") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
-
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
-        }
-        if (!cJSON_IsNumber(level_j) || level_j->valuedouble < 0 || level_j->valuedouble > 254) {
-            ws_send_rsp(fd, id, false, "bad level");
-            return;
-        }
+// State topic: a client gets a full snapshot when it subscribes, then batches of the keys whose
+// store version advanced, at most one per state_interval_ms. One task builds every state frame,
+// so a client never sees an older value after a newer one. The store's change listener only
+// wakes it.
+#define GW_WS_STATE_INTERVAL_MS 250
+#define GW_WS_STATE_INTERVAL_MIN_MS 50
+#define GW_WS_STATE_INTERVAL_MAX_MS 10000
+#define GW_WS_STATE_BATCH_MAX 48 // items per frame
 
-        uint8_t endpoint = 1;
-        if (cJSON_IsNumber(endpoint_j) && endpoint_j->valuedouble >= 1 && endpoint_j->valuedouble <= 240) {
-            endpoint = (uint8_t)endpoint_j->valuedouble;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
-        }
+static TaskHandle_t s_state_task = NULL;
+static gw_state_item_t s_state_items[GW_WS_STATE_BATCH_MAX]; // owned by ws_state_task
 
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-        gw_zigbee_level_t level = {.level = (uint8_t)level_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_level_move_to_level(&uid, endpoint, level);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "level failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+static void ws_state_changed(const gw_state_item_t *item, void *user_ctx)
+{
+    (void)item;
+    (void)user_ctx;
+    if (s_state_task) {
+        xTaskNotifyGive(s_state_task);
     }
+}
 
-    if (strcmp(m->valuestring, "devices.color_xy") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *endpoint_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "endpoint") : NULL;
-        cJSON *x_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "x") : NULL;
-        cJSON *y_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "y") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
-
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
-        }
-        if (!cJSON_IsNumber(x_j) || x_j->valuedouble < 0 || x_j->valuedouble > 65535) {
-            ws_send_rsp(fd, id, false, "bad x");
-            return;
-        }
-        if (!cJSON_IsNumber(y_j) || y_j->valuedouble < 0 || y_j->valuedouble > 65535) {
-            ws_send_rsp(fd, id, false, "bad y");
-            return;
-        }
+typedef struct {
+    const gw_state_item_t *items;
+    size_t count;
+    bool full;
+    uint32_t ver;
+} ws_state_batch_t;
 
-        uint8_t endpoint = 1;
-        if (cJSON_IsNumber(endpoint_j) && endpoint_j->valuedouble >= 1 && endpoint_j->valuedouble <= 240) {
-            endpoint = (uint8_t)endpoint_j->valuedouble;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
-        }
+static int ws_state_item_cmp(const void *a, const void *b)
+{
+    const gw_state_item_t *x = (const gw_state_item_t *)a;
+    const gw_state_item_t *y = (const gw_state_item_t *)b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    return (int)x->key - (int)y->key;
+}
 
+// {"t":"state","full":bool,"ver":N,"devices":{"<uid>":{"<key>":value,...},...}}; items sorted by device.
+static void ws_build_state(gw_json_writer_t *w, const void *ctx)
+{
+    const ws_state_batch_t *b = (const ws_state_batch_t *)ctx;
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "state");
+    gw_json_kv_bool(w, "full", b->full);
+    gw_json_kv_u64(w, "ver", b->ver);
+    gw_json_key(w, "devices");
+    gw_json_obj_begin(w);
+    for (size_t i = 0; i < b->count;) {
+        const gw_dev_handle_t dev = b->items[i].dev;
         gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-        gw_zigbee_color_xy_t color = {.x = (uint16_t)x_j->valuedouble, .y = (uint16_t)y_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_color_move_to_xy(&uid, endpoint, color);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "color failed");
-            return;
+        const bool named = gw_device_registry_handle_uid(dev, &uid) == ESP_OK;
+        if (named) {
+            gw_json_key(w, uid.uid);
+            gw_json_obj_begin(w);
+        }
+        for (; i < b->count && b->items[i].dev == dev; i++) {
+            if (named) {
+                gw_json_key(w, gw_state_key_name(b->items[i].key));
+                gw_state_write_json_value(w, &b->items[i]);
+            }
+        }
+        if (named) {
+            gw_json_obj_end(w);
         }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
     }
+    gw_json_obj_end(w);
+    gw_json_obj_end(w);
+}
 
-    if (strcmp(m->valuestring, "devices.color_temp") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "uid") : NULL;
-        cJSON *endpoint_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "endpoint") : NULL;
-        cJSON *mireds_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "mireds") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
+static bool ws_state_send_batch(int fd, const ws_state_batch_t *b)
+{
+    gw_ws_frame_t *f = ws_build_frame(ws_build_state, b);
+    if (!f) {
+        return false;
+    }
+    const bool queued = ws_client_push_event(fd, f, false, 0, 0);
+    ws_frame_release(f);
+    return queued;
+}
 
-        if (!cJSON_IsString(uid_j) || !uid_j->valuestring || uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing uid");
-            return;
+// Sends the items of `filter` changed after `since` (all of them when `full`), split into frames of
+// GW_WS_STATE_BATCH_MAX; only the first frame of a snapshot is marked full. Returns false if a frame
+// was lost, in which case the caller falls back to a snapshot.
+static bool ws_state_flush(int fd, const ws_sub_filter_t *filter, bool full, uint32_t since, uint32_t ver)
+{
+    size_t cursor = 0;
+    size_t n = 0;
+    bool first = true;
+    bool more = true;
+    while (more) {
+        const size_t got = gw_state_store_changed_since(full ? 0 : since, &cursor, &s_state_items[n], GW_WS_STATE_BATCH_MAX - n);
+        more = n + got == GW_WS_STATE_BATCH_MAX;
+        const size_t base = n;
+        for (size_t i = 0; i < got; i++) {
+            if (ws_filter_dev(filter, s_state_items[base + i].dev)) {
+                s_state_items[n++] = s_state_items[base + i];
+            }
         }
-        if (!cJSON_IsNumber(mireds_j) || mireds_j->valuedouble < 1 || mireds_j->valuedouble > 1000) {
-            ws_send_rsp(fd, id, false, "bad mireds");
-            return;
+        // Flush when the buffer is full or the walk is done; an empty snapshot is still sent.
+        if (n == GW_WS_STATE_BATCH_MAX || (!more && (n > 0 || (full && first)))) {
+            qsort(s_state_items, n, sizeof(s_state_items[0]), ws_state_item_cmp);
+            const ws_state_batch_t b = {.items = s_state_items, .count = n, .full = full && first, .ver = ver};
+            if (!ws_state_send_batch(fd, &b)) {
+                return false;
+            }
+            first = false;
+            n = 0;
         }
+    }
+    return true;
+}
 
-        uint8_t endpoint = 1;
-        if (cJSON_IsNumber(endpoint_j) && endpoint_j->valuedouble >= 1 && endpoint_j->valuedouble <= 240) {
-            endpoint = (uint8_t)endpoint_j->valuedouble;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
-        }
+static void ws_state_task_fn(void *arg)
+{
+    (void)arg;
+    while (true) {
+        const int64_t now = esp_timer_get_time();
+        ws_filters_rebind();
+        const uint32_t ver = gw_state_store_version();
+        const uint32_t floor = gw_state_store_removed_floor();
+        int64_t next_us = now + 1000000;
 
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_j->valuestring, sizeof(uid.uid));
-        gw_zigbee_color_temp_t temp = {.mireds = (uint16_t)mireds_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_color_move_to_temp(&uid, endpoint, temp);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "color temp failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
-    }
+        for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+            portENTER_CRITICAL(&s_client_lock);
+            const gw_ws_client_t *c = &s_clients[i];
+            const int fd = c->fd;
+            const bool want = fd != 0 && c->subscribed_state && (c->state_full || c->state_ver != ver);
+            const bool full = c->state_full || c->state_ver < floor;
+            const uint32_t since = c->state_ver;
+            const int64_t due = c->state_due_us;
+            const ws_sub_filter_t filter = c->filter;
+            portEXIT_CRITICAL(&s_client_lock);
+            if (!want) {
+                continue;
+            }
+            if (due > now) {
+                next_us = due < next_us ? due : next_us;
+                continue;
+            }
 
-    if (strcmp(m->valuestring, "groups.onoff") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *cmd_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "cmd") : NULL;
+            const bool ok = ws_state_flush(fd, &filter, full, since, ver);
 
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
-        }
-        if (!cJSON_IsString(cmd_j) || !cmd_j->valuestring) {
-            ws_send_rsp(fd, id, false, "missing cmd");
-            return;
+            portENTER_CRITICAL(&s_client_lock);
+            gw_ws_client_t *cl = &s_clients[i];
+            if (cl->fd == fd && cl->subscribed_state) {
+                cl->state_full = !ok;
+                cl->state_ver = ok ? ver : 0;
+                cl->state_due_us = now + (int64_t)cl->state_interval_ms * 1000;
+            }
+            portEXIT_CRITICAL(&s_client_lock);
         }
 
-        gw_zigbee_onoff_cmd_t cmd;
-        if (strcmp(cmd_j->valuestring, "off") == 0) cmd = GW_ZIGBEE_ONOFF_CMD_OFF;
-        else if (strcmp(cmd_j->valuestring, "on") == 0) cmd = GW_ZIGBEE_ONOFF_CMD_ON;
-        else if (strcmp(cmd_j->valuestring, "toggle") == 0) cmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        else {
-            ws_send_rsp(fd, id, false, "bad cmd");
-            return;
-        }
+        const int64_t wait_ms = (next_us - now + 999) / 1000;
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms) > 0 ? pdMS_TO_TICKS(wait_ms) : 1);
+    }
+}
 
-        esp_err_t err = gw_zigbee_group_onoff_cmd(group_id, cmd);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "group onoff failed");
-            return;
+// Response envelope: {"t":"rsp","id":...,"ok":...,"err"?:...,"res"?:...}.
+typedef struct {
+    const cJSON *id;
+    bool ok;
+    const char *err;
+    ws_build_fn res; // optional result writer
+    const void *res_ctx;
+} ws_rsp_t;
+
+static void ws_write_id(gw_json_writer_t *w, const cJSON *id)
+{
+    if (cJSON_IsString(id) && id->valuestring) {
+        gw_json_str(w, id->valuestring);
+    } else if (cJSON_IsNumber(id)) {
+        const double v = id->valuedouble;
+        if (v == (double)(int64_t)v) {
+            gw_json_i64(w, (int64_t)v);
+        } else {
+            gw_json_f64(w, v, 6);
         }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+    } else if (cJSON_IsBool(id)) {
+        gw_json_bool(w, cJSON_IsTrue(id));
+    } else {
+        gw_json_null(w);
     }
+}
 
-    if (strcmp(m->valuestring, "groups.level") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *level_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "level") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
+static void ws_build_rsp(gw_json_writer_t *w, const void *ctx)
+{
+    const ws_rsp_t *r = (const ws_rsp_t *)ctx;
+    gw_json_obj_begin(w);
+    gw_json_kv_str(w, "t", "rsp");
+    if (r->id) {
+        gw_json_key(w, "id");
+        ws_write_id(w, r->id);
+    }
+    gw_json_kv_bool(w, "ok", r->ok);
+    if (!r->ok && r->err) {
+        gw_json_kv_str(w, "err", r->err);
+    }
+    if (r->res) {
+        gw_json_key(w, "res");
+        r->res(w, r->res_ctx);
+    }
+    gw_json_obj_end(w);
+}
 
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
-        }
-        if (!cJSON_IsNumber(level_j) || level_j->valuedouble < 0 || level_j->valuedouble > 254) {
-            ws_send_rsp(fd, id, false, "bad level");
-            return;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
-        }
+static void ws_send_rsp(int fd, const cJSON *id, bool ok, const char *err)
+{
+    const ws_rsp_t r = {.id = id, .ok = ok, .err = err};
+    (void)ws_send_built(fd, ws_build_rsp, &r);
+}
 
-        gw_zigbee_level_t level = {.level = (uint8_t)level_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_group_level_move_to_level(group_id, level);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "group level failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
+static void ws_send_rsp_res(int fd, const cJSON *id, ws_build_fn res, const void *res_ctx)
+{
+    const ws_rsp_t r = {.id = id, .ok = true, .res = res, .res_ctx = res_ctx};
+    gw_ws_frame_t *f = ws_build_frame(ws_build_rsp, &r);
+    if (!f) {
+        ws_send_rsp(fd, id, false, "no mem");
         return;
     }
+    (void)ws_send_frame_async(fd, f, HTTPD_WS_TYPE_TEXT);
+    ws_frame_release(f);
+}
 
-    if (strcmp(m->valuestring, "groups.color_xy") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *x_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "x") : NULL;
-        cJSON *y_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "y") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
+// Transport side of a gw_rpc call: where the response goes.
+typedef struct {
+    gw_rpc_call_t call;
+    int fd;
+    uint32_t session;
+    const cJSON *id;
+} ws_call_t;
 
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
-        }
-        if (!cJSON_IsNumber(x_j) || x_j->valuedouble < 0 || x_j->valuedouble > 65535) {
-            ws_send_rsp(fd, id, false, "bad x");
-            return;
-        }
-        if (!cJSON_IsNumber(y_j) || y_j->valuedouble < 0 || y_j->valuedouble > 65535) {
-            ws_send_rsp(fd, id, false, "bad y");
-            return;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
-        }
+static void ws_rpc_reply(gw_rpc_call_t *call, bool ok, const char *err, gw_rpc_result_fn res, const void *res_ctx)
+{
+    const ws_call_t *c = (const ws_call_t *)call->transport_ctx;
+    if (ws_client_session(c->fd) != c->session) {
+        return; // the connection went away while the request ran
+    }
+    if (res) {
+        ws_send_rsp_res(c->fd, c->id, res, res_ctx);
+    } else {
+        ws_send_rsp(c->fd, c->id, ok, err);
+    }
+}
 
-        gw_zigbee_color_xy_t color = {.x = (uint16_t)x_j->valuedouble, .y = (uint16_t)y_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_group_color_move_to_xy(group_id, color);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "group color failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+static void ws_handle_req(int fd, uint32_t session, cJSON *root)
+{
+    const cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    cJSON *m = cJSON_GetObjectItemCaseSensitive(root, "m");
+    ws_call_t c = {
+        .call = {
+            .method = m->valuestring,
+            .params = cJSON_GetObjectItemCaseSensitive(root, "p"),
+            .reply = ws_rpc_reply,
+        },
+        .fd = fd,
+        .session = session,
+        .id = id,
+    };
+    c.call.transport_ctx = &c;
+    if (gw_rpc_dispatch(&c.call) == ESP_ERR_NOT_FOUND && ws_client_session(fd) == session) {
+        ws_send_rsp(fd, id, false, "unknown method");
     }
+}
 
-    if (strcmp(m->valuestring, "groups.color_temp") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *mireds_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "mireds") : NULL;
-        cJSON *transition_ms_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "transition_ms") : NULL;
+// Requests run on a small worker pool instead of the httpd task, so a slow method (flash writes,
+// Zigbee calls) does not stall static files, other sockets or event push. Jobs of one connection
+// run one at a time in arrival order; different connections run in parallel. Responses carry the
+// request id, so they may interleave with pushed events. `since` replays (journal reads from
+// flash, paced by the client's send queue) are jobs of the same kind.
+#define GW_WS_WORKERS 2
+#define GW_WS_WORKER_STACK 6144
+#define GW_WS_JOB_QUEUE 16
+#define GW_WS_JOBS_PER_CLIENT 8
 
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
-        }
-        if (!cJSON_IsNumber(mireds_j) || mireds_j->valuedouble < 1 || mireds_j->valuedouble > 1000) {
-            ws_send_rsp(fd, id, false, "bad mireds");
-            return;
-        }
-        uint16_t transition_ms = 0;
-        if (cJSON_IsNumber(transition_ms_j) && transition_ms_j->valuedouble >= 0 && transition_ms_j->valuedouble <= 60000) {
-            transition_ms = (uint16_t)transition_ms_j->valuedouble;
+typedef struct {
+    int fd;
+    uint32_t session;
+    cJSON *root;    // owned by the job; NULL for a replay job
+    uint32_t since; // replay job: replay events after this id
+} ws_job_t;
+
+static ws_job_t s_jobs[GW_WS_JOB_QUEUE]; // FIFO
+static size_t s_job_count;
+static int s_job_running_fd[GW_WS_WORKERS]; // 0 = idle
+static portMUX_TYPE s_job_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_job_sem; // given whenever a job may have become runnable
+static TaskHandle_t s_workers[GW_WS_WORKERS];
+
+static bool ws_job_fd_running_locked(int fd)
+{
+    for (size_t i = 0; i < GW_WS_WORKERS; i++) {
+        if (s_job_running_fd[i] == fd) {
+            return true;
         }
+    }
+    return false;
+}
 
-        gw_zigbee_color_temp_t temp = {.mireds = (uint16_t)mireds_j->valuedouble, .transition_ms = transition_ms};
-        esp_err_t err = gw_zigbee_group_color_move_to_temp(group_id, temp);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "group color temp failed");
-            return;
+// Takes the oldest job whose connection has nothing running; marks it running on `worker`.
+static bool ws_job_take(size_t worker, ws_job_t *out)
+{
+    bool found = false;
+    portENTER_CRITICAL(&s_job_lock);
+    for (size_t i = 0; i < s_job_count; i++) {
+        if (!ws_job_fd_running_locked(s_jobs[i].fd)) {
+            *out = s_jobs[i];
+            s_job_count--;
+            memmove(&s_jobs[i], &s_jobs[i + 1], (s_job_count - i) * sizeof(s_jobs[0]));
+            s_job_running_fd[worker] = out->fd;
+            found = true;
+            break;
         }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
     }
+    portEXIT_CRITICAL(&s_job_lock);
+    return found;
+}
 
-    if (strcmp(m->valuestring, "scenes.store") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *scene_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "scene_id") : NULL;
-
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
+static void ws_worker_fn(void *arg)
+{
+    const size_t worker = (size_t)(uintptr_t)arg;
+    ws_job_t job;
+    while (true) {
+        if (!ws_job_take(worker, &job)) {
+            (void)xSemaphoreTake(s_job_sem, portMAX_DELAY);
+            continue;
         }
-        if (!cJSON_IsNumber(scene_id_j) || scene_id_j->valuedouble < 1 || scene_id_j->valuedouble > 255) {
-            ws_send_rsp(fd, id, false, "bad scene_id");
-            return;
+        if (job.root) {
+            ws_handle_req(job.fd, job.session, job.root);
+            cJSON_Delete(job.root);
+        } else if (ws_client_session(job.fd) == job.session) {
+            ws_send_events_since(job.fd, job.since, GW_WS_REPLAY_MAX, true);
         }
 
-        esp_err_t err = gw_zigbee_scene_store(group_id, (uint8_t)scene_id_j->valuedouble);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "scene store failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
-        return;
+        portENTER_CRITICAL(&s_job_lock);
+        s_job_running_fd[worker] = 0;
+        portEXIT_CRITICAL(&s_job_lock);
+        (void)xSemaphoreGive(s_job_sem); // the connection's next job may be waiting
     }
+}
 
-    if (strcmp(m->valuestring, "scenes.recall") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *group_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "group_id") : NULL;
-        cJSON *scene_id_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "scene_id") : NULL;
-
-        uint16_t group_id = 0;
-        if (!ws_parse_u16(group_id_j, &group_id) || group_id == 0 || group_id == 0xFFFF) {
-            ws_send_rsp(fd, id, false, "bad group_id");
-            return;
-        }
-        if (!cJSON_IsNumber(scene_id_j) || scene_id_j->valuedouble < 1 || scene_id_j->valuedouble > 255) {
-            ws_send_rsp(fd, id, false, "bad scene_id");
-            return;
-        }
+// Queues a job unless the queue or fd's share of it is full.
+static bool ws_job_push(const ws_job_t *job)
+{
+    bool queued = false;
+    portENTER_CRITICAL(&s_job_lock);
+    size_t per_fd = 0;
+    for (size_t i = 0; i < s_job_count; i++) {
+        per_fd += (s_jobs[i].fd == job->fd) ? 1 : 0;
+    }
+    if (s_job_count < GW_WS_JOB_QUEUE && per_fd < GW_WS_JOBS_PER_CLIENT) {
+        s_jobs[s_job_count++] = *job;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&s_job_lock);
+    if (queued) {
+        (void)xSemaphoreGive(s_job_sem);
+    }
+    return queued;
+}
 
-        esp_err_t err = gw_zigbee_scene_recall(group_id, (uint8_t)scene_id_j->valuedouble);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, "scene recall failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
+// Takes ownership of root. Without a worker pool the request runs inline.
+static void ws_submit_req(int fd, cJSON *root)
+{
+    const cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    cJSON *m = cJSON_GetObjectItemCaseSensitive(root, "m");
+    if (!cJSON_IsString(m) || !m->valuestring) {
+        ws_send_rsp(fd, id, false, "missing m");
+        cJSON_Delete(root);
+        return;
+    }
+    const uint32_t session = ws_client_session(fd);
+    if (!s_job_sem) {
+        ws_handle_req(fd, session, root);
+        cJSON_Delete(root);
         return;
     }
 
-    if (strcmp(m->valuestring, "bindings.bind") == 0 || strcmp(m->valuestring, "bindings.unbind") == 0) {
-        const bool unbind = (strcmp(m->valuestring, "bindings.unbind") == 0);
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *src_uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "src_uid") : NULL;
-        cJSON *src_ep_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "src_endpoint") : NULL;
-        cJSON *cluster_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "cluster_id") : NULL;
-        cJSON *dst_uid_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "dst_uid") : NULL;
-        cJSON *dst_ep_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "dst_endpoint") : NULL;
-
-        if (!cJSON_IsString(src_uid_j) || !src_uid_j->valuestring || src_uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing src_uid");
-            return;
-        }
-        if (!cJSON_IsString(dst_uid_j) || !dst_uid_j->valuestring || dst_uid_j->valuestring[0] == '\0') {
-            ws_send_rsp(fd, id, false, "missing dst_uid");
-            return;
-        }
-        if (!cJSON_IsNumber(src_ep_j) || src_ep_j->valuedouble < 1 || src_ep_j->valuedouble > 240) {
-            ws_send_rsp(fd, id, false, "bad src_endpoint");
-            return;
-        }
-        if (!cJSON_IsNumber(dst_ep_j) || dst_ep_j->valuedouble < 1 || dst_ep_j->valuedouble > 240) {
-            ws_send_rsp(fd, id, false, "bad dst_endpoint");
-            return;
-        }
-        uint16_t cluster_id = 0;
-        if (!ws_parse_u16(cluster_j, &cluster_id) || cluster_id == 0) {
-            ws_send_rsp(fd, id, false, "bad cluster_id");
-            return;
-        }
-
-        gw_device_uid_t src_uid = {0};
-        gw_device_uid_t dst_uid = {0};
-        strlcpy(src_uid.uid, src_uid_j->valuestring, sizeof(src_uid.uid));
-        strlcpy(dst_uid.uid, dst_uid_j->valuestring, sizeof(dst_uid.uid));
+    if (!ws_job_push(&(ws_job_t){.fd = fd, .session = session, .root = root})) {
+        ws_send_rsp(fd, id, false, "busy");
+        cJSON_Delete(root);
+    }
+}
 
-        esp_err_t err = unbind ? gw_zigbee_unbind(&src_uid, (uint8_t)src_ep_j->valuedouble, cluster_id, &dst_uid, (uint8_t)dst_ep_j->valuedouble)
-                               : gw_zigbee_bind(&src_uid, (uint8_t)src_ep_j->valuedouble, cluster_id, &dst_uid, (uint8_t)dst_ep_j->valuedouble);
-        if (err != ESP_OK) {
-            ws_send_rsp(fd, id, false, unbind ? "unbind failed" : "bind failed");
-            return;
-        }
-        ws_send_rsp(fd, id, true, NULL);
+// Replays events after `since` on a worker; the caller has counted it in the client's replays.
+// Without a worker pool it runs inline, unpaced; if the job queue is full the client gets a resync
+// marker so it fetches the gap itself.
+static void ws_submit_replay(int fd, uint32_t since)
+{
+    if (!s_job_sem) {
+        ws_send_events_since(fd, since, GW_WS_REPLAY_MAX, false);
         return;
     }
+    const uint32_t session = ws_client_session(fd);
+    if (!ws_job_push(&(ws_job_t){.fd = fd, .session = session, .since = since})) {
+        ws_replay_abort(fd, session);
+    }
+}
 
-    if (strcmp(m->valuestring, "actions.exec") == 0) {
-        cJSON *p = cJSON_GetObjectItemCaseSensitive(root, "p");
-        cJSON *action_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "action") : NULL;
-        cJSON *actions_j = cJSON_IsObject(p) ? cJSON_GetObjectItemCaseSensitive(p, "actions") : NULL;
+// Drops the queued (not running) jobs of fd, or of every connection when fd < 0.
+static void ws_jobs_drop_fd(int fd)
+{
+    cJSON *drop[GW_WS_JOB_QUEUE];
+    size_t n = 0;
+    portENTER_CRITICAL(&s_job_lock);
+    size_t keep = 0;
+    for (size_t i = 0; i < s_job_count; i++) {
+        if (fd < 0 || s_jobs[i].fd == fd) {
+            drop[n++] = s_jobs[i].root;
+        } else {
+            s_jobs[keep++] = s_jobs[i];
+        }
+    }
+    s_job_count = keep;
+    portEXIT_CRITICAL(&s_job_lock);
+    for (size_t i = 0; i < n; i++) {
+        cJSON_Delete(drop[i]);
+    }
+}
 
-        if (cJSON_IsObject(action_j)) {
-            char errbuf[96];
-            esp_err_t err = gw_action_exec(action_j, errbuf, sizeof(errbuf));
-            if (err != ESP_OK) {
-                ws_send_rsp(fd, id, false, (errbuf[0] != '\0') ? errbuf : "action failed");
-                return;
+// Reads optional "devices" (uid strings) and "types" arrays of `obj`. Each array that is present
+// replaces that part of *f; entries beyond the caps are ignored.
+static void ws_parse_filter(cJSON *obj, ws_sub_filter_t *f)
+{
+    cJSON *devices = cJSON_GetObjectItemCaseSensitive(obj, "devices");
+    if (cJSON_IsArray(devices)) {
+        f->dev_count = 0;
+        memset(f->uids, 0, sizeof(f->uids));
+        cJSON *it = NULL;
+        cJSON_ArrayForEach(it, devices)
+        {
+            if (!cJSON_IsString(it) || !it->valuestring || it->valuestring[0] == '\0' ||
+                f->dev_count >= GW_WS_SUB_MAX_DEVICES) {
+                continue;
             }
-            ws_send_rsp(fd, id, true, NULL);
-            return;
+            strlcpy(f->uids[f->dev_count++].uid, it->valuestring, sizeof(f->uids[0].uid));
         }
+        // Lookup only: a uid that has not joined yet matches nothing until it gets a handle.
+        ws_filter_bind(f, gw_device_registry_handle_gen());
+    }
 
-        if (cJSON_IsArray(actions_j)) {
-            cJSON *it = NULL;
-            cJSON_ArrayForEach(it, actions_j)
-            {
-                if (!cJSON_IsObject(it)) {
-                    ws_send_rsp(fd, id, false, "actions must be objects");
-                    return;
-                }
-                char errbuf[96];
-                esp_err_t err = gw_action_exec(it, errbuf, sizeof(errbuf));
-                if (err != ESP_OK) {
-                    ws_send_rsp(fd, id, false, (errbuf[0] != '\0') ? errbuf : "action failed");
-                    return;
-                }
+    cJSON *types = cJSON_GetObjectItemCaseSensitive(obj, "types");
+    if (cJSON_IsArray(types)) {
+        f->type_count = 0;
+        cJSON *it = NULL;
+        cJSON_ArrayForEach(it, types)
+        {
+            if (!cJSON_IsString(it) || !it->valuestring || it->valuestring[0] == '\0' ||
+                strlen(it->valuestring) >= sizeof(f->types[0]) || f->type_count >= GW_WS_SUB_MAX_TYPES) {
+                continue;
             }
-            ws_send_rsp(fd, id, true, NULL);
-            return;
+            strlcpy(f->types[f->type_count++], it->valuestring, sizeof(f->types[0]));
         }
-
-        ws_send_rsp(fd, id, false, "missing action/actions");
-        return;
     }
-
-    ws_send_rsp(fd, id, false, "unknown method");
 }
 
-static void ws_apply_subscriptions(int fd, cJSON *subs, uint32_t since)
+// Subscribes to the topics named in `topics` (strings; others are ignored) and applies the filter
+// fields of `obj`. With `replace` the client's topic set becomes exactly `topics` (hello).
+static void ws_apply_subscriptions(int fd, cJSON *obj, cJSON *topics, bool replace, uint32_t since)
 {
     bool want_events = false;
-    if (cJSON_IsArray(subs)) {
+    bool want_state = false;
+    if (cJSON_IsArray(topics)) {
         cJSON *it = NULL;
-        cJSON_ArrayForEach(it, subs)
+        cJSON_ArrayForEach(it, topics)
         {
-            if (cJSON_IsString(it) && it->valuestring && strcmp(it->valuestring, "events") == 0) {
-                want_events = true;
-            }
+            if (!cJSON_IsString(it) || !it->valuestring) continue;
+            if (strcmp(it->valuestring, "events") == 0) want_events = true;
+            if (strcmp(it->valuestring, "state") == 0) want_state = true;
         }
+    } else if (cJSON_IsString(topics) && topics->valuestring) {
+        want_events = strcmp(topics->valuestring, "events") == 0;
+        want_state = strcmp(topics->valuestring, "state") == 0;
     }
 
     portENTER_CRITICAL(&s_client_lock);
-    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == fd) {
-            s_clients[i].subscribed_events = want_events;
-            break;
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    ws_sub_filter_t filter = c ? c->filter : (ws_sub_filter_t){0};
+    portEXIT_CRITICAL(&s_client_lock);
+    if (!c) {
+        return;
+    }
+
+    ws_parse_filter(obj, &filter);
+
+    uint16_t interval_ms = GW_WS_STATE_INTERVAL_MS;
+    cJSON *interval_j = cJSON_GetObjectItemCaseSensitive(obj, "interval_ms");
+    if (cJSON_IsNumber(interval_j)) {
+        const double v = interval_j->valuedouble;
+        interval_ms = (uint16_t)(v < GW_WS_STATE_INTERVAL_MIN_MS ? GW_WS_STATE_INTERVAL_MIN_MS
+                                 : v > GW_WS_STATE_INTERVAL_MAX_MS ? GW_WS_STATE_INTERVAL_MAX_MS
+                                                                   : v);
+    }
+
+    portENTER_CRITICAL(&s_client_lock);
+    c = ws_client_find_locked(fd);
+    if (c) {
+        c->filter = filter;
+        c->subscribed_events = want_events || (!replace && c->subscribed_events);
+        if (want_events) {
+            c->replays++; // holds live pushes from now until the replay has caught up
+        }
+        c->subscribed_state = want_state || (!replace && c->subscribed_state);
+        if (want_state) {
+            // (Re)subscribing, or changing the device set, starts over with a snapshot.
+            c->state_full = true;
+            c->state_ver = 0;
+            c->state_due_us = 0;
+            c->state_interval_ms = interval_ms;
         }
     }
     portEXIT_CRITICAL(&s_client_lock);
 
+    if (want_state && s_state_task) {
+        xTaskNotifyGive(s_state_task);
+    }
+
     if (want_events) {
-        ws_send_events_since(fd, since, 64);
+        ws_submit_replay(fd, since);
     }
 }
 
@@ -1049,8 +1403,18 @@ static void ws_handle_text(int fd, const char *payload, size_t len)
             since = (uint32_t)since_j->valuedouble;
         }
         cJSON *subs = cJSON_GetObjectItemCaseSensitive(root, "subs");
+        cJSON *enc_j = cJSON_GetObjectItemCaseSensitive(root, "enc");
+        const bool binary = cJSON_IsString(enc_j) && enc_j->valuestring && strcmp(enc_j->valuestring, "tlv") == 0;
+        portENTER_CRITICAL(&s_client_lock);
+        for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+            if (s_clients[i].fd == fd) {
+                s_clients[i].binary_events = binary;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&s_client_lock);
         ws_send_hello(fd);
-        ws_apply_subscriptions(fd, subs, since);
+        ws_apply_subscriptions(fd, root, subs, true, since);
         cJSON_Delete(root);
         return;
     }
@@ -1062,25 +1426,21 @@ static void ws_handle_text(int fd, const char *payload, size_t len)
         if (cJSON_IsNumber(since_j) && since_j->valuedouble >= 0) {
             since = (uint32_t)since_j->valuedouble;
         }
-        if (cJSON_IsString(topic) && topic->valuestring && strcmp(topic->valuestring, "events") == 0) {
-            cJSON *subs = cJSON_CreateArray();
-            cJSON_AddItemToArray(subs, cJSON_CreateString("events"));
-            ws_apply_subscriptions(fd, subs, since);
-            cJSON_Delete(subs);
-        }
+        ws_apply_subscriptions(fd, root, topic, false, since);
         cJSON_Delete(root);
         return;
     }
 
     if (strcmp(t->valuestring, "unsub") == 0) {
         cJSON *topic = cJSON_GetObjectItemCaseSensitive(root, "topic");
-        if (cJSON_IsString(topic) && topic->valuestring && strcmp(topic->valuestring, "events") == 0) {
+        if (cJSON_IsString(topic) && topic->valuestring) {
+            const bool events = strcmp(topic->valuestring, "events") == 0;
+            const bool state = strcmp(topic->valuestring, "state") == 0;
             portENTER_CRITICAL(&s_client_lock);
-            for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-                if (s_clients[i].fd == fd) {
-                    s_clients[i].subscribed_events = false;
-                    break;
-                }
+            gw_ws_client_t *c = ws_client_find_locked(fd);
+            if (c) {
+                c->subscribed_events = c->subscribed_events && !events;
+                c->subscribed_state = c->subscribed_state && !state;
             }
             portEXIT_CRITICAL(&s_client_lock);
         }
@@ -1095,8 +1455,7 @@ static void ws_handle_text(int fd, const char *payload, size_t len)
     }
 
     if (strcmp(t->valuestring, "req") == 0) {
-        ws_handle_req(fd, root);
-        cJSON_Delete(root);
+        ws_submit_req(fd, root);
         return;
     }
 
@@ -1168,7 +1527,7 @@ esp_err_t gw_ws_register(httpd_handle_t server)
     }
 
     s_server = server;
-    memset(s_clients, 0, sizeof(s_clients));
+    ws_client_clear(-1);
 
     static const httpd_uri_t ws_uri = {
         .uri = "/ws",
@@ -1184,16 +1543,15 @@ esp_err_t gw_ws_register(httpd_handle_t server)
         return err;
     }
 
-    err = gw_event_bus_add_listener(ws_publish_event_to_clients, NULL);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "event listener not installed: %s", esp_err_to_name(err));
-    }
-
-    // Create internal queue/task for offloading event -> WS work.
-    if (!s_event_q) {
-        s_event_q = xQueueCreate(32, sizeof(gw_event_t));
+    // Create internal ring consumer/task for offloading event -> WS work.
+    if (!s_event_consumer) {
+        err = gw_event_bus_consumer_open("ws", &s_event_consumer);
+        if (err != ESP_OK) {
+            s_event_consumer = NULL;
+            ESP_LOGW(TAG, "event consumer not installed: %s", esp_err_to_name(err));
+        }
     }
-    if (s_event_q && !s_event_task) {
+    if (s_event_consumer && !s_event_task) {
         BaseType_t ok = xTaskCreate(ws_event_task_fn, "ws_events", 4096, NULL, 4, &s_event_task);
         if (ok != pdPASS) {
             s_event_task = NULL;
@@ -1201,6 +1559,31 @@ esp_err_t gw_ws_register(httpd_handle_t server)
         }
     }
 
+    if (!s_job_sem) {
+        s_job_sem = xSemaphoreCreateCounting(GW_WS_JOB_QUEUE + GW_WS_WORKERS, 0);
+        for (size_t i = 0; s_job_sem && i < GW_WS_WORKERS; i++) {
+            if (xTaskCreate(ws_worker_fn, "ws_req", GW_WS_WORKER_STACK, (void *)(uintptr_t)i, 4, &s_workers[i]) != pdPASS) {
+                s_workers[i] = NULL;
+                ESP_LOGW(TAG, "failed to create ws request worker %u", (unsigned)i);
+            }
+        }
+        if (s_job_sem && !s_workers[0]) {
+            // No worker at all: keep running requests inline.
+            vSemaphoreDelete(s_job_sem);
+            s_job_sem = NULL;
+        }
+    }
+
+    if (!s_state_task) {
+        BaseType_t ok = xTaskCreate(ws_state_task_fn, "ws_state", 3072, NULL, 4, &s_state_task);
+        if (ok != pdPASS) {
+            s_state_task = NULL;
+            ESP_LOGW(TAG, "failed to create ws state task");
+        } else if (gw_state_store_add_listener(ws_state_changed, NULL) != ESP_OK) {
+            ESP_LOGW(TAG, "state listener not installed");
+        }
+    }
+
     ESP_LOGI(TAG, "WebSocket enabled at /ws");
     return ESP_OK;
 }
@@ -1210,19 +1593,32 @@ void gw_ws_unregister(void)
     if (!s_server) {
         return;
     }
-    (void)gw_event_bus_remove_listener(ws_publish_event_to_clients, NULL);
-
-    portENTER_CRITICAL(&s_client_lock);
-    memset(s_clients, 0, sizeof(s_clients));
-    portEXIT_CRITICAL(&s_client_lock);
+    ws_client_clear(-1);
     s_server = NULL;
-    // Cleanup event task/queue
+    // Cleanup event task/consumer
     if (s_event_task) {
         vTaskDelete(s_event_task);
         s_event_task = NULL;
     }
-    if (s_event_q) {
-        vQueueDelete(s_event_q);
-        s_event_q = NULL;
+    if (s_event_consumer) {
+        gw_event_bus_consumer_close(s_event_consumer);
+        s_event_consumer = NULL;
+    }
+    if (s_job_sem) {
+        for (size_t i = 0; i < GW_WS_WORKERS; i++) {
+            if (s_workers[i]) {
+                vTaskDelete(s_workers[i]);
+                s_workers[i] = NULL;
+            }
+            s_job_running_fd[i] = 0;
+        }
+        ws_jobs_drop_fd(-1);
+        vSemaphoreDelete(s_job_sem);
+        s_job_sem = NULL;
+    }
+    if (s_state_task) {
+        (void)gw_state_store_remove_listener(ws_state_changed, NULL);
+        vTaskDelete(s_state_task);
+        s_state_task = NULL;
     }
 }
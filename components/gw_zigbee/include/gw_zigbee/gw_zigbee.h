@@ -77,6 +77,10 @@ esp_err_t gw_zigbee_unbind(const gw_device_uid_t *src_uid, uint8_t src_endpoint,
 // Request a remote device's APS binding table (Mgmt_Bind_req). Results are published via event bus.
 esp_err_t gw_zigbee_binding_table_req(const gw_device_uid_t *uid, uint8_t start_index);
 
+// Registers the Zigbee request methods (network.*, devices.* commands, groups.*, scenes.*, bindings.*)
+// into the gw_core method table (gw_core/rpc.h).
+esp_err_t gw_zigbee_rpc_register(void);
+
 #ifdef __cplusplus
 }
 #endif
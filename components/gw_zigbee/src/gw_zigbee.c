@@ -641,7 +641,7 @@ void gw_zigbee_on_device_annce(const uint8_t ieee_addr[8], uint16_t short_addr,
     d.short_addr = short_addr;
     d.last_seen_ms = (uint64_t)(esp_timer_get_time() / 1000);
 
-    (void)gw_state_store_set_u64(&d.device_uid, "last_seen_ms", d.last_seen_ms, d.last_seen_ms);
+    (void)gw_state_store_set_u64(gw_device_registry_handle(&d.device_uid), GW_STATE_KEY_LAST_SEEN_MS, d.last_seen_ms, d.last_seen_ms);
 
     esp_err_t err = gw_device_registry_upsert(&d);
     if (err != ESP_OK) {
@@ -0,0 +1,311 @@
+#include "gw_zigbee/gw_zigbee.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gw_core/device_registry.h"
+#include "gw_core/event_bus.h"
+#include "gw_core/rpc.h"
+
+// Request methods backed by Zigbee commands; registered into the gw_core method table.
+
+#define ARG_UID(name) {name, GW_RPC_ARG_STR, true, 1, 0}
+#define ARG_ENDPOINT {"endpoint", GW_RPC_ARG_NUM, false, 1, 240}
+#define ARG_GROUP {"group_id", GW_RPC_ARG_U16, true, 1, 0xFFFE}
+#define ARG_TRANSITION {"transition_ms", GW_RPC_ARG_NUM, false, 0, 60000}
+
+static void copy_uid(const gw_rpc_call_t *call, size_t i, gw_device_uid_t *uid)
+{
+    memset(uid, 0, sizeof(*uid));
+    strlcpy(uid->uid, gw_rpc_arg_str(call, i, ""), sizeof(uid->uid));
+}
+
+static bool parse_onoff(const char *s, gw_zigbee_onoff_cmd_t *out)
+{
+    if (strcmp(s, "on") == 0) *out = GW_ZIGBEE_ONOFF_CMD_ON;
+    else if (strcmp(s, "off") == 0) *out = GW_ZIGBEE_ONOFF_CMD_OFF;
+    else if (strcmp(s, "toggle") == 0) *out = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
+    else return false;
+    return true;
+}
+
+static const gw_rpc_arg_t s_permit_join_args[] = {
+    {"seconds", GW_RPC_ARG_NUM, false, 1, 255},
+};
+
+static void network_permit_join(gw_rpc_call_t *call)
+{
+    const unsigned seconds = (unsigned)gw_rpc_arg_num(call, 0, 180);
+    if (gw_zigbee_permit_join((uint8_t)seconds) != ESP_OK) {
+        gw_rpc_reply_err(call, "permit_join failed");
+        return;
+    }
+    char emsg[48];
+    (void)snprintf(emsg, sizeof(emsg), "seconds=%u", seconds);
+    gw_event_bus_publish("api_permit_join", "ws", "", 0, emsg);
+}
+
+static const gw_rpc_arg_t s_devices_remove_args[] = {
+    ARG_UID("uid"),
+    {"kick", GW_RPC_ARG_BOOL, false, 0, 0},
+};
+
+static void devices_remove(gw_rpc_call_t *call)
+{
+    gw_device_uid_t uid;
+    copy_uid(call, 0, &uid);
+    const bool kick = gw_rpc_arg_bool(call, 1, false);
+
+    uint16_t short_addr = 0;
+    if (kick) {
+        gw_device_t d = {0};
+        if (gw_device_registry_get(&uid, &d) != ESP_OK) {
+            gw_rpc_reply_err(call, "device not found");
+            return;
+        }
+        short_addr = d.short_addr;
+        if (gw_zigbee_device_leave(&uid, short_addr, false) != ESP_OK) {
+            gw_rpc_reply_err(call, "leave failed");
+            return;
+        }
+        char msg[64];
+        (void)snprintf(msg, sizeof(msg), "uid=%s short=0x%04x", uid.uid, (unsigned)short_addr);
+        gw_event_bus_publish("api_device_kick", "ws", uid.uid, short_addr, msg);
+    }
+
+    if (gw_device_registry_remove(&uid) != ESP_OK) {
+        gw_rpc_reply_err(call, "device not found");
+        return;
+    }
+    gw_event_bus_publish("api_device_removed", "ws", uid.uid, short_addr, kick ? "kick=1" : "kick=0");
+}
+
+static const gw_rpc_arg_t s_devices_onoff_args[] = {
+    ARG_UID("uid"),
+    ARG_ENDPOINT,
+    {"cmd", GW_RPC_ARG_STR, true, 1, 0},
+};
+
+static void devices_onoff(gw_rpc_call_t *call)
+{
+    gw_zigbee_onoff_cmd_t cmd;
+    if (!parse_onoff(gw_rpc_arg_str(call, 2, ""), &cmd)) {
+        gw_rpc_reply_err(call, "bad cmd");
+        return;
+    }
+    gw_device_uid_t uid;
+    copy_uid(call, 0, &uid);
+    if (gw_zigbee_onoff_cmd(&uid, (uint8_t)gw_rpc_arg_num(call, 1, 1), cmd) != ESP_OK) {
+        gw_rpc_reply_err(call, "onoff failed");
+    }
+}
+
+static const gw_rpc_arg_t s_devices_level_args[] = {
+    ARG_UID("uid"),
+    ARG_ENDPOINT,
+    {"level", GW_RPC_ARG_NUM, true, 0, 254},
+    ARG_TRANSITION,
+};
+
+static void devices_level(gw_rpc_call_t *call)
+{
+    gw_device_uid_t uid;
+    copy_uid(call, 0, &uid);
+    const gw_zigbee_level_t level = {
+        .level = (uint8_t)gw_rpc_arg_num(call, 2, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 3, 0),
+    };
+    if (gw_zigbee_level_move_to_level(&uid, (uint8_t)gw_rpc_arg_num(call, 1, 1), level) != ESP_OK) {
+        gw_rpc_reply_err(call, "level failed");
+    }
+}
+
+static const gw_rpc_arg_t s_devices_color_xy_args[] = {
+    ARG_UID("uid"),
+    ARG_ENDPOINT,
+    {"x", GW_RPC_ARG_NUM, true, 0, 65535},
+    {"y", GW_RPC_ARG_NUM, true, 0, 65535},
+    ARG_TRANSITION,
+};
+
+static void devices_color_xy(gw_rpc_call_t *call)
+{
+    gw_device_uid_t uid;
+    copy_uid(call, 0, &uid);
+    const gw_zigbee_color_xy_t color = {
+        .x = (uint16_t)gw_rpc_arg_num(call, 2, 0),
+        .y = (uint16_t)gw_rpc_arg_num(call, 3, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 4, 0),
+    };
+    if (gw_zigbee_color_move_to_xy(&uid, (uint8_t)gw_rpc_arg_num(call, 1, 1), color) != ESP_OK) {
+        gw_rpc_reply_err(call, "color failed");
+    }
+}
+
+static const gw_rpc_arg_t s_devices_color_temp_args[] = {
+    ARG_UID("uid"),
+    ARG_ENDPOINT,
+    {"mireds", GW_RPC_ARG_NUM, true, 1, 1000},
+    ARG_TRANSITION,
+};
+
+static void devices_color_temp(gw_rpc_call_t *call)
+{
+    gw_device_uid_t uid;
+    copy_uid(call, 0, &uid);
+    const gw_zigbee_color_temp_t temp = {
+        .mireds = (uint16_t)gw_rpc_arg_num(call, 2, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 3, 0),
+    };
+    if (gw_zigbee_color_move_to_temp(&uid, (uint8_t)gw_rpc_arg_num(call, 1, 1), temp) != ESP_OK) {
+        gw_rpc_reply_err(call, "color temp failed");
+    }
+}
+
+static const gw_rpc_arg_t s_groups_onoff_args[] = {
+    ARG_GROUP,
+    {"cmd", GW_RPC_ARG_STR, true, 0, 0}, // "" is a "bad cmd"
+};
+
+static void groups_onoff(gw_rpc_call_t *call)
+{
+    gw_zigbee_onoff_cmd_t cmd;
+    if (!parse_onoff(gw_rpc_arg_str(call, 1, ""), &cmd)) {
+        gw_rpc_reply_err(call, "bad cmd");
+        return;
+    }
+    if (gw_zigbee_group_onoff_cmd((uint16_t)gw_rpc_arg_num(call, 0, 0), cmd) != ESP_OK) {
+        gw_rpc_reply_err(call, "group onoff failed");
+    }
+}
+
+static const gw_rpc_arg_t s_groups_level_args[] = {
+    ARG_GROUP,
+    {"level", GW_RPC_ARG_NUM, true, 0, 254},
+    ARG_TRANSITION,
+};
+
+static void groups_level(gw_rpc_call_t *call)
+{
+    const gw_zigbee_level_t level = {
+        .level = (uint8_t)gw_rpc_arg_num(call, 1, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 2, 0),
+    };
+    if (gw_zigbee_group_level_move_to_level((uint16_t)gw_rpc_arg_num(call, 0, 0), level) != ESP_OK) {
+        gw_rpc_reply_err(call, "group level failed");
+    }
+}
+
+static const gw_rpc_arg_t s_groups_color_xy_args[] = {
+    ARG_GROUP,
+    {"x", GW_RPC_ARG_NUM, true, 0, 65535},
+    {"y", GW_RPC_ARG_NUM, true, 0, 65535},
+    ARG_TRANSITION,
+};
+
+static void groups_color_xy(gw_rpc_call_t *call)
+{
+    const gw_zigbee_color_xy_t color = {
+        .x = (uint16_t)gw_rpc_arg_num(call, 1, 0),
+        .y = (uint16_t)gw_rpc_arg_num(call, 2, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 3, 0),
+    };
+    if (gw_zigbee_group_color_move_to_xy((uint16_t)gw_rpc_arg_num(call, 0, 0), color) != ESP_OK) {
+        gw_rpc_reply_err(call, "group color failed");
+    }
+}
+
+static const gw_rpc_arg_t s_groups_color_temp_args[] = {
+    ARG_GROUP,
+    {"mireds", GW_RPC_ARG_NUM, true, 1, 1000},
+    ARG_TRANSITION,
+};
+
+static void groups_color_temp(gw_rpc_call_t *call)
+{
+    const gw_zigbee_color_temp_t temp = {
+        .mireds = (uint16_t)gw_rpc_arg_num(call, 1, 0),
+        .transition_ms = (uint16_t)gw_rpc_arg_num(call, 2, 0),
+    };
+    if (gw_zigbee_group_color_move_to_temp((uint16_t)gw_rpc_arg_num(call, 0, 0), temp) != ESP_OK) {
+        gw_rpc_reply_err(call, "group color temp failed");
+    }
+}
+
+static const gw_rpc_arg_t s_scene_args[] = {
+    ARG_GROUP,
+    {"scene_id", GW_RPC_ARG_NUM, true, 1, 255},
+};
+
+static void scenes_store(gw_rpc_call_t *call)
+{
+    if (gw_zigbee_scene_store((uint16_t)gw_rpc_arg_num(call, 0, 0), (uint8_t)gw_rpc_arg_num(call, 1, 0)) != ESP_OK) {
+        gw_rpc_reply_err(call, "scene store failed");
+    }
+}
+
+static void scenes_recall(gw_rpc_call_t *call)
+{
+    if (gw_zigbee_scene_recall((uint16_t)gw_rpc_arg_num(call, 0, 0), (uint8_t)gw_rpc_arg_num(call, 1, 0)) != ESP_OK) {
+        gw_rpc_reply_err(call, "scene recall failed");
+    }
+}
+
+static const gw_rpc_arg_t s_binding_args[] = {
+    ARG_UID("src_uid"),
+    ARG_UID("dst_uid"),
+    {"src_endpoint", GW_RPC_ARG_NUM, true, 1, 240},
+    {"dst_endpoint", GW_RPC_ARG_NUM, true, 1, 240},
+    {"cluster_id", GW_RPC_ARG_U16, true, 1, 0xFFFF},
+};
+
+static void binding(gw_rpc_call_t *call, bool unbind)
+{
+    gw_device_uid_t src_uid;
+    gw_device_uid_t dst_uid;
+    copy_uid(call, 0, &src_uid);
+    copy_uid(call, 1, &dst_uid);
+    const uint8_t src_ep = (uint8_t)gw_rpc_arg_num(call, 2, 0);
+    const uint8_t dst_ep = (uint8_t)gw_rpc_arg_num(call, 3, 0);
+    const uint16_t cluster_id = (uint16_t)gw_rpc_arg_num(call, 4, 0);
+
+    esp_err_t err = unbind ? gw_zigbee_unbind(&src_uid, src_ep, cluster_id, &dst_uid, dst_ep)
+                           : gw_zigbee_bind(&src_uid, src_ep, cluster_id, &dst_uid, dst_ep);
+    if (err != ESP_OK) {
+        gw_rpc_reply_err(call, unbind ? "unbind failed" : "bind failed");
+    }
+}
+
+static void bindings_bind(gw_rpc_call_t *call)
+{
+    binding(call, false);
+}
+
+static void bindings_unbind(gw_rpc_call_t *call)
+{
+    binding(call, true);
+}
+
+#define ARGS(a) (a), (sizeof(a) / sizeof((a)[0]))
+
+static const gw_rpc_method_t s_zigbee_methods[] = {
+    {"bindings.bind", bindings_bind, ARGS(s_binding_args)},
+    {"bindings.unbind", bindings_unbind, ARGS(s_binding_args)},
+    {"devices.color_temp", devices_color_temp, ARGS(s_devices_color_temp_args)},
+    {"devices.color_xy", devices_color_xy, ARGS(s_devices_color_xy_args)},
+    {"devices.level", devices_level, ARGS(s_devices_level_args)},
+    {"devices.onoff", devices_onoff, ARGS(s_devices_onoff_args)},
+    {"devices.remove", devices_remove, ARGS(s_devices_remove_args)},
+    {"groups.color_temp", groups_color_temp, ARGS(s_groups_color_temp_args)},
+    {"groups.color_xy", groups_color_xy, ARGS(s_groups_color_xy_args)},
+    {"groups.level", groups_level, ARGS(s_groups_level_args)},
+    {"groups.onoff", groups_onoff, ARGS(s_groups_onoff_args)},
+    {"network.permit_join", network_permit_join, ARGS(s_permit_join_args)},
+    {"scenes.recall", scenes_recall, ARGS(s_scene_args)},
+    {"scenes.store", scenes_store, ARGS(s_scene_args)},
+};
+
+esp_err_t gw_zigbee_rpc_register(void)
+{
+    return gw_rpc_register(s_zigbee_methods, sizeof(s_zigbee_methods) / sizeof(s_zigbee_methods[0]));
+}
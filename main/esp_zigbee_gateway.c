@@ -33,10 +33,14 @@
 #include "gw_wifi.h"
 #include "gw_zigbee/gw_zigbee.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/event_journal.h"
+#include "gw_core/event_log.h"
+#include "gw_core/metrics.h"
 #include "gw_core/device_registry.h"
 #include "gw_core/automation_store.h"
 #include "gw_core/sensor_store.h"
 #include "gw_core/state_store.h"
+#include "gw_core/rpc.h"
 #include "gw_core/rules_engine.h"
 #include "gw_core/zb_model.h"
 #include "gw_http/gw_http.h"
@@ -73,6 +77,7 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
         const uint16_t cluster_id = m->cluster;
         const uint16_t attr_id = m->attribute.id;
         if (uid.uid[0] != '\0' && m->attribute.data.value != NULL) {
+            const gw_dev_handle_t dev = gw_device_registry_handle(&uid);
             gw_sensor_value_t v = {0};
             v.uid = uid;
             v.short_addr = src_short;
@@ -88,14 +93,14 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                 (void)gw_sensor_store_upsert(&v);
 
                 // Normalized state key for automations.
-                (void)gw_state_store_set_f32(&uid, "temperature_c", ((float)v.value_i32) / 100.0f, v.ts_ms);
+                (void)gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, ((float)v.value_i32) / 100.0f, v.ts_ms);
             } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID &&
                        m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2) {
                 v.value_type = GW_SENSOR_VALUE_U32;
                 v.value_u32 = *((const uint16_t *)m->attribute.data.value);
                 (void)gw_sensor_store_upsert(&v);
 
-                (void)gw_state_store_set_f32(&uid, "humidity_pct", ((float)v.value_u32) / 100.0f, v.ts_ms);
+                (void)gw_state_store_set_f32(dev, GW_STATE_KEY_HUMIDITY_PCT, ((float)v.value_u32) / 100.0f, v.ts_ms);
             } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG && attr_id == ESP_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID &&
                        m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1) {
                 v.value_type = GW_SENSOR_VALUE_U32;
@@ -103,16 +108,16 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                 (void)gw_sensor_store_upsert(&v);
 
                 // Battery percentage is 0.5% units. Normalize to integer percent.
-                (void)gw_state_store_set_u32(&uid, "battery_pct", (uint32_t)(v.value_u32 / 2u), v.ts_ms);
+                (void)gw_state_store_set_u32(dev, GW_STATE_KEY_BATTERY_PCT, (uint32_t)(v.value_u32 / 2u), v.ts_ms);
             } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF && attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
                        (m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL || m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
                        m->attribute.data.size >= 1) {
                 uint8_t onoff = *((const uint8_t *)m->attribute.data.value);
-                (void)gw_state_store_set_bool(&uid, "onoff", onoff != 0, v.ts_ms);
+                (void)gw_state_store_set_bool(dev, GW_STATE_KEY_ONOFF, onoff != 0, v.ts_ms);
             }
 
             // Keep last seen fresh on any attribute report.
-            (void)gw_state_store_set_u64(&uid, "last_seen_ms", v.ts_ms, v.ts_ms);
+            (void)gw_state_store_set_u64(dev, GW_STATE_KEY_LAST_SEEN_MS, v.ts_ms, v.ts_ms);
         }
 
         // Normalized event: zigbee.attr_report (msg + structured payload)
@@ -127,10 +132,20 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                            (unsigned)m->attribute.data.type,
                            (unsigned)m->attribute.data.size);
 
+            gw_event_data_t data = {
+                .evt_type = GW_AUTO_EVT_ZIGBEE_ATTR_REPORT,
+                .flags = GW_EVENT_DATA_HAS_ENDPOINT | GW_EVENT_DATA_HAS_CLUSTER | GW_EVENT_DATA_HAS_ATTR,
+                .endpoint = m->src_endpoint,
+                .cluster_id = cluster_id,
+                .attr_id = attr_id,
+            };
+
             char payload[160];
             if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID &&
                 m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 && m->attribute.data.size >= 2 && m->attribute.data.value != NULL) {
                 const int16_t v = *((const int16_t *)m->attribute.data.value);
+                data.flags |= GW_EVENT_DATA_HAS_VALUE;
+                data.value = v;
                 (void)snprintf(payload,
                                sizeof(payload),
                                "{\"endpoint\":%u,\"cluster\":\"0x%04x\",\"attr\":\"0x%04x\",\"value\":%d,\"unit\":\"cC\"}",
@@ -141,6 +156,8 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
             } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID &&
                        m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2 && m->attribute.data.value != NULL) {
                 const uint16_t v = *((const uint16_t *)m->attribute.data.value);
+                data.flags |= GW_EVENT_DATA_HAS_VALUE;
+                data.value = v;
                 (void)snprintf(payload,
                                sizeof(payload),
                                "{\"endpoint\":%u,\"cluster\":\"0x%04x\",\"attr\":\"0x%04x\",\"value\":%u,\"unit\":\"cP\"}",
@@ -152,6 +169,8 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                        attr_id == ESP_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID &&
                        m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1 && m->attribute.data.value != NULL) {
                 const uint8_t v = *((const uint8_t *)m->attribute.data.value);
+                data.flags |= GW_EVENT_DATA_HAS_VALUE;
+                data.value = v;
                 (void)snprintf(payload,
                                sizeof(payload),
                                "{\"endpoint\":%u,\"cluster\":\"0x%04x\",\"attr\":\"0x%04x\",\"value\":%u,\"unit\":\"half_pct\"}",
@@ -169,7 +188,7 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                                (unsigned)m->attribute.data.type,
                                (unsigned)m->attribute.data.size);
             }
-            gw_event_bus_publish_ex("zigbee.attr_report", "zigbee", uid.uid, src_short, msg, payload);
+            gw_event_bus_publish_data("zigbee.attr_report", "zigbee", uid.uid, src_short, msg, payload, &data);
         }
 
         return ESP_OK;
@@ -282,7 +301,14 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
                                (unsigned)m->info.src_endpoint,
                                (unsigned)ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
                                (int)m->info.header.rssi);
-                gw_event_bus_publish_ex("zigbee.command", "zigbee", uid.uid, src_short, msg, payload);
+                const gw_event_data_t data = {
+                    .evt_type = GW_AUTO_EVT_ZIGBEE_COMMAND,
+                    .flags = GW_EVENT_DATA_HAS_ENDPOINT | GW_EVENT_DATA_HAS_CLUSTER | GW_EVENT_DATA_HAS_CMD,
+                    .endpoint = m->info.src_endpoint,
+                    .cmd = GW_EVENT_CMD_TOGGLE,
+                    .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                };
+                gw_event_bus_publish_data("zigbee.command", "zigbee", uid.uid, src_short, msg, payload, &data);
             }
         }
     }
@@ -444,6 +470,14 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(gw_event_bus_init());
+    esp_err_t journal_err = gw_event_journal_init();
+    if (journal_err != ESP_OK) {
+        ESP_LOGW(TAG, "event journal disabled (%s)", esp_err_to_name(journal_err));
+    }
+    esp_err_t log_err = gw_event_log_init();
+    if (log_err != ESP_OK) {
+        ESP_LOGW(TAG, "event console log disabled (%s)", esp_err_to_name(log_err));
+    }
     ESP_ERROR_CHECK(gw_zb_model_init());
     ESP_ERROR_CHECK(gw_sensor_store_init());
     ESP_ERROR_CHECK(gw_state_store_init());
@@ -463,6 +497,9 @@ void app_main(void)
 
     ESP_ERROR_CHECK(gw_device_registry_init());
     ESP_ERROR_CHECK(gw_automation_store_init());
+    ESP_ERROR_CHECK(gw_metrics_init());
+    ESP_ERROR_CHECK(gw_rpc_register_core());
+    ESP_ERROR_CHECK(gw_zigbee_rpc_register());
     ESP_ERROR_CHECK(gw_http_start());
 #if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
     ESP_ERROR_CHECK(esp_zb_gateway_console_init());
@@ -0,0 +1,154 @@
+#define GW_AUTOMATION_CAP 1024 // the store holds 32; the engine's index is what is measured here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_rules.h"
+#include "host_test.h"
+
+// Dispatches synthetic zigbee.attr_report events against 32, 256 and 1024 rules through the
+// engine's trigger index, and through a scan of every bound trigger for comparison; both include
+// running the matched rules (action stub, rules.* events). Rules are spread over DEVICES devices
+// and CLUSTERS clusters, so an event matches N / 256 of them on average; the executed actions
+// are checked against that.
+
+#include "../../components/gw_core/src/rules_engine.c"
+
+#define DEVICES HOST_RULES_DEVICES
+#define CLUSTERS 4
+#define CLUSTER_BASE 0x0402 // temperature measurement
+#define EVENTS 100000
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Rule i fires on attribute reports of device i % DEVICES in cluster CLUSTER_BASE + i / DEVICES % CLUSTERS
+// and switches that device.
+static gw_automation_snapshot_t *build_snapshot(size_t count, uint32_t version)
+{
+    gw_automation_snapshot_t *snap =
+        (gw_automation_snapshot_t *)calloc(1, sizeof(*snap) + count * sizeof(gw_automation_entry_t));
+    CHECK(snap);
+    snap->version = version;
+    snap->count = count;
+    for (size_t i = 0; i < count; i++) {
+        gw_automation_entry_t *e = &snap->items[i];
+        snprintf(e->id, sizeof(e->id), "rule-%zu", i);
+        e->enabled = true;
+        e->mode = GW_AUTO_MODE_SINGLE;
+        host_rules_dev_uid((unsigned)(i % DEVICES), e->string_table + 1, sizeof(e->string_table) - 1);
+        e->string_table_size = (uint16_t)(1 + strlen(e->string_table + 1) + 1);
+
+        e->triggers_count = 1;
+        e->triggers[0].event_type = GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+        e->triggers[0].device_uid_off = 1;
+        e->triggers[0].cluster_id = (uint16_t)(CLUSTER_BASE + i / DEVICES % CLUSTERS);
+
+        e->actions_count = 1;
+        e->actions[0].kind = GW_AUTO_ACT_DEVICE;
+        e->actions[0].op = GW_AUTO_ACT_OP_ONOFF;
+        e->actions[0].endpoint = 1;
+        e->actions[0].uid_off = 1;
+    }
+    return snap;
+}
+
+static void make_event(uint32_t n, gw_event_t *e)
+{
+    memset(e, 0, sizeof(*e));
+    strcpy(e->type, "zigbee.attr_report");
+    strcpy(e->source, "zigbee");
+    host_rules_dev_uid(n % DEVICES, e->device_uid, sizeof(e->device_uid));
+    e->short_addr = (uint16_t)(0x1000 + n % DEVICES);
+    e->data.evt_type = GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+    e->data.flags = GW_EVENT_DATA_HAS_ENDPOINT | GW_EVENT_DATA_HAS_CLUSTER | GW_EVENT_DATA_HAS_ATTR | GW_EVENT_DATA_HAS_VALUE;
+    e->data.endpoint = 1;
+    e->data.cluster_id = (uint16_t)(CLUSTER_BASE + n / DEVICES % CLUSTERS);
+    e->data.attr_id = 0x0000;
+    e->data.value = 2150;
+}
+
+static size_t expected_matches(size_t rules, uint32_t n)
+{
+    size_t m = 0;
+    for (size_t i = n % DEVICES; i < rules; i += DEVICES) {
+        m += i / DEVICES % CLUSTERS == n / DEVICES % CLUSTERS;
+    }
+    return m;
+}
+
+// Dispatch as it was before the index: every bound trigger tested against every event, then the
+// same run path for the matches.
+static void dispatch_by_scan(const gw_event_t *e)
+{
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, e->device_uid, sizeof(uid.uid));
+    const gw_dev_handle_t dev = gw_device_registry_handle(&uid);
+    const uint16_t sub = event_sub(&e->data);
+    uint16_t matched[GW_AUTOMATION_CAP];
+    size_t matched_count = 0;
+    next_seen_stamp();
+    for (size_t i = 0; i < s_index_count; i++) {
+        const trig_index_entry_t *ie = &s_index[i];
+        if (s_rt[ie->auto_idx].seen == s_seen_stamp || !trigger_matches(ie, dev, sub, &e->data)) continue;
+        s_rt[ie->auto_idx].seen = s_seen_stamp;
+        matched[matched_count++] = ie->auto_idx;
+    }
+    sort_matched(matched, matched_count);
+    for (size_t i = 0; i < matched_count; i++) {
+        on_trigger(matched[i], dev, e->short_addr);
+    }
+}
+
+static void bench(size_t rules, uint32_t version)
+{
+    gw_automation_snapshot_t *snap = build_snapshot(rules, version);
+    host_rules_set_snapshot(snap);
+    automations_refresh();
+    CHECK(s_snap == snap && s_index_count == rules && s_unbound == 0);
+
+    gw_event_t e;
+    size_t expected = 0;
+    for (uint32_t n = 0; n < EVENTS; n++) {
+        expected += expected_matches(rules, n);
+    }
+
+    uint32_t exec0 = host_rules_exec_count();
+    const double t0 = now_s();
+    for (uint32_t n = 0; n < EVENTS; n++) {
+        make_event(n, &e);
+        process_event(&e);
+    }
+    const double indexed = now_s() - t0;
+    CHECK(host_rules_exec_count() - exec0 == expected);
+
+    exec0 = host_rules_exec_count();
+    const double t1 = now_s();
+    for (uint32_t n = 0; n < EVENTS; n++) {
+        make_event(n, &e);
+        dispatch_by_scan(&e);
+    }
+    const double scan = now_s() - t1;
+    CHECK(host_rules_exec_count() - exec0 == expected);
+
+    printf("%4zu rules, %.2f matches/event: indexed %6.0f ns/event, full scan %6.0f ns/event\n", rules,
+           (double)expected / EVENTS, indexed * 1e9 / EVENTS, scan * 1e9 / EVENTS);
+}
+
+int main(void)
+{
+    CHECK(gw_event_bus_init() == ESP_OK);
+    CHECK(gw_state_store_init() == ESP_OK);
+    CHECK(gw_timer_wheel_create("bench", wheel_wake, NULL, &s_wheel) == ESP_OK);
+
+    bench(32, 1);
+    bench(256, 2);
+    bench(1024, 3);
+    return 0;
+}
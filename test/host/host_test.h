@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Host tests stop at the first failed check; ctest reports the non-zero exit.
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                               \
+        }                                                                          \
+    } while (0)
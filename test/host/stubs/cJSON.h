@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+
+// The cJSON node layout and the accessors gw_core / gw_http use; host_stubs.c implements them.
+// Host tests build their input trees by hand: there is no parser (cJSON_ParseWithLength returns NULL).
+
+#define cJSON_Invalid (0)
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+#define cJSON_Raw (1 << 7)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length);
+void cJSON_Delete(cJSON *item);
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string);
+cJSON_bool cJSON_IsBool(const cJSON *item);
+cJSON_bool cJSON_IsTrue(const cJSON *item);
+cJSON_bool cJSON_IsNumber(const cJSON *item);
+cJSON_bool cJSON_IsString(const cJSON *item);
+cJSON_bool cJSON_IsArray(const cJSON *item);
+cJSON_bool cJSON_IsObject(const cJSON *item);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// esp_http_server on the host: just the types and calls gw_ws uses. The test that builds gw_ws
+// defines the functions, so it decides what a send does.
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+    HTTP_GET = 1,
+    HTTP_POST = 3,
+} httpd_method_t;
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    const char *uri;
+    void *user_ctx;
+} httpd_req_t;
+
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    bool is_websocket;
+} httpd_uri_t;
+
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+} httpd_err_code_t;
+
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE = 0x0,
+    HTTPD_WS_TYPE_TEXT = 0x1,
+    HTTPD_WS_TYPE_BINARY = 0x2,
+    HTTPD_WS_TYPE_CLOSE = 0x8,
+    HTTPD_WS_TYPE_PING = 0x9,
+    HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+typedef enum {
+    HTTPD_WS_CLIENT_INVALID = 0x0,
+    HTTPD_WS_CLIENT_HTTP = 0x1,
+    HTTPD_WS_CLIENT_WEBSOCKET = 0x2,
+} httpd_ws_client_info_t;
+
+typedef struct {
+    bool final;
+    bool fragmented;
+    httpd_ws_type_t type;
+    uint8_t *payload;
+    size_t len;
+} httpd_ws_frame_t;
+
+typedef void (*transfer_complete_cb)(esp_err_t err, int socket, void *arg);
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+int httpd_req_to_sockfd(httpd_req_t *r);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd);
+esp_err_t httpd_ws_send_data_async(httpd_handle_t handle, int socket, httpd_ws_frame_t *frame,
+                                   transfer_complete_cb callback, void *arg);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdio.h>
+
+// Warnings and errors go to stderr so a failing test shows what the code under test complained
+// about; info and debug are dropped.
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGV(tag, fmt, ...) ((void)(tag))
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host FreeRTOS subset on pthreads. One tick is one millisecond of real time. Critical sections
+// share one recursive mutex, like a single-core port masking interrupts.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define portENTER_CRITICAL(mux) ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux) ((void)(mux), host_critical_exit())
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Test-side control of the virtual clock behind esp_timer_get_time() and of the esp_timers
+// started on it (see host_stubs.c).
+
+void host_clock_set_us(int64_t now_us);
+void host_clock_advance_us(int64_t delta_us);
+
+// Earliest deadline of a started one-shot esp_timer, false if none is running.
+bool host_timer_next_due(int64_t *out_us);
+// Runs the callbacks of every started esp_timer whose deadline is <= now; returns how many ran.
+int host_timer_fire_due(void);
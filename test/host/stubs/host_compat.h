@@ -0,0 +1,8 @@
+#pragma once
+
+// Force-included into every host test translation unit: what newlib has and glibc lacks.
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
@@ -0,0 +1,74 @@
+#include "host_rules.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gw_core/action_exec.h"
+#include "gw_core/device_registry.h"
+
+static gw_automation_snapshot_t *s_snap;
+static uint32_t s_exec_count;
+
+void host_rules_set_snapshot(gw_automation_snapshot_t *snap)
+{
+    s_snap = snap;
+}
+
+uint32_t host_rules_exec_count(void)
+{
+    return s_exec_count;
+}
+
+const gw_automation_snapshot_t *gw_automation_store_snapshot_acquire(void)
+{
+    return s_snap;
+}
+
+void gw_automation_store_snapshot_release(const gw_automation_snapshot_t *snap)
+{
+    (void)snap;
+}
+
+void host_rules_dev_uid(unsigned n, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "0x00124b00000000%02x", n);
+}
+
+gw_dev_handle_t gw_device_registry_find_handle(const gw_device_uid_t *uid)
+{
+    const unsigned long n = strtoul(uid->uid + 16, NULL, 16);
+    return n < HOST_RULES_DEVICES ? (gw_dev_handle_t)(n + 1) : GW_DEV_HANDLE_INVALID;
+}
+
+gw_dev_handle_t gw_device_registry_handle(const gw_device_uid_t *uid)
+{
+    return gw_device_registry_find_handle(uid);
+}
+
+esp_err_t gw_device_registry_handle_uid(gw_dev_handle_t handle, gw_device_uid_t *out_uid)
+{
+    if (handle == GW_DEV_HANDLE_INVALID || handle > HOST_RULES_DEVICES) return ESP_ERR_NOT_FOUND;
+    host_rules_dev_uid(handle - 1u, out_uid->uid, sizeof(out_uid->uid));
+    return ESP_OK;
+}
+
+uint32_t gw_device_registry_handle_gen(void)
+{
+    return HOST_RULES_DEVICES;
+}
+
+uint32_t gw_device_registry_handle_release_gen(void)
+{
+    return 0;
+}
+
+esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled, const gw_auto_bin_action_v2_t *action, char *err,
+                                  size_t err_size)
+{
+    (void)compiled;
+    (void)action;
+    (void)err;
+    (void)err_size;
+    s_exec_count++;
+    return ESP_OK;
+}
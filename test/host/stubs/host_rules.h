@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gw_core/automation_store.h"
+
+// Collaborators of rules_engine.c on the host (host_rules.c): the automation store serves
+// whatever snapshot the test installs, HOST_RULES_DEVICES devices already have handles, and
+// actions only count their executions.
+
+#define HOST_RULES_DEVICES 64
+
+// Device n's uid, "0x00124b00000000NN"; its handle is n + 1.
+void host_rules_dev_uid(unsigned n, char *out, size_t out_size);
+
+void host_rules_set_snapshot(gw_automation_snapshot_t *snap);
+uint32_t host_rules_exec_count(void);
@@ -0,0 +1,548 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cJSON.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_clock.h"
+#include "nvs.h"
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t len = strlen(src);
+    if (size > 0) {
+        const size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+    const size_t used = strnlen(dst, size);
+    return used + strlcpy(dst + used, src, size - used);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "ESP_ERR_?";
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, TickType_t ticks_to_wait)
+{
+    (void)base;
+    (void)id;
+    (void)data;
+    (void)size;
+    (void)ticks_to_wait;
+    return ESP_OK;
+}
+
+#define HOST_NVS_BLOBS 8
+#define HOST_NVS_NAMESPACES 8
+
+static struct {
+    char name[32];
+    void *data;
+    size_t size;
+} s_nvs[HOST_NVS_BLOBS];
+static char s_nvs_ns[HOST_NVS_NAMESPACES][16];
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    (void)open_mode;
+    for (size_t i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (s_nvs_ns[i][0] == '\0') {
+            strlcpy(s_nvs_ns[i], name, sizeof(s_nvs_ns[i]));
+        }
+        if (strcmp(s_nvs_ns[i], name) == 0) {
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+static size_t nvs_slot(nvs_handle_t handle, const char *key, bool create)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s/%s", s_nvs_ns[handle - 1], key);
+    for (size_t i = 0; i < HOST_NVS_BLOBS; i++) {
+        if (strcmp(s_nvs[i].name, name) == 0) return i;
+    }
+    for (size_t i = 0; create && i < HOST_NVS_BLOBS; i++) {
+        if (s_nvs[i].name[0] == '\0') {
+            strlcpy(s_nvs[i].name, name, sizeof(s_nvs[i].name));
+            return i;
+        }
+    }
+    return HOST_NVS_BLOBS;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    const size_t i = nvs_slot(handle, key, false);
+    if (i == HOST_NVS_BLOBS) return ESP_ERR_NVS_NOT_FOUND;
+    if (out_value) {
+        if (*length < s_nvs[i].size) return ESP_ERR_INVALID_SIZE;
+        memcpy(out_value, s_nvs[i].data, s_nvs[i].size);
+    }
+    *length = s_nvs[i].size;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    const size_t i = nvs_slot(handle, key, true);
+    if (i == HOST_NVS_BLOBS) return ESP_ERR_NO_MEM;
+    void *data = realloc(s_nvs[i].data, length);
+    if (!data) return ESP_ERR_NO_MEM;
+    memcpy(data, value, length);
+    s_nvs[i].data = data;
+    s_nvs[i].size = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    if (mkdir(conf->base_path, 0755) != 0 && errno != EEXIST) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    (void)partition_label;
+    *total_bytes = 0;
+    *used_bytes = 0;
+    return ESP_OK;
+}
+
+// ---- cJSON accessors ----
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length)
+{
+    (void)value;
+    (void)buffer_length;
+    return NULL;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string)
+{
+    if (!object || !string) return NULL;
+    for (cJSON *it = object->child; it; it = it->next) {
+        if (it->string && strcmp(it->string, string) == 0) return it;
+    }
+    return NULL;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *item)
+{
+    return item && (item->type & 0xff & (cJSON_True | cJSON_False)) != 0;
+}
+
+cJSON_bool cJSON_IsTrue(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_True;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Array;
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Object;
+}
+
+// ---- critical sections ----
+
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+// ---- tasks and notifications ----
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+static _Thread_local struct host_task *s_self;
+
+static struct host_task *task_new(void)
+{
+    struct host_task *t = (struct host_task *)calloc(1, sizeof(*t));
+    if (t) {
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&t->cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    return t;
+}
+
+static void deadline_after(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *task_entry(void *arg)
+{
+    struct host_task *t = (struct host_task *)arg;
+    s_self = t;
+    t->fn(t->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+    (void)name;
+    (void)stack;
+    (void)prio;
+    struct host_task *t = task_new();
+    if (!t) {
+        return pdFAIL;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&t->thread, NULL, task_entry, t) != 0) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    if (out) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // Test processes exit with their tasks still blocked; nothing to reclaim.
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_self) {
+        s_self = task_new(); // the test's main thread, or any thread not made by xTaskCreate
+    }
+    return s_self;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct host_task *t = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    deadline_after(&deadline, ticks_to_wait);
+    pthread_mutex_lock(&t->lock);
+    while (t->notify == 0 && ticks_to_wait != 0) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&t->cond, &t->lock);
+        } else if (pthread_cond_timedwait(&t->cond, &t->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    const uint32_t value = t->notify;
+    if (value) {
+        t->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+// ---- semaphores ----
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_sem *s = (struct host_sem *)calloc(1, sizeof(*s));
+    if (s) {
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&s->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        s->count = initial;
+        s->max = max;
+    }
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    deadline_after(&deadline, ticks_to_wait);
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0 && ticks_to_wait != 0) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        } else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    const bool taken = sem->count > 0;
+    if (taken) {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    const bool given = sem->count < sem->max;
+    if (given) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (sem) {
+        pthread_mutex_destroy(&sem->lock);
+        pthread_cond_destroy(&sem->cond);
+        free(sem);
+    }
+}
+
+// ---- esp_timer on the virtual clock ----
+
+#define HOST_TIMER_CAP 8
+
+struct esp_timer {
+    esp_timer_cb_t cb;
+    void *arg;
+    bool running;
+    int64_t due_us;
+};
+
+static _Atomic int64_t s_now_us;
+static struct esp_timer s_timers[HOST_TIMER_CAP];
+static size_t s_timer_count;
+
+void host_clock_set_us(int64_t now_us)
+{
+    atomic_store(&s_now_us, now_us);
+}
+
+void host_clock_advance_us(int64_t delta_us)
+{
+    atomic_fetch_add(&s_now_us, delta_us);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return atomic_load(&s_now_us);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (!args || !out || !args->callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_critical_enter();
+    if (s_timer_count == HOST_TIMER_CAP) {
+        host_critical_exit();
+        return ESP_ERR_NO_MEM;
+    }
+    struct esp_timer *t = &s_timers[s_timer_count++];
+    *t = (struct esp_timer){.cb = args->callback, .arg = args->arg};
+    host_critical_exit();
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    host_critical_enter();
+    const bool running = timer->running;
+    if (!running) {
+        timer->running = true;
+        timer->due_us = esp_timer_get_time() + (int64_t)timeout_us;
+    }
+    host_critical_exit();
+    return running ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    host_critical_enter();
+    const bool running = timer->running;
+    timer->running = false;
+    host_critical_exit();
+    return running ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+bool host_timer_next_due(int64_t *out_us)
+{
+    bool any = false;
+    host_critical_enter();
+    for (size_t i = 0; i < s_timer_count; i++) {
+        if (s_timers[i].running && (!any || s_timers[i].due_us < *out_us)) {
+            *out_us = s_timers[i].due_us;
+            any = true;
+        }
+    }
+    host_critical_exit();
+    return any;
+}
+
+int host_timer_fire_due(void)
+{
+    int fired = 0;
+    const int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < s_timer_count; i++) {
+        struct esp_timer *t = &s_timers[i];
+        host_critical_enter();
+        const bool due = t->running && t->due_us <= now;
+        if (due) {
+            t->running = false;
+        }
+        host_critical_exit();
+        if (due) {
+            t->cb(t->arg);
+            fired++;
+        }
+    }
+    return fired;
+}
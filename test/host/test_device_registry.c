@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+
+// Built into this file so the checks can look at the handle table itself.
+#include "../../components/gw_core/src/device_registry.c"
+
+static gw_device_uid_t uid_of(unsigned n)
+{
+    gw_device_uid_t uid = {0};
+    snprintf(uid.uid, sizeof(uid.uid), "0x00124b0000%06x", n);
+    return uid;
+}
+
+static void add_device(unsigned n)
+{
+    gw_device_t d = {0};
+    d.device_uid = uid_of(n);
+    CHECK(gw_device_registry_upsert(&d) == ESP_OK);
+}
+
+static size_t hash_entries(void)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < GW_DEV_HANDLE_HASH_CAP; i++) {
+        n += s_handle_hash[i] != 0;
+    }
+    return n;
+}
+
+// Registered devices keep their handles; unregistered UIDs share the rest, and a reclaimed handle
+// comes back empty in every store.
+static void test_reclaim(void)
+{
+    CHECK(gw_state_store_init() == ESP_OK);
+    CHECK(gw_sensor_store_init() == ESP_OK);
+    CHECK(gw_zb_model_init() == ESP_OK);
+    CHECK(gw_device_registry_init() == ESP_OK);
+
+    gw_dev_handle_t reg[GW_DEVICE_REGISTRY_CAP];
+    for (unsigned i = 0; i < GW_DEVICE_REGISTRY_CAP; i++) {
+        add_device(i);
+        const gw_device_uid_t uid = uid_of(i);
+        reg[i] = gw_device_registry_find_handle(&uid);
+        CHECK(reg[i] != GW_DEV_HANDLE_INVALID);
+    }
+
+    // Fill the rest of the table with UIDs the registry does not know.
+    const unsigned extra = GW_DEV_HANDLE_MAX - GW_DEVICE_REGISTRY_CAP;
+    for (unsigned i = 0; i < extra; i++) {
+        const gw_device_uid_t uid = uid_of(1000 + i);
+        const gw_dev_handle_t h = gw_device_registry_handle(&uid);
+        CHECK(h != GW_DEV_HANDLE_INVALID);
+        CHECK(gw_state_store_set_u32(h, GW_STATE_KEY_BATTERY_PCT, i, i) == ESP_OK);
+        const gw_sensor_value_t v = {.uid = uid, .endpoint = 1, .cluster_id = 0x0402, .value_type = GW_SENSOR_VALUE_I32};
+        CHECK(gw_sensor_store_upsert(&v) == ESP_OK);
+        const gw_zb_endpoint_t ep = {.uid = uid, .endpoint = 1};
+        CHECK(gw_zb_model_upsert_endpoint(&ep) == ESP_OK);
+    }
+    CHECK(s_handle_count == GW_DEV_HANDLE_MAX);
+    CHECK(gw_device_registry_handle_release_gen() == 0);
+
+    // A new UID takes the handle of an unregistered one, which the stores forgot first.
+    const gw_device_uid_t first = uid_of(1000);
+    const gw_dev_handle_t victim = gw_device_registry_find_handle(&first);
+    const gw_device_uid_t fresh = uid_of(5000);
+    const uint32_t gen = gw_device_registry_handle_gen();
+    CHECK(gw_device_registry_handle(&fresh) == victim);
+    CHECK(gw_device_registry_find_handle(&first) == GW_DEV_HANDLE_INVALID);
+    CHECK(gw_device_registry_handle_release_gen() == 1);
+    CHECK(gw_device_registry_handle_gen() != gen);
+    gw_device_uid_t back;
+    CHECK(gw_device_registry_handle_uid(victim, &back) == ESP_OK && strcmp(back.uid, fresh.uid) == 0);
+    gw_state_item_t item;
+    CHECK(gw_state_store_get(victim, GW_STATE_KEY_BATTERY_PCT, &item) == ESP_ERR_NOT_FOUND);
+    gw_sensor_value_t vals[4];
+    CHECK(gw_sensor_store_list(victim, vals, 4) == 0);
+    gw_zb_endpoint_t eps[2];
+    CHECK(gw_zb_model_list_endpoints(victim, eps, 2) == 0);
+    CHECK(gw_state_store_removed_floor() == gw_state_store_version());
+
+    // Churn through many more unknown UIDs: registered handles never move, the table stays sound.
+    for (unsigned i = 0; i < 500; i++) {
+        const gw_device_uid_t uid = uid_of(6000 + i);
+        CHECK(gw_device_registry_handle(&uid) != GW_DEV_HANDLE_INVALID);
+    }
+    for (unsigned i = 0; i < GW_DEVICE_REGISTRY_CAP; i++) {
+        const gw_device_uid_t uid = uid_of(i);
+        CHECK(gw_device_registry_find_handle(&uid) == reg[i]);
+    }
+    CHECK(hash_entries() == GW_DEV_HANDLE_MAX);
+    for (size_t i = 0; i < GW_DEV_HANDLE_MAX; i++) {
+        CHECK(gw_device_registry_find_handle(&s_handle_uids[i]) == (gw_dev_handle_t)(i + 1));
+    }
+
+    // A removed device keeps its handle until the table needs it.
+    const gw_device_uid_t gone = uid_of(3);
+    CHECK(gw_device_registry_remove(&gone) == ESP_OK);
+    CHECK(gw_device_registry_find_handle(&gone) == reg[3]);
+    bool reclaimed = false;
+    for (unsigned i = 0; i < extra + 1 && !reclaimed; i++) {
+        const gw_device_uid_t uid = uid_of(8000 + i);
+        reclaimed = gw_device_registry_handle(&uid) == reg[3];
+    }
+    CHECK(reclaimed);
+    CHECK(gw_device_registry_find_handle(&gone) == GW_DEV_HANDLE_INVALID);
+}
+
+int main(void)
+{
+    test_reclaim();
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gw_core/event_bus.h"
+#include "host_test.h"
+
+// Single-threaded: the test's main thread publishes and reads (with no wait), so every step is
+// deterministic.
+
+static uint32_t s_published;
+
+static void publish(const char *type)
+{
+    char msg[32];
+    s_published++;
+    snprintf(msg, sizeof(msg), "%u", (unsigned)s_published);
+    gw_event_bus_publish(type, "test", "", 0, msg);
+}
+
+static gw_event_consumer_stats_t consumer_stats(const char *name)
+{
+    gw_event_consumer_stats_t st[6];
+    const size_t n = gw_event_bus_consumer_stats(st, 6);
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(st[i].name, name) == 0) return st[i];
+    }
+    CHECK(!"consumer not found");
+    return st[0];
+}
+
+static void test_cursor(void)
+{
+    gw_event_consumer_t *c = NULL;
+    CHECK(gw_event_bus_consumer_open("cursor", &c) == ESP_OK);
+    const uint32_t first = s_published + 1;
+    for (int i = 0; i < 10; i++) publish("test.a");
+
+    gw_event_t e;
+    for (uint32_t id = first; id < first + 10; id++) {
+        CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_OK);
+        CHECK(e.id == id);
+        CHECK(strcmp(e.type, "test.a") == 0 && strcmp(e.source, "test") == 0);
+        CHECK((uint32_t)strtoul(e.msg, NULL, 10) == id);
+    }
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_ERR_TIMEOUT);
+
+    const gw_event_consumer_stats_t st = consumer_stats("cursor");
+    CHECK(st.delivered == 10 && st.dropped == 0 && st.filtered == 0 && st.backlog == 0);
+
+    gw_event_t out[4];
+    uint32_t last = 0;
+    CHECK(gw_event_bus_list_since(first + 5, out, 4, &last) == 4);
+    CHECK(out[0].id == first + 6 && out[3].id == first + 9 && last == first + 9);
+    gw_event_bus_consumer_close(c);
+}
+
+// A reader that falls a ring behind resumes at the oldest event still held and counts the rest.
+static void test_overrun(void)
+{
+    gw_event_consumer_t *c = NULL;
+    CHECK(gw_event_bus_consumer_open("overrun", &c) == ESP_OK);
+    gw_event_t e;
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_ERR_TIMEOUT);
+
+    const uint32_t first = s_published + 1;
+    for (int i = 0; i < 2000; i++) publish("test.a");
+
+    uint32_t delivered = 0;
+    uint32_t prev = 0;
+    while (gw_event_bus_consumer_read(c, &e, 0) == ESP_OK) {
+        CHECK(prev == 0 || e.id == prev + 1);
+        prev = e.id;
+        delivered++;
+    }
+    const gw_event_consumer_stats_t st = consumer_stats("overrun");
+    printf("overrun: %u delivered, %u dropped of 2000\n", (unsigned)st.delivered, (unsigned)st.dropped);
+    CHECK(prev == s_published);
+    CHECK(st.delivered == delivered);
+    CHECK(st.dropped > 0 && st.dropped == s_published - first + 1 - delivered);
+    gw_event_bus_consumer_close(c);
+}
+
+// An idle filtered consumer must not see a flood of events it filters out as an overrun.
+static void test_filtered_idle(void)
+{
+    static const char *const types[] = {"test.wanted"};
+    const gw_event_filter_t filter = {.types = types, .type_count = 1};
+    gw_event_consumer_t *c = NULL;
+    CHECK(gw_event_bus_consumer_open("filtered", &c) == ESP_OK);
+    CHECK(gw_event_bus_consumer_set_filter(c, &filter) == ESP_OK);
+    gw_event_t e;
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_ERR_TIMEOUT);
+
+    for (int i = 0; i < 3000; i++) publish("test.other");
+    publish("test.wanted");
+
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_OK);
+    CHECK(e.id == s_published && strcmp(e.type, "test.wanted") == 0);
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_ERR_TIMEOUT);
+
+    const gw_event_consumer_stats_t st = consumer_stats("filtered");
+    CHECK(st.delivered == 1 && st.dropped == 0 && st.filtered == 3000);
+    gw_event_bus_consumer_close(c);
+}
+
+// More type names than the intern table holds: the overflow is stored inline, and every name reads
+// back (and filters) the same either way.
+static void test_many_names(void)
+{
+    char type[32];
+    const uint32_t first = s_published + 1;
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 120; i++) {
+            snprintf(type, sizeof(type), "test.name%d", i);
+            publish(type);
+        }
+    }
+
+    gw_event_t e;
+    gw_event_t *events = calloc(240, sizeof(gw_event_t));
+    CHECK(events != NULL);
+    CHECK(gw_event_bus_list_since(first - 1, events, 240, NULL) == 240);
+    for (int i = 0; i < 240; i++) {
+        snprintf(type, sizeof(type), "test.name%d", i % 120);
+        CHECK(events[i].id == first + (uint32_t)i && strcmp(events[i].type, type) == 0);
+    }
+    free(events);
+
+    static const char *const types[] = {"test.name7"};
+    const gw_event_filter_t filter = {.types = types, .type_count = 1};
+    gw_event_consumer_t *c = NULL;
+    CHECK(gw_event_bus_consumer_open("names", &c) == ESP_OK);
+    CHECK(gw_event_bus_consumer_set_filter(c, &filter) == ESP_OK);
+    publish("test.name6");
+    publish("test.name7");
+    CHECK(gw_event_bus_consumer_read(c, &e, 0) == ESP_OK);
+    CHECK(e.id == s_published && strcmp(e.type, "test.name7") == 0);
+    gw_event_bus_consumer_close(c);
+}
+
+int main(void)
+{
+    CHECK(gw_event_bus_init() == ESP_OK);
+    test_cursor();
+    test_overrun();
+    test_filtered_idle();
+    test_many_names();
+    return 0;
+}
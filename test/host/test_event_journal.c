@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_clock.h"
+#include "host_test.h"
+
+// Built into this file so the checks can see segments, batch and token bucket. Segment files go
+// to GW_STORAGE_BASE_PATH, a scratch directory under the test's working directory.
+#include "../../components/gw_core/src/event_journal.c"
+
+#define REPLAY_CHUNK 50
+
+static uint32_t s_published;
+static gw_event_t s_out[GW_JOURNAL_SEGMENTS * GW_JOURNAL_SEG_BYTES / 64];
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Ids start at 1 on an empty journal, so the n-th event has id n; the message carries it for
+// checking decoded records, padded to a realistic record size (~150 bytes).
+static void publish(void)
+{
+    char msg[96];
+    s_published++;
+    snprintf(msg, sizeof(msg), "%u padding padding padding padding padding padding padding padding",
+             (unsigned)s_published);
+    gw_event_bus_publish("test.tick", "test", "0x00124b0000000001", 0x1234, msg);
+}
+
+// Highest id the writer has dealt with: batched, flushed or dropped.
+static uint32_t journal_last_locked(void)
+{
+    uint32_t last = s_stats.last_drop.last_id;
+    for (size_t i = 0; i < GW_JOURNAL_SEGMENTS; i++) {
+        if (s_segs[i].last_id > last) last = s_segs[i].last_id;
+    }
+    for (size_t off = 0; off < s_batch_len;) {
+        gw_journal_rec_t h;
+        memcpy(&h, &s_batch[off], sizeof(h));
+        if (h.id > last) last = h.id;
+        off += h.len;
+    }
+    return last;
+}
+
+static void wait_caught_up(void)
+{
+    for (int i = 0; i < 5000; i++) {
+        xSemaphoreTake(s_io_lock, portMAX_DELAY);
+        const bool done = journal_last_locked() == s_published;
+        xSemaphoreGive(s_io_lock);
+        if (done) return;
+        usleep(1000);
+    }
+    CHECK(!"journal writer did not catch up");
+}
+
+// Makes the pending batch due and has the writer flush it.
+static void flush_pending(void)
+{
+    host_clock_advance_us((int64_t)GW_JOURNAL_FLUSH_MS * 1000);
+    for (int i = 0; i < 5000; i++) {
+        gw_event_bus_consumer_wake(s_consumer);
+        xSemaphoreTake(s_io_lock, portMAX_DELAY);
+        const bool done = s_batch_len == 0;
+        xSemaphoreGive(s_io_lock);
+        if (done) return;
+        usleep(1000);
+    }
+    CHECK(!"batch was not flushed");
+}
+
+static void check_event(const gw_event_t *e)
+{
+    CHECK(strcmp(e->type, "test.tick") == 0);
+    CHECK(strcmp(e->source, "test") == 0);
+    CHECK(strcmp(e->device_uid, "0x00124b0000000001") == 0);
+    CHECK(e->short_addr == 0x1234);
+    CHECK((uint32_t)strtoul(e->msg, NULL, 10) == e->id);
+}
+
+// Enough events, with virtual time for the write budget, to rotate through every segment.
+static void test_rotation_and_replay(void)
+{
+    const double t0 = now_s();
+    for (int i = 0; i < 1000; i++) {
+        publish();
+        host_clock_advance_us(4 * 1000 * 1000); // 256 budget bytes per ~150-byte event
+        if (i % 20 == 19) wait_caught_up();
+    }
+    wait_caught_up();
+    flush_pending();
+    const double dt = now_s() - t0;
+    CHECK(s_stats.batches_dropped == 0);
+
+    uint32_t oldest = UINT32_MAX;
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < GW_JOURNAL_SEGMENTS; i++) {
+        CHECK(s_segs[i].first_id != 0);
+        CHECK(s_segs[i].size <= GW_JOURNAL_SEG_BYTES);
+        if (s_segs[i].first_id < oldest) oldest = s_segs[i].first_id;
+        bytes += s_segs[i].size;
+    }
+    CHECK(oldest > 1); // the first segments were recycled
+    CHECK(s_segs[s_cur].last_id == s_published);
+    printf("journal: %u events through bus and writer in %.1f ms, %u bytes kept from id %u\n",
+           (unsigned)s_published, dt * 1e3, (unsigned)bytes, (unsigned)oldest);
+
+    // Replay everything kept, in chunks, across segments, the batch boundary and the RAM ring.
+    const double r0 = now_s();
+    uint32_t since = oldest - 1;
+    size_t total = 0;
+    for (;;) {
+        uint32_t last = 0;
+        gw_event_gap_t gap;
+        const size_t n = gw_event_journal_list_since(since, s_out, REPLAY_CHUNK, &last, &gap);
+        CHECK(last == s_published);
+        CHECK(gap.first_id == 0);
+        if (n == 0) break;
+        for (size_t i = 0; i < n; i++) {
+            CHECK(s_out[i].id == since + 1 + i);
+            check_event(&s_out[i]);
+        }
+        since = s_out[n - 1].id;
+        total += n;
+    }
+    const double rt = now_s() - r0;
+    CHECK(since == s_published);
+    CHECK(total == s_published - oldest + 1);
+    printf("replay: %zu events in chunks of %d in %.1f ms (%.1f us/event)\n", total, REPLAY_CHUNK, rt * 1e3,
+           rt * 1e6 / (double)total);
+
+    // A cursor older than the journal gets what is left plus the gap before it.
+    uint32_t last = 0;
+    gw_event_gap_t gap;
+    const size_t n = gw_event_journal_list_since(1, s_out, REPLAY_CHUNK, &last, &gap);
+    CHECK(n == REPLAY_CHUNK && s_out[0].id == oldest);
+    CHECK(gap.first_id == 2 && gap.last_id == oldest - 1);
+}
+
+// Publishing without letting virtual time pass drains the token bucket: full batches are then
+// dropped, counted, and show up as a gap to a reader whose cursor is before them.
+static void test_budget_drop(void)
+{
+    const uint32_t start = s_published;
+    for (int i = 0; i < 400; i++) {
+        publish();
+        if (i % 20 == 19) wait_caught_up();
+    }
+    wait_caught_up();
+
+    gw_event_journal_stats_t st;
+    gw_event_journal_stats(&st);
+    printf("budget: %u batches (%u events) dropped, last %u..%u\n", (unsigned)st.batches_dropped,
+           (unsigned)st.events_dropped, (unsigned)st.last_drop.first_id, (unsigned)st.last_drop.last_id);
+    CHECK(st.batches_dropped > 0);
+    CHECK(st.events_dropped >= st.batches_dropped);
+    CHECK(st.last_drop.first_id > start && st.last_drop.first_id <= st.last_drop.last_id);
+    CHECK(st.last_drop.last_id <= s_published);
+
+    // The first dropped batch starts where the flushed ids stop.
+    uint32_t flushed = 0;
+    for (size_t i = 0; i < GW_JOURNAL_SEGMENTS; i++) {
+        if (s_segs[i].last_id > flushed) flushed = s_segs[i].last_id;
+    }
+    CHECK(flushed > start && flushed < st.last_drop.first_id);
+
+    uint32_t last = 0;
+    gw_event_gap_t gap;
+    const size_t n = gw_event_journal_list_since(start, s_out, sizeof(s_out) / sizeof(s_out[0]), &last, &gap);
+    CHECK(n > 0 && last == s_published);
+    CHECK(gap.first_id == flushed + 1);
+    CHECK(gap.last_id >= gap.first_id && gap.last_id < s_published);
+    CHECK(s_out[0].id == start + 1);
+    for (size_t i = 1; i < n; i++) {
+        CHECK(s_out[i].id > s_out[i - 1].id);
+        check_event(&s_out[i]);
+    }
+}
+
+int main(void)
+{
+    host_clock_set_us(1000 * 1000);
+    for (size_t i = 0; i < GW_JOURNAL_SEGMENTS; i++) {
+        char path[32];
+        seg_path(i, path, sizeof(path));
+        (void)remove(path);
+    }
+
+    CHECK(gw_event_bus_init() == ESP_OK);
+    CHECK(gw_event_journal_init() == ESP_OK);
+
+    test_rotation_and_replay();
+    test_budget_drop();
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_clock.h"
+#include "host_rules.h"
+#include "host_test.h"
+
+// Delays, modes, debounce, throttle and intervals of the rules engine on the virtual clock, and
+// its cached condition results. The test plays rules_task: it dispatches events and runs the wheel
+// when its esp_timer fires.
+#include "../../components/gw_core/src/rules_engine.c"
+
+#define MS 1000LL
+
+static int64_t s_t0_us;
+static uint32_t s_version;
+static uint32_t s_exec_base;
+
+static uint32_t execs(void)
+{
+    return host_rules_exec_count() - s_exec_base;
+}
+
+// Moves virtual time to t0 + ms, firing the wheel's esp_timer on the way.
+static void advance_to(int64_t ms)
+{
+    const int64_t target = s_t0_us + ms * MS;
+    int64_t due = 0;
+    while (host_timer_next_due(&due) && due <= target) {
+        if (due > esp_timer_get_time()) host_clock_set_us(due);
+        CHECK(host_timer_fire_due() == 1);
+        gw_timer_wheel_run(s_wheel);
+    }
+    host_clock_set_us(target);
+}
+
+static void trigger(void)
+{
+    gw_event_t e = {0};
+    strcpy(e.type, "zigbee.attr_report");
+    strcpy(e.source, "zigbee");
+    host_rules_dev_uid(0, e.device_uid, sizeof(e.device_uid));
+    e.data.evt_type = GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+    e.data.flags = GW_EVENT_DATA_HAS_CLUSTER | GW_EVENT_DATA_HAS_ATTR;
+    e.data.cluster_id = 0x0406;
+    process_event(&e);
+    gw_timer_wheel_run(s_wheel);
+}
+
+static gw_automation_entry_t *add_action(gw_automation_entry_t *e, uint8_t op, uint32_t arg0)
+{
+    gw_auto_bin_action_v2_t *a = &e->actions[e->actions_count++];
+    a->kind = op == GW_AUTO_ACT_OP_DELAY ? GW_AUTO_ACT_DELAY : GW_AUTO_ACT_DEVICE;
+    a->op = op;
+    a->arg0_u32 = arg0;
+    a->uid_off = 1;
+    return e;
+}
+
+// One automation, triggered by occupancy reports of device 0 unless `interval_ms` is set.
+static gw_automation_entry_t *new_automation(uint8_t mode, uint32_t interval_ms)
+{
+    gw_automation_snapshot_t *snap = (gw_automation_snapshot_t *)calloc(1, sizeof(*snap) + sizeof(gw_automation_entry_t));
+    CHECK(snap);
+    snap->version = ++s_version;
+    snap->count = 1;
+    gw_automation_entry_t *e = &snap->items[0];
+    strcpy(e->id, "timing");
+    e->enabled = true;
+    e->mode = mode;
+    host_rules_dev_uid(0, e->string_table + 1, sizeof(e->string_table) - 1);
+    e->string_table_size = (uint16_t)(1 + strlen(e->string_table + 1) + 1);
+    e->triggers_count = 1;
+    if (interval_ms) {
+        e->triggers[0].event_type = GW_AUTO_EVT_INTERVAL;
+        e->triggers[0].interval_ms = interval_ms;
+    } else {
+        e->triggers[0].event_type = GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+        e->triggers[0].device_uid_off = 1;
+        e->triggers[0].cluster_id = 0x0406;
+    }
+    host_rules_set_snapshot(snap);
+    return e;
+}
+
+// Installs the automation built since new_automation() and starts the case's clock.
+static void start(void)
+{
+    automations_refresh();
+    gw_timer_wheel_run(s_wheel);
+    s_t0_us = esp_timer_get_time();
+    s_exec_base = host_rules_exec_count();
+}
+
+// on, delay 1000 ms, off
+static void delayed_off(uint8_t mode)
+{
+    gw_automation_entry_t *e = new_automation(mode, 0);
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 1);
+    add_action(e, GW_AUTO_ACT_OP_DELAY, 1000);
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 0);
+    start();
+}
+
+static void test_delay_single(void)
+{
+    delayed_off(GW_AUTO_MODE_SINGLE);
+    trigger();
+    CHECK(execs() == 1);
+    advance_to(500);
+    trigger(); // ignored: the first run is still waiting
+    CHECK(execs() == 1);
+    advance_to(990);
+    CHECK(execs() == 1);
+    advance_to(1020);
+    CHECK(execs() == 2);
+    advance_to(3000);
+    CHECK(execs() == 2);
+}
+
+static void test_restart(void)
+{
+    delayed_off(GW_AUTO_MODE_RESTART);
+    trigger();
+    advance_to(500);
+    trigger(); // drops the waiting run and starts over
+    CHECK(execs() == 2);
+    advance_to(1200);
+    CHECK(execs() == 2);
+    advance_to(1520);
+    CHECK(execs() == 3);
+    advance_to(4000);
+    CHECK(execs() == 3);
+}
+
+static void test_queued(void)
+{
+    delayed_off(GW_AUTO_MODE_QUEUED);
+    trigger();
+    advance_to(200);
+    trigger(); // runs after the first one
+    CHECK(execs() == 1);
+    advance_to(1020);
+    CHECK(execs() == 3); // first run's off, queued run's on
+    advance_to(1990);
+    CHECK(execs() == 3);
+    advance_to(2040);
+    CHECK(execs() == 4);
+}
+
+static void test_debounce(void)
+{
+    gw_automation_entry_t *e = new_automation(GW_AUTO_MODE_SINGLE, 0);
+    e->debounce_ms = 500;
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 1);
+    start();
+    trigger();
+    advance_to(200);
+    trigger();
+    advance_to(400);
+    trigger();
+    advance_to(890);
+    CHECK(execs() == 0);
+    advance_to(920);
+    CHECK(execs() == 1);
+    advance_to(3000);
+    CHECK(execs() == 1);
+}
+
+static void test_throttle(void)
+{
+    gw_automation_entry_t *e = new_automation(GW_AUTO_MODE_SINGLE, 0);
+    e->throttle_ms = 1000;
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 1);
+    start();
+    trigger();
+    advance_to(500);
+    trigger();
+    CHECK(execs() == 1);
+    advance_to(1000);
+    trigger();
+    CHECK(execs() == 2);
+}
+
+static void test_interval(void)
+{
+    gw_automation_entry_t *e = new_automation(GW_AUTO_MODE_SINGLE, 1000);
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 2);
+    start();
+    advance_to(3500);
+    CHECK(execs() == 3);
+
+    // A new build drops the old interval and its phase.
+    e = new_automation(GW_AUTO_MODE_SINGLE, 2000);
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 2);
+    start();
+    advance_to(1990);
+    CHECK(execs() == 0);
+    advance_to(2020);
+    CHECK(execs() == 1);
+}
+
+// A condition cached as passing must fail once the state it read is evicted from the store.
+static void test_condition_eviction(void)
+{
+    gw_automation_entry_t *e = new_automation(GW_AUTO_MODE_SINGLE, 0);
+    const uint16_t key_off = e->string_table_size;
+    strcpy(e->string_table + key_off, "onoff");
+    e->string_table_size = (uint16_t)(key_off + sizeof("onoff"));
+    e->conditions_count = 1;
+    e->conditions[0] = (gw_auto_bin_condition_v2_t){
+        .op = GW_AUTO_OP_EQ,
+        .val_type = GW_AUTO_VAL_BOOL,
+        .device_uid_off = 1,
+        .key_off = key_off,
+        .v.b = 1,
+    };
+    add_action(e, GW_AUTO_ACT_OP_ONOFF, 1);
+    start();
+
+    const gw_dev_handle_t dev = 1; // device 0
+    CHECK(gw_state_store_set_bool(dev, GW_STATE_KEY_ONOFF, true, 1) == ESP_OK);
+    trigger();
+    CHECK(execs() == 1);
+    trigger();
+    CHECK(execs() == 2); // from the cached result
+
+    // Newer items for other devices push the condition's slot out of the store.
+    for (uint32_t i = 0; i < GW_STATE_MAX_ITEMS; i++) {
+        CHECK(gw_state_store_set_u32((gw_dev_handle_t)(2 + i % 60), (gw_state_key_t)(1 + i / 60), i, 2) == ESP_OK);
+    }
+    gw_state_item_t item;
+    CHECK(gw_state_store_get(dev, GW_STATE_KEY_ONOFF, &item) == ESP_ERR_NOT_FOUND);
+    trigger();
+    CHECK(execs() == 2);
+
+    CHECK(gw_state_store_set_bool(dev, GW_STATE_KEY_ONOFF, true, 3) == ESP_OK);
+    trigger();
+    CHECK(execs() == 3);
+}
+
+int main(void)
+{
+    host_clock_set_us(1000 * 1000);
+    CHECK(gw_event_bus_init() == ESP_OK);
+    CHECK(gw_state_store_init() == ESP_OK);
+    CHECK(gw_timer_wheel_create("rules", wheel_wake, NULL, &s_wheel) == ESP_OK);
+    CHECK(gw_state_store_add_listener(on_state_change, NULL) == ESP_OK);
+
+    test_delay_single();
+    test_restart();
+    test_queued();
+    test_debounce();
+    test_throttle();
+    test_interval();
+    test_condition_eviction();
+    return 0;
+}
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "host_test.h"
+
+// Built into this file so the checks can look at the hash table itself.
+#include "../../components/gw_core/src/state_store.c"
+
+#define DEVICES 100
+#define KEYS 5 // built-in keys per device
+#define LOOKUPS 1000000
+
+static uint64_t s_rng = 0x2545f4914f6cdd1dull;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng % n);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t probe_len(size_t pos)
+{
+    const uint16_t slot = (uint16_t)(s_hash[pos] - 1);
+    const size_t home = item_hash(s_dev[slot], s_key[slot]) & (GW_STATE_HASH_CAP - 1);
+    return (pos - home) & (GW_STATE_HASH_CAP - 1);
+}
+
+// Handles are handed out as 1, 2, 3, ...: a table filled from them must not cluster.
+static void test_distribution(void)
+{
+    CHECK(gw_state_store_init() == ESP_OK);
+    for (gw_dev_handle_t dev = 1; dev <= DEVICES; dev++) {
+        for (gw_state_key_t key = 1; key <= KEYS; key++) {
+            CHECK(gw_state_store_set_u32(dev, key, dev * 100u + key, 1) == ESP_OK);
+        }
+    }
+    CHECK(s_item_count == DEVICES * KEYS);
+
+    static bool home_used[GW_STATE_HASH_CAP];
+    size_t homes = 0;
+    size_t total = 0;
+    size_t longest = 0;
+    for (size_t pos = 0; pos < GW_STATE_HASH_CAP; pos++) {
+        if (s_hash[pos] == 0) {
+            continue;
+        }
+        const uint16_t slot = (uint16_t)(s_hash[pos] - 1);
+        const size_t home = item_hash(s_dev[slot], s_key[slot]) & (GW_STATE_HASH_CAP - 1);
+        homes += !home_used[home];
+        home_used[home] = true;
+        const size_t len = probe_len(pos);
+        total += len;
+        if (len > longest) longest = len;
+    }
+    const double avg = (double)total / (DEVICES * KEYS);
+    printf("items %d, distinct home buckets %zu, avg probe %.2f, max probe %zu\n", DEVICES * KEYS, homes, avg, longest);
+    // Uniform hashing at load 0.49 gives ~390 distinct homes and ~0.5 average displacement.
+    CHECK(homes >= 350);
+    CHECK(avg < 1.0);
+    CHECK(longest <= 16);
+
+    for (gw_dev_handle_t dev = 1; dev <= DEVICES; dev++) {
+        for (gw_state_key_t key = 1; key <= KEYS; key++) {
+            gw_state_item_t item;
+            CHECK(gw_state_store_get(dev, key, &item) == ESP_OK);
+            CHECK(item.dev == dev && item.key == key && item.value.u32 == dev * 100u + key);
+        }
+    }
+    gw_state_item_t item;
+    CHECK(gw_state_store_get(DEVICES + 1, 1, &item) == ESP_ERR_NOT_FOUND);
+}
+
+static uint32_t s_gone; // (dev << 8 | key) of the last removal reported to the listener
+static uint32_t s_gone_count;
+
+static void on_change(const gw_state_item_t *item, void *ctx)
+{
+    (void)ctx;
+    if (item->value_type == GW_STATE_VALUE_NONE) {
+        s_gone = (uint32_t)item->dev << 8 | item->key;
+        s_gone_count++;
+    }
+}
+
+// Random updates and inserts past GW_STATE_MAX_ITEMS against a reference LRU list; evictions go
+// through backward-shift deletion, so every surviving item must stay reachable, and each one is
+// reported to the change listeners.
+static void test_lru_eviction(void)
+{
+    enum { MODEL_CAP = GW_STATE_MAX_ITEMS, UNIVERSE_DEVS = 200 };
+    static uint32_t model[MODEL_CAP]; // (dev << 8 | key), most recently updated first
+    static uint32_t value_of[UNIVERSE_DEVS + 1][GW_STATE_KEY_CAP];
+    size_t count = 0;
+
+    CHECK(gw_state_store_init() == ESP_OK);
+    CHECK(gw_state_store_add_listener(on_change, NULL) == ESP_OK);
+    uint32_t evictions = 0;
+    for (uint32_t op = 1; op <= 20000; op++) {
+        const gw_dev_handle_t dev = (gw_dev_handle_t)(1 + rnd(UNIVERSE_DEVS));
+        const gw_state_key_t key = (gw_state_key_t)(1 + rnd(KEYS));
+        const uint32_t id = (uint32_t)dev << 8 | key;
+
+        size_t at = 0;
+        while (at < count && model[at] != id) at++;
+        uint32_t evicted = 0;
+        if (at == count) {
+            if (count == MODEL_CAP) {
+                evicted = model[--count];
+            }
+            at = count++;
+        }
+        memmove(&model[1], &model[0], at * sizeof(model[0]));
+        model[0] = id;
+        value_of[dev][key] = op;
+        CHECK(gw_state_store_set_u32(dev, key, op, op) == ESP_OK);
+
+        gw_state_item_t item;
+        if (evicted) {
+            CHECK(gw_state_store_get((gw_dev_handle_t)(evicted >> 8), (gw_state_key_t)(evicted & 0xff), &item) == ESP_ERR_NOT_FOUND);
+            CHECK(s_gone == evicted && s_gone_count == ++evictions);
+        }
+        CHECK(s_gone_count == evictions);
+        if (op % 500 == 0) {
+            for (size_t i = 0; i < count; i++) {
+                const gw_dev_handle_t d = (gw_dev_handle_t)(model[i] >> 8);
+                const gw_state_key_t k = (gw_state_key_t)(model[i] & 0xff);
+                CHECK(gw_state_store_get(d, k, &item) == ESP_OK);
+                CHECK(item.value.u32 == value_of[d][k]);
+            }
+        }
+    }
+    CHECK(count == MODEL_CAP);
+    CHECK(s_item_count == GW_STATE_MAX_ITEMS);
+    CHECK(evictions > 0);
+    CHECK(gw_state_store_remove_listener(on_change, NULL) == ESP_OK);
+
+    size_t longest = 0;
+    for (size_t pos = 0; pos < GW_STATE_HASH_CAP; pos++) {
+        if (s_hash[pos] != 0 && probe_len(pos) > longest) longest = probe_len(pos);
+    }
+    printf("after eviction churn: max probe %zu\n", longest);
+    CHECK(longest <= 24);
+}
+
+// Walks a whole delta the way the WS state task does.
+static size_t delta(uint32_t since, gw_state_item_t *out, size_t max_out)
+{
+    size_t cursor = 0;
+    size_t n = 0;
+    size_t got;
+    do {
+        got = gw_state_store_changed_since(since, &cursor, &out[n], 7 < max_out - n ? 7 : max_out - n);
+        n += got;
+    } while (got > 0 && n < max_out);
+    return n;
+}
+
+static void test_delta_removals(void)
+{
+    static gw_state_item_t out[GW_STATE_MAX_ITEMS + 64];
+    CHECK(gw_state_store_init() == ESP_OK);
+    for (uint32_t i = 0; i < GW_STATE_MAX_ITEMS; i++) {
+        CHECK(gw_state_store_set_u32((gw_dev_handle_t)(1 + i / KEYS), (gw_state_key_t)(1 + i % KEYS), i, i) == ESP_OK);
+    }
+    const uint32_t since = gw_state_store_version();
+    CHECK(delta(0, out, 1000) == GW_STATE_MAX_ITEMS);
+    CHECK(delta(since, out, 1000) == 0);
+
+    // Three inserts evict the three oldest items (dev 1); the delta carries both.
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(gw_state_store_set_u32(250, (gw_state_key_t)(1 + i), i, i) == ESP_OK);
+    }
+    size_t n = delta(since, out, 1000);
+    CHECK(n == 6);
+    size_t removed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (out[i].value_type == GW_STATE_VALUE_NONE) {
+            CHECK(out[i].dev == 1 && out[i].key >= 1 && out[i].key <= 3 && out[i].version > since);
+            removed++;
+        } else {
+            CHECK(out[i].dev == 250);
+        }
+    }
+    CHECK(removed == 3);
+    CHECK(delta(0, out, 1000) == GW_STATE_MAX_ITEMS); // a snapshot has no removals
+
+    // A key set again is reported by its value only, once (its insert evicts dev 1 key 4).
+    CHECK(gw_state_store_set_u32(1, 2, 7, 7) == ESP_OK);
+    n = delta(since, out, 1000);
+    CHECK(n == 7);
+    size_t dev1_key2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (out[i].dev == 1 && out[i].key == 2) {
+            CHECK(out[i].value_type == GW_STATE_VALUE_U32 && out[i].value.u32 == 7);
+            dev1_key2++;
+        }
+    }
+    CHECK(dev1_key2 == 1);
+
+    // More removals than the log holds: a delta from `since` is no longer complete.
+    CHECK(gw_state_store_removed_floor() < since);
+    for (uint32_t i = 0; i < 40; i++) {
+        CHECK(gw_state_store_set_u32((gw_dev_handle_t)(200 + i / KEYS), (gw_state_key_t)(1 + i % KEYS), i, i) == ESP_OK);
+    }
+    CHECK(gw_state_store_removed_floor() > since);
+    const uint32_t later = gw_state_store_version();
+    CHECK(gw_state_store_removed_floor() < later);
+    CHECK(delta(later, out, 1000) == 0);
+}
+
+static void test_drop_dev(void)
+{
+    CHECK(gw_state_store_init() == ESP_OK);
+    for (uint32_t i = 0; i < 300; i++) {
+        CHECK(gw_state_store_set_u32((gw_dev_handle_t)(1 + i % 60), (gw_state_key_t)(1 + i / 60), i, i) == ESP_OK);
+    }
+    CHECK(gw_state_store_add_listener(on_change, NULL) == ESP_OK);
+    const uint32_t gone_before = s_gone_count;
+    gw_state_store_drop_dev(7);
+    CHECK(s_gone_count == gone_before + KEYS);
+    CHECK(gw_state_store_remove_listener(on_change, NULL) == ESP_OK);
+    CHECK(gw_state_store_removed_floor() == gw_state_store_version());
+    CHECK(s_item_count == 300 - KEYS);
+
+    // Every other item is still found through the hash, and the LRU list covers exactly the live slots.
+    gw_state_item_t item;
+    for (uint32_t i = 0; i < 300; i++) {
+        const gw_dev_handle_t dev = (gw_dev_handle_t)(1 + i % 60);
+        const esp_err_t err = gw_state_store_get(dev, (gw_state_key_t)(1 + i / 60), &item);
+        CHECK(dev == 7 ? err == ESP_ERR_NOT_FOUND : (err == ESP_OK && item.value.u32 == i));
+    }
+    size_t walked = 0;
+    for (uint16_t slot = s_lru_head; slot != SLOT_NIL; slot = s_next[slot]) {
+        CHECK(slot < s_item_count && s_dev[slot] != 7);
+        walked++;
+    }
+    CHECK(walked == s_item_count);
+    CHECK(s_lru_tail != SLOT_NIL && s_next[s_lru_tail] == SLOT_NIL);
+}
+
+static uint32_t s_fired[GW_STATE_WATCH_CAP];
+
+static void on_watch(uint16_t watch_id, const gw_state_item_t *item, void *ctx)
+{
+    CHECK(watch_id < GW_STATE_WATCH_CAP && item->dev == (gw_dev_handle_t)(uintptr_t)ctx);
+    s_fired[watch_id]++;
+}
+
+// A full watch table: sets only step the watches of their own slot, in id order per bucket.
+static void test_watches(void)
+{
+    CHECK(gw_state_store_init() == ESP_OK);
+    uint16_t ids[GW_STATE_WATCH_CAP];
+    for (size_t i = 0; i < GW_STATE_WATCH_CAP; i++) {
+        const gw_state_watch_t w = {
+            .dev = (gw_dev_handle_t)(1 + i),
+            .key = GW_STATE_KEY_TEMPERATURE_C,
+            .kind = GW_STATE_WATCH_ABOVE,
+            .threshold = 25.0f,
+            .hysteresis = 1.0f,
+        };
+        CHECK(gw_state_store_watch_add(&w, on_watch, (void *)(uintptr_t)w.dev, &ids[i]) == ESP_OK);
+    }
+    const gw_state_watch_t extra = {.dev = 1, .key = GW_STATE_KEY_ONOFF, .kind = GW_STATE_WATCH_CHANGE};
+    CHECK(gw_state_store_watch_add(&extra, on_watch, NULL, NULL) == ESP_ERR_NO_MEM);
+
+    size_t longest = 0;
+    for (size_t b = 0; b < WATCH_BUCKETS; b++) {
+        size_t len = 0;
+        int prev = -1;
+        for (uint8_t id = s_watch_head[b]; id != 0; id = s_watch_next[id - 1]) {
+            CHECK((int)id - 1 > prev);
+            prev = id - 1;
+            len++;
+        }
+        if (len > longest) longest = len;
+    }
+    printf("watches: %d in %d buckets, longest chain %zu\n", GW_STATE_WATCH_CAP, WATCH_BUCKETS, longest);
+    CHECK(longest <= 4);
+
+    const gw_dev_handle_t dev = 7;
+    const uint16_t id = ids[dev - 1];
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 20.0f, 1) == ESP_OK); // arms
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 26.0f, 2) == ESP_OK); // fires
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 24.5f, 3) == ESP_OK); // within hysteresis
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 27.0f, 4) == ESP_OK);
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 23.0f, 5) == ESP_OK); // re-arms
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 30.0f, 6) == ESP_OK); // fires
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_HUMIDITY_PCT, 99.0f, 7) == ESP_OK);
+    for (size_t i = 0; i < GW_STATE_WATCH_CAP; i++) {
+        CHECK(s_fired[i] == (i == id ? 2u : 0u));
+    }
+
+    gw_state_store_watch_clear(on_watch);
+    for (size_t b = 0; b < WATCH_BUCKETS; b++) {
+        CHECK(s_watch_head[b] == 0);
+    }
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 20.0f, 8) == ESP_OK);
+    CHECK(gw_state_store_set_f32(dev, GW_STATE_KEY_TEMPERATURE_C, 40.0f, 9) == ESP_OK);
+    CHECK(s_fired[id] == 2);
+}
+
+static void bench_get(void)
+{
+    CHECK(gw_state_store_init() == ESP_OK);
+    for (gw_dev_handle_t dev = 1; dev <= DEVICES; dev++) {
+        for (gw_state_key_t key = 1; key <= KEYS; key++) {
+            CHECK(gw_state_store_set_f32(dev, key, 1.0f, 1) == ESP_OK);
+        }
+    }
+    uint32_t found = 0;
+    const double t0 = now_s();
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+        gw_state_item_t item;
+        found += gw_state_store_get((gw_dev_handle_t)(1 + i % DEVICES), (gw_state_key_t)(1 + i / DEVICES % KEYS), &item) == ESP_OK;
+    }
+    const double dt = now_s() - t0;
+    CHECK(found == LOOKUPS);
+    printf("get: %.0f ns/lookup over %d items\n", dt * 1e9 / LOOKUPS, DEVICES * KEYS);
+}
+
+int main(void)
+{
+    test_distribution();
+    test_lru_eviction();
+    test_delta_removals();
+    test_drop_dev();
+    test_watches();
+    bench_get();
+    return 0;
+}
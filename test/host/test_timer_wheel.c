@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_timer.h"
+#include "gw_core/timer_wheel.h"
+#include "host_clock.h"
+#include "host_test.h"
+
+// 10k timers with delays from one tick up past the last level, re-armed and cancelled from
+// callbacks, on a virtual clock that starts just before the 32-bit tick counter wraps. The
+// esp_timer is fired a few ms late at random, as a loaded esp_timer task would.
+
+#define TIMERS 10000
+#define MAX_LATE_US 20000 // one tick of rounding up plus the injected esp_timer lateness
+#define TICK_US ((int64_t)GW_TIMER_WHEEL_TICK_MS * 1000)
+
+typedef struct {
+    gw_timer_t t;
+    int64_t due_us;
+    int rearms;
+} test_timer_t;
+
+static test_timer_t s_timers[TIMERS];
+static gw_timer_wheel_t *s_wheel;
+static uint64_t s_rng = 0x9e3779b97f4a7c15ull;
+static unsigned s_expected;
+static unsigned s_fired;
+static bool s_woken;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (uint32_t)(s_rng % n);
+}
+
+static uint32_t rnd_delay_ms(void)
+{
+    switch (rnd(10)) {
+    case 0: return rnd(3) * GW_TIMER_WHEEL_TICK_MS; // zero, one and two ticks
+    case 1: return 50u * 3600 * 1000 + rnd(3600 * 1000); // beyond 64^4 ticks
+    case 2: return rnd(3 * 3600 * 1000);                 // levels 2 and 3
+    case 3:
+    case 4: return rnd(60 * 1000);
+    default: return rnd(640);
+    }
+}
+
+static void arm(test_timer_t *tt)
+{
+    const uint32_t delay_ms = rnd_delay_ms();
+    tt->due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    gw_timer_arm(s_wheel, &tt->t, delay_ms);
+    s_expected++;
+}
+
+static void on_fire(gw_timer_t *t, void *user_ctx)
+{
+    test_timer_t *tt = (test_timer_t *)user_ctx;
+    const int64_t now = esp_timer_get_time();
+    CHECK(&tt->t == t);
+    CHECK(!gw_timer_pending(t));
+    CHECK(now >= tt->due_us);
+    CHECK(now - tt->due_us <= MAX_LATE_US);
+    s_fired++;
+
+    if (tt->rearms > 0) {
+        tt->rearms--;
+        arm(tt);
+    }
+    // Cancel another timer now and then, possibly one on the list being fired right now.
+    if (rnd(8) == 0) {
+        test_timer_t *other = &s_timers[rnd(TIMERS)];
+        if (other != tt && gw_timer_cancel(s_wheel, &other->t)) {
+            s_expected--;
+        }
+    }
+}
+
+static void on_wake(void *ctx)
+{
+    (void)ctx;
+    s_woken = true;
+}
+
+int main(void)
+{
+    // 10 s of virtual time before the tick counter wraps.
+    host_clock_set_us(((int64_t)UINT32_MAX + 1 - 1000) * TICK_US);
+
+    CHECK(gw_timer_wheel_create("test", on_wake, NULL, &s_wheel) == ESP_OK);
+    for (size_t i = 0; i < TIMERS; i++) {
+        gw_timer_init(&s_timers[i].t, on_fire, &s_timers[i]);
+        s_timers[i].rearms = (int)rnd(4);
+        arm(&s_timers[i]);
+    }
+    for (size_t i = 0; i < TIMERS / 10; i++) {
+        const size_t k = rnd(TIMERS);
+        if (gw_timer_cancel(s_wheel, &s_timers[k].t)) {
+            s_expected--;
+        }
+    }
+    CHECK(gw_timer_wheel_armed(s_wheel) == s_expected);
+    gw_timer_wheel_run(s_wheel);
+
+    unsigned wakes = 0;
+    int64_t due = 0;
+    while (host_timer_next_due(&due)) {
+        const int64_t late = rnd(4) == 0 ? (int64_t)rnd(5000) : 0;
+        if (due + late > esp_timer_get_time()) {
+            host_clock_set_us(due + late);
+        }
+        CHECK(host_timer_fire_due() == 1);
+        CHECK(s_woken);
+        s_woken = false;
+        wakes++;
+        gw_timer_wheel_run(s_wheel);
+    }
+
+    printf("timers fired %u, expected %u, wakes %u\n", s_fired, s_expected, wakes);
+    CHECK(s_fired == s_expected);
+    CHECK(gw_timer_wheel_armed(s_wheel) == 0);
+    for (size_t i = 0; i < TIMERS; i++) {
+        CHECK(!gw_timer_pending(&s_timers[i].t));
+    }
+    return 0;
+}
@@ -0,0 +1,269 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+
+// Built into this file so the test can subscribe and look at the push queue directly. httpd is
+// faked below: every send completes at once and its text lands in a log, in send order.
+#include "../../components/gw_http/src/gw_ws.c"
+
+#define TEST_FD 7
+#define LOG_MAX 4096
+
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *s_log[LOG_MAX];
+static size_t s_log_count;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    (void)handle;
+    (void)uri_handler;
+    return ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    (void)r;
+    return TEST_FD;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    (void)req;
+    (void)error;
+    (void)msg;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    (void)req;
+    (void)pkt;
+    (void)max_len;
+    return ESP_FAIL;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    (void)hd;
+    return fd == TEST_FD ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_INVALID;
+}
+
+esp_err_t httpd_ws_send_data_async(httpd_handle_t handle, int socket, httpd_ws_frame_t *frame,
+                                   transfer_complete_cb callback, void *arg)
+{
+    (void)handle;
+    char *text = (char *)malloc(frame->len + 1);
+    CHECK(text != NULL);
+    memcpy(text, frame->payload, frame->len);
+    text[frame->len] = '\0';
+    pthread_mutex_lock(&s_log_lock);
+    CHECK(s_log_count < LOG_MAX);
+    s_log[s_log_count++] = text;
+    pthread_mutex_unlock(&s_log_lock);
+    callback(ESP_OK, socket, arg);
+    return ESP_OK;
+}
+
+esp_err_t gw_rpc_dispatch(gw_rpc_call_t *call)
+{
+    (void)call;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void log_clear(void)
+{
+    pthread_mutex_lock(&s_log_lock);
+    for (size_t i = 0; i < s_log_count; i++) {
+        free(s_log[i]);
+    }
+    s_log_count = 0;
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+static uint32_t json_u32(const char *text, const char *key)
+{
+    const char *p = strstr(text, key);
+    CHECK(p != NULL);
+    return (uint32_t)strtoul(p + strlen(key), NULL, 10);
+}
+
+// Walks the log of a subscription with `since`: events must come in id order, each once; a resync
+// or gap skips ahead. Returns the newest id the client has seen or been told about.
+static uint32_t check_stream(uint32_t since, size_t *resyncs)
+{
+    uint32_t expect = since + 1;
+    *resyncs = 0;
+    pthread_mutex_lock(&s_log_lock);
+    for (size_t i = 0; i < s_log_count; i++) {
+        const char *m = s_log[i];
+        if (strstr(m, "\"t\":\"event\"")) {
+            const uint32_t id = json_u32(m, "\"id\":");
+            if (id != expect) {
+                fprintf(stderr, "message %zu: event %u, expected %u\n", i, (unsigned)id, (unsigned)expect);
+            }
+            CHECK(id == expect);
+            expect++;
+        } else if (strstr(m, "\"t\":\"resync\"")) {
+            const uint32_t last = json_u32(m, "\"last_id\":");
+            CHECK(last + 1 >= expect);
+            expect = last + 1;
+            (*resyncs)++;
+        } else if (strstr(m, "\"t\":\"gap\"")) {
+            const uint32_t last = json_u32(m, "\"last_id\":");
+            CHECK(last >= expect);
+            expect = last + 1;
+        }
+    }
+    pthread_mutex_unlock(&s_log_lock);
+    return expect - 1;
+}
+
+static void publish(unsigned n)
+{
+    char msg[16];
+    snprintf(msg, sizeof(msg), "%u", n);
+    gw_event_bus_publish("test.tick", "test", "", 0, msg);
+}
+
+static void *publisher(void *arg)
+{
+    const unsigned count = (unsigned)(uintptr_t)arg;
+    for (unsigned i = 0; i < count; i++) {
+        publish(i);
+        usleep(200);
+    }
+    return NULL;
+}
+
+static void connect_client(void)
+{
+    ws_client_remove_fd(TEST_FD);
+    log_clear();
+    CHECK(ws_client_add_fd(TEST_FD));
+}
+
+static void subscribe_events(uint32_t since)
+{
+    cJSON obj = {.type = cJSON_Object};
+    cJSON topic = {.type = cJSON_String, .valuestring = "events"};
+    ws_apply_subscriptions(TEST_FD, &obj, &topic, false, since);
+}
+
+// Waits until the client has seen (or been told about) every published id.
+static size_t wait_stream(uint32_t since)
+{
+    size_t resyncs = 0;
+    for (int i = 0; i < 500 && check_stream(since, &resyncs) < gw_event_bus_last_id(); i++) {
+        usleep(10000);
+    }
+    CHECK(check_stream(since, &resyncs) == gw_event_bus_last_id());
+    return resyncs;
+}
+
+// Events published while a `since` replay runs arrive once, in order, right after it.
+static void test_replay_while_publishing(void)
+{
+    for (unsigned i = 0; i < 20; i++) {
+        publish(i);
+    }
+    for (int round = 0; round < 20; round++) {
+        connect_client();
+        pthread_t t;
+        CHECK(pthread_create(&t, NULL, publisher, (void *)(uintptr_t)40) == 0);
+        usleep(1000);
+        const uint32_t since = gw_event_bus_last_id() - 3;
+        subscribe_events(since);
+        CHECK(pthread_join(t, NULL) == 0);
+        (void)wait_stream(since);
+    }
+}
+
+// More missing events than one replay covers: the replay stops with a resync, then live events follow.
+static void test_replay_over_budget(void)
+{
+    connect_client();
+    for (unsigned i = 0; i < GW_WS_REPLAY_MAX + 20; i++) {
+        publish(i);
+    }
+    const uint32_t since = gw_event_bus_last_id() - GW_WS_REPLAY_MAX - 10;
+    subscribe_events(since);
+    CHECK(wait_stream(since) == 1);
+
+    for (unsigned i = 0; i < 5; i++) {
+        publish(i);
+    }
+    CHECK(wait_stream(since) == 1);
+}
+
+// A queued attribute report is only replaced by a newer one.
+static void test_coalesce_by_id(void)
+{
+    connect_client();
+    portENTER_CRITICAL(&s_client_lock);
+    ws_client_find_locked(TEST_FD)->pumping = true; // hold the queue as if another task were sending
+    portEXIT_CRITICAL(&s_client_lock);
+
+    const uint32_t key = 0x1234;
+    gw_ws_frame_t *f50 = ws_frame_alloc(2);
+    gw_ws_frame_t *f40 = ws_frame_alloc(2);
+    gw_ws_frame_t *f60 = ws_frame_alloc(2);
+    CHECK(ws_client_push_event(TEST_FD, f50, false, key, 50));
+    CHECK(ws_client_push_event(TEST_FD, f40, false, key, 40));
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(TEST_FD);
+    CHECK(c->q_len == 1 && c->q[0].f == f50);
+    portEXIT_CRITICAL(&s_client_lock);
+    CHECK(ws_client_push_event(TEST_FD, f60, false, key, 60));
+    portENTER_CRITICAL(&s_client_lock);
+    CHECK(c->q_len == 1 && c->q[0].f == f60 && c->q[0].event_id == 60);
+    c->pumping = false;
+    portEXIT_CRITICAL(&s_client_lock);
+    ws_frame_release(f50);
+    ws_frame_release(f40);
+    ws_frame_release(f60);
+    ws_client_pump(TEST_FD);
+}
+
+// A filter naming a device that has not joined takes no handle, and matches once the device joins.
+static void test_filter_lookup_only(void)
+{
+    connect_client();
+    cJSON uid = {.type = cJSON_String, .valuestring = "0x00124b00000000aa"};
+    cJSON devices = {.type = cJSON_Array, .child = &uid, .string = "devices"};
+    cJSON obj = {.type = cJSON_Object, .child = &devices};
+    cJSON topic = {.type = cJSON_String, .valuestring = "state"};
+    const uint32_t gen = gw_device_registry_handle_gen();
+    ws_apply_subscriptions(TEST_FD, &obj, &topic, false, 0);
+
+    gw_device_uid_t u = {0};
+    strlcpy(u.uid, uid.valuestring, sizeof(u.uid));
+    CHECK(gw_device_registry_find_handle(&u) == GW_DEV_HANDLE_INVALID);
+    CHECK(gw_device_registry_handle_gen() == gen);
+    portENTER_CRITICAL(&s_client_lock);
+    CHECK(s_clients[0].filter.dev_count == 1 && s_clients[0].filter.devs[0] == GW_DEV_HANDLE_INVALID);
+    portEXIT_CRITICAL(&s_client_lock);
+
+    const gw_dev_handle_t h = gw_device_registry_handle(&u);
+    CHECK(h != GW_DEV_HANDLE_INVALID);
+    ws_filters_rebind();
+    portENTER_CRITICAL(&s_client_lock);
+    CHECK(s_clients[0].filter.devs[0] == h);
+    portEXIT_CRITICAL(&s_client_lock);
+}
+
+int main(void)
+{
+    CHECK(gw_event_bus_init() == ESP_OK);
+    CHECK(gw_state_store_init() == ESP_OK);
+    CHECK(gw_ws_register((httpd_handle_t)1) == ESP_OK);
+
+    test_replay_while_publishing();
+    test_replay_over_budget();
+    test_coalesce_by_id();
+    test_filter_lookup_only();
+    return 0;
+}